@@ -139,7 +139,14 @@ nvme_list_opts () {
 			;;
 		"telemetry-log")
 		opts+=" --output-file= -O --host-generate= -g \
-			--controller-init -c --data-area= -d"
+			--controller-init -c --data-area= -d --manifest"
+			;;
+		"telemetry-diff")
+		opts+=" --block-size= -b --output-format= -o"
+			;;
+		"telemetry-monitor")
+		opts+=" --output-dir= -O --data-area= -d \
+			--min-interval= -i --manifest"
 			;;
 		"fw-log")
 		opts+=" --raw-binary -b --output-format= -o"
@@ -1204,6 +1211,9 @@ plugin_solidigm_opts () {
 		--data-area -d --config-file -j \
 		--source-file -s"
 			;;
+		"telemetry-diff")
+		opts+=" --config-file= -j --block-size= -b --output-format= -o"
+			;;
 		"clear-fw-activate-history")
 		opts+=" --no-uuid -n"
 			;;
@@ -1625,6 +1635,9 @@ plugin_ocp_opts () {
 		"telemetry-string-log")
 		opts+=" --output-file= -f --output-format= -o"
 			;;
+		"telemetry-diff")
+		opts+=" --string-log= -s --block-size= -b --output-format= -o"
+			;;
 		"set-telemetry-profile")
 		opts+=" --telemetry-profile-select= -t"
 			;;
@@ -1718,7 +1731,7 @@ _nvme_subcmds () {
 			change-cap set-feature get-feature"
 		[solidigm]="id-ctrl vs-smart-add-log garbage-collect-log \
 			vs-internal-log latency-tracking-log \
-			clear-pcie-correctable-errors parse-telemetry-log \
+			clear-pcie-correctable-errors parse-telemetry-log telemetry-diff \
 			clear-fw-activate-history vs-fw-activate-history log-page-directory \
 			vs-drive-info cloud-SSDplugin-version market-log \
 			smart-log-add temp-stats workload-tracker version help"
@@ -1733,7 +1746,7 @@ _nvme_subcmds () {
 		[ymtc]="smart-log-add"
 		[inspur]="nvme-vendor-log"
 		[ocp]="smart-add-log latency-monitor-log \
-			set-latency-monitor-feature internal-log \
+			set-latency-monitor-feature internal-log telemetry-diff \
 			clear-fw-activate-history eol-plp-failure-mode \
 			clear-pcie-correctable-error-counters \
 			vs-fw-activate-history device-capability-log \
@@ -1778,8 +1791,8 @@ _nvme_subcmds () {
 		id-ns-lba-format nvm-id-ns nvm-id-ns-lba-format \
 		nvm-id-ctrl primary-ctrl-caps list-secondary \
 		ns-descs id-nvmset id-uuid id-iocs id-domain create-ns \
-		delete-ns get-ns-id get-log telemetry-log \
-		fw-log changed-ns-list-log smart-log ana-log \
+		delete-ns get-ns-id get-log telemetry-log telemetry-diff \
+		telemetry-monitor fw-log changed-ns-list-log smart-log ana-log \
 		error-log effects-log endurance-log \
 		predictable-lat-log pred-lat-event-agg-log \
 		persistent-event-log endurance-agg-log \
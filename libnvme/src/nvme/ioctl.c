@@ -88,6 +88,9 @@ int nvme_get_nsid(struct nvme_transport_handle *hdl, __u32 *nsid)
 {
 	__u32 tmp;
 
+	if (hdl->type == NVME_TRANSPORT_HANDLE_TYPE_REPLAY)
+		return __nvme_replay_get_nsid(hdl, nsid);
+
 	errno = 0;
 	tmp = ioctl(hdl->fd, NVME_IOCTL_ID);
 	if (errno)
@@ -114,34 +117,63 @@ bool __nvme_decide_retry(struct nvme_transport_handle *hdl,
 	return false;
 }
 
+/* the commands being submitted by this thread, innermost first */
+static __thread struct nvme_submit_state *nvme_submit_cur;
+
+struct nvme_submit_state *__nvme_submit_state(
+		struct nvme_transport_handle *hdl)
+{
+	struct nvme_submit_state *s;
+
+	for (s = nvme_submit_cur; s; s = s->prev)
+		if (s->hdl == hdl)
+			return s;
+
+	return NULL;
+}
+
+/*
+ * The decide-retry callback gets the first say; the retry policy engine is
+ * only consulted if the callback declined to retry.
+ */
+static bool nvme_retry(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, int err,
+		struct nvme_submit_state *s)
+{
+	if (!err)
+		return false;
+
+	if (hdl->decide_retry(hdl, cmd, err))
+		return true;
+
+	return __nvme_retry_check(hdl, cmd, err, &s->retry);
+}
+
 /*
  * The 64 bit version is the preferred version to use, but for backwards
  * compatibility keep a 32 version.
  */
 static int nvme_submit_passthru32(struct nvme_transport_handle *hdl,
-		unsigned long ioctl_cmd, struct nvme_passthru_cmd *cmd)
+		unsigned long ioctl_cmd, struct nvme_passthru_cmd *cmd,
+		struct nvme_submit_state *s)
 {
 	struct linux_passthru_cmd32 cmd32;
-	void *user_data;
+	__u64 start;
 	int err = 0;
 
-	user_data = hdl->submit_entry(hdl, cmd);
-	if (hdl->ctx->dry_run)
-		goto out;
-
 	memcpy(&cmd32, cmd, offsetof(struct linux_passthru_cmd32, result));
 	cmd32.result = 0;
 
 	do {
+		start = __nvme_record_start(hdl);
+		cmd32.timeout_ms = cmd->timeout_ms;
 		err = ioctl(hdl->fd, ioctl_cmd, &cmd32);
-		if (err >= 0)
-			break;
-		err = -errno;
-	} while (hdl->decide_retry(hdl, cmd, err));
+		if (err < 0)
+			err = -errno;
+	} while (nvme_retry(hdl, cmd, err, s));
 
-out:
 	cmd->result = cmd32.result;
-	hdl->submit_exit(hdl, cmd, err, user_data);
+	__nvme_record_cmd(hdl, cmd, s->admin, err, start);
 	return err;
 }
 
@@ -150,37 +182,78 @@ out:
  * 65e68edce0db ("nvme: allow 64-bit results in passthru commands")
  */
 static int nvme_submit_passthru64(struct nvme_transport_handle *hdl,
-		unsigned long ioctl_cmd, struct nvme_passthru_cmd *cmd)
+		unsigned long ioctl_cmd, struct nvme_passthru_cmd *cmd,
+		struct nvme_submit_state *s)
 {
-	void *user_data;
+	__u64 start;
 	int err = 0;
 
-	user_data = hdl->submit_entry(hdl, cmd);
-	if (hdl->ctx->dry_run)
-		goto out;
-
 	do {
 		/*
 		 * struct nvme_passtrhu_cmd is identically to struct
 		 * linux_passthru_cmd64, thus just pass it in directly.
 		 */
+		start = __nvme_record_start(hdl);
 		err = ioctl(hdl->fd, ioctl_cmd, cmd);
-		if (err >= 0)
-			break;
-		err = -errno;
-	} while (hdl->decide_retry(hdl, cmd, err));
+		if (err < 0)
+			err = -errno;
+	} while (nvme_retry(hdl, cmd, err, s));
+
+	__nvme_record_cmd(hdl, cmd, s->admin, err, start);
+	return err;
+}
+
+/*
+ * Replay handles serve recorded completions instead of issuing ioctls, but
+ * still go through the submit hooks so that logging and tracing work.
+ */
+static int nvme_submit_passthru_replay(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, struct nvme_submit_state *s)
+{
+	int err = 0;
+
+	do {
+		err = __nvme_replay_cmd(hdl, cmd, s->admin);
+	} while (nvme_retry(hdl, cmd, err, s));
+
+	return err;
+}
+
+static int nvme_submit_passthru(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin)
+{
+	struct nvme_submit_state s = {
+		.hdl = hdl,
+		.admin = admin,
+		.prev = nvme_submit_cur,
+	};
+	void *user_data;
+	int err = 0;
+
+	nvme_submit_cur = &s;
+	user_data = hdl->submit_entry(hdl, cmd);
+	if (hdl->ctx->dry_run)
+		goto out;
 
+	__nvme_retry_begin(hdl, cmd, admin, &s.retry);
+	if (hdl->type == NVME_TRANSPORT_HANDLE_TYPE_REPLAY)
+		err = nvme_submit_passthru_replay(hdl, cmd, &s);
+	else if (hdl->ioctl64)
+		err = nvme_submit_passthru64(hdl, admin ?
+			NVME_IOCTL_ADMIN64_CMD : NVME_IOCTL_IO64_CMD, cmd, &s);
+	else
+		err = nvme_submit_passthru32(hdl, admin ?
+			NVME_IOCTL_ADMIN_CMD : NVME_IOCTL_IO_CMD, cmd, &s);
 out:
 	hdl->submit_exit(hdl, cmd, err, user_data);
+	nvme_submit_cur = s.prev;
 	return err;
 }
 
 int nvme_submit_io_passthru(struct nvme_transport_handle *hdl,
 		struct nvme_passthru_cmd *cmd)
 {
-	if (hdl->ioctl64)
-		return nvme_submit_passthru64(hdl, NVME_IOCTL_IO64_CMD, cmd);
-	return nvme_submit_passthru32(hdl, NVME_IOCTL_IO_CMD, cmd);
+	return nvme_submit_passthru(hdl, cmd, false);
 }
 
 int nvme_submit_admin_passthru(struct nvme_transport_handle *hdl,
@@ -188,15 +261,13 @@ int nvme_submit_admin_passthru(struct nvme_transport_handle *hdl,
 {
 	switch (hdl->type) {
 	case NVME_TRANSPORT_HANDLE_TYPE_DIRECT:
-		if (hdl->ioctl64)
-			return nvme_submit_passthru64(hdl,
-				NVME_IOCTL_ADMIN64_CMD, cmd);
-		if (cmd->opcode == nvme_admin_fabrics)
+		if (!hdl->ioctl64 && cmd->opcode == nvme_admin_fabrics)
 			return -ENOTSUP;
-		return nvme_submit_passthru32(hdl,
-				NVME_IOCTL_ADMIN_CMD, cmd);
+		return nvme_submit_passthru(hdl, cmd, true);
 	case NVME_TRANSPORT_HANDLE_TYPE_MI:
 		return nvme_mi_admin_admin_passthru(hdl, cmd);
+	case NVME_TRANSPORT_HANDLE_TYPE_REPLAY:
+		return nvme_submit_passthru(hdl, cmd, true);
 	default:
 		break;
 	}
@@ -111,6 +111,7 @@ static int __nvme_transport_handle_open_direct(struct nvme_transport_handle *hdl
 	ret = ioctl(hdl->fd, NVME_IOCTL_ADMIN64_CMD, &dummy);
 	if (ret > 0)
 		hdl->ioctl64 = true;
+	hdl->record = __nvme_record_enabled();
 
 	return 0;
 }
@@ -159,12 +160,19 @@ int nvme_open(struct nvme_global_ctx *ctx, const char *name,
 
 		if (!strcmp(name, "NVME_TEST_FD64"))
 			hdl->ioctl64 = true;
+		hdl->record = __nvme_record_enabled();
 
 		*hdlp = hdl;
 		return 0;
 	}
 
-	if (!strncmp(name, "mctp:", strlen("mctp:")))
+	if (!strncmp(name, "replay:", strlen("replay:")))
+		ret = __nvme_transport_handle_open_replay(hdl,
+				name + strlen("replay:"), NULL);
+	else if (getenv("LIBNVME_REPLAY"))
+		ret = __nvme_transport_handle_open_replay(hdl,
+				getenv("LIBNVME_REPLAY"), name);
+	else if (!strncmp(name, "mctp:", strlen("mctp:")))
 		ret = __nvme_transport_handle_open_mi(hdl, name);
 	else
   		ret = __nvme_transport_handle_open_direct(hdl, name);
@@ -185,6 +193,7 @@ void nvme_close(struct nvme_transport_handle *hdl)
 		return;
 
 	free(hdl->name);
+	__nvme_retry_free(hdl);
 
 	switch (hdl->type) {
 	case NVME_TRANSPORT_HANDLE_TYPE_DIRECT:
@@ -193,6 +202,7 @@ void nvme_close(struct nvme_transport_handle *hdl)
 	case NVME_TRANSPORT_HANDLE_TYPE_MI:
 		__nvme_transport_handle_close_mi(hdl);
 		break;
+	case NVME_TRANSPORT_HANDLE_TYPE_REPLAY:
 	case NVME_TRANSPORT_HANDLE_TYPE_UNKNOWN:
 		free(hdl);
 		break;
@@ -229,6 +239,13 @@ bool nvme_transport_handle_is_mi(struct nvme_transport_handle *hdl)
 	return hdl->type == NVME_TRANSPORT_HANDLE_TYPE_MI;
 }
 
+bool nvme_transport_handle_is_admin_cmd(struct nvme_transport_handle *hdl)
+{
+	struct nvme_submit_state *s = __nvme_submit_state(hdl);
+
+	return s && s->admin;
+}
+
 int nvme_fw_download_seq(struct nvme_transport_handle *hdl, __u32 size,
 		__u32 xfer, __u32 offset, void *buf)
 {
@@ -287,6 +287,22 @@ bool nvme_transport_handle_is_direct(struct nvme_transport_handle *hdl);
  */
 bool nvme_transport_handle_is_mi(struct nvme_transport_handle *hdl);
 
+/**
+ * nvme_transport_handle_is_admin_cmd - Check if the command in flight is an
+ *	admin command
+ * @hdl:	Transport handle
+ *
+ * Intended to be called from the submit-entry, submit-exit and decide-retry
+ * callbacks, which are shared between the admin and the I/O submission path.
+ * The answer is about the command the calling thread is submitting on @hdl,
+ * other threads may submit commands on the same handle meanwhile.
+ *
+ * Return: Return true if the command currently being submitted by the
+ * calling thread was issued through nvme_submit_admin_passthru(), otherwise
+ * false.
+ */
+bool nvme_transport_handle_is_admin_cmd(struct nvme_transport_handle *hdl);
+
 /**
  * nvme_transport_handle_set_submit_entry() - Install a submit-entry callback
  * @hdl:	Transport handle to configure
@@ -351,6 +367,116 @@ void nvme_transport_handle_set_decide_retry(struct nvme_transport_handle *hdl,
 		bool (*decide_retry)(struct nvme_transport_handle *hdl,
 				struct nvme_passthru_cmd *cmd, int err));
 
+/**
+ * enum nvme_retry_key - Selects which commands a retry policy applies to
+ * @NVME_RETRY_KEY_DEFAULT:	 All commands without a more specific policy
+ * @NVME_RETRY_KEY_ADMIN_OPCODE: Admin commands with the given opcode
+ * @NVME_RETRY_KEY_IO_OPCODE:	 I/O commands with the given opcode
+ * @NVME_RETRY_KEY_LOG_ID:	 Get Log Page commands for the given log id
+ * @NVME_RETRY_KEY_FEATURE_ID:	 Get/Set Features commands for the given
+ *				 feature id
+ */
+enum nvme_retry_key {
+	NVME_RETRY_KEY_DEFAULT,
+	NVME_RETRY_KEY_ADMIN_OPCODE,
+	NVME_RETRY_KEY_IO_OPCODE,
+	NVME_RETRY_KEY_LOG_ID,
+	NVME_RETRY_KEY_FEATURE_ID,
+};
+
+/**
+ * struct nvme_retry_policy - Retry, backoff and timeout policy
+ * @max_retries:	Maximum number of retries after the first attempt
+ * @base_delay_ms:	Delay before the first retry, doubled for every
+ *			further retry
+ * @max_delay_ms:	Upper bound for the backoff delay, 0 for no bound
+ * @jitter_pct:		Random jitter applied to each delay, in percent of
+ *			the delay (0-100)
+ * @deadline_ms:	Time budget for the command including all retries,
+ *			0 for no deadline. Also caps the per attempt timeout.
+ * @timeout_ms:		Per attempt timeout for commands which do not set
+ *			one, 0 for the kernel default
+ * @retry_transient:	Retry on transient errors: Namespace Not Ready,
+ *			Command Interrupted and ANA Transition status codes
+ *			with DNR cleared, -EAGAIN and -EBUSY
+ */
+struct nvme_retry_policy {
+	__u32	max_retries;
+	__u32	base_delay_ms;
+	__u32	max_delay_ms;
+	__u32	jitter_pct;
+	__u32	deadline_ms;
+	__u32	timeout_ms;
+	bool	retry_transient;
+};
+
+/**
+ * struct nvme_retry_stats - Retry policy counters of a transport handle
+ * @commands:		Commands submitted under a retry policy
+ * @retries:		Total number of retries
+ * @status_retries:	Retries caused by a transient NVMe status
+ * @errno_retries:	Retries caused by a transient errno
+ * @exhausted:		Commands which failed after @max_retries retries
+ * @deadline_expired:	Commands which failed because the deadline expired
+ * @backoff_ns:		Total time spent in backoff delays
+ */
+struct nvme_retry_stats {
+	__u64	commands;
+	__u64	retries;
+	__u64	status_retries;
+	__u64	errno_retries;
+	__u64	exhausted;
+	__u64	deadline_expired;
+	__u64	backoff_ns;
+};
+
+/**
+ * nvme_transport_handle_set_retry_policy() - Install a retry policy
+ * @hdl:	Transport handle to configure
+ * @key:	Which class of commands the policy applies to
+ * @id:		Opcode, log id or feature id, depending on @key. Ignored for
+ *		%NVME_RETRY_KEY_DEFAULT.
+ * @policy:	Policy to install, copied into the handle. NULL removes a
+ *		previously installed policy.
+ *
+ * The most specific policy is applied to a command: feature id, then log id,
+ * then opcode and finally the default policy. The retry policy is consulted
+ * after the decide-retry callback declined to retry.
+ *
+ * Return: 0 on success, -EINVAL for an invalid @key or policy, -ENOMEM
+ * if the policy table could not be allocated.
+ */
+int nvme_transport_handle_set_retry_policy(struct nvme_transport_handle *hdl,
+		enum nvme_retry_key key, __u8 id,
+		const struct nvme_retry_policy *policy);
+
+/**
+ * nvme_transport_handle_get_retry_stats() - Read the retry policy counters
+ * @hdl:	Transport handle
+ * @stats:	Returns the counters accumulated since the handle was opened
+ *
+ * Return: 0 on success.
+ */
+int nvme_transport_handle_get_retry_stats(struct nvme_transport_handle *hdl,
+		struct nvme_retry_stats *stats);
+
+/**
+ * nvme_transport_handle_get_cmd_retry_stats() - Read the retry policy
+ *	counters of the command in flight
+ * @hdl:	Transport handle
+ * @stats:	Returns the counters of the command the calling thread is
+ *		submitting on @hdl
+ *
+ * Intended to be called from the submit-exit callback. Unlike the handle
+ * wide counters these do not include the commands other threads submit on
+ * the same handle meanwhile.
+ *
+ * Return: 0 on success, -ENOENT if the calling thread is not submitting a
+ * command on @hdl.
+ */
+int nvme_transport_handle_get_cmd_retry_stats(struct nvme_transport_handle *hdl,
+		struct nvme_retry_stats *stats);
+
 /**
  * enum nvme_hmac_alg - HMAC algorithm
  * @NVME_HMAC_ALG_NONE:		No HMAC algorithm
@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 
 #include <nvme/fabrics.h>
+#include <nvme/linux.h>
 #include <nvme/mi.h>
 
 const char *nvme_subsys_sysfs_dir(void);
@@ -83,6 +84,7 @@ enum nvme_transport_handle_type {
 	NVME_TRANSPORT_HANDLE_TYPE_UNKNOWN = 0,
 	NVME_TRANSPORT_HANDLE_TYPE_DIRECT,
 	NVME_TRANSPORT_HANDLE_TYPE_MI,
+	NVME_TRANSPORT_HANDLE_TYPE_REPLAY,
 };
 
 struct nvme_transport_handle {
@@ -97,11 +99,17 @@ struct nvme_transport_handle {
 			int err, void *user_data);
 	bool (*decide_retry)(struct nvme_transport_handle *hdl,
 			struct nvme_passthru_cmd *cmd, int err);
+	struct nvme_retry_table *retry;
 
 	/* direct */
 	int fd;
 	struct stat stat;
 	bool ioctl64;
+	bool record;
+
+	/* replay */
+	size_t replay_pos;
+	bool replay_dev;
 
 	/* mi */
 	struct nvme_mi_ep *ep;
@@ -403,6 +411,46 @@ struct nvme_transport_handle *__nvme_create_transport_handle(struct nvme_global_
 int __nvme_transport_handle_open_mi(struct nvme_transport_handle *hdl, const char *devname);
 int __nvme_transport_handle_init_mi(struct nvme_transport_handle *hdl);
 void __nvme_transport_handle_close_mi(struct nvme_transport_handle *hdl);
+int __nvme_transport_handle_open_replay(struct nvme_transport_handle *hdl,
+		const char *path, const char *devname);
+
+struct nvme_retry_state {
+	const struct nvme_retry_policy *policy;
+	__u64 start_ns;
+	struct nvme_retry_stats stats;	/* of this command */
+	unsigned int seed;
+};
+
+/*
+ * A command on its way through the submission path. A handle may be shared
+ * by several threads, so this lives on the stack of the submitting one and
+ * is found by the hooks through __nvme_submit_state().
+ */
+struct nvme_submit_state {
+	struct nvme_transport_handle *hdl;
+	bool admin;
+	struct nvme_retry_state retry;
+	struct nvme_submit_state *prev;
+};
+
+struct nvme_submit_state *__nvme_submit_state(
+		struct nvme_transport_handle *hdl);
+
+void __nvme_retry_begin(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin,
+		struct nvme_retry_state *state);
+bool __nvme_retry_check(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, int err,
+		struct nvme_retry_state *state);
+void __nvme_retry_free(struct nvme_transport_handle *hdl);
+
+bool __nvme_record_enabled(void);
+__u64 __nvme_record_start(struct nvme_transport_handle *hdl);
+void __nvme_record_cmd(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin, int err, __u64 start);
+int __nvme_replay_cmd(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin);
+int __nvme_replay_get_nsid(struct nvme_transport_handle *hdl, __u32 *nsid);
 
 nvme_ctrl_t __nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
 			       const char *traddr, const char *host_traddr,
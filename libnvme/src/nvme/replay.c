@@ -0,0 +1,449 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ *
+ * Record and replay of passthru command streams.
+ *
+ * When LIBNVME_RECORD is set, every admin and I/O passthru command issued on
+ * a direct transport handle is appended to the given file together with its
+ * status, result, latency and, for commands transferring data from the
+ * controller, the returned data.
+ *
+ * A replay transport handle serves the responses of such a file instead of
+ * talking to a device. It is created by opening "replay:<file>", or by
+ * opening any device name while LIBNVME_REPLAY=<file> is set. The replay
+ * speed is controlled by LIBNVME_REPLAY_SPEED: 1 (default) uses the recorded
+ * latencies, N replays N times faster and 0 does not delay at all.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cleanup.h"
+#include "ioctl.h"
+#include "log.h"
+#include "private.h"
+
+#define NVME_REPLAY_MAGIC	"NVMEREC"
+#define NVME_REPLAY_VERSION	1
+
+struct nvme_replay_file_hdr {
+	char	magic[8];
+	__u32	version;
+	__u32	rsvd;
+};
+
+struct nvme_replay_rec {
+	__u32	len;		/* record length including returned data */
+	__u8	admin;
+	__u8	opcode;
+	__u8	flags;
+	__u8	rsvd;
+	__u32	nsid;
+	__u32	cdw2;
+	__u32	cdw3;
+	__u32	cdw10;
+	__u32	cdw11;
+	__u32	cdw12;
+	__u32	cdw13;
+	__u32	cdw14;
+	__u32	cdw15;
+	__u32	data_len;
+	__u32	metadata_len;
+	__u32	out_len;	/* bytes of returned data following the record */
+	__s32	err;
+	__u64	result;
+	__u64	latency_ns;
+	char	dev[32];
+};
+
+/*
+ * Records follow each other without padding, so their headers are copied
+ * out of the mapping rather than accessed in place, which may be unaligned.
+ */
+struct nvme_replay {
+	char *path;
+	void *map;
+	size_t map_len;
+	struct nvme_replay_rec *recs;
+	const void **data;	/* returned data of each record */
+	bool *used;
+	size_t nr_recs;
+	double speed;
+};
+
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct nvme_replay *replay;
+static int record_fd = -1;
+
+static __u64 nvme_replay_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool nvme_replay_cmd_reads(struct nvme_passthru_cmd *cmd)
+{
+	/* bit 1 of the opcode: data transfer from controller to host */
+	return cmd->opcode & 0x2;
+}
+
+static int nvme_record_open(const char *path)
+{
+	struct nvme_replay_file_hdr hdr = {
+		.magic = NVME_REPLAY_MAGIC,
+		.version = NVME_REPLAY_VERSION,
+	};
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0 ||
+	    (!st.st_size && write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+bool __nvme_record_enabled(void)
+{
+	const char *path = getenv("LIBNVME_RECORD");
+
+	return path && *path;
+}
+
+__u64 __nvme_record_start(struct nvme_transport_handle *hdl)
+{
+	if (!hdl->record)
+		return 0;
+
+	return nvme_replay_now();
+}
+
+void __nvme_record_cmd(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin, int err, __u64 start)
+{
+	_cleanup_free_ struct nvme_replay_rec *rec = NULL;
+	__u32 out_len = 0;
+	size_t len;
+
+	if (!hdl->record)
+		return;
+
+	if (!err && nvme_replay_cmd_reads(cmd) && cmd->addr)
+		out_len = cmd->data_len;
+
+	len = sizeof(*rec) + out_len;
+	rec = calloc(1, len);
+	if (!rec)
+		return;
+
+	*rec = (struct nvme_replay_rec) {
+		.len = len,
+		.admin = admin,
+		.opcode = cmd->opcode,
+		.flags = cmd->flags,
+		.nsid = cmd->nsid,
+		.cdw2 = cmd->cdw2,
+		.cdw3 = cmd->cdw3,
+		.cdw10 = cmd->cdw10,
+		.cdw11 = cmd->cdw11,
+		.cdw12 = cmd->cdw12,
+		.cdw13 = cmd->cdw13,
+		.cdw14 = cmd->cdw14,
+		.cdw15 = cmd->cdw15,
+		.data_len = cmd->data_len,
+		.metadata_len = cmd->metadata_len,
+		.out_len = out_len,
+		.err = err,
+		.result = cmd->result,
+		.latency_ns = nvme_replay_now() - start,
+	};
+	strncpy(rec->dev, basename(hdl->name), sizeof(rec->dev) - 1);
+	if (out_len)
+		memcpy(rec + 1, (void *)(uintptr_t)cmd->addr, out_len);
+
+	pthread_mutex_lock(&replay_lock);
+	if (record_fd < 0) {
+		record_fd = nvme_record_open(getenv("LIBNVME_RECORD"));
+		if (record_fd < 0)
+			nvme_msg(hdl->ctx, LOG_ERR,
+				 "failed to open record file: %s\n",
+				 strerror(-record_fd));
+	}
+	/* a single O_APPEND write keeps records of concurrent writers intact */
+	if (record_fd >= 0 && write(record_fd, rec, len) != (ssize_t)len)
+		nvme_msg(hdl->ctx, LOG_ERR, "failed to record command: %s\n",
+			 strerror(errno));
+	pthread_mutex_unlock(&replay_lock);
+}
+
+static int nvme_replay_load(const char *path, struct nvme_replay **rp)
+{
+	struct nvme_replay_file_hdr *hdr;
+	struct nvme_replay *r;
+	const char *speed;
+	struct stat st;
+	size_t off, n;
+	int fd, err;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+		goto free_replay;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		goto close_fd;
+	}
+
+	err = -EINVAL;
+	if ((size_t)st.st_size < sizeof(*hdr))
+		goto close_fd;
+
+	r->map_len = st.st_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (r->map == MAP_FAILED) {
+		err = -errno;
+		goto close_fd;
+	}
+
+	hdr = r->map;
+	if (memcmp(hdr->magic, NVME_REPLAY_MAGIC, sizeof(NVME_REPLAY_MAGIC)) ||
+	    hdr->version != NVME_REPLAY_VERSION)
+		goto unmap;
+
+	for (off = sizeof(*hdr), n = 0; off + sizeof(struct nvme_replay_rec) <= r->map_len; n++) {
+		__u32 len;
+
+		memcpy(&len, r->map + off + offsetof(struct nvme_replay_rec, len),
+		       sizeof(len));
+		if (len < sizeof(struct nvme_replay_rec) || off + len > r->map_len)
+			break;
+		off += len;
+	}
+
+	err = -ENOMEM;
+	r->recs = calloc(n ?: 1, sizeof(*r->recs));
+	r->data = calloc(n ?: 1, sizeof(*r->data));
+	r->used = calloc(n ?: 1, sizeof(*r->used));
+	if (!r->recs || !r->data || !r->used)
+		goto unmap;
+
+	for (off = sizeof(*hdr); r->nr_recs < n; r->nr_recs++) {
+		struct nvme_replay_rec *rec = &r->recs[r->nr_recs];
+
+		memcpy(rec, r->map + off, sizeof(*rec));
+		r->data[r->nr_recs] = r->map + off + sizeof(*rec);
+		off += rec->len;
+	}
+
+	r->speed = 1.0;
+	speed = getenv("LIBNVME_REPLAY_SPEED");
+	if (speed)
+		r->speed = strtod(speed, NULL);
+
+	r->path = strdup(path);
+	if (!r->path)
+		goto unmap;
+
+	close(fd);
+	*rp = r;
+	return 0;
+
+unmap:
+	free(r->recs);
+	free(r->data);
+	free(r->used);
+	munmap(r->map, r->map_len);
+close_fd:
+	close(fd);
+free_replay:
+	free(r);
+	return err;
+}
+
+static void nvme_replay_free(struct nvme_replay *r)
+{
+	if (!r)
+		return;
+
+	free(r->path);
+	free(r->recs);
+	free(r->data);
+	free(r->used);
+	munmap(r->map, r->map_len);
+	free(r);
+}
+
+static bool nvme_replay_has_dev(struct nvme_replay *r, const char *dev)
+{
+	size_t i;
+
+	for (i = 0; i < r->nr_recs; i++)
+		if (!strncmp(r->recs[i].dev, dev, sizeof(r->recs[i].dev)))
+			return true;
+
+	return false;
+}
+
+int __nvme_transport_handle_open_replay(struct nvme_transport_handle *hdl,
+		const char *path, const char *devname)
+{
+	const char *dev;
+	int ret = 0, id, ns;
+
+	hdl->type = NVME_TRANSPORT_HANDLE_TYPE_REPLAY;
+	hdl->fd = -1;
+
+	pthread_mutex_lock(&replay_lock);
+	if (!replay || strcmp(replay->path, path)) {
+		nvme_replay_free(replay);
+		replay = NULL;
+		ret = nvme_replay_load(path, &replay);
+	}
+	pthread_mutex_unlock(&replay_lock);
+	if (ret) {
+		nvme_msg(hdl->ctx, LOG_ERR, "failed to load replay file %s: %s\n",
+			 path, strerror(-ret));
+		return ret;
+	}
+
+	/*
+	 * Without an explicit device name serve every record in the file,
+	 * taking the character/block device type from the first one.
+	 */
+	if (devname) {
+		dev = basename(devname);
+		hdl->replay_dev = nvme_replay_has_dev(replay, dev);
+	} else {
+		dev = replay->nr_recs ? replay->recs[0].dev : "";
+		free(hdl->name);
+		hdl->name = strndup(dev, sizeof(replay->recs[0].dev));
+		if (!hdl->name)
+			return -ENOMEM;
+	}
+
+	if (sscanf(dev, "nvme%dn%d", &id, &ns) == 2)
+		hdl->stat.st_mode = S_IFBLK;
+	else
+		hdl->stat.st_mode = S_IFCHR;
+	hdl->ioctl64 = true;
+
+	return 0;
+}
+
+static bool nvme_replay_match(struct nvme_transport_handle *hdl,
+		struct nvme_replay_rec *rec, struct nvme_passthru_cmd *cmd,
+		bool admin)
+{
+	if (hdl->replay_dev &&
+	    strncmp(rec->dev, basename(hdl->name), sizeof(rec->dev)))
+		return false;
+
+	return rec->admin == admin &&
+		rec->opcode == cmd->opcode &&
+		rec->nsid == cmd->nsid &&
+		rec->cdw2 == cmd->cdw2 &&
+		rec->cdw3 == cmd->cdw3 &&
+		rec->cdw10 == cmd->cdw10 &&
+		rec->cdw11 == cmd->cdw11 &&
+		rec->cdw12 == cmd->cdw12 &&
+		rec->cdw13 == cmd->cdw13 &&
+		rec->cdw14 == cmd->cdw14 &&
+		rec->cdw15 == cmd->cdw15 &&
+		rec->data_len == cmd->data_len;
+}
+
+static void nvme_replay_delay(struct nvme_replay_rec *rec, double speed)
+{
+	struct timespec ts;
+	__u64 ns;
+
+	if (speed <= 0)
+		return;
+
+	ns = rec->latency_ns / speed;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+int __nvme_replay_cmd(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin)
+{
+	struct nvme_replay_rec *rec = NULL;
+	const void *data = NULL;
+	size_t i;
+
+	/*
+	 * Serve the oldest matching record which has not been consumed yet,
+	 * starting the search at the handle's cursor so that a sequential
+	 * stream is served in O(1) per command.
+	 */
+	pthread_mutex_lock(&replay_lock);
+	for (i = 0; i < replay->nr_recs; i++) {
+		size_t idx = (hdl->replay_pos + i) % replay->nr_recs;
+
+		if (replay->used[idx] ||
+		    !nvme_replay_match(hdl, &replay->recs[idx], cmd, admin))
+			continue;
+
+		rec = &replay->recs[idx];
+		data = replay->data[idx];
+		replay->used[idx] = true;
+		hdl->replay_pos = idx + 1;
+		break;
+	}
+	pthread_mutex_unlock(&replay_lock);
+
+	if (!rec) {
+		nvme_msg(hdl->ctx, LOG_ERR,
+			 "no recorded response for opcode %#x nsid %#x cdw10 %#x\n",
+			 cmd->opcode, cmd->nsid, cmd->cdw10);
+		return -ENODATA;
+	}
+
+	nvme_replay_delay(rec, replay->speed);
+
+	if (rec->out_len && cmd->addr)
+		memcpy((void *)(uintptr_t)cmd->addr, data,
+		       rec->out_len < cmd->data_len ? rec->out_len : cmd->data_len);
+	cmd->result = rec->result;
+
+	return rec->err;
+}
+
+int __nvme_replay_get_nsid(struct nvme_transport_handle *hdl, __u32 *nsid)
+{
+	int id, ns;
+
+	if (!S_ISBLK(hdl->stat.st_mode) ||
+	    sscanf(basename(hdl->name), "nvme%dn%d", &id, &ns) != 2)
+		return -ENOTTY;
+
+	*nsid = ns;
+	return 0;
+}
@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ *
+ * Retry, backoff and timeout policy engine for passthru commands.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ioctl.h"
+#include "linux.h"
+#include "private.h"
+
+struct nvme_retry_entry {
+	struct nvme_retry_policy policy;
+	bool set;
+};
+
+struct nvme_retry_table {
+	struct nvme_retry_entry def;
+	struct nvme_retry_entry admin[256];
+	struct nvme_retry_entry io[256];
+	struct nvme_retry_entry log[256];
+	struct nvme_retry_entry feat[256];
+	/* shared by all threads submitting on the handle, updated atomically */
+	struct nvme_retry_stats stats;
+};
+
+/* counted for the command itself and for the handle */
+#define nvme_retry_stat_add(t, state, field, n)				\
+	do {								\
+		(state)->stats.field += n;				\
+		__atomic_fetch_add(&(t)->stats.field, n,		\
+				   __ATOMIC_RELAXED);			\
+	} while (0)
+
+static __u64 nvme_retry_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int nvme_transport_handle_set_retry_policy(struct nvme_transport_handle *hdl,
+		enum nvme_retry_key key, __u8 id,
+		const struct nvme_retry_policy *policy)
+{
+	struct nvme_retry_table *t = hdl->retry;
+	struct nvme_retry_entry *e;
+
+	if (policy && policy->jitter_pct > 100)
+		return -EINVAL;
+
+	if (!t) {
+		if (!policy)
+			return 0;
+		t = calloc(1, sizeof(*t));
+		if (!t)
+			return -ENOMEM;
+		hdl->retry = t;
+	}
+
+	switch (key) {
+	case NVME_RETRY_KEY_DEFAULT:
+		e = &t->def;
+		break;
+	case NVME_RETRY_KEY_ADMIN_OPCODE:
+		e = &t->admin[id];
+		break;
+	case NVME_RETRY_KEY_IO_OPCODE:
+		e = &t->io[id];
+		break;
+	case NVME_RETRY_KEY_LOG_ID:
+		e = &t->log[id];
+		break;
+	case NVME_RETRY_KEY_FEATURE_ID:
+		e = &t->feat[id];
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	e->set = !!policy;
+	if (policy)
+		e->policy = *policy;
+
+	return 0;
+}
+
+int nvme_transport_handle_get_retry_stats(struct nvme_transport_handle *hdl,
+		struct nvme_retry_stats *stats)
+{
+	struct nvme_retry_stats *s;
+
+	if (!hdl->retry) {
+		memset(stats, 0, sizeof(*stats));
+		return 0;
+	}
+
+	s = &hdl->retry->stats;
+	stats->commands = __atomic_load_n(&s->commands, __ATOMIC_RELAXED);
+	stats->retries = __atomic_load_n(&s->retries, __ATOMIC_RELAXED);
+	stats->status_retries = __atomic_load_n(&s->status_retries,
+						__ATOMIC_RELAXED);
+	stats->errno_retries = __atomic_load_n(&s->errno_retries,
+					       __ATOMIC_RELAXED);
+	stats->exhausted = __atomic_load_n(&s->exhausted, __ATOMIC_RELAXED);
+	stats->deadline_expired = __atomic_load_n(&s->deadline_expired,
+						  __ATOMIC_RELAXED);
+	stats->backoff_ns = __atomic_load_n(&s->backoff_ns, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int nvme_transport_handle_get_cmd_retry_stats(struct nvme_transport_handle *hdl,
+		struct nvme_retry_stats *stats)
+{
+	struct nvme_submit_state *s = __nvme_submit_state(hdl);
+
+	if (!s)
+		return -ENOENT;
+
+	*stats = s->retry.stats;
+	return 0;
+}
+
+void __nvme_retry_free(struct nvme_transport_handle *hdl)
+{
+	free(hdl->retry);
+	hdl->retry = NULL;
+}
+
+/*
+ * The most specific policy wins: feature id, then log id, then opcode and
+ * finally the handle wide default.
+ */
+static const struct nvme_retry_policy *nvme_retry_lookup(
+		struct nvme_transport_handle *hdl, struct nvme_passthru_cmd *cmd,
+		bool admin)
+{
+	struct nvme_retry_table *t = hdl->retry;
+	__u8 id = cmd->cdw10 & 0xff;
+
+	if (!admin)
+		return t->io[cmd->opcode].set ? &t->io[cmd->opcode].policy :
+			t->def.set ? &t->def.policy : NULL;
+
+	switch (cmd->opcode) {
+	case nvme_admin_get_features:
+	case nvme_admin_set_features:
+		if (t->feat[id].set)
+			return &t->feat[id].policy;
+		break;
+	case nvme_admin_get_log_page:
+		if (t->log[id].set)
+			return &t->log[id].policy;
+		break;
+	default:
+		break;
+	}
+
+	if (t->admin[cmd->opcode].set)
+		return &t->admin[cmd->opcode].policy;
+
+	return t->def.set ? &t->def.policy : NULL;
+}
+
+void __nvme_retry_begin(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, bool admin,
+		struct nvme_retry_state *state)
+{
+	memset(state, 0, sizeof(*state));
+
+	if (!hdl->retry)
+		return;
+
+	state->policy = nvme_retry_lookup(hdl, cmd, admin);
+	if (!state->policy)
+		return;
+
+	state->start_ns = nvme_retry_now_ns();
+	if (!cmd->timeout_ms)
+		cmd->timeout_ms = state->policy->timeout_ms;
+	if (state->policy->deadline_ms &&
+	    (!cmd->timeout_ms || cmd->timeout_ms > state->policy->deadline_ms))
+		cmd->timeout_ms = state->policy->deadline_ms;
+
+	nvme_retry_stat_add(hdl->retry, state, commands, 1);
+}
+
+static bool nvme_retry_is_transient(int err)
+{
+	__u16 sct, sc;
+
+	if (err < 0)
+		return err == -EAGAIN || err == -EBUSY;
+
+	if (err & NVME_SC_DNR)
+		return false;
+
+	sct = nvme_status_code_type(err);
+	sc = nvme_status_code(err);
+
+	switch (sct) {
+	case NVME_SCT_GENERIC:
+		return sc == NVME_SC_NS_NOT_READY ||
+			sc == NVME_SC_CMD_INTERRUPTED;
+	case NVME_SCT_PATH:
+		return sc == NVME_SC_ANA_TRANSITION;
+	default:
+		return false;
+	}
+}
+
+static __u64 nvme_retry_backoff_ns(struct nvme_retry_state *state,
+		const struct nvme_retry_policy *p, __u32 retry)
+{
+	__u64 delay = (__u64)p->base_delay_ms * 1000000ULL;
+	__u64 max = (__u64)p->max_delay_ms * 1000000ULL;
+
+	delay <<= retry < 32 ? retry : 32;
+	if (max && delay > max)
+		delay = max;
+
+	if (p->jitter_pct && delay) {
+		__u64 jitter = delay * p->jitter_pct / 100;
+
+		/* seeded per command, the handle may be used by several threads */
+		if (!retry)
+			state->seed = (unsigned int)(state->start_ns ^
+						     (uintptr_t)state);
+		delay -= jitter;
+		delay += ((__u64)rand_r(&state->seed) << 31 |
+			  rand_r(&state->seed)) % (2 * jitter + 1);
+	}
+
+	return delay;
+}
+
+bool __nvme_retry_check(struct nvme_transport_handle *hdl,
+		struct nvme_passthru_cmd *cmd, int err,
+		struct nvme_retry_state *state)
+{
+	const struct nvme_retry_policy *p = state->policy;
+	struct nvme_retry_table *t = hdl->retry;
+	struct timespec ts;
+	__u64 delay, now;
+
+	if (!p || !err)
+		return false;
+
+	if (!p->retry_transient || !nvme_retry_is_transient(err))
+		return false;
+
+	if (state->stats.retries >= p->max_retries) {
+		nvme_retry_stat_add(t, state, exhausted, 1);
+		return false;
+	}
+
+	delay = nvme_retry_backoff_ns(state, p, state->stats.retries);
+	now = nvme_retry_now_ns();
+	if (p->deadline_ms) {
+		__u64 deadline = state->start_ns + (__u64)p->deadline_ms * 1000000ULL;
+		__u64 left;
+
+		if (now + delay >= deadline) {
+			nvme_retry_stat_add(t, state, deadline_expired, 1);
+			return false;
+		}
+
+		/* the next attempt must not outlive the deadline either */
+		left = (deadline - now - delay) / 1000000ULL;
+		if (!left) {
+			nvme_retry_stat_add(t, state, deadline_expired, 1);
+			return false;
+		}
+		if (!cmd->timeout_ms || cmd->timeout_ms > left)
+			cmd->timeout_ms = left;
+	}
+
+	/* a signal during the backoff aborts the retry sequence */
+	ts.tv_sec = delay / 1000000000ULL;
+	ts.tv_nsec = delay % 1000000000ULL;
+	if (nanosleep(&ts, NULL) < 0)
+		return false;
+
+	if (err > 0)
+		nvme_retry_stat_add(t, state, status_retries, 1);
+	else
+		nvme_retry_stat_add(t, state, errno_retries, 1);
+	nvme_retry_stat_add(t, state, retries, 1);
+	nvme_retry_stat_add(t, state, backoff_ns, delay);
+
+	return true;
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <libnvme.h>
+
+#include "mock.h"
+#include "util.h"
+
+#define TEST_FD 0xFD
+#define TEST_NSID 0x12345678
+#define TEST_SC NVME_SC_INVALID_FIELD
+
+static char record_path[] = "/tmp/libnvme-replay-XXXXXX";
+static struct nvme_global_ctx *ctx;
+
+static struct nvme_id_ctrl expected_id;
+static struct nvme_id_ns expected_ns;
+
+static void test_record(void)
+{
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.opcode = nvme_admin_identify,
+			.data_len = sizeof(expected_id),
+			.cdw10 = NVME_IDENTIFY_CNS_CTRL,
+			.out_data = &expected_id,
+		},
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(expected_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = TEST_SC,
+		},
+	};
+	struct nvme_transport_handle *hdl;
+	struct nvme_id_ctrl id = {};
+	struct nvme_id_ns ns = {};
+	struct nvme_passthru_cmd cmd;
+	int err;
+
+	setenv("LIBNVME_RECORD", record_path, 1);
+	check(!nvme_open(ctx, "NVME_TEST_FD", &hdl), "opening test link failed");
+
+	arbitrary(&expected_id, sizeof(expected_id));
+	set_mock_admin_cmds(mock_admin_cmds, 2);
+	nvme_init_identify_ctrl(&cmd, &id);
+	err = nvme_submit_admin_passthru(hdl, &cmd);
+	check(err == 0, "identify returned error %d", err);
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(hdl, &cmd);
+	check(err == TEST_SC, "got error %d, expected %d", err, TEST_SC);
+	end_mock_cmds();
+
+	nvme_close(hdl);
+	unsetenv("LIBNVME_RECORD");
+}
+
+static void test_replay(void)
+{
+	_cleanup_free_ char *name = NULL;
+	struct nvme_transport_handle *hdl;
+	struct nvme_id_ctrl id = {};
+	struct nvme_id_ns ns = {};
+	struct nvme_passthru_cmd cmd;
+	int err;
+
+	check(asprintf(&name, "replay:%s", record_path) > 0, "asprintf failed");
+	check(!nvme_open(ctx, name, &hdl), "opening replay handle failed");
+	check(nvme_transport_handle_is_chardev(hdl), "expected a char device");
+
+	/* no mock commands are set up, any ioctl() would fail the test */
+	nvme_init_identify_ctrl(&cmd, &id);
+	err = nvme_submit_admin_passthru(hdl, &cmd);
+	check(err == 0, "identify returned error %d", err);
+	cmp(&id, &expected_id, sizeof(id), "incorrect identify data");
+
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(hdl, &cmd);
+	check(err == TEST_SC, "got error %d, expected %d", err, TEST_SC);
+
+	/* every recorded completion is served only once */
+	nvme_init_identify_ctrl(&cmd, &id);
+	err = nvme_submit_admin_passthru(hdl, &cmd);
+	check(err == -ENODATA, "got error %d, expected %d", err, -ENODATA);
+
+	nvme_close(hdl);
+}
+
+static void run_test(const char *test_name, void (*test_fn)(void))
+{
+	printf("Running test %s...", test_name);
+	fflush(stdout);
+	test_fn();
+	puts(" OK");
+}
+
+#define RUN_TEST(name) run_test(#name, test_ ## name)
+
+int main(void)
+{
+	int fd;
+
+	ctx = nvme_create_global_ctx(stdout, DEFAULT_LOGLEVEL);
+	set_mock_fd(TEST_FD);
+	setenv("LIBNVME_REPLAY_SPEED", "0", 1);
+
+	fd = mkstemp(record_path);
+	check(fd >= 0, "mkstemp failed");
+	close(fd);
+
+	RUN_TEST(record);
+	RUN_TEST(replay);
+
+	unlink(record_path);
+	nvme_free_global_ctx(ctx);
+}
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <ccan/array_size/array_size.h>
+#include <libnvme.h>
+
+#include "mock.h"
+#include "util.h"
+
+#define TEST_FD 0xFD
+#define TEST_NSID 0x12345678
+
+static struct nvme_transport_handle *test_hdl;
+
+static const struct nvme_retry_policy test_policy = {
+	.max_retries = 2,
+	.base_delay_ms = 1,
+	.max_delay_ms = 2,
+	.jitter_pct = 50,
+	.retry_transient = true,
+};
+
+static void test_transient_status(void)
+{
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = NVME_SC_NS_NOT_READY,
+		},
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = NVME_SCT_PATH << NVME_SCT_SHIFT |
+				NVME_SC_ANA_TRANSITION,
+		},
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+		},
+	};
+	struct nvme_retry_stats stats;
+	struct nvme_passthru_cmd cmd;
+	struct nvme_id_ns ns;
+	int err;
+
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(test_hdl, &cmd);
+	end_mock_cmds();
+	check(err == 0, "identify returned error %d", err);
+
+	nvme_transport_handle_get_retry_stats(test_hdl, &stats);
+	check(stats.retries == 2, "got %llu retries, expected 2",
+	      (unsigned long long)stats.retries);
+	check(stats.status_retries == 2, "got %llu status retries, expected 2",
+	      (unsigned long long)stats.status_retries);
+}
+
+static void test_dnr(void)
+{
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = NVME_SC_NS_NOT_READY | NVME_SC_DNR,
+		},
+	};
+	struct nvme_passthru_cmd cmd;
+	struct nvme_id_ns ns;
+	int err;
+
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(test_hdl, &cmd);
+	end_mock_cmds();
+	check(err == (NVME_SC_NS_NOT_READY | NVME_SC_DNR),
+	      "got error %d, expected %d", err,
+	      NVME_SC_NS_NOT_READY | NVME_SC_DNR);
+}
+
+static void test_exhausted(void)
+{
+	struct mock_cmd mock_admin_cmds[3];
+	struct nvme_retry_stats before, after;
+	struct nvme_passthru_cmd cmd;
+	struct nvme_id_ns ns;
+	int err, i;
+
+	for (i = 0; i < ARRAY_SIZE(mock_admin_cmds); i++)
+		mock_admin_cmds[i] = (struct mock_cmd) {
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = NVME_SC_CMD_INTERRUPTED,
+		};
+
+	nvme_transport_handle_get_retry_stats(test_hdl, &before);
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(test_hdl, &cmd);
+	end_mock_cmds();
+	check(err == NVME_SC_CMD_INTERRUPTED, "got error %d, expected %d", err,
+	      NVME_SC_CMD_INTERRUPTED);
+
+	nvme_transport_handle_get_retry_stats(test_hdl, &after);
+	check(after.exhausted == before.exhausted + 1,
+	      "exhausted counter not incremented");
+}
+
+static void test_log_policy(void)
+{
+	struct nvme_retry_policy no_retry = { 0 };
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.opcode = nvme_admin_get_log_page,
+			.nsid = NVME_NSID_ALL,
+			.data_len = sizeof(struct nvme_smart_log),
+			.cdw10 = (sizeof(struct nvme_smart_log) / 4 - 1) << 16 |
+				 NVME_LOG_LID_SMART,
+			.err = NVME_SC_NS_NOT_READY,
+		},
+	};
+	struct nvme_smart_log log;
+	int err;
+
+	/* a log id policy takes precedence over the default policy */
+	check(!nvme_transport_handle_set_retry_policy(test_hdl,
+			NVME_RETRY_KEY_LOG_ID, NVME_LOG_LID_SMART, &no_retry),
+	      "failed to set log policy");
+
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	err = nvme_get_log_smart(test_hdl, NVME_NSID_ALL, &log);
+	end_mock_cmds();
+	check(err == NVME_SC_NS_NOT_READY, "got error %d, expected %d", err,
+	      NVME_SC_NS_NOT_READY);
+
+	nvme_transport_handle_set_retry_policy(test_hdl, NVME_RETRY_KEY_LOG_ID,
+					       NVME_LOG_LID_SMART, NULL);
+}
+
+static void test_invalid_policy(void)
+{
+	struct nvme_retry_policy policy = { .jitter_pct = 101 };
+
+	check(nvme_transport_handle_set_retry_policy(test_hdl,
+			NVME_RETRY_KEY_DEFAULT, 0, &policy) == -EINVAL,
+	      "jitter above 100%% accepted");
+}
+
+static struct nvme_retry_stats exit_stats;
+static bool exit_admin;
+
+static void cmd_stats_exit(struct nvme_transport_handle *hdl,
+			   struct nvme_passthru_cmd *cmd, int err,
+			   void *user_data)
+{
+	exit_admin = nvme_transport_handle_is_admin_cmd(hdl);
+	nvme_transport_handle_get_cmd_retry_stats(hdl, &exit_stats);
+}
+
+static void test_cmd_stats(void)
+{
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+			.err = NVME_SC_NS_NOT_READY,
+		},
+		{
+			.opcode = nvme_admin_identify,
+			.nsid = TEST_NSID,
+			.data_len = sizeof(struct nvme_id_ns),
+			.cdw10 = NVME_IDENTIFY_CNS_NS,
+		},
+	};
+	struct nvme_retry_stats stats;
+	struct nvme_passthru_cmd cmd;
+	struct nvme_id_ns ns;
+	int err;
+
+	/* only the command in flight, not what the handle did before */
+	nvme_transport_handle_set_submit_exit(test_hdl, cmd_stats_exit);
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	nvme_init_identify_ns(&cmd, TEST_NSID, &ns);
+	err = nvme_submit_admin_passthru(test_hdl, &cmd);
+	end_mock_cmds();
+	nvme_transport_handle_set_submit_exit(test_hdl, NULL);
+	check(err == 0, "identify returned error %d", err);
+
+	check(exit_admin, "admin command not seen as admin command");
+	check(exit_stats.commands == 1 && exit_stats.retries == 1 &&
+	      exit_stats.status_retries == 1,
+	      "got %llu commands, %llu retries, expected 1 and 1",
+	      (unsigned long long)exit_stats.commands,
+	      (unsigned long long)exit_stats.retries);
+
+	check(nvme_transport_handle_get_cmd_retry_stats(test_hdl, &stats) ==
+	      -ENOENT, "stats of a command outside of the submission");
+}
+
+static void run_test(const char *test_name, void (*test_fn)(void))
+{
+	printf("Running test %s...", test_name);
+	fflush(stdout);
+	test_fn();
+	puts(" OK");
+}
+
+#define RUN_TEST(name) run_test(#name, test_ ## name)
+
+int main(void)
+{
+	struct nvme_global_ctx *ctx =
+		nvme_create_global_ctx(stdout, DEFAULT_LOGLEVEL);
+
+	set_mock_fd(TEST_FD);
+	check(!nvme_open(ctx, "NVME_TEST_FD", &test_hdl),
+	      "opening test link failed");
+	check(!nvme_transport_handle_set_retry_policy(test_hdl,
+			NVME_RETRY_KEY_DEFAULT, 0, &test_policy),
+	      "failed to set default policy");
+
+	RUN_TEST(transient_status);
+	RUN_TEST(dnr);
+	RUN_TEST(exhausted);
+	RUN_TEST(log_policy);
+	RUN_TEST(invalid_policy);
+	RUN_TEST(cmd_stats);
+
+	nvme_close(test_hdl);
+	nvme_free_global_ctx(ctx);
+}
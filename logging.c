@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/ioctl.h>
@@ -15,17 +16,21 @@
 
 #include <ccan/endian/endian.h>
 
+#include "common.h"
 #include "logging.h"
 #include "util/sighdl.h"
+#include "util/trace.h"
 #include "nvme-print.h"
 
 struct submit_data {
 	struct timeval start;
 	struct timeval end;
+	uint64_t start_ns;
+	struct nvme_passthru_cmd mi_cmd;
 };
 
 int log_level;
-static struct submit_data sb;
+static __thread struct submit_data sb;
 
 bool is_printable_at_level(int level)
 {
@@ -106,6 +111,60 @@ static void nvme_log_retry(int errnum)
 	printf("passthru command returned '%s'\n", strerror(errnum));
 }
 
+int nvme_trace_setup(void)
+{
+	const char *path = getenv("NVME_TRACE");
+
+	if (!path || !*path)
+		return 0;
+
+	return nvme_trace_init(path, getenv("NVME_TRACE_FORMAT"));
+}
+
+static void nvme_trace_command(struct nvme_passthru_cmd *cmd, __u8 queue,
+			       int err, uint64_t start_ns, uint16_t retries)
+{
+	struct nvme_trace_rec rec = {
+		.start_ns = start_ns,
+		.latency_ns = nvme_trace_now() - start_ns,
+		.nsid = cmd->nsid,
+		.data_len = cmd->data_len,
+		.cdw = {
+			cmd->cdw10, cmd->cdw11, cmd->cdw12,
+			cmd->cdw13, cmd->cdw14, cmd->cdw15,
+		},
+		.status = err,
+		.queue = queue,
+		.opcode = cmd->opcode,
+		.retries = retries,
+	};
+
+	nvme_trace_record(&rec);
+}
+
+/* the retries of this command alone, other threads may share the handle */
+static uint16_t nvme_trace_retries(struct nvme_transport_handle *hdl)
+{
+	struct nvme_retry_stats s;
+	struct nvme_trace_file_counters c;
+
+	if (nvme_transport_handle_get_cmd_retry_stats(hdl, &s))
+		return 0;
+
+	c = (struct nvme_trace_file_counters) {
+		.commands = s.commands,
+		.retries = s.retries,
+		.status_retries = s.status_retries,
+		.errno_retries = s.errno_retries,
+		.exhausted = s.exhausted,
+		.deadline_expired = s.deadline_expired,
+		.backoff_ns = s.backoff_ns,
+	};
+	nvme_trace_add_retry_stats(&c);
+
+	return s.retries > UINT16_MAX ? UINT16_MAX : s.retries;
+}
+
 void *nvme_submit_entry(struct nvme_transport_handle *hdl,
 		struct nvme_passthru_cmd *cmd)
 {
@@ -113,6 +172,8 @@ void *nvme_submit_entry(struct nvme_transport_handle *hdl,
 
 	if (log_level >= LOG_DEBUG)
 		gettimeofday(&sb.start, NULL);
+	if (nvme_trace_enabled())
+		sb.start_ns = nvme_trace_now();
 
 	return &sb;
 }
@@ -122,6 +183,11 @@ void nvme_submit_exit(struct nvme_transport_handle *hdl,
 {
 	struct submit_data *sb = user_data;
 
+	if (nvme_trace_enabled())
+		nvme_trace_command(cmd, nvme_transport_handle_is_admin_cmd(hdl) ?
+				   NVME_TRACE_QUEUE_ADMIN : NVME_TRACE_QUEUE_IO,
+				   err, sb->start_ns, nvme_trace_retries(hdl));
+
 	if (log_level >= LOG_DEBUG) {
 		gettimeofday(&sb->end, NULL);
 		nvme_show_command(cmd, err);
@@ -132,21 +198,56 @@ void nvme_submit_exit(struct nvme_transport_handle *hdl,
 bool nvme_decide_retry(struct nvme_transport_handle *hdl,
 		struct nvme_passthru_cmd *cmd, int err)
 {
-	if (!nvme_cfg.no_retries)
+	if (nvme_cfg.no_retries)
 		return false;
 
-	if (err != -EAGAIN ||
-	    !(err == -EINTR && !nvme_sigint_received))
+	/*
+	 * Only restart interrupted system calls here. Transient errors and
+	 * NVMe status codes are handled by the retry policy installed with
+	 * nvme_set_retry_policy(), which adds a backoff delay.
+	 */
+	if (err != -EINTR || nvme_sigint_received)
 		return false;
 
-	nvme_log_retry(errno);
+	nvme_log_retry(-err);
 	return true;
 }
 
-static void nvme_show_req_admin(const struct nvme_mi_admin_req_hdr *hdr, size_t hdr_len,
-				const void *data, size_t data_len)
+void nvme_set_retry_policy(struct nvme_transport_handle *hdl)
 {
-	struct nvme_passthru_cmd cmd = {
+	struct nvme_retry_policy policy = {
+		.max_retries = 5,
+		.base_delay_ms = 10,
+		.max_delay_ms = 1000,
+		.jitter_pct = 25,
+		.retry_transient = true,
+	};
+
+	/*
+	 * Only commands which are safe to repeat: a retried Format NVM,
+	 * Sanitize, Firmware Commit or Namespace Management may well have
+	 * been started by the attempt which reported the transient error.
+	 */
+	static const __u8 opcodes[] = {
+		nvme_admin_identify,
+		nvme_admin_get_log_page,
+		nvme_admin_get_features,
+	};
+	size_t i;
+
+	if (nvme_cfg.no_retries)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(opcodes); i++)
+		nvme_transport_handle_set_retry_policy(hdl,
+				NVME_RETRY_KEY_ADMIN_OPCODE, opcodes[i], &policy);
+}
+
+static void nvme_mi_admin_to_cmd(const struct nvme_mi_admin_req_hdr *hdr,
+				 const void *data, size_t data_len,
+				 struct nvme_passthru_cmd *cmd)
+{
+	*cmd = (struct nvme_passthru_cmd) {
 		.opcode = hdr->opcode,
 		.flags = hdr->flags,
 		.nsid = le32_to_cpu(hdr->cdw1),
@@ -161,7 +262,20 @@ static void nvme_show_req_admin(const struct nvme_mi_admin_req_hdr *hdr, size_t
 		.cdw14 = le32_to_cpu(hdr->cdw14),
 		.cdw15 = le32_to_cpu(hdr->cdw15),
 	};
+}
+
+static bool nvme_mi_is_admin(__u8 type, const struct nvme_mi_msg_hdr *hdr)
+{
+	return type == NVME_MI_MSGTYPE_NVME &&
+		(hdr->nmp >> 3 & 0xf) == NVME_MI_MT_ADMIN;
+}
+
+static void nvme_show_req_admin(const struct nvme_mi_admin_req_hdr *hdr, size_t hdr_len,
+				const void *data, size_t data_len)
+{
+	struct nvme_passthru_cmd cmd;
 
+	nvme_mi_admin_to_cmd(hdr, data, data_len, &cmd);
 	nvme_show_common(&cmd);
 	nvme_show_key_value("doff         ", "%08x", le32_to_cpu(hdr->doff));
 	nvme_show_key_value("dlen         ", "%08x", le32_to_cpu(hdr->dlen));
@@ -199,6 +313,11 @@ void *nvme_mi_submit_entry(__u8 type, const struct nvme_mi_msg_hdr *hdr, size_t
 		nvme_show_req(type, hdr, hdr_len, data, data_len);
 		gettimeofday(&sb.start, NULL);
 	}
+	if (nvme_trace_enabled() && nvme_mi_is_admin(type, hdr)) {
+		nvme_mi_admin_to_cmd((struct nvme_mi_admin_req_hdr *)hdr, data,
+				     data_len, &sb.mi_cmd);
+		sb.start_ns = nvme_trace_now();
+	}
 
 	return &sb;
 }
@@ -238,6 +357,11 @@ void nvme_mi_submit_exit(__u8 type, const struct nvme_mi_msg_hdr *hdr, size_t hd
 {
 	struct submit_data *sb = user_data;
 
+	if (nvme_trace_enabled() && sb->start_ns && nvme_mi_is_admin(type, hdr))
+		nvme_trace_command(&sb->mi_cmd, NVME_TRACE_QUEUE_MI,
+				   ((struct nvme_mi_admin_resp_hdr *)hdr)->status,
+				   sb->start_ns, 0);
+
 	if (log_level >= LOG_DEBUG) {
 		gettimeofday(&sb->end, NULL);
 		nvme_show_resp(type, hdr, hdr_len, data, data_len);
@@ -28,6 +28,9 @@ void nvme_submit_exit(struct nvme_transport_handle *hdl,
 		struct nvme_passthru_cmd *cmd, int err, void *user_data);
 bool nvme_decide_retry(struct nvme_transport_handle *hdl,
 		struct nvme_passthru_cmd *cmd, int err);
+void nvme_set_retry_policy(struct nvme_transport_handle *hdl);
+
+int nvme_trace_setup(void);
 
 bool is_printable_at_level(int level);
 int map_log_level(int verbose, bool quiet);
@@ -32,9 +32,12 @@ COMMAND_LIST(
 	ENTRY("delete-ns", "Deletes a namespace from the controller", delete_ns)
 	ENTRY("attach-ns", "Attaches a namespace to requested controller(s)", attach_ns)
 	ENTRY("detach-ns", "Detaches a namespace from requested controller(s)", detach_ns)
+	ENTRY("provision-ns", "Creates and attaches a number of namespaces with a single rescan", provision_ns)
 	ENTRY("get-ns-id", "Retrieve the namespace ID of opened block device", get_ns_id)
 	ENTRY("get-log", "Generic NVMe get log, returns log in raw format", get_log)
 	ENTRY("telemetry-log", "Retrieve FW Telemetry log write to file", get_telemetry_log)
+	ENTRY("telemetry-diff", "Compare two telemetry log captures", telemetry_diff)
+	ENTRY("telemetry-monitor", "Capture controller-initiated telemetry as it is reported", telemetry_monitor)
 	ENTRY("fw-log", "Retrieve FW Log, show it", get_fw_log)
 	ENTRY("changed-ns-list-log", "Retrieve Changed Attached Namespace List, show it", get_changed_attach_ns_list_log)
 	ENTRY("smart-log", "Retrieve SMART Log, show it", get_smart_log)
@@ -52,6 +55,7 @@ COMMAND_LIST(
 	ENTRY("phy-rx-eom-log", "Retrieve Physical Interface Receiver Eye Opening Measurement, show it", get_phy_rx_eom_log)
 	ENTRY("get-feature", "Get feature and show the resulting value", get_feature)
 	ENTRY("device-self-test", "Perform the necessary tests to observe the performance", device_self_test)
+	ENTRY("wait", "Wait for self-test or sanitize operations to finish", wait_cmd)
 	ENTRY("self-test-log", "Retrieve the SELF-TEST Log, show it", self_test_log)
 	ENTRY("supported-log-pages", "Retrieve the Supported Log pages details, show it", get_supported_log_pages)
 	ENTRY("fid-support-effects-log", "Retrieve FID Support and Effects log and show it", get_fid_support_effects_log)
@@ -73,6 +77,7 @@ COMMAND_LIST(
 	ENTRY("format", "Format namespace with new block format", format_cmd)
 	ENTRY("fw-commit", "Verify and commit firmware to a specific slot (fw-activate in old version < 1.2)", fw_commit, "fw-activate")
 	ENTRY("fw-download", "Download new firmware", fw_download)
+	ENTRY("fw-rollout", "Download and commit firmware to many controllers", fw_rollout)
 	ENTRY("admin-passthru", "Submit an arbitrary admin command, return results", admin_passthru)
 	ENTRY("io-passthru", "Submit an arbitrary IO command, return results", io_passthru)
 	ENTRY("security-send", "Submit a Security Send command, return results", sec_send)
@@ -84,6 +89,7 @@ COMMAND_LIST(
 	ENTRY("resv-release", "Submit a Reservation Release, return results", resv_release)
 	ENTRY("resv-report", "Submit a Reservation Report, return results", resv_report)
 	ENTRY("dsm", "Submit a Data Set Management command, return results", dsm)
+	ENTRY("wipe", "Zero a namespace or range list with the fastest supported method", wipe_cmd)
 	ENTRY("copy", "Submit a Simple Copy command, return results", copy_cmd)
 	ENTRY("flush", "Submit a Flush command, return results", flush_cmd)
 	ENTRY("compare", "Submit a Compare command, return results", compare)
@@ -92,6 +98,7 @@ COMMAND_LIST(
 	ENTRY("write-zeroes", "Submit a write zeroes command, return results", write_zeroes)
 	ENTRY("write-uncor", "Submit a write uncorrectable command, return results", write_uncor)
 	ENTRY("verify", "Submit a verify command, return results", verify_cmd)
+	ENTRY("scrub", "Verify a namespace or range list in the background", scrub_cmd)
 	ENTRY("sanitize", "Submit a sanitize command", sanitize_cmd)
 	ENTRY("sanitize-log", "Retrieve sanitize log, show it", sanitize_log)
 	ENTRY("sanitize-ns", "Submit a sanitize namespace command",
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-capture.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+
+#define NSEC_PER_SEC			1000000000ULL
+
+#define NVME_CAPTURE_PROGRESS_NS	NSEC_PER_SEC
+#define NVME_CAPTURE_DEFAULT_CHUNK	(NVME_LOG_PAGE_PDU_SIZE << 6)
+
+static uint64_t nvme_capture_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+uint32_t nvme_capture_ctrl_max_chunk(const struct nvme_id_ctrl *ctrl)
+{
+	/* transfers of up to MDTS, at most 1 MiB */
+	if (ctrl->mdts && ctrl->mdts < 8)
+		return NVME_LOG_PAGE_PDU_SIZE << ctrl->mdts;
+	return NVME_LOG_PAGE_PDU_SIZE << 8;
+}
+
+uint32_t nvme_capture_max_chunk(struct nvme_transport_handle *hdl)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+
+	if (!hdl)
+		return NVME_CAPTURE_DEFAULT_CHUNK;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl || nvme_identify_ctrl(hdl, ctrl))
+		return NVME_CAPTURE_DEFAULT_CHUNK;
+
+	return nvme_capture_ctrl_max_chunk(ctrl);
+}
+
+void nvme_capture_init(struct nvme_capture *c, struct nvme_transport_handle *hdl)
+{
+	memset(c, 0, sizeof(*c));
+	c->align = 4;
+	c->max_chunk = nvme_capture_max_chunk(hdl);
+}
+
+#define NVME_CAPTURE_P1	0x9e3779b185ebca87ULL
+#define NVME_CAPTURE_P2	0xc2b2ae3d27d4eb4fULL
+#define NVME_CAPTURE_P3	0x165667b19e3779f9ULL
+#define NVME_CAPTURE_P4	0x85ebca77c2b2ae63ULL
+#define NVME_CAPTURE_P5	0x27d4eb2f165667c5ULL
+
+static inline uint64_t nvme_capture_rotl(uint64_t v, unsigned int n)
+{
+	return v << n | v >> (64 - n);
+}
+
+/*
+ * The single lane of xxh64: every word is mixed on its own before it is
+ * folded in, so a difference in any bit reaches all bits of the hash.
+ */
+uint64_t nvme_capture_block_hash(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint64_t h = NVME_CAPTURE_P5 + len, any = 0, w;
+	size_t i;
+
+	for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+		memcpy(&w, p + i, sizeof(w));
+		any |= w;
+		w = nvme_capture_rotl(w * NVME_CAPTURE_P2, 31) * NVME_CAPTURE_P1;
+		h = nvme_capture_rotl(h ^ w, 27) * NVME_CAPTURE_P1 +
+			NVME_CAPTURE_P4;
+	}
+	for (; i < len; i++) {
+		any |= p[i];
+		h = nvme_capture_rotl(h ^ p[i] * NVME_CAPTURE_P5, 11) *
+			NVME_CAPTURE_P1;
+	}
+	if (!any)
+		return 0;
+
+	h ^= h >> 33;
+	h *= NVME_CAPTURE_P2;
+	h ^= h >> 29;
+	h *= NVME_CAPTURE_P3;
+	h ^= h >> 32;
+
+	return h ? h : 1;
+}
+
+static int nvme_capture_file_out(struct nvme_capture_file *f,
+				 const unsigned char *p, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(f->fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* @len is a multiple of the block size, except for the last block */
+static int nvme_capture_file_blocks(struct nvme_capture_file *f,
+				    const unsigned char *p, size_t len)
+{
+	bool zero = false, z;
+	uint64_t hash;
+	size_t run, blk;
+	int err;
+
+	while (len) {
+		/* a run of data blocks is written, a run of zero blocks seeked over */
+		for (run = 0; run < len; run += blk) {
+			blk = min(len - run, (size_t)NVME_CAPTURE_BLOCK);
+			hash = nvme_capture_block_hash(p + run, blk);
+			z = !hash && blk == NVME_CAPTURE_BLOCK &&
+				(f->flags & NVME_CAPTURE_SPARSE);
+			if (run && z != zero)
+				break;
+			zero = z;
+			if (f->manifest)
+				fprintf(f->manifest, "%016" PRIx64 "\n", hash);
+		}
+
+		if (zero) {
+			if (lseek(f->fd, run, SEEK_CUR) < 0)
+				return -errno;
+			f->holes += run;
+		} else {
+			err = nvme_capture_file_out(f, p, run);
+			if (err)
+				return err;
+		}
+		f->hole = zero;
+		f->size += run;
+		p += run;
+		len -= run;
+	}
+
+	return 0;
+}
+
+int nvme_capture_file_open(struct nvme_capture_file *f, const char *path,
+			   unsigned int flags)
+{
+	_cleanup_free_ char *name = NULL;
+	struct stat st;
+	int err;
+
+	memset(f, 0, sizeof(*f));
+	f->flags = flags;
+	f->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (f->fd < 0)
+		return -errno;
+
+	if (fstat(f->fd, &st) || !S_ISREG(st.st_mode))
+		f->flags &= ~NVME_CAPTURE_SPARSE;
+
+	if (!(flags & NVME_CAPTURE_MANIFEST))
+		return 0;
+
+	if (asprintf(&name, "%s.blocks", path) < 0) {
+		name = NULL;
+		err = -ENOMEM;
+		goto close_fd;
+	}
+	f->manifest = fopen(name, "w");
+	if (!f->manifest) {
+		err = -errno;
+		goto close_fd;
+	}
+	fprintf(f->manifest, "nvme-capture-manifest 1\nblock-size %d\n",
+		NVME_CAPTURE_BLOCK);
+
+	return 0;
+
+close_fd:
+	close(f->fd);
+	f->fd = -1;
+	return err;
+}
+
+int nvme_capture_file_write(struct nvme_capture_file *f, const void *buf,
+			    size_t len)
+{
+	const unsigned char *p = buf;
+	size_t n;
+
+	if (f->err)
+		return f->err;
+
+	/* the blocks stay at block aligned file offsets */
+	if (f->len) {
+		n = min(len, (size_t)NVME_CAPTURE_BLOCK - f->len);
+		memcpy(f->block + f->len, p, n);
+		f->len += n;
+		p += n;
+		len -= n;
+		if (f->len < NVME_CAPTURE_BLOCK)
+			return 0;
+
+		f->len = 0;
+		f->err = nvme_capture_file_blocks(f, f->block, NVME_CAPTURE_BLOCK);
+		if (f->err)
+			return f->err;
+	}
+
+	n = len - len % NVME_CAPTURE_BLOCK;
+	if (n) {
+		f->err = nvme_capture_file_blocks(f, p, n);
+		if (f->err)
+			return f->err;
+	}
+
+	memcpy(f->block, p + n, len - n);
+	f->len = len - n;
+
+	return 0;
+}
+
+int nvme_capture_file_close(struct nvme_capture_file *f)
+{
+	int err = f->err;
+
+	if (f->fd < 0)
+		return err ? err : -EBADF;
+
+	if (!err && f->len)
+		err = nvme_capture_file_blocks(f, f->block, f->len);
+	f->len = 0;
+
+	/* a hole at the end is not allocated by the seek alone */
+	if (!err && f->hole && ftruncate(f->fd, f->size))
+		err = -errno;
+	if (!err && (f->flags & NVME_CAPTURE_SYNC) && fsync(f->fd))
+		err = -errno;
+	if (close(f->fd) && !err)
+		err = -errno;
+	f->fd = -1;
+
+	if (f->manifest) {
+		fprintf(f->manifest, "size %" PRIu64 "\n", f->size);
+		if ((ferror(f->manifest) | fclose(f->manifest)) && !err)
+			err = -EIO;
+		f->manifest = NULL;
+	}
+
+	return err;
+}
+
+static int nvme_capture_write(struct nvme_capture *c,
+			      struct nvme_capture_slot *s)
+{
+	if (c->write)
+		return c->write(c, s->buf, s->off, s->len);
+	return nvme_capture_file_write(c->file, s->buf, s->len);
+}
+
+static void *nvme_capture_writer(void *arg)
+{
+	struct nvme_capture *c = arg;
+	struct nvme_capture_slot *s;
+	unsigned int i = 0;
+	int err;
+
+	pthread_mutex_lock(&c->lock);
+	for (;;) {
+		s = &c->slot[i];
+		while (!s->full && !c->eof && !c->stop)
+			pthread_cond_wait(&c->cond, &c->lock);
+		if (c->stop || !s->full)
+			break;
+		pthread_mutex_unlock(&c->lock);
+
+		err = nvme_capture_write(c, s);
+
+		pthread_mutex_lock(&c->lock);
+		if (err) {
+			if (!c->err)
+				c->err = err;
+			c->stop = true;
+		} else {
+			c->done += s->len;
+		}
+		s->full = false;
+		pthread_cond_broadcast(&c->cond);
+		i ^= 1;
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+static int nvme_capture_fetch(struct nvme_capture *c,
+			      struct nvme_capture_slot *s)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i <= c->retries; i++) {
+		err = c->fetch(c, s->buf, s->off, s->len);
+		if (!err || nvme_sigint_received)
+			break;
+	}
+	if (!err)
+		return 0;
+
+	if (!c->status)
+		c->status = err;
+	if (!c->skip_errors || nvme_sigint_received)
+		return err;
+
+	/* keep the offsets of the following chunks */
+	memset(s->buf, 0, s->len);
+	c->failed++;
+
+	return 0;
+}
+
+/* the writer thread updates it under the lock */
+static uint64_t nvme_capture_done(struct nvme_capture *c)
+{
+	uint64_t done;
+
+	pthread_mutex_lock(&c->lock);
+	done = c->done;
+	pthread_mutex_unlock(&c->lock);
+
+	return done;
+}
+
+static int nvme_capture_check(struct nvme_capture *c)
+{
+	uint64_t now;
+
+	if (nvme_sigint_received)
+		return -EINTR;
+
+	now = nvme_capture_now();
+	if (!c->progress || now - c->progress_ns < NVME_CAPTURE_PROGRESS_NS)
+		return 0;
+
+	c->progress_ns = now;
+	return c->progress(c, nvme_capture_done(c), c->arg) ? -ECANCELED : 0;
+}
+
+int nvme_capture_run(struct nvme_capture *c)
+{
+	uint64_t off = c->offset, end = c->offset + c->size;
+	struct nvme_capture_slot *s;
+	uint32_t chunk, align;
+	pthread_t writer;
+	bool threaded;
+	unsigned int i;
+	int err = 0;
+
+	align = c->align ? c->align : 1;
+	chunk = c->chunk ? c->chunk : c->max_chunk;
+	if (c->max_chunk && chunk > c->max_chunk)
+		chunk = c->max_chunk;
+	chunk -= chunk % align;
+	if (!chunk)
+		chunk = align;
+
+	if (!c->write && !c->file)
+		return -EINVAL;
+
+	for (i = 0; i < 2; i++) {
+		c->slot[i].buf = nvme_alloc(chunk);
+		c->slot[i].full = false;
+	}
+	if (!c->slot[0].buf || !c->slot[1].buf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	c->stop = false;
+	c->eof = false;
+	c->err = 0;
+	c->start_ns = nvme_capture_now();
+	c->progress_ns = c->start_ns;
+	nvme_sigint_received = false;
+
+	/* without a writer thread every chunk is written before the next fetch */
+	threaded = !pthread_create(&writer, NULL, nvme_capture_writer, c);
+
+	for (i = 0; off < end; i ^= 1) {
+		s = &c->slot[i];
+
+		pthread_mutex_lock(&c->lock);
+		while (s->full && !c->stop)
+			pthread_cond_wait(&c->cond, &c->lock);
+		err = c->err;
+		pthread_mutex_unlock(&c->lock);
+		if (err)
+			break;
+
+		s->off = off;
+		s->len = min(end - off, (uint64_t)chunk);
+		err = nvme_capture_fetch(c, s);
+		if (err)
+			break;
+		off += s->len;
+		c->chunks++;
+
+		if (threaded) {
+			pthread_mutex_lock(&c->lock);
+			s->full = true;
+			pthread_cond_broadcast(&c->cond);
+			pthread_mutex_unlock(&c->lock);
+		} else {
+			err = nvme_capture_write(c, s);
+			if (err)
+				break;
+			c->done += s->len;
+		}
+
+		err = nvme_capture_check(c);
+		if (err)
+			break;
+	}
+
+	/* the chunks fetched before a failure are still written */
+	pthread_mutex_lock(&c->lock);
+	c->eof = true;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+
+	if (threaded)
+		pthread_join(writer, NULL);
+	if (!err)
+		err = c->err;
+
+	if (c->progress)
+		c->progress(c, c->done, c->arg);
+
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+out:
+	for (i = 0; i < 2; i++) {
+		free(c->slot[i].buf);
+		c->slot[i].buf = NULL;
+	}
+
+	return err;
+}
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_CAPTURE_H
+#define _NVME_CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libnvme.h>
+
+#define NVME_CAPTURE_BLOCK		4096
+
+enum nvme_capture_file_flags {
+	NVME_CAPTURE_SPARSE	= 1 << 0,
+	NVME_CAPTURE_MANIFEST	= 1 << 1,
+	NVME_CAPTURE_SYNC	= 1 << 2,
+};
+
+/*
+ * Output file of a capture.
+ *
+ * The data is written in blocks of NVME_CAPTURE_BLOCK bytes at block
+ * aligned file offsets. With NVME_CAPTURE_SPARSE the all zero blocks of a
+ * regular file are seeked over and left as holes. NVME_CAPTURE_MANIFEST
+ * writes "<path>.blocks" next to the file, a text manifest with a content
+ * hash of every block, 0 for a zero block, and the size of the file: the
+ * blocks whose hash did not change since the previous capture of a drive
+ * need not be stored again. NVME_CAPTURE_SYNC syncs the file on close.
+ *
+ * nvme_capture_file_close() flushes the last partial block and returns
+ * the first error seen while writing the file or the manifest.
+ */
+struct nvme_capture_file {
+	int		fd;
+	unsigned int	flags;
+	FILE		*manifest;
+	uint64_t	size;		/* bytes written */
+	uint64_t	holes;		/* bytes left as holes */
+	bool		hole;		/* the file ends in a hole */
+	int		err;
+	uint32_t	len;		/* of the partial block */
+	unsigned char	block[NVME_CAPTURE_BLOCK];
+};
+
+int nvme_capture_file_open(struct nvme_capture_file *f, const char *path,
+			   unsigned int flags);
+int nvme_capture_file_write(struct nvme_capture_file *f, const void *buf,
+			    size_t len);
+int nvme_capture_file_close(struct nvme_capture_file *f);
+
+/* content hash of a block as listed in the manifest, 0 for all zeros */
+uint64_t nvme_capture_block_hash(const void *buf, size_t len);
+
+/*
+ * Chunked capture of a vendor log or dump.
+ *
+ * @size bytes starting at byte @offset of the log are read with @fetch in
+ * chunks of @chunk bytes, a multiple of @align and at most @max_chunk.
+ * @fetch returns 0, an NVMe status or a negative errno, and is retried up
+ * to @retries times. A chunk which still fails stops the capture, unless
+ * @skip_errors is set: the chunk is then written as zeros, counted in
+ * @failed and the capture goes on with the next one.
+ *
+ * The chunks are fetched strictly in order, since many vendor dumps are
+ * stateful, while the previous chunk is written by a second thread. The
+ * data goes to @write if set and to @file otherwise.
+ *
+ * @progress is called about once a second and at the end with the number
+ * of bytes written so far, a non zero return cancels the capture.
+ */
+struct nvme_capture {
+	/* set by the caller, nvme_capture_init() fills in the limits */
+	uint64_t	offset;
+	uint64_t	size;
+	uint32_t	chunk;		/* 0 for @max_chunk */
+	uint32_t	max_chunk;	/* MDTS of the controller */
+	uint32_t	align;
+	unsigned int	retries;
+	bool		skip_errors;
+	struct nvme_capture_file *file;
+	int (*fetch)(struct nvme_capture *c, void *buf, uint64_t off,
+		     uint32_t len);
+	int (*write)(struct nvme_capture *c, const void *buf, uint64_t off,
+		     uint32_t len);
+	int (*progress)(struct nvme_capture *c, uint64_t done, void *arg);
+	void		*arg;
+	void		*priv;
+
+	/* updated by the engine */
+	uint64_t	done;		/* bytes written */
+	unsigned int	chunks;
+	unsigned int	failed;
+	int		status;		/* first failed fetch */
+	uint64_t	start_ns;
+
+	/* engine internal */
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	struct nvme_capture_slot {
+		void		*buf;
+		uint64_t	off;
+		uint32_t	len;
+		bool		full;
+	} slot[2];
+	bool		stop;
+	bool		eof;
+	int		err;
+	uint64_t	progress_ns;
+};
+
+/*
+ * Returns the largest transfer of the controller behind @hdl, MDTS capped
+ * at 1 MiB, or 256 KiB if it cannot be determined.
+ */
+uint32_t nvme_capture_max_chunk(struct nvme_transport_handle *hdl);
+/* the same for an already identified controller */
+uint32_t nvme_capture_ctrl_max_chunk(const struct nvme_id_ctrl *ctrl);
+
+void nvme_capture_init(struct nvme_capture *c, struct nvme_transport_handle *hdl);
+int nvme_capture_run(struct nvme_capture *c);
+
+#endif /* _NVME_CAPTURE_H */
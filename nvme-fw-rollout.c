@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-fw-rollout.h"
+#include "nvme-wait.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+
+/* FWUG is in units of 4 KiB */
+#define FW_ROLLOUT_FWUG_UNIT		4096
+/* MDTS is in units of CAP.MPSMIN, which is 4 KiB on all Linux hosts */
+#define FW_ROLLOUT_MDTS_UNIT		4096
+/* default chunk limit if neither MDTS nor the user restrict it */
+#define FW_ROLLOUT_MAX_XFER		(128 * 1024)
+
+typedef int (*fw_rollout_fn)(struct nvme_fw_rollout_dev *dev,
+			     const struct nvme_fw_rollout_cfg *cfg);
+
+struct fw_rollout_pool {
+	struct nvme_fw_rollout_dev	*devs;
+	int				nr;
+	int				next;
+	const struct nvme_fw_rollout_cfg *cfg;
+	fw_rollout_fn			fn;
+};
+
+struct fw_rollout_submit {
+	struct nvme_fw_rollout_dev	*dev;
+	const struct nvme_fw_rollout_cfg *cfg;
+};
+
+const char *nvme_fw_rollout_state_str(enum nvme_fw_rollout_state state)
+{
+	switch (state) {
+	case NVME_FW_ROLLOUT_PENDING:
+		return "pending";
+	case NVME_FW_ROLLOUT_DOWNLOADED:
+		return "downloaded";
+	case NVME_FW_ROLLOUT_COMMITTED:
+		return "committed";
+	case NVME_FW_ROLLOUT_FAILED:
+		return "failed";
+	case NVME_FW_ROLLOUT_SKIPPED:
+		return "skipped";
+	}
+
+	return "unknown";
+}
+
+static uint64_t fw_rollout_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fw_rollout_fail(struct nvme_fw_rollout_dev *dev, int err)
+{
+	int expected = 0;
+
+	__atomic_compare_exchange_n(&dev->err, &expected, err, false,
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void *fw_rollout_pool_worker(void *arg)
+{
+	struct fw_rollout_pool *pool = arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) <
+	       pool->nr)
+		pool->fn(&pool->devs[i], pool->cfg);
+
+	return NULL;
+}
+
+/* runs @fn for every controller on up to @jobs threads */
+static void fw_rollout_run(struct nvme_fw_rollout_dev *devs, int nr,
+			   unsigned int jobs,
+			   const struct nvme_fw_rollout_cfg *cfg,
+			   fw_rollout_fn fn)
+{
+	struct fw_rollout_pool pool = {
+		.devs = devs,
+		.nr = nr,
+		.cfg = cfg,
+		.fn = fn,
+	};
+	_cleanup_free_ pthread_t *threads = NULL;
+	unsigned int i, started = 0;
+
+	if (jobs > (unsigned int)nr)
+		jobs = nr;
+	if (jobs > 1)
+		threads = calloc(jobs - 1, sizeof(*threads));
+
+	/* a thread which failed to start only reduces the concurrency */
+	for (i = 0; threads && i < jobs - 1; i++) {
+		if (pthread_create(&threads[i], NULL, fw_rollout_pool_worker,
+				   &pool))
+			break;
+		started++;
+	}
+
+	fw_rollout_pool_worker(&pool);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/*
+ * Chunks must be a multiple of FWUG, and a larger multiple saves commands
+ * as long as it fits into MDTS. A controller whose FWUG does not fit at
+ * all cannot be updated.
+ */
+static int fw_rollout_prepare(struct nvme_fw_rollout_dev *dev,
+			      const struct nvme_fw_rollout_cfg *cfg)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	__u32 gran = FW_ROLLOUT_FWUG_UNIT;
+	__u32 max = FW_ROLLOUT_MAX_XFER;
+	int err;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(dev->hdl, ctrl);
+	if (err)
+		return err;
+
+	if (cfg->slot > ((ctrl->frmw >> 1) & 0x7))
+		return -EINVAL;
+	if (cfg->slot == 1 && (ctrl->frmw & 0x1) &&
+	    cfg->action != NVME_FW_COMMIT_CA_SET_ACTIVE)
+		return -EROFS;
+
+	if (ctrl->fwug && ctrl->fwug != 0xff)
+		gran = ctrl->fwug * FW_ROLLOUT_FWUG_UNIT;
+
+	if (cfg->xfer)
+		max = cfg->xfer;
+	if (ctrl->mdts && ctrl->mdts < 20 &&
+	    (FW_ROLLOUT_MDTS_UNIT << ctrl->mdts) < max)
+		max = FW_ROLLOUT_MDTS_UNIT << ctrl->mdts;
+
+	if (gran > max) {
+		fprintf(stderr,
+			"%s: FWUG exceeds MDTS: %u bytes, transfer limit %u bytes\n",
+			dev->name, gran, max);
+		return -EINVAL;
+	}
+
+	dev->xfer = max - max % gran;
+	dev->chunks = (cfg->size + dev->xfer - 1) / dev->xfer;
+
+	return 0;
+}
+
+static bool fw_rollout_is_ovr(int err)
+{
+	return err > 0 &&
+		nvme_status_get_type(err) == NVME_STATUS_TYPE_NVME &&
+		NVME_GET(err, SCT) == NVME_SCT_CMD_SPECIFIC &&
+		NVME_GET(err, SC) == NVME_SC_OVERLAPPING_RANGE;
+}
+
+/*
+ * Transient errors are retried by the retry policy of the handle, so any
+ * error reaching us here aborts the download of this controller.
+ */
+static void *fw_rollout_submit(void *arg)
+{
+	struct fw_rollout_submit *s = arg;
+	struct nvme_fw_rollout_dev *dev = s->dev;
+	const struct nvme_fw_rollout_cfg *cfg = s->cfg;
+	struct nvme_passthru_cmd cmd;
+	__u32 chunk, offset, len;
+	int err;
+
+	while (!__atomic_load_n(&dev->err, __ATOMIC_RELAXED)) {
+		if (nvme_sigint_received) {
+			fw_rollout_fail(dev, -EINTR);
+			break;
+		}
+
+		chunk = __atomic_fetch_add(&dev->next, 1, __ATOMIC_RELAXED);
+		if (chunk >= dev->chunks)
+			break;
+
+		offset = chunk * dev->xfer;
+		len = min(dev->xfer, (__u32)(cfg->size - offset));
+
+		err = nvme_init_fw_download(&cmd,
+					    (char *)cfg->image + offset,
+					    len, offset);
+		if (!err)
+			err = nvme_submit_admin_passthru(dev->hdl, &cmd);
+		if (err && !(cfg->ignore_ovr && fw_rollout_is_ovr(err))) {
+			fw_rollout_fail(dev, err);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int fw_rollout_download_one(struct nvme_fw_rollout_dev *dev,
+				   const struct nvme_fw_rollout_cfg *cfg)
+{
+	struct fw_rollout_submit s = { .dev = dev, .cfg = cfg };
+	_cleanup_free_ pthread_t *threads = NULL;
+	unsigned int qd = cfg->qd ? cfg->qd : 1;
+	unsigned int i, started = 0;
+	uint64_t start = fw_rollout_now();
+	int err;
+
+	err = fw_rollout_prepare(dev, cfg);
+	if (err) {
+		dev->err = err;
+		dev->state = NVME_FW_ROLLOUT_FAILED;
+		return err;
+	}
+
+	/* only the kernel driver lets us have several commands in flight */
+	if (!nvme_transport_handle_is_direct(dev->hdl))
+		qd = 1;
+	if (qd > dev->chunks)
+		qd = dev->chunks;
+	if (qd > 1)
+		threads = calloc(qd - 1, sizeof(*threads));
+
+	for (i = 0; threads && i < qd - 1; i++) {
+		if (pthread_create(&threads[i], NULL, fw_rollout_submit, &s))
+			break;
+		started++;
+	}
+
+	fw_rollout_submit(&s);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	dev->download_ns = fw_rollout_now() - start;
+	dev->state = dev->err ? NVME_FW_ROLLOUT_FAILED :
+		NVME_FW_ROLLOUT_DOWNLOADED;
+
+	return dev->err;
+}
+
+int nvme_fw_rollout_download(struct nvme_fw_rollout_dev *devs, int nr,
+			     const struct nvme_fw_rollout_cfg *cfg)
+{
+	int i;
+
+	if (!cfg->size || cfg->size & 0x3 || cfg->size > UINT32_MAX)
+		return -EINVAL;
+
+	nvme_sigint_received = false;
+	fw_rollout_run(devs, nr, cfg->jobs ? cfg->jobs : 1, cfg,
+		       fw_rollout_download_one);
+
+	if (nvme_sigint_received)
+		return -EINTR;
+
+	for (i = 0; i < nr; i++)
+		if (devs[i].state != NVME_FW_ROLLOUT_DOWNLOADED)
+			return -EIO;
+
+	return 0;
+}
+
+static bool fw_rollout_needs_reset(int err)
+{
+	if (err <= 0 || nvme_status_get_type(err) != NVME_STATUS_TYPE_NVME)
+		return false;
+
+	switch (nvme_status_get_value(err) & 0x7ff) {
+	case NVME_SC_FW_NEEDS_CONV_RESET:
+	case NVME_SC_FW_NEEDS_SUBSYS_RESET:
+	case NVME_SC_FW_NEEDS_RESET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int fw_rollout_commit_one(struct nvme_fw_rollout_dev *dev,
+				 const struct nvme_fw_rollout_cfg *cfg)
+{
+	_cleanup_free_ struct nvme_firmware_slot *fw = NULL;
+	struct nvme_passthru_cmd cmd;
+	int err;
+
+	if (dev->state != NVME_FW_ROLLOUT_DOWNLOADED)
+		return 0;
+
+	/* the health check compares the slots against these */
+	fw = nvme_alloc(sizeof(*fw));
+	if (!fw) {
+		err = -ENOMEM;
+		goto out;
+	}
+	err = nvme_get_log_fw_slot(dev->hdl, false, fw);
+	if (err)
+		goto out;
+	dev->afi = fw->afi;
+	if (fw->afi & 0x7)
+		memcpy(dev->fr, fw->frs[(fw->afi & 0x7) - 1], sizeof(dev->fr));
+
+	nvme_init_fw_commit(&cmd, cfg->slot, cfg->action, false);
+	err = nvme_submit_admin_passthru(dev->hdl, &cmd);
+	dev->committed = true;
+	dev->commit_result = cmd.result;
+	if (fw_rollout_needs_reset(err)) {
+		dev->reset_required = true;
+		err = 0;
+	}
+
+out:
+	dev->err = err;
+	dev->state = err ? NVME_FW_ROLLOUT_FAILED : NVME_FW_ROLLOUT_COMMITTED;
+
+	return err;
+}
+
+/*
+ * Whether the Firmware Slot log shows the activation of the commit. With
+ * slot 0 the controller picked the slot, then an immediate activation has
+ * to have switched the active slot or replaced its revision.
+ */
+static bool fw_rollout_activated(struct nvme_fw_rollout_dev *dev,
+				 const struct nvme_fw_rollout_cfg *cfg,
+				 const struct nvme_firmware_slot *fw)
+{
+	__u8 active = fw->afi & 0x7;
+	__u8 next = (fw->afi >> 4) & 0x7;
+
+	switch (cfg->action) {
+	case NVME_FW_COMMIT_CA_REPLACE:
+		return true;
+	case NVME_FW_COMMIT_CA_REPLACE_AND_ACTIVATE_IMMEDIATE:
+		if (dev->reset_required)
+			break;
+		if (cfg->slot)
+			return active == cfg->slot;
+		return active && (active != (dev->afi & 0x7) ||
+				  memcmp(fw->frs[active - 1], dev->fr,
+					 sizeof(dev->fr)));
+	default:
+		break;
+	}
+
+	/* activated at the next reset */
+	return cfg->slot ? next == cfg->slot : next != 0;
+}
+
+/*
+ * A controller is healthy if it still answers admin commands, reports no
+ * critical warning and the Firmware Slot log shows the new slot active,
+ * or to be activated at the next reset.
+ */
+static int fw_rollout_health_one(struct nvme_fw_rollout_dev *dev,
+				 const struct nvme_fw_rollout_cfg *cfg)
+{
+	_cleanup_free_ struct nvme_smart_log *smart = NULL;
+	_cleanup_free_ struct nvme_firmware_slot *fw = NULL;
+	int err;
+
+	if (dev->state != NVME_FW_ROLLOUT_COMMITTED)
+		return 0;
+
+	smart = nvme_alloc(sizeof(*smart));
+	fw = nvme_alloc(sizeof(*fw));
+	if (!smart || !fw)
+		return -ENOMEM;
+
+	err = nvme_get_log_smart(dev->hdl, NVME_NSID_ALL, smart);
+	if (!err && smart->critical_warning)
+		err = -EIO;
+
+	if (!err) {
+		err = nvme_get_log_fw_slot(dev->hdl, false, fw);
+		if (!err && !fw_rollout_activated(dev, cfg, fw))
+			err = -EIO;
+	}
+
+	if (err) {
+		dev->err = err;
+		dev->state = NVME_FW_ROLLOUT_FAILED;
+	}
+
+	return err;
+}
+
+int nvme_fw_rollout_commit(struct nvme_fw_rollout_dev *devs, int nr,
+			   const struct nvme_fw_rollout_cfg *cfg)
+{
+	int wave = cfg->wave ? cfg->wave : nr;
+	int start, i, n, err;
+
+	for (start = 0; start < nr; start += n) {
+		int downloaded = 0;
+
+		/* a wave has @wave controllers to commit, failed ones aside */
+		for (n = 0; start + n < nr && downloaded < wave; n++)
+			if (devs[start + n].state == NVME_FW_ROLLOUT_DOWNLOADED)
+				downloaded++;
+
+		fw_rollout_run(devs + start, n, cfg->jobs ? cfg->jobs : 1, cfg,
+			       fw_rollout_commit_one);
+
+		err = cfg->wave_delay ? nvme_wait_countdown(cfg->wave_delay) : 0;
+		if (!err)
+			fw_rollout_run(devs + start, n,
+				       cfg->jobs ? cfg->jobs : 1, cfg,
+				       fw_rollout_health_one);
+
+		for (i = start; !err && i < start + n; i++)
+			if (devs[i].committed &&
+			    devs[i].state != NVME_FW_ROLLOUT_COMMITTED)
+				err = -EIO;
+
+		if (err) {
+			/* stop the rollout, later waves keep the old image */
+			for (i = start + n; i < nr; i++)
+				if (devs[i].state == NVME_FW_ROLLOUT_DOWNLOADED)
+					devs[i].state = NVME_FW_ROLLOUT_SKIPPED;
+			return err;
+		}
+	}
+
+	/* a commit not sent, e.g. for a failed download, fails as well */
+	for (i = 0; i < nr; i++)
+		if (devs[i].state != NVME_FW_ROLLOUT_COMMITTED)
+			return -EIO;
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_FW_ROLLOUT_H
+#define _NVME_FW_ROLLOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libnvme.h>
+
+/*
+ * Firmware rollout to many controllers
+ *
+ * The image is downloaded to up to @jobs controllers at once. Each
+ * controller gets chunks sized by its FWUG and MDTS, with up to @qd
+ * Firmware Image Download commands outstanding on direct transports.
+ * Once all downloads finished the image is committed in waves of @wave
+ * controllers which downloaded it, and the next wave is only started
+ * after every controller of the previous one passed a health check. A
+ * controller whose download failed stays failed and is not committed.
+ */
+
+enum nvme_fw_rollout_state {
+	NVME_FW_ROLLOUT_PENDING,
+	NVME_FW_ROLLOUT_DOWNLOADED,
+	NVME_FW_ROLLOUT_COMMITTED,
+	NVME_FW_ROLLOUT_FAILED,
+	NVME_FW_ROLLOUT_SKIPPED,
+};
+
+struct nvme_fw_rollout_cfg {
+	const void	*image;
+	size_t		size;
+	__u32		xfer;		/* chunk size limit, 0 derived */
+	unsigned int	qd;		/* chunks in flight per controller */
+	unsigned int	jobs;		/* controllers downloading at once */
+	__u8		slot;
+	__u8		action;
+	unsigned int	wave;		/* controllers per commit wave, 0 all */
+	unsigned int	wave_delay;	/* seconds before the health check */
+	bool		ignore_ovr;
+};
+
+struct nvme_fw_rollout_dev {
+	const char			*name;
+	struct nvme_transport_handle	*hdl;
+
+	enum nvme_fw_rollout_state	state;
+	int				err;
+	__u32				xfer;
+	__u32				chunks;
+	uint64_t			download_ns;
+	__u64				commit_result;
+	bool				committed;	/* a commit was sent */
+	bool				reset_required;
+	/* Active Firmware Info and revision of the active slot before it */
+	__u8				afi;
+	char				fr[8];
+
+	/* next chunk to download, shared by the submitting threads */
+	__u32				next;
+};
+
+int nvme_fw_rollout_download(struct nvme_fw_rollout_dev *devs, int nr,
+			     const struct nvme_fw_rollout_cfg *cfg);
+int nvme_fw_rollout_commit(struct nvme_fw_rollout_dev *devs, int nr,
+			   const struct nvme_fw_rollout_cfg *cfg);
+const char *nvme_fw_rollout_state_str(enum nvme_fw_rollout_state state);
+
+#endif /* _NVME_FW_ROLLOUT_H */
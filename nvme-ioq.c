@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <libnvme.h>
+
+#include "nvme-ioq.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+
+static void ioq_abort(struct nvme_ioq *q, int err)
+{
+	if (!q->err)
+		q->err = err;
+	q->stop = true;
+}
+
+static void *ioq_worker(void *arg)
+{
+	struct nvme_ioq *q = arg;
+	struct nvme_passthru_cmd cmd;
+	void *buf = NULL;
+	int ret, err;
+
+	if (q->buf_size) {
+		buf = nvme_alloc(q->buf_size);
+		if (!buf) {
+			pthread_mutex_lock(&q->lock);
+			ioq_abort(q, -ENOMEM);
+			pthread_mutex_unlock(&q->lock);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_lock(&q->lock);
+	while (!q->stop) {
+		if (nvme_sigint_received) {
+			ioq_abort(q, -EINTR);
+			break;
+		}
+
+		ret = q->prep(q, &cmd, buf);
+		if (ret <= 0) {
+			if (ret < 0)
+				ioq_abort(q, ret);
+			q->stop = true;
+			break;
+		}
+		pthread_mutex_unlock(&q->lock);
+
+		err = q->wait ? q->wait(q, &cmd, buf) : 0;
+		if (!err && q->admin)
+			err = nvme_submit_admin_passthru(q->hdl, &cmd);
+		else if (!err)
+			err = nvme_submit_io_passthru(q->hdl, &cmd);
+
+		pthread_mutex_lock(&q->lock);
+		ret = q->done ? q->done(q, &cmd, buf, err) : err;
+		if (ret)
+			ioq_abort(q, ret);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	free(buf);
+	return NULL;
+}
+
+int nvme_ioq_run(struct nvme_ioq *q)
+{
+	_cleanup_free_ pthread_t *threads = NULL;
+	unsigned int depth = q->depth ? q->depth : 1;
+	unsigned int i, started = 0;
+
+	if (!nvme_transport_handle_is_direct(q->hdl))
+		depth = 1;
+
+	pthread_mutex_init(&q->lock, NULL);
+	q->err = 0;
+	q->stop = false;
+	nvme_sigint_received = false;
+
+	if (depth > 1)
+		threads = calloc(depth - 1, sizeof(*threads));
+
+	/* a slot which failed to start only reduces the queue depth */
+	for (i = 0; threads && i < depth - 1; i++) {
+		if (pthread_create(&threads[i], NULL, ioq_worker, q))
+			break;
+		started++;
+	}
+
+	ioq_worker(q);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&q->lock);
+
+	return q->err;
+}
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_IOQ_H
+#define _NVME_IOQ_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libnvme.h>
+
+/*
+ * Keeps up to @depth I/O commands in flight on one handle.
+ *
+ * The passthru ioctls are synchronous, so every slot is a thread with its
+ * own data buffer of @buf_size bytes. @prep fills in the next command and
+ * @done consumes its completion; both are called with the queue lock held
+ * and may therefore share state without further locking. @prep returns a
+ * positive value if it prepared a command, 0 when there is no more work,
+ * and a negative errno to abort. A non zero return of @done aborts as
+ * well.
+ *
+ * The optional @wait is called without the lock between @prep and the
+ * submission, so a slot may block there, e.g. to pace the commands,
+ * without holding up the others. A negative errno it returns is passed to
+ * @done instead of submitting the command.
+ *
+ * Only the kernel transports are able to have several commands in flight,
+ * for any other transport @depth is reduced to 1.
+ */
+struct nvme_ioq {
+	struct nvme_transport_handle *hdl;
+	unsigned int	depth;
+	size_t		buf_size;
+	bool		admin;
+	int (*prep)(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		    void *buf);
+	int (*done)(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		    void *buf, int err);
+	int (*wait)(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		    void *buf);
+	void		*priv;
+
+	/* internal */
+	pthread_mutex_t	lock;
+	int		err;
+	bool		stop;
+};
+
+int nvme_ioq_run(struct nvme_ioq *q);
+
+#endif /* _NVME_IOQ_H */
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nvme-latency.h"
+#include "nvme-wait.h"
+#include "util/json.h"
+
+const double nvme_lat_pct[NVME_LAT_NR_PCT] = { 50, 90, 99, 99.9, 99.99 };
+
+static const char * const nvme_lat_pct_str[NVME_LAT_NR_PCT] = {
+	"p50", "p90", "p99", "p99.9", "p99.99",
+};
+
+int nvme_lat_hist_alloc(struct nvme_lat_hist *h, unsigned int nr)
+{
+	h->nr = nr;
+	h->edge_us = calloc(nr + 1, sizeof(*h->edge_us));
+	h->count = calloc(nr, sizeof(*h->count));
+	if (!h->edge_us || !h->count) {
+		nvme_lat_hist_free(h);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void nvme_lat_hist_free(struct nvme_lat_hist *h)
+{
+	free(h->edge_us);
+	free(h->count);
+	h->edge_us = NULL;
+	h->count = NULL;
+	h->nr = 0;
+}
+
+unsigned int nvme_lat_hist_linear(struct nvme_lat_hist *h, unsigned int i,
+				  unsigned int nr, uint64_t start_us,
+				  uint64_t step_us)
+{
+	unsigned int j;
+
+	for (j = 0; j <= nr && i + j <= h->nr; j++)
+		h->edge_us[i + j] = start_us + j * step_us;
+
+	return i + nr;
+}
+
+uint64_t nvme_lat_hist_total(const struct nvme_lat_hist *h)
+{
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < h->nr; i++)
+		total += h->count[i];
+
+	return total;
+}
+
+double nvme_lat_hist_percentile(const struct nvme_lat_hist *h, double pct)
+{
+	uint64_t total = nvme_lat_hist_total(h), lower, upper;
+	double target, cum = 0;
+	unsigned int i;
+
+	if (!total)
+		return 0;
+
+	target = pct * total / 100;
+	for (i = 0; i < h->nr; i++) {
+		if (!h->count[i] || cum + h->count[i] < target) {
+			cum += h->count[i];
+			continue;
+		}
+
+		lower = h->edge_us[i];
+		upper = h->edge_us[i + 1];
+		if (upper == NVME_LAT_INF || upper <= lower)
+			return lower;
+		return lower + (target - cum) / h->count[i] * (upper - lower);
+	}
+
+	return 0;
+}
+
+static double nvme_lat_hist_max(const struct nvme_lat_hist *h)
+{
+	unsigned int i;
+
+	for (i = h->nr; i > 0; i--) {
+		if (!h->count[i - 1])
+			continue;
+		if (h->edge_us[i] == NVME_LAT_INF)
+			return h->edge_us[i - 1];
+		return h->edge_us[i];
+	}
+
+	return 0;
+}
+
+static void nvme_lat_sampler_print(struct nvme_lat_sampler *s, double t)
+{
+	struct json_object *root;
+	unsigned int i;
+
+	if (s->json) {
+		root = json_create_object();
+		json_object_add_value_double(root, "time", t);
+		if (s->name)
+			json_object_add_value_string(root, "type", s->name);
+		json_object_add_value_uint64(root, "ios", s->ios);
+		for (i = 0; i < NVME_LAT_NR_PCT; i++)
+			json_object_add_value_double(root, nvme_lat_pct_str[i],
+						     s->pct_us[i]);
+		json_object_add_value_double(root, "max", s->max_us);
+		json_print_object_line(root);
+		json_free_object(root);
+		fflush(stdout);
+		return;
+	}
+
+	if (s->samples == 1) {
+		printf("%s command latency in us\n", s->name ? s->name : "IO");
+		printf("%-12s %10s", "time", "ios");
+		for (i = 0; i < NVME_LAT_NR_PCT; i++)
+			printf(" %9s", nvme_lat_pct_str[i]);
+		printf(" %9s\n", "max");
+	}
+
+	printf("[%9.1fs] %10" PRIu64, t, s->ios);
+	for (i = 0; i < NVME_LAT_NR_PCT; i++)
+		printf(" %9.1f", s->pct_us[i]);
+	printf(" %9.1f\n", s->max_us);
+	fflush(stdout);
+}
+
+static void nvme_lat_sampler_delta(struct nvme_lat_sampler *s, uint64_t *cur)
+{
+	struct nvme_lat_hist *h = &s->hist;
+	struct timeval now;
+	unsigned int i;
+	double t;
+
+	for (i = 0; i < h->nr; i++) {
+		if (s->cleared || cur[i] < s->prev[i])
+			h->count[i] = cur[i];
+		else
+			h->count[i] = cur[i] - s->prev[i];
+		s->prev[i] = cur[i];
+	}
+
+	s->samples++;
+	s->ios = nvme_lat_hist_total(h);
+	for (i = 0; i < NVME_LAT_NR_PCT; i++)
+		s->pct_us[i] = nvme_lat_hist_percentile(h, nvme_lat_pct[i]);
+	s->max_us = nvme_lat_hist_max(h);
+
+	gettimeofday(&now, NULL);
+	t = (now.tv_sec - s->start.tv_sec) +
+		(now.tv_usec - s->start.tv_usec) / 1e6;
+	if (s->report)
+		s->report(s, t);
+	else
+		nvme_lat_sampler_print(s, t);
+}
+
+int nvme_lat_sampler_run(struct nvme_lat_sampler *s)
+{
+	uint64_t *cur;
+	unsigned int i;
+	int err;
+
+	s->prev = calloc(s->hist.nr, sizeof(*s->prev));
+	cur = calloc(s->hist.nr, sizeof(*cur));
+	if (!s->prev || !cur) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* the first read is the base line, or empties a cleared log */
+	err = s->sample(s, s->prev);
+	if (err)
+		goto out;
+	gettimeofday(&s->start, NULL);
+
+	for (i = 0; !s->count || i < s->count; i++) {
+		if (nvme_wait_countdown(s->interval))
+			break;
+
+		err = s->sample(s, cur);
+		if (err)
+			break;
+
+		nvme_lat_sampler_delta(s, cur);
+	}
+
+out:
+	free(cur);
+	free(s->prev);
+	s->prev = NULL;
+
+	return err;
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_LATENCY_H
+#define _NVME_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define NVME_LAT_INF		UINT64_MAX
+#define NVME_LAT_NR_PCT		5
+
+/*
+ * Latency histogram in a vendor independent form: bucket @i counts the
+ * commands with a latency from edge_us[i] up to edge_us[i + 1]. The last
+ * edge may be NVME_LAT_INF for an open ended bucket.
+ */
+struct nvme_lat_hist {
+	unsigned int	nr;
+	uint64_t	*edge_us;	/* nr + 1 */
+	uint64_t	*count;
+};
+
+int nvme_lat_hist_alloc(struct nvme_lat_hist *h, unsigned int nr);
+void nvme_lat_hist_free(struct nvme_lat_hist *h);
+
+/*
+ * Sets the edges of @nr buckets from bucket @i on, starting at @start_us
+ * in steps of @step_us. Returns the index of the next bucket.
+ */
+unsigned int nvme_lat_hist_linear(struct nvme_lat_hist *h, unsigned int i,
+				  unsigned int nr, uint64_t start_us,
+				  uint64_t step_us);
+
+uint64_t nvme_lat_hist_total(const struct nvme_lat_hist *h);
+
+/*
+ * The latency below which @pct percent of the commands completed,
+ * interpolated linearly within the bucket. An open ended bucket yields
+ * its lower edge.
+ */
+double nvme_lat_hist_percentile(const struct nvme_lat_hist *h, double pct);
+
+/*
+ * Periodic sampler for the cumulative latency histograms of vendor logs.
+ *
+ * @sample reads the counters of all buckets of @hist. Every @interval
+ * seconds the difference to the previous sample is stored in the counts
+ * of @hist and reported as the number of commands and their percentiles
+ * in that interval, one line or json object per sample. A counter which
+ * went backwards was reset by the device and counts from zero again. The
+ * logs which are cleared by every read are @cleared and taken as is.
+ */
+struct nvme_lat_sampler {
+	/* set by the caller, the bucket edges with nvme_lat_hist_alloc() */
+	struct nvme_lat_hist hist;
+	const char	*name;
+	unsigned int	interval;	/* seconds */
+	unsigned int	count;		/* samples, 0 until interrupted */
+	bool		cleared;
+	bool		json;
+	int (*sample)(struct nvme_lat_sampler *s, uint64_t *count);
+	void (*report)(struct nvme_lat_sampler *s, double t);
+	void		*priv;
+
+	/* updated by the sampler */
+	unsigned int	samples;
+	uint64_t	ios;
+	double		pct_us[NVME_LAT_NR_PCT];
+	double		max_us;
+
+	/* sampler internal */
+	uint64_t	*prev;
+	struct timeval	start;
+};
+
+extern const double nvme_lat_pct[NVME_LAT_NR_PCT];
+
+int nvme_lat_sampler_run(struct nvme_lat_sampler *s);
+
+#endif /* _NVME_LATENCY_H */
@@ -1820,12 +1820,12 @@ static void json_pevent_entry(void *pevent_log_info, __u8 action, __u32 size, co
 	struct json_object *valid_attrs;
 
 	for (i = 0; i < le32_to_cpu(pevent_log_head->tnev); i++) {
-		if (offset + sizeof(*pevent_entry_head) >= size)
+		if (offset + sizeof(*pevent_entry_head) > size)
 			break;
 
 		pevent_entry_head = pevent_log_info + offset;
 
-		if (offset + pevent_entry_head->ehl + 3 + le16_to_cpu(pevent_entry_head->el) >=
+		if (offset + pevent_entry_head->ehl + 3 + le16_to_cpu(pevent_entry_head->el) >
 		    size)
 			break;
 
@@ -1916,6 +1916,27 @@ static void json_persistent_event_log(void *pevent_log_info, __u8 action,
 	json_print(r);
 }
 
+/* one line per event, numbered from @first */
+static void json_persistent_event_entries(void *pevent_log_info, __u32 size,
+					  __u64 first, const char *devname)
+{
+	struct json_object *valid = json_create_array();
+	struct json_object *entry;
+	size_t i;
+
+	json_pevent_entry(pevent_log_info, NVME_PEVENT_LOG_READ, size, devname,
+			  sizeof(struct nvme_persistent_event_log), valid);
+
+	for (i = 0; i < json_object_array_length(valid); i++) {
+		entry = json_object_array_get_idx(valid, i);
+		obj_add_str(entry, "device", devname);
+		obj_add_uint64(entry, "event_number", first + i);
+		json_print_object_line(entry);
+	}
+
+	json_free_object(valid);
+}
+
 static void json_endurance_group_event_agg_log(
 		struct nvme_aggregate_endurance_group_event *endurance_log,
 		__u64 log_entries, __u32 size, const char *devname)
@@ -5548,6 +5569,7 @@ static struct print_ops json_print_ops = {
 	.ns_list_log			= json_changed_ns_list_log,
 	.nvm_id_ns			= json_nvme_nvm_id_ns,
 	.persistent_event_log		= json_persistent_event_log,
+	.persistent_event_entries	= json_persistent_event_entries,
 	.predictable_latency_event_agg_log = json_predictable_latency_event_agg_log,
 	.predictable_latency_per_nvmset	= json_predictable_latency_per_nvmset,
 	.primary_ctrl_cap		= json_nvme_primary_ctrl_cap,
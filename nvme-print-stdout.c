@@ -309,10 +309,10 @@ void nvme_show_pel_header(struct nvme_persistent_event_log *pevent_log_head, int
 	}
 }
 
-static void pel_event_header(int i, struct nvme_persistent_event_entry *pevent_entry_head,
+static void pel_event_header(__u64 nr, struct nvme_persistent_event_entry *pevent_entry_head,
 			     int human)
 {
-	printf("Event Number: %u\n", i);
+	printf("Event Number: %"PRIu64"\n", (uint64_t)nr);
 	printf("Event Type: %s\n", nvme_pel_event_to_string(pevent_entry_head->etype));
 	printf("Event Type Revision: %u\n", pevent_entry_head->etype_rev);
 	printf("Event Header Length: %u\n", pevent_entry_head->ehl);
@@ -493,41 +493,24 @@ static void pel_thermal_excursion_event(void *pevent_log_info, __u32 offset)
 	printf("Threshold: %u\n", thermal_exc_event->threshold);
 }
 
-static void stdout_persistent_event_log(void *pevent_log_info, __u8 action, __u32 size,
-					const char *devname)
+static void stdout_pevent_entries(void *pevent_log_info, __u32 size, __u64 first,
+				  const char *devname, int human)
 {
-	struct nvme_persistent_event_log *pevent_log_head;
+	struct nvme_persistent_event_log *pevent_log_head = pevent_log_info;
 	__u32 offset = sizeof(*pevent_log_head);
 	struct nvme_persistent_event_entry *pevent_entry_head;
-	int human = stdout_print_ops.flags & VERBOSE;
-
-	printf("Persistent Event Log for device: %s\n", devname);
-	printf("Action for Persistent Event Log: %u\n", action);
 
-	if (size < offset) {
-		printf("No log data can be shown with this log len at least " \
-		       "512 bytes is required or can be 0 to read the complete " \
-		       "log page after context established\n");
-		return;
-	}
-
-	pevent_log_head = pevent_log_info;
-
-	nvme_show_pel_header(pevent_log_head, human);
-
-	printf("\n");
-	printf("\nPersistent Event Entries:\n");
 	for (int i = 0; i < le32_to_cpu(pevent_log_head->tnev); i++) {
-		if (offset + sizeof(*pevent_entry_head) >= size)
+		if (offset + sizeof(*pevent_entry_head) > size)
 			break;
 
 		pevent_entry_head = pevent_log_info + offset;
 
 		if ((offset + pevent_entry_head->ehl + 3 +
-			le16_to_cpu(pevent_entry_head->el)) >= size)
+			le16_to_cpu(pevent_entry_head->el)) > size)
 			break;
 
-		pel_event_header(i, pevent_entry_head, human);
+		pel_event_header(first + i, pevent_entry_head, human);
 
 		offset += pevent_entry_head->ehl + 3;
 
@@ -583,6 +566,35 @@ static void stdout_persistent_event_log(void *pevent_log_info, __u8 action, __u3
 	}
 }
 
+static void stdout_persistent_event_log(void *pevent_log_info, __u8 action, __u32 size,
+					const char *devname)
+{
+	int human = stdout_print_ops.flags & VERBOSE;
+
+	printf("Persistent Event Log for device: %s\n", devname);
+	printf("Action for Persistent Event Log: %u\n", action);
+
+	if (size < sizeof(struct nvme_persistent_event_log)) {
+		printf("No log data can be shown with this log len at least " \
+		       "512 bytes is required or can be 0 to read the complete " \
+		       "log page after context established\n");
+		return;
+	}
+
+	nvme_show_pel_header(pevent_log_info, human);
+
+	printf("\n");
+	printf("\nPersistent Event Entries:\n");
+	stdout_pevent_entries(pevent_log_info, size, 0, devname, human);
+}
+
+static void stdout_persistent_event_entries(void *pevent_log_info, __u32 size,
+					    __u64 first, const char *devname)
+{
+	stdout_pevent_entries(pevent_log_info, size, first, devname,
+			      stdout_print_ops.flags & VERBOSE);
+}
+
 static void stdout_endurance_group_event_agg_log(
 		struct nvme_aggregate_endurance_group_event *endurance_log,
 		__u64 log_entries, __u32 size, const char *devname)
@@ -6667,6 +6679,7 @@ static struct print_ops stdout_print_ops = {
 	.ns_list_log			= stdout_changed_ns_list_log,
 	.nvm_id_ns			= stdout_nvm_id_ns,
 	.persistent_event_log		= stdout_persistent_event_log,
+	.persistent_event_entries	= stdout_persistent_event_entries,
 	.predictable_latency_event_agg_log = stdout_predictable_latency_event_agg_log,
 	.predictable_latency_per_nvmset	= stdout_predictable_latency_per_nvmset,
 	.primary_ctrl_cap		= stdout_primary_ctrl_cap,
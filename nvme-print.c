@@ -262,6 +262,20 @@ void nvme_show_persistent_event_log(void *pevent_log_info,
 		   pevent_log_info, action, size, devname);
 }
 
+void nvme_show_persistent_event_entries(void *pevent_log_info,
+	__u32 size, __u64 first, const char *devname,
+	nvme_print_flags_t flags)
+{
+	if (flags & BINARY) {
+		nvme_print(persistent_event_log, flags, pevent_log_info,
+			   NVME_PEVENT_LOG_READ, size, devname);
+		return;
+	}
+
+	nvme_print(persistent_event_entries, flags,
+		   pevent_log_info, size, first, devname);
+}
+
 void nvme_show_endurance_group_event_agg_log(
 	struct nvme_aggregate_endurance_group_event *endurance_log,
 	__u64 log_entries, __u32 size, const char *devname,
@@ -63,6 +63,7 @@ struct print_ops {
 	void (*ns_list_log)(struct nvme_ns_list *log, const char *devname, bool alloc);
 	void (*nvm_id_ns)(struct nvme_nvm_id_ns *nvm_ns, unsigned int nsid, struct nvme_id_ns *ns, unsigned int lba_index, bool cap_only);
 	void (*persistent_event_log)(void *pevent_log_info, __u8 action, __u32 size, const char *devname);
+	void (*persistent_event_entries)(void *pevent_log_info, __u32 size, __u64 first, const char *devname);
 	void (*predictable_latency_event_agg_log)(struct nvme_aggregate_predictable_lat_event *pea_log, __u64 log_entries, __u32 size, const char *devname);
 	void (*predictable_latency_per_nvmset)(struct nvme_nvmset_predictable_lat_log *plpns_log, __u16 nvmset_id, const char *devname);
 	void (*primary_ctrl_cap)(const struct nvme_primary_ctrl_cap *caps);
@@ -211,6 +212,9 @@ void nvme_show_predictable_latency_event_agg_log(
 void nvme_show_persistent_event_log(void *pevent_log_info,
 	__u8 action, __u32 size, const char *devname,
 	nvme_print_flags_t flags);
+void nvme_show_persistent_event_entries(void *pevent_log_info,
+	__u32 size, __u64 first, const char *devname,
+	nvme_print_flags_t flags);
 void nvme_show_endurance_group_event_agg_log(
 	struct nvme_aggregate_endurance_group_event *endurance_log,
 	__u64 log_entries, __u32 size, const char *devname,
@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ccan/endian/endian.h>
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-ioq.h"
+#include "nvme-scrub.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+#include "util/statefile.h"
+
+#define NSEC_PER_SEC			1000000000ULL
+
+#define NVME_SCRUB_STATE_MAGIC		"nvme-scrub 1"
+/* the Verify size limit is in units of the minimum memory page size */
+#define NVME_SCRUB_PAGE_SIZE		4096
+#define NVME_SCRUB_MAX_NLB		65536
+#define NVME_SCRUB_SAVE_NS		(10 * NSEC_PER_SEC)
+#define NVME_SCRUB_PROGRESS_NS		NSEC_PER_SEC
+
+struct nvme_scrub_slot {
+	uint64_t	pos;
+	uint64_t	slba;
+	uint32_t	nlb;
+	uint64_t	when;	/* not submitted before, 0 for right away */
+};
+
+static uint64_t nvme_scrub_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int nvme_scrub_init(struct nvme_scrub *s, struct nvme_transport_handle *hdl,
+		    uint32_t nsid, struct nvme_extent_list *list)
+{
+	_cleanup_free_ struct nvme_id_ctrl_nvm *ctrl_nvm = NULL;
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	struct nvme_passthru_cmd cmd;
+	uint64_t max = NVME_SCRUB_MAX_NLB;
+	__u8 lbaf;
+	int err;
+
+	memset(s, 0, sizeof(*s));
+	s->hdl = hdl;
+	s->nsid = nsid;
+	s->list = list;
+	s->depth = 1;
+
+	ns = nvme_alloc(sizeof(*ns));
+	if (!ns)
+		return -ENOMEM;
+
+	err = nvme_identify_ns(hdl, nsid, ns);
+	if (err)
+		return err;
+
+	nvme_id_ns_flbas_to_lbaf_inuse(ns->flbas, &lbaf);
+	s->lba_size = 1 << ns->lbaf[lbaf].ds;
+
+	ctrl_nvm = nvme_alloc(sizeof(*ctrl_nvm));
+	if (!ctrl_nvm)
+		return -ENOMEM;
+
+	/* controllers without the NVM command set structure have no limit */
+	nvme_init_identify_csi_ctrl(&cmd, NVME_CSI_NVM, ctrl_nvm);
+	if (!nvme_submit_admin_passthru(hdl, &cmd) && ctrl_nvm->vsl &&
+	    ctrl_nvm->vsl < 32)
+		max = min(max, ((uint64_t)NVME_SCRUB_PAGE_SIZE << ctrl_nvm->vsl) /
+			  s->lba_size);
+
+	s->max_nlb = max ? max : 1;
+	nvme_init_verify(&s->tmpl, nsid, 0, 0, 0, 0, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+void nvme_scrub_free(struct nvme_scrub *s)
+{
+	free(s->errors);
+	free(s->inflight);
+	s->errors = NULL;
+	s->inflight = NULL;
+	s->nr_errors = 0;
+}
+
+static int nvme_scrub_add_error(struct nvme_scrub *s, uint64_t pos,
+				uint64_t slba, uint32_t nlb, int status)
+{
+	struct nvme_scrub_error *e;
+
+	e = realloc(s->errors, (s->nr_errors + 1) * sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+
+	s->errors = e;
+	e = &s->errors[s->nr_errors++];
+	e->pos = pos;
+	e->slba = slba;
+	e->nlb = nlb;
+	e->status = status;
+
+	return 0;
+}
+
+static int nvme_scrub_load(struct nvme_scrub *s)
+{
+	unsigned long long pos, slba, blocks, done;
+	unsigned int nsid, nlb;
+	char line[128];
+	size_t extents;
+	FILE *f;
+	int status, err = 0;
+
+	f = fopen(s->state_file, "r");
+	if (!f)
+		return errno == ENOENT ? 0 : -errno;
+
+	if (!fgets(line, sizeof(line), f) ||
+	    strncmp(line, NVME_SCRUB_STATE_MAGIC, strlen(NVME_SCRUB_STATE_MAGIC)) ||
+	    fscanf(f, "nsid %u\nblocks %llu\nextents %zu\ndone %llu\n",
+		   &nsid, &blocks, &extents, &done) != 4) {
+		err = -EBADMSG;
+		goto out;
+	}
+
+	/* a state file of another namespace or range list is not resumed */
+	if (nsid != s->nsid || blocks != s->total ||
+	    extents != s->list->nr || done > blocks) {
+		err = -ESTALE;
+		goto out;
+	}
+
+	while (fscanf(f, "error %llu %llu %u %d\n", &pos, &slba, &nlb,
+		      &status) == 4) {
+		err = nvme_scrub_add_error(s, pos, slba, nlb, status);
+		if (err)
+			goto out;
+	}
+
+	s->done = done;
+	s->resumed = done;
+out:
+	fclose(f);
+	return err;
+}
+
+static int nvme_scrub_save(struct nvme_scrub *s)
+{
+	_cleanup_free_ char *buf = NULL;
+	unsigned int i;
+	size_t len;
+	FILE *f;
+
+	if (s->done == s->total) {
+		if (unlink(s->state_file) && errno != ENOENT)
+			return -errno;
+		return 0;
+	}
+
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -errno;
+
+	fprintf(f, NVME_SCRUB_STATE_MAGIC "\n");
+	fprintf(f, "nsid %u\nblocks %llu\nextents %zu\ndone %llu\n", s->nsid,
+		(unsigned long long)s->total, s->list->nr,
+		(unsigned long long)s->done);
+
+	/* errors beyond the checkpoint are found again by the next run */
+	for (i = 0; i < s->nr_errors; i++) {
+		struct nvme_scrub_error *e = &s->errors[i];
+
+		if (e->pos < s->done)
+			fprintf(f, "error %llu %llu %u %d\n",
+				(unsigned long long)e->pos,
+				(unsigned long long)e->slba, e->nlb, e->status);
+	}
+
+	if (fclose(f))
+		return -errno;
+
+	return nvme_state_file_write(s->state_file, buf, len);
+}
+
+static void nvme_scrub_seek(struct nvme_scrub *s, uint64_t pos)
+{
+	s->idx = 0;
+	s->off = 0;
+	s->pos = pos;
+
+	while (s->idx < s->list->nr && pos >= s->list->ext[s->idx].nlb)
+		pos -= s->list->ext[s->idx++].nlb;
+	s->off = pos;
+}
+
+static uint64_t nvme_scrub_checkpoint(struct nvme_scrub *s)
+{
+	uint64_t done = s->pos;
+	unsigned int i;
+
+	for (i = 0; i < s->depth; i++)
+		done = min(done, s->inflight[i]);
+
+	return done;
+}
+
+/* the time the next command fits into the IOPS and bandwidth limit */
+static uint64_t nvme_scrub_deadline(struct nvme_scrub *s, uint32_t nlb)
+{
+	uint64_t when = 0, bytes;
+
+	if (s->iops)
+		when = s->start_ns + s->cmds * NSEC_PER_SEC / s->iops;
+	if (s->bps) {
+		bytes = (s->pos - s->resumed + nlb) * s->lba_size;
+		when = max(when, s->start_ns +
+			   (uint64_t)((double)bytes * NSEC_PER_SEC / s->bps));
+	}
+
+	return when;
+}
+
+/* sleeps outside of the queue lock, the other slots keep going */
+static int nvme_scrub_wait(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			   void *buf)
+{
+	struct nvme_scrub_slot *slot = buf;
+	uint64_t now = nvme_scrub_now();
+	struct timespec ts;
+
+	if (slot->when <= now)
+		return 0;
+
+	ts.tv_sec = (slot->when - now) / NSEC_PER_SEC;
+	ts.tv_nsec = (slot->when - now) % NSEC_PER_SEC;
+	nanosleep(&ts, NULL);
+
+	return nvme_sigint_received ? -EINTR : 0;
+}
+
+static int nvme_scrub_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			   void *buf)
+{
+	struct nvme_scrub *s = q->priv;
+	struct nvme_scrub_slot *slot = buf;
+	struct nvme_extent *e;
+	unsigned int i;
+	uint32_t nlb;
+
+	if (s->idx >= s->list->nr)
+		return 0;
+
+	e = &s->list->ext[s->idx];
+	nlb = min(e->nlb - s->off, (uint64_t)s->max_nlb);
+
+	slot->when = nvme_scrub_deadline(s, nlb);
+	slot->pos = s->pos;
+	slot->slba = e->slba + s->off;
+	slot->nlb = nlb;
+
+	for (i = 0; i < s->depth; i++) {
+		if (s->inflight[i] == UINT64_MAX) {
+			s->inflight[i] = slot->pos;
+			break;
+		}
+	}
+
+	*cmd = s->tmpl;
+	cmd->cdw10 = slot->slba & 0xffffffff;
+	cmd->cdw11 = slot->slba >> 32;
+	cmd->cdw12 &= ~(NVME_IOCS_COMMON_CDW12_NLB_MASK <<
+			NVME_IOCS_COMMON_CDW12_NLB_SHIFT);
+	cmd->cdw12 |= NVME_FIELD_ENCODE(nlb - 1,
+					NVME_IOCS_COMMON_CDW12_NLB_SHIFT,
+					NVME_IOCS_COMMON_CDW12_NLB_MASK);
+
+	s->pos += nlb;
+	s->off += nlb;
+	if (s->off == e->nlb) {
+		s->idx++;
+		s->off = 0;
+	}
+	s->cmds++;
+
+	return 1;
+}
+
+static int nvme_scrub_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			   void *buf, int err)
+{
+	struct nvme_scrub *s = q->priv;
+	struct nvme_scrub_slot *slot = buf;
+	uint64_t now;
+	unsigned int i;
+
+	/* the range stays in flight, the checkpoint must not pass it */
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < s->depth; i++) {
+		if (s->inflight[i] == slot->pos) {
+			s->inflight[i] = UINT64_MAX;
+			break;
+		}
+	}
+
+	if (err > 0) {
+		err = nvme_scrub_add_error(s, slot->pos, slot->slba, slot->nlb,
+					   err);
+		if (err)
+			return err;
+	}
+
+	s->verified += slot->nlb;
+	s->done = nvme_scrub_checkpoint(s);
+
+	now = nvme_scrub_now();
+	if (s->state_file && now - s->save_ns >= NVME_SCRUB_SAVE_NS) {
+		s->save_ns = now;
+		err = nvme_scrub_save(s);
+		if (err)
+			return err;
+	}
+	if (s->progress && now - s->progress_ns >= NVME_SCRUB_PROGRESS_NS) {
+		s->progress_ns = now;
+		if (s->progress(s, s->arg))
+			return -ECANCELED;
+	}
+
+	return 0;
+}
+
+int nvme_scrub_run(struct nvme_scrub *s)
+{
+	struct nvme_ioq q = { 0 };
+	unsigned int i;
+	int err, ret;
+
+	s->total = nvme_extent_blocks(s->list);
+	if (s->state_file) {
+		err = nvme_scrub_load(s);
+		if (err)
+			return err;
+	}
+	nvme_scrub_seek(s, s->done);
+
+	if (!s->depth)
+		s->depth = 1;
+	s->inflight = malloc(s->depth * sizeof(*s->inflight));
+	if (!s->inflight)
+		return -ENOMEM;
+	for (i = 0; i < s->depth; i++)
+		s->inflight[i] = UINT64_MAX;
+
+	s->start_ns = nvme_scrub_now();
+	s->save_ns = s->start_ns;
+	s->progress_ns = s->start_ns;
+
+	q.hdl = s->hdl;
+	q.depth = s->depth;
+	q.buf_size = sizeof(struct nvme_scrub_slot);
+	q.prep = nvme_scrub_prep;
+	q.done = nvme_scrub_done;
+	q.wait = nvme_scrub_wait;
+	q.priv = s;
+
+	err = nvme_ioq_run(&q);
+
+	s->done = nvme_scrub_checkpoint(s);
+	if (s->state_file) {
+		ret = nvme_scrub_save(s);
+		if (!err)
+			err = ret;
+	}
+	if (s->progress)
+		s->progress(s, s->arg);
+
+	return err;
+}
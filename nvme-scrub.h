@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_SCRUB_H
+#define _NVME_SCRUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libnvme.h>
+
+#include "util/extent.h"
+
+/*
+ * Media scrub engine built on the Verify command.
+ *
+ * The extents of @list are walked in ascending order with Verify commands
+ * of up to the Verify Size Limit, keeping @depth of them in flight and
+ * optionally throttled to @iops commands and @bps bytes per second. A
+ * Verify failing with an NVMe status does not stop the scrub, the range
+ * is recorded in @errors instead.
+ *
+ * With a @state_file the progress is checkpointed periodically and on
+ * exit, and a later run over the same extents continues where the last
+ * one stopped. The checkpoint is the position below which every Verify
+ * completed, so a few commands may be repeated after a resume.
+ */
+
+struct nvme_scrub_error {
+	uint64_t	pos;		/* blocks into the extent list */
+	uint64_t	slba;
+	uint32_t	nlb;
+	int		status;
+};
+
+struct nvme_scrub {
+	/* set by the caller, nvme_scrub_init() fills in the limits */
+	struct nvme_transport_handle *hdl;
+	struct nvme_passthru_cmd tmpl;	/* Verify with control and tags */
+	struct nvme_extent_list *list;
+	uint32_t	nsid;
+	uint32_t	max_nlb;	/* blocks per Verify */
+	uint32_t	lba_size;
+	unsigned int	depth;
+	uint64_t	iops;		/* 0 unlimited */
+	uint64_t	bps;		/* 0 unlimited */
+	const char	*state_file;
+	int (*progress)(struct nvme_scrub *s, void *arg);
+	void		*arg;
+
+	/* updated by the engine */
+	uint64_t	total;		/* blocks */
+	uint64_t	done;		/* checkpoint */
+	uint64_t	verified;	/* blocks completed by this run */
+	uint64_t	resumed;	/* checkpoint loaded from the state file */
+	uint64_t	cmds;
+	uint64_t	start_ns;
+	struct nvme_scrub_error	*errors;
+	unsigned int	nr_errors;
+
+	/* engine internal */
+	size_t		idx;
+	uint64_t	off;
+	uint64_t	pos;
+	uint64_t	*inflight;
+	uint64_t	save_ns;
+	uint64_t	progress_ns;
+};
+
+int nvme_scrub_init(struct nvme_scrub *s, struct nvme_transport_handle *hdl,
+		    uint32_t nsid, struct nvme_extent_list *list);
+int nvme_scrub_run(struct nvme_scrub *s);
+void nvme_scrub_free(struct nvme_scrub *s);
+
+#endif /* _NVME_SCRUB_H */
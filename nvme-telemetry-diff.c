@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-telemetry-diff.h"
+#include "util/json.h"
+
+/* equal data is skipped in spans of this size with a single memcmp() */
+#define NVME_TDIFF_SPAN		(64 * 1024)
+
+static int nvme_tdiff_layout(struct nvme_tdiff_log *l)
+{
+	const struct nvme_telemetry_log *hdr = (const void *)l->buf;
+	uint32_t last[NVME_TDIFF_NR_DA + 1] = {
+		0,
+		le16_to_cpu(hdr->dalb1),
+		le16_to_cpu(hdr->dalb2),
+		le16_to_cpu(hdr->dalb3),
+		le32_to_cpu(hdr->dalb4),
+	};
+	unsigned int i;
+	uint64_t end;
+
+	l->last_da = 0;
+	for (i = 1; i <= NVME_TDIFF_NR_DA; i++) {
+		/* data area 4 reads as 0 when it is not supported */
+		if (last[i] < last[i - 1]) {
+			if (i < NVME_TDIFF_NR_DA) {
+				fprintf(stderr,
+					"%s: data area %u ends before data area %u\n",
+					l->path, i, i - 1);
+				return -EINVAL;
+			}
+			break;
+		}
+
+		l->da_off[i] = (uint64_t)(last[i - 1] + 1) * NVME_LOG_TELEM_BLOCK_SIZE;
+		l->da_len[i] = (uint64_t)(last[i] - last[i - 1]) * NVME_LOG_TELEM_BLOCK_SIZE;
+		end = l->da_off[i] + l->da_len[i];
+		if (end > l->size) {
+			if (l->da_off[i] < l->size)
+				fprintf(stderr, "%s: data area %u is truncated\n",
+					l->path, i);
+			break;
+		}
+		l->last_da = i;
+	}
+
+	return 0;
+}
+
+static int nvme_tdiff_map(struct nvme_tdiff_log *l, const char *path)
+{
+	struct stat st;
+	void *buf;
+	int fd, err;
+
+	memset(l, 0, sizeof(*l));
+	l->path = path;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err = -errno;
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return err;
+	}
+
+	if (fstat(fd, &st)) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+	if (st.st_size < NVME_LOG_TELEM_BLOCK_SIZE) {
+		fprintf(stderr, "%s: too short for a telemetry log\n", path);
+		close(fd);
+		return -EINVAL;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return -errno;
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+	l->buf = buf;
+	l->size = st.st_size;
+	l->lid = l->buf[0];
+	if (l->lid != NVME_LOG_LID_TELEMETRY_HOST &&
+	    l->lid != NVME_LOG_LID_TELEMETRY_CTRL) {
+		fprintf(stderr, "%s: not a telemetry log, log identifier 0x%02x\n",
+			path, l->lid);
+		return -EINVAL;
+	}
+
+	return nvme_tdiff_layout(l);
+}
+
+static void nvme_tdiff_unmap(struct nvme_tdiff_log *l)
+{
+	if (l->buf)
+		munmap(l->buf, l->size);
+	l->buf = NULL;
+}
+
+int nvme_tdiff_open(struct nvme_tdiff *d, const char *before, const char *after)
+{
+	const struct nvme_telemetry_log *a, *b;
+	int err;
+
+	memset(&d->after, 0, sizeof(d->after));
+	d->regions = NULL;
+	d->nr_regions = 0;
+
+	err = nvme_tdiff_map(&d->before, before);
+	if (!err)
+		err = nvme_tdiff_map(&d->after, after);
+	if (err)
+		goto close;
+
+	a = (const void *)d->before.buf;
+	b = (const void *)d->after.buf;
+	if (a->lpi != b->lpi) {
+		fprintf(stderr, "%s and %s are different telemetry logs\n",
+			before, after);
+		err = -EINVAL;
+	} else if (memcmp(a->ieee, b->ieee, sizeof(a->ieee))) {
+		fprintf(stderr, "%s and %s are from different vendors\n",
+			before, after);
+		err = -EINVAL;
+	}
+	if (!err)
+		return 0;
+
+close:
+	nvme_tdiff_close(d);
+	return err;
+}
+
+void nvme_tdiff_close(struct nvme_tdiff *d)
+{
+	nvme_tdiff_unmap(&d->before);
+	nvme_tdiff_unmap(&d->after);
+	free(d->regions);
+	d->regions = NULL;
+	d->nr_regions = 0;
+}
+
+static int nvme_tdiff_add(struct nvme_tdiff *d, unsigned int da, uint64_t off,
+			  uint64_t len)
+{
+	struct nvme_tdiff_region *r;
+
+	d->changed += len;
+
+	/* adjacent changed blocks are one region */
+	if (d->nr_regions) {
+		r = &d->regions[d->nr_regions - 1];
+		if (r->da == da && r->off + r->len == off) {
+			r->len += len;
+			return 0;
+		}
+	}
+
+	/* grows by powers of two */
+	if (!d->nr_regions ||
+	    (d->nr_regions >= 16 && !(d->nr_regions & (d->nr_regions - 1)))) {
+		r = realloc(d->regions, (d->nr_regions ? d->nr_regions * 2 : 16) *
+			    sizeof(*r));
+		if (!r)
+			return -ENOMEM;
+		d->regions = r;
+	}
+
+	r = &d->regions[d->nr_regions++];
+	r->da = da;
+	r->off = off;
+	r->len = len;
+
+	return 0;
+}
+
+static int nvme_tdiff_area(struct nvme_tdiff *d, unsigned int da)
+{
+	const uint8_t *a = d->before.buf + d->before.da_off[da];
+	const uint8_t *b = d->after.buf + d->after.da_off[da];
+	uint64_t len = min(d->before.da_len[da], d->after.da_len[da]);
+	uint64_t longer = max(d->before.da_len[da], d->after.da_len[da]);
+	uint64_t off = 0, end, blk;
+	int err;
+
+	while (off < len) {
+		end = min(len, off + NVME_TDIFF_SPAN);
+
+		/* memcmp() of the C library compares vectorized */
+		if (!memcmp(a + off, b + off, end - off)) {
+			off = end;
+			continue;
+		}
+
+		for (; off < end; off += blk) {
+			blk = min(end - off, (uint64_t)d->block);
+			if (!memcmp(a + off, b + off, blk))
+				continue;
+			err = nvme_tdiff_add(d, da, off, blk);
+			if (err)
+				return err;
+		}
+	}
+	d->compared += len;
+
+	if (longer > len)
+		return nvme_tdiff_add(d, da, len, longer - len);
+
+	return 0;
+}
+
+int nvme_tdiff_compare(struct nvme_tdiff *d)
+{
+	unsigned int da;
+	int err;
+
+	if (!d->block)
+		d->block = NVME_TDIFF_DEFAULT_BLOCK;
+
+	d->nr_regions = 0;
+	d->compared = 0;
+	d->changed = 0;
+	d->last_da = min(d->before.last_da, d->after.last_da);
+
+	for (da = 1; da <= d->last_da; da++) {
+		err = nvme_tdiff_area(d, da);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static void nvme_tdiff_print_text(const struct nvme_tdiff *d)
+{
+	const struct nvme_telemetry_log *a = (const void *)d->before.buf;
+	const struct nvme_telemetry_log *b = (const void *)d->after.buf;
+	const struct nvme_tdiff_region *r;
+	unsigned int i;
+
+	printf("Telemetry %s log: %s -> %s\n",
+	       d->before.lid == NVME_LOG_LID_TELEMETRY_HOST ? "Host-Initiated" :
+	       "Controller-Initiated", d->before.path, d->after.path);
+	if (d->before.lid == NVME_LOG_LID_TELEMETRY_HOST)
+		printf("%-28s: %u -> %u\n", "Host-Initiated Generation",
+		       a->hostdgn, b->hostdgn);
+	printf("%-28s: %u -> %u\n", "Controller-Initiated Generation",
+	       a->ctrldgn, b->ctrldgn);
+	printf("%-28s: %s\n", "Reason Identifier",
+	       memcmp(a->rsnident, b->rsnident, sizeof(a->rsnident)) ?
+	       "changed" : "unchanged");
+
+	printf("\n%-10s %14s %14s %14s\n", "Data Area", "before", "after",
+	       "changed");
+	for (i = 1; i <= NVME_TDIFF_NR_DA; i++) {
+		uint64_t changed = 0;
+		unsigned int j;
+
+		for (j = 0; j < d->nr_regions; j++)
+			if (d->regions[j].da == i)
+				changed += d->regions[j].len;
+
+		if (i > d->before.last_da && i > d->after.last_da)
+			continue;
+		printf("%-10u %14" PRIu64 " %14" PRIu64, i,
+		       i <= d->before.last_da ? d->before.da_len[i] : 0,
+		       i <= d->after.last_da ? d->after.da_len[i] : 0);
+		if (i <= d->last_da)
+			printf(" %14" PRIu64 "\n", changed);
+		else
+			printf(" %14s\n", "-");
+	}
+
+	printf("\n%" PRIu64 " of %" PRIu64 " bytes changed in %u regions\n",
+	       d->changed, d->compared, d->nr_regions);
+	for (i = 0; i < d->nr_regions; i++) {
+		r = &d->regions[i];
+		printf("  Data Area %u: 0x%08" PRIx64 " - 0x%08" PRIx64
+		       " (%" PRIu64 " bytes)\n", r->da, r->off,
+		       r->off + r->len - 1, r->len);
+	}
+}
+
+void nvme_tdiff_print(const struct nvme_tdiff *d, struct json_object *root)
+{
+	const struct nvme_telemetry_log *a = (const void *)d->before.buf;
+	const struct nvme_telemetry_log *b = (const void *)d->after.buf;
+	struct json_object *areas, *regions, *obj;
+	unsigned int i;
+
+	if (!root) {
+		nvme_tdiff_print_text(d);
+		return;
+	}
+
+	json_object_add_value_string(root, "before", d->before.path);
+	json_object_add_value_string(root, "after", d->after.path);
+	json_object_add_value_uint(root, "log_id", d->before.lid);
+	if (d->before.lid == NVME_LOG_LID_TELEMETRY_HOST) {
+		json_object_add_value_uint(root, "host_generation_before", a->hostdgn);
+		json_object_add_value_uint(root, "host_generation_after", b->hostdgn);
+	}
+	json_object_add_value_uint(root, "ctrl_generation_before", a->ctrldgn);
+	json_object_add_value_uint(root, "ctrl_generation_after", b->ctrldgn);
+	json_object_add_value_uint(root, "reason_identifier_changed",
+				   !!memcmp(a->rsnident, b->rsnident, sizeof(a->rsnident)));
+
+	areas = json_create_array();
+	for (i = 1; i <= NVME_TDIFF_NR_DA; i++) {
+		if (i > d->before.last_da && i > d->after.last_da)
+			continue;
+		obj = json_create_object();
+		json_object_add_value_uint(obj, "data_area", i);
+		json_object_add_value_uint64(obj, "before_size",
+			i <= d->before.last_da ? d->before.da_len[i] : 0);
+		json_object_add_value_uint64(obj, "after_size",
+			i <= d->after.last_da ? d->after.da_len[i] : 0);
+		json_object_add_value_uint(obj, "compared", i <= d->last_da);
+		json_array_add_value_object(areas, obj);
+	}
+	json_object_add_value_array(root, "data_areas", areas);
+
+	json_object_add_value_uint64(root, "compared", d->compared);
+	json_object_add_value_uint64(root, "changed", d->changed);
+
+	regions = json_create_array();
+	for (i = 0; i < d->nr_regions; i++) {
+		obj = json_create_object();
+		json_object_add_value_uint(obj, "data_area", d->regions[i].da);
+		json_object_add_value_uint64(obj, "offset", d->regions[i].off);
+		json_object_add_value_uint64(obj, "length", d->regions[i].len);
+		json_array_add_value_object(regions, obj);
+	}
+	json_object_add_value_array(root, "regions", regions);
+}
+
+void nvme_tdiff_show(const struct nvme_tdiff *d, bool json)
+{
+	struct json_object *root = json ? json_create_object() : NULL;
+
+	nvme_tdiff_print(d, root);
+	if (root) {
+		json_print_object(root, NULL);
+		printf("\n");
+		json_free_object(root);
+	}
+}
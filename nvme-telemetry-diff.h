@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_TELEMETRY_DIFF_H
+#define _NVME_TELEMETRY_DIFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct json_object;
+
+#define NVME_TDIFF_NR_DA		4
+#define NVME_TDIFF_DEFAULT_BLOCK	512
+
+/*
+ * A telemetry log capture mapped from a file, the 512 byte header followed
+ * by the data areas, as written by telemetry-log and the vendor capture
+ * commands. @da_off and @da_len are the file ranges of data areas 1 to 4
+ * from the last blocks in the header; @last_da is the last data area which
+ * is contained in the file, captures often stop before data area 3 or 4.
+ */
+struct nvme_tdiff_log {
+	const char	*path;
+	uint8_t		*buf;
+	size_t		size;
+	uint8_t		lid;
+	uint64_t	da_off[NVME_TDIFF_NR_DA + 1];	/* [0] unused */
+	uint64_t	da_len[NVME_TDIFF_NR_DA + 1];
+	unsigned int	last_da;
+};
+
+/* a run of changed blocks, the offset is within the data area */
+struct nvme_tdiff_region {
+	unsigned int	da;
+	uint64_t	off;
+	uint64_t	len;
+};
+
+/*
+ * Comparison of two captures of the same log of the same controller.
+ *
+ * nvme_tdiff_open() maps both captures and checks that they are telemetry
+ * logs of the same kind and vendor with consistent data area boundaries.
+ * nvme_tdiff_compare() finds the changed @block sized blocks of the data
+ * areas present in both and merges adjacent ones into @regions; a data
+ * area which grew or shrank is changed from the end of the shorter one.
+ * The vendor plugins decode the statistics and events of the two mapped
+ * captures on top of this.
+ */
+struct nvme_tdiff {
+	struct nvme_tdiff_log	before;
+	struct nvme_tdiff_log	after;
+	uint32_t		block;		/* 0 for the telemetry block */
+
+	/* filled in by nvme_tdiff_compare() */
+	struct nvme_tdiff_region *regions;
+	unsigned int		nr_regions;
+	unsigned int		last_da;	/* compared */
+	uint64_t		compared;	/* bytes */
+	uint64_t		changed;	/* bytes */
+};
+
+int nvme_tdiff_open(struct nvme_tdiff *d, const char *before, const char *after);
+void nvme_tdiff_close(struct nvme_tdiff *d);
+int nvme_tdiff_compare(struct nvme_tdiff *d);
+
+/* adds the header and region diff to @root, prints it as text without */
+void nvme_tdiff_print(const struct nvme_tdiff *d, struct json_object *root);
+void nvme_tdiff_show(const struct nvme_tdiff *d, bool json);
+
+#endif /* _NVME_TELEMETRY_DIFF_H */
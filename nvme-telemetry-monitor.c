@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ccan/endian/endian.h>
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-capture.h"
+#include "nvme-telemetry-monitor.h"
+#include "nvme-wait.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+
+#define NSEC_PER_SEC			1000000000ULL
+/* a failed capture is retried, the controller keeps the data meanwhile */
+#define NVME_TMON_RETRY_S		60
+/* checks for data whose notice was lost or never sent as a uevent */
+#define NVME_TMON_POLL_S		600
+#define NVME_TMON_POLL_NO_UEVENT_S	30
+
+static uint64_t nvme_tmon_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* the identify strings are space padded */
+static void nvme_tmon_str(char *dst, const char *src, size_t len)
+{
+	while (len && (src[len - 1] == ' ' || !src[len - 1]))
+		len--;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+int nvme_tmon_ctrl_init(struct nvme_tmon_ctrl *c)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	const char *name = strrchr(c->name, '/');
+	int err;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(c->hdl, ctrl);
+	if (err)
+		return err;
+
+	/* Telemetry Host-Initiated and Controller-Initiated logs */
+	if (!(ctrl->lpa & 0x8))
+		return -EOPNOTSUPP;
+
+	name = name ? name + 1 : c->name;
+	if (sscanf(name, "nvme%d", &c->instance) != 1)
+		c->instance = -1;
+
+	nvme_tmon_str(c->sn, ctrl->sn, sizeof(ctrl->sn));
+	nvme_tmon_str(c->mn, ctrl->mn, sizeof(ctrl->mn));
+	nvme_tmon_str(c->fr, ctrl->fr, sizeof(ctrl->fr));
+	c->da4 = ctrl->lpa & 0x40;
+	c->max_chunk = nvme_capture_max_chunk(c->hdl);
+
+	/* data which is already there is captured right away */
+	c->pending = true;
+	c->next_ns = 0;
+	c->poll_ns = 0;
+
+	return 0;
+}
+
+struct nvme_tmon_fetch {
+	struct nvme_transport_handle *hdl;
+	uint64_t end;
+};
+
+static int nvme_tmon_fetch(struct nvme_capture *cap, void *buf, uint64_t off,
+			   uint32_t len)
+{
+	struct nvme_tmon_fetch *f = cap->priv;
+
+	/* only reading the last chunk acknowledges the notice */
+	return nvme_get_log_telemetry_ctrl(f->hdl, off + len < f->end, off, buf,
+					   len);
+}
+
+static int nvme_tmon_meta(const char *path, struct nvme_tmon_ctrl *c,
+			  const struct nvme_telemetry_log *hdr, time_t t,
+			  uint64_t size)
+{
+	char stamp[32];
+	struct tm tm;
+	unsigned int i;
+	FILE *f;
+	int err = 0;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	gmtime_r(&t, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+	fprintf(f, "controller: %s\n", c->name);
+	fprintf(f, "serial: %s\n", c->sn);
+	fprintf(f, "model: %s\n", c->mn);
+	fprintf(f, "firmware: %s\n", c->fr);
+	fprintf(f, "timestamp: %s\n", stamp);
+	fprintf(f, "generation: %u\n", hdr->ctrldgn);
+	fprintf(f, "size: %" PRIu64 "\n", size);
+	fprintf(f, "reason-identifier: ");
+	for (i = 0; i < sizeof(hdr->rsnident); i++)
+		fprintf(f, "%02x", hdr->rsnident[i]);
+	fprintf(f, "\n");
+
+	if (fflush(f) || fsync(fileno(f)))
+		err = -errno;
+	if (fclose(f) && !err)
+		err = -errno;
+
+	return err;
+}
+
+static size_t nvme_tmon_size(struct nvme_tmon *m, struct nvme_tmon_ctrl *c,
+			     const struct nvme_telemetry_log *hdr)
+{
+	size_t dalb;
+
+	switch (m->da) {
+	case NVME_TELEMETRY_DA_1:
+		dalb = le16_to_cpu(hdr->dalb1);
+		break;
+	case NVME_TELEMETRY_DA_2:
+		dalb = le16_to_cpu(hdr->dalb2);
+		break;
+	case NVME_TELEMETRY_DA_4:
+		/* without support data area 4 is not there, take up to 3 */
+		dalb = c->da4 ? le32_to_cpu(hdr->dalb4) : le16_to_cpu(hdr->dalb3);
+		break;
+	default:
+		dalb = le16_to_cpu(hdr->dalb3);
+		break;
+	}
+
+	return (dalb + 1) * NVME_LOG_TELEM_BLOCK_SIZE;
+}
+
+int nvme_tmon_capture(struct nvme_tmon *m, struct nvme_tmon_ctrl *c)
+{
+	_cleanup_free_ struct nvme_telemetry_log *hdr = NULL;
+	_cleanup_free_ char *path = NULL, *meta = NULL;
+	struct nvme_tmon_fetch f = { .hdl = c->hdl };
+	struct nvme_capture_file file;
+	struct nvme_capture cap;
+	char sn[sizeof(c->sn)];
+	char stamp[32];
+	unsigned int flags, i;
+	struct tm tm;
+	time_t now;
+	int err, ret;
+
+	hdr = nvme_alloc(NVME_LOG_TELEM_BLOCK_SIZE);
+	if (!hdr)
+		return -ENOMEM;
+
+	err = nvme_get_log_telemetry_ctrl(c->hdl, true, 0, hdr,
+					  NVME_LOG_TELEM_BLOCK_SIZE);
+	if (err)
+		return err;
+
+	/* nothing to capture, acknowledge a notice so the next one is sent */
+	if (!hdr->ctrlavail)
+		return nvme_get_log_telemetry_ctrl(c->hdl, false, 0, hdr,
+						   NVME_LOG_TELEM_BLOCK_SIZE);
+
+	f.end = nvme_tmon_size(m, c, hdr);
+
+	/* the serial number names the files, keep it a plain file name */
+	for (i = 0; c->sn[i]; i++)
+		sn[i] = isalnum((unsigned char)c->sn[i]) || c->sn[i] == '-' ?
+			c->sn[i] : '_';
+	sn[i] = '\0';
+
+	now = time(NULL);
+	gmtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	if (asprintf(&path, "%s/%s-%s-gen%u.bin", m->dir, sn[0] ? sn : c->name,
+		     stamp, hdr->ctrldgn) < 0)
+		return -ENOMEM;
+	if (asprintf(&meta, "%.*s.meta", (int)strlen(path) - 4, path) < 0)
+		return -ENOMEM;
+
+	flags = NVME_CAPTURE_SPARSE | NVME_CAPTURE_SYNC;
+	if (m->manifest)
+		flags |= NVME_CAPTURE_MANIFEST;
+	err = nvme_capture_file_open(&file, path, flags);
+	if (err)
+		goto report;
+
+	nvme_capture_init(&cap, NULL);
+	cap.max_chunk = c->max_chunk;
+	cap.align = NVME_LOG_TELEM_BLOCK_SIZE;
+	cap.size = f.end;
+	cap.retries = 2;
+	cap.file = &file;
+	cap.fetch = nvme_tmon_fetch;
+	cap.priv = &f;
+
+	err = nvme_capture_run(&cap);
+	ret = nvme_capture_file_close(&file);
+	if (!err)
+		err = ret;
+	if (!err)
+		err = nvme_tmon_meta(meta, c, hdr, now, f.end);
+
+	if (err) {
+		/* the notice was not acknowledged, the retry gets all of it */
+		unlink(path);
+		unlink(meta);
+	} else {
+		c->captures++;
+	}
+
+report:
+	if (m->report)
+		m->report(m, c, path, f.end, err);
+
+	return err;
+}
+
+/*
+ * A telemetry notice for a controller makes it check for data, a new
+ * controller is handed to the caller.
+ */
+static int nvme_tmon_uevent(const char *msg, size_t len, void *arg)
+{
+	struct nvme_tmon *m = arg;
+	const char *p, *devname = NULL;
+	bool telemetry = false, add = false, ctrl = false;
+	int instance = -1, i;
+	unsigned int aen;
+
+	for (p = msg; p < msg + len; p += strlen(p) + 1) {
+		if (!strncmp(p, "DEVNAME=", 8))
+			devname = p + 8;
+		else if (!strcmp(p, "ACTION=add"))
+			add = true;
+		else if (!strcmp(p, "SUBSYSTEM=nvme"))
+			ctrl = true;
+		else if (sscanf(p, "NVME_AEN=%x", &aen) == 1)
+			telemetry = (aen & 0x7) == NVME_AER_NOTICE &&
+				((aen >> 8) & 0xff) == NVME_AER_NOTICE_TELEMETRY;
+	}
+	if (!devname)
+		return 0;
+
+	if (add && ctrl && m->added) {
+		m->added(m, devname);
+		return 0;
+	}
+
+	if (!telemetry || sscanf(devname, "nvme%d", &instance) != 1)
+		return 0;
+
+	for (i = 0; i < m->nr; i++) {
+		if (m->ctrl[i].instance != instance)
+			continue;
+		m->ctrl[i].events++;
+		m->ctrl[i].pending = true;
+	}
+
+	return 0;
+}
+
+static void nvme_tmon_check(struct nvme_tmon *m, struct nvme_tmon_ctrl *c)
+{
+	unsigned int captures = c->captures;
+	int err;
+
+	err = nvme_tmon_capture(m, c);
+	if (err) {
+		c->failures++;
+		c->next_ns = nvme_tmon_now() + NVME_TMON_RETRY_S * NSEC_PER_SEC;
+		return;
+	}
+
+	c->pending = false;
+	if (c->captures != captures)
+		c->next_ns = nvme_tmon_now() +
+			(uint64_t)m->min_interval * NSEC_PER_SEC;
+}
+
+int nvme_tmon_run(struct nvme_tmon *m)
+{
+	_cleanup_fd_ int ufd = -1;
+	uint64_t now, next, interval;
+	struct nvme_tmon_ctrl *c;
+	struct pollfd pfd;
+	int i, timeout;
+
+	ufd = nvme_wait_uevent_open();
+	pfd.fd = ufd;
+	pfd.events = POLLIN;
+	interval = (ufd >= 0 ? NVME_TMON_POLL_S : NVME_TMON_POLL_NO_UEVENT_S) *
+		NSEC_PER_SEC;
+
+	nvme_sigint_received = false;
+
+	while (true) {
+		now = nvme_tmon_now();
+		next = UINT64_MAX;
+
+		for (i = 0; i < m->nr; i++) {
+			c = &m->ctrl[i];
+
+			if (c->poll_ns <= now) {
+				c->pending = true;
+				c->poll_ns = now + interval;
+			}
+
+			/* a capture within the interval waits, the data stays */
+			if (c->pending && c->next_ns <= now) {
+				nvme_tmon_check(m, c);
+				if (nvme_sigint_received)
+					return -EINTR;
+				now = nvme_tmon_now();
+			}
+
+			next = min(next, c->poll_ns);
+			if (c->pending)
+				next = min(next, c->next_ns);
+		}
+
+		/* with no controller left only a uevent or a signal wakes us */
+		now = nvme_tmon_now();
+		if (next == UINT64_MAX)
+			timeout = -1;
+		else if (next > now)
+			timeout = min((next - now + NSEC_PER_SEC / 1000 - 1) /
+				      (NSEC_PER_SEC / 1000), (uint64_t)INT_MAX);
+		else
+			timeout = 0;
+
+		if (poll(&pfd, ufd >= 0 ? 1 : 0, timeout) > 0)
+			nvme_wait_uevent_read(ufd, nvme_tmon_uevent, m);
+		if (nvme_sigint_received)
+			return -EINTR;
+	}
+}
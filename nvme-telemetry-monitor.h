@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_TELEMETRY_MONITOR_H
+#define _NVME_TELEMETRY_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libnvme.h>
+
+/*
+ * Capture daemon for controller-initiated telemetry.
+ *
+ * The controllers are watched for Telemetry Log Changed notices, the
+ * NVME_AEN uevents of the kernel, and polled for the Controller-Initiated
+ * Data Available flag in case an event was lost or there is no access to
+ * the uevent socket. Data found at start is captured right away. A
+ * controller which shows up while running, after a hot plug or a
+ * reconnect, is passed to @added, which may add it to @ctrl.
+ *
+ * A capture streams the log to "<dir>/<serial>-<time>-gen<N>.bin" in MDTS
+ * sized chunks and writes the controller's serial number, model,
+ * firmware, the time and the reason identifier to a ".meta" file next to
+ * it. All chunks but the last are read with Retain Asynchronous Event set,
+ * so the notice is only acknowledged and the next one armed once the whole
+ * log was read; a capture which failed is retried.
+ *
+ * The first capture of a controller is never delayed. Later ones wait
+ * until @min_interval seconds passed since the previous one; until then
+ * the controller keeps the data and sends no further notices, so a burst
+ * of failures keeps the earliest signature rather than the last one.
+ */
+struct nvme_tmon_ctrl {
+	/* set by the caller */
+	const char			*name;
+	struct nvme_transport_handle	*hdl;
+
+	/* filled in by nvme_tmon_ctrl_init() */
+	int		instance;
+	char		sn[21];
+	char		mn[41];
+	char		fr[9];
+	bool		da4;
+	uint32_t	max_chunk;
+
+	/* updated by the monitor */
+	bool		pending;
+	unsigned int	captures;
+	unsigned int	failures;
+	unsigned int	events;
+	uint64_t	next_ns;	/* earliest next capture */
+	uint64_t	poll_ns;	/* next check for available data */
+};
+
+struct nvme_tmon {
+	/* set by the caller */
+	const char	*dir;
+	enum nvme_telemetry_da da;
+	unsigned int	min_interval;	/* seconds between captures */
+	bool		manifest;
+	struct nvme_tmon_ctrl *ctrl;
+	int		nr;
+
+	/* called after every capture attempt with its file, NULL if none */
+	void (*report)(struct nvme_tmon *m, struct nvme_tmon_ctrl *c,
+		       const char *path, uint64_t size, int err);
+	/* called with the device name (nvmeX) of a new controller */
+	void (*added)(struct nvme_tmon *m, const char *name);
+	void		*priv;
+};
+
+int nvme_tmon_ctrl_init(struct nvme_tmon_ctrl *c);
+
+/*
+ * Captures the controller-initiated log of @c if it holds data. Returns
+ * 0 without a capture if there is none, a negative errno or an NVMe
+ * status otherwise.
+ */
+int nvme_tmon_capture(struct nvme_tmon *m, struct nvme_tmon_ctrl *c);
+
+/* runs until interrupted, returns -EINTR then */
+int nvme_tmon_run(struct nvme_tmon *m);
+
+#endif /* _NVME_TELEMETRY_MONITOR_H */
@@ -0,0 +1,502 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include <ccan/endian/endian.h>
+#include <libnvme.h>
+
+#include "nvme-wait.h"
+#include "util/cleanup.h"
+#include "util/mem.h"
+#include "util/sighdl.h"
+
+#define NVME_WAIT_MIN_INTERVAL_MS	100
+#define NVME_WAIT_MAX_INTERVAL_MS	5000
+/* with uevents an AEN wakes us up, polling only has to catch lost events */
+#define NVME_WAIT_MAX_EVENT_INTERVAL_MS	30000
+#define NVME_WAIT_SHORT_SELF_TEST_MS	(2 * 60 * 1000)
+
+#define NSEC_PER_MSEC			1000000ULL
+
+#define NVME_WAIT_SYSFS_CTRL		"/sys/class/nvme"
+/* without uevents the namespaces are looked for at this interval */
+#define NVME_WAIT_NS_INTERVAL_MS	1000
+
+static uint64_t nvme_wait_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char *nvme_wait_op_str(enum nvme_wait_op op)
+{
+	switch (op) {
+	case NVME_WAIT_SELF_TEST:
+		return "self-test";
+	case NVME_WAIT_SANITIZE:
+		return "sanitize";
+	}
+
+	return "unknown";
+}
+
+/* nvmeX, nvmeXnY and ngXnY all map to controller instance X */
+static int nvme_wait_instance(const char *name)
+{
+	int instance;
+
+	if (sscanf(name, "nvme%d", &instance) == 1 ||
+	    sscanf(name, "ng%d", &instance) == 1)
+		return instance;
+
+	return -1;
+}
+
+int nvme_wait_init(struct nvme_wait *w, struct nvme_transport_handle *hdl,
+		   enum nvme_wait_op op)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	int err;
+
+	memset(w, 0, sizeof(*w));
+	w->hdl = hdl;
+	w->op = op;
+	w->instance = nvme_wait_instance(nvme_transport_handle_get_name(hdl));
+	w->interval_ms = NVME_WAIT_MIN_INTERVAL_MS;
+	w->start_ns = nvme_wait_now();
+	w->progress_ns = w->start_ns;
+
+	if (op != NVME_WAIT_SELF_TEST)
+		return 0;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(hdl, ctrl);
+	if (err)
+		return err;
+
+	/* EDSTT is in minutes, the short self-test is at most 2 minutes */
+	w->estimate_ns = le16_to_cpu(ctrl->edstt) * 60000ULL * NSEC_PER_MSEC;
+	w->stall_ms = (le16_to_cpu(ctrl->edstt) * 60 / 100 + 60) * 1000;
+
+	return 0;
+}
+
+static int nvme_wait_poll_self_test(struct nvme_wait *w)
+{
+	_cleanup_free_ struct nvme_self_test_log *log = NULL;
+	__u8 op;
+	int err;
+
+	log = nvme_alloc(sizeof(*log));
+	if (!log)
+		return -ENOMEM;
+
+	err = nvme_get_log_device_self_test(w->hdl, log);
+	if (err)
+		return err;
+
+	op = log->current_operation & NVME_ST_CURR_OP_MASK;
+	if (op == NVME_ST_CURR_OP_NOT_RUNNING) {
+		w->result = log->result[0].dsts & NVME_ST_RESULT_MASK;
+		w->progress = 100;
+		w->done = true;
+		return 0;
+	}
+
+	if (!w->seen_running && op == NVME_ST_CURR_OP_SHORT)
+		w->estimate_ns = NVME_WAIT_SHORT_SELF_TEST_MS * NSEC_PER_MSEC;
+	w->seen_running = true;
+	w->progress = log->completion & NVME_ST_CURR_OP_CMPL_MASK;
+
+	return 0;
+}
+
+static uint64_t nvme_wait_sanitize_estimate(struct nvme_sanitize_log_page *log)
+{
+	__u32 cdw10 = le32_to_cpu(log->scdw10);
+	bool nodas = cdw10 & (1 << 9);
+	__u32 est;
+
+	switch (cdw10 & 0x7) {
+	case NVME_SANITIZE_SANACT_START_BLOCK_ERASE:
+		est = le32_to_cpu(nodas ? log->etbend : log->etbe);
+		break;
+	case NVME_SANITIZE_SANACT_START_OVERWRITE:
+		est = le32_to_cpu(nodas ? log->etond : log->eto);
+		break;
+	case NVME_SANITIZE_SANACT_START_CRYPTO_ERASE:
+		est = le32_to_cpu(nodas ? log->etcend : log->etce);
+		break;
+	default:
+		return 0;
+	}
+
+	/* 0xffffffff means no estimate is reported */
+	if (est == 0xffffffff)
+		return 0;
+
+	return est * 1000ULL * NSEC_PER_MSEC;
+}
+
+static int nvme_wait_poll_sanitize(struct nvme_wait *w)
+{
+	_cleanup_free_ struct nvme_sanitize_log_page *log = NULL;
+	__u16 status;
+	int err;
+
+	log = nvme_alloc(sizeof(*log));
+	if (!log)
+		return -ENOMEM;
+
+	err = nvme_get_log_sanitize(w->hdl, false, log);
+	if (err)
+		return err;
+
+	status = (le16_to_cpu(log->sstat) >> NVME_SANITIZE_SSTAT_STATUS_SHIFT) &
+		NVME_SANITIZE_SSTAT_STATUS_MASK;
+	w->result = status;
+
+	switch (status) {
+	case NVME_SANITIZE_SSTAT_STATUS_IN_PROGESS:
+		if (!w->seen_running)
+			w->estimate_ns = nvme_wait_sanitize_estimate(log);
+		w->seen_running = true;
+		w->progress = le16_to_cpu(log->sprog) * 100 / 65536;
+		return 0;
+	case NVME_SANITIZE_SSTAT_STATUS_COMPLETED_FAILED:
+		w->err = -EIO;
+		break;
+	default:
+		w->progress = 100;
+		break;
+	}
+
+	w->done = true;
+	return 0;
+}
+
+/*
+ * Poll again after roughly a tenth of the expected remaining time. The
+ * remaining time is extrapolated from the progress made so far, or taken
+ * from the estimate reported by the controller before any progress shows.
+ */
+static void nvme_wait_schedule(struct nvme_wait *w, uint64_t now, bool uevents)
+{
+	uint64_t elapsed = now - w->start_ns;
+	unsigned int max = NVME_WAIT_MAX_INTERVAL_MS;
+	uint64_t remaining = 0;
+
+	if (uevents && w->op == NVME_WAIT_SANITIZE)
+		max = NVME_WAIT_MAX_EVENT_INTERVAL_MS;
+
+	if (w->progress > 0 && w->progress < 100)
+		remaining = elapsed * (100 - w->progress) / w->progress;
+	else if (w->estimate_ns > elapsed)
+		remaining = w->estimate_ns - elapsed;
+
+	if (remaining)
+		w->interval_ms = remaining / 10 / NSEC_PER_MSEC;
+	else
+		w->interval_ms *= 2;
+
+	if (w->interval_ms < NVME_WAIT_MIN_INTERVAL_MS)
+		w->interval_ms = NVME_WAIT_MIN_INTERVAL_MS;
+	else if (w->interval_ms > max)
+		w->interval_ms = max;
+
+	w->eta_ns = remaining;
+	w->next_poll_ns = now + w->interval_ms * NSEC_PER_MSEC;
+}
+
+static int nvme_wait_poll(struct nvme_wait *w, uint64_t now, bool uevents)
+{
+	int progress = w->progress;
+	int err;
+
+	w->polls++;
+	switch (w->op) {
+	case NVME_WAIT_SELF_TEST:
+		err = nvme_wait_poll_self_test(w);
+		break;
+	case NVME_WAIT_SANITIZE:
+		err = nvme_wait_poll_sanitize(w);
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+
+	if (err) {
+		w->err = err;
+		w->done = true;
+		return 1;
+	}
+
+	if (w->done)
+		return 1;
+
+	if (w->progress != progress)
+		w->progress_ns = now;
+	else if (w->stall_ms &&
+		 now - w->progress_ns > w->stall_ms * NSEC_PER_MSEC) {
+		w->err = -ETIMEDOUT;
+		w->done = true;
+		return 1;
+	}
+
+	nvme_wait_schedule(w, now, uevents);
+
+	return w->progress != progress;
+}
+
+int nvme_wait_uevent_open(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,		/* kernel uevents */
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -errno;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		int err = -errno;
+
+		close(fd);
+		return err;
+	}
+
+	return fd;
+}
+
+int nvme_wait_uevent_read(int ufd, nvme_wait_uevent_fn fn, void *arg)
+{
+	struct sockaddr_nl addr;
+	socklen_t addrlen;
+	char buf[8192];
+	ssize_t len;
+	int ret;
+
+	while (true) {
+		addrlen = sizeof(addr);
+		len = recvfrom(ufd, buf, sizeof(buf) - 1, 0,
+			       (struct sockaddr *)&addr, &addrlen);
+		if (len <= 0)
+			return 0;
+		/* only the kernel's own messages are trusted */
+		if (addr.nl_pid || !fn)
+			continue;
+		buf[len] = '\0';
+
+		ret = fn(buf, len, arg);
+		if (ret)
+			return ret;
+	}
+}
+
+struct nvme_wait_uevent_arg {
+	struct nvme_wait	*w;
+	int			nr;
+};
+
+/* a uevent for a controller or one of its namespaces triggers a poll */
+static int nvme_wait_uevent(const char *msg, size_t len, void *arg)
+{
+	struct nvme_wait_uevent_arg *a = arg;
+	const char *p;
+	int instance = -1, i;
+
+	for (p = msg; p < msg + len; p += strlen(p) + 1)
+		if (!strncmp(p, "DEVNAME=", 8))
+			instance = nvme_wait_instance(p + 8);
+	if (instance < 0)
+		return 0;
+
+	for (i = 0; i < a->nr; i++) {
+		if (a->w[i].done || a->w[i].instance != instance)
+			continue;
+		a->w[i].events++;
+		a->w[i].next_poll_ns = 0;
+	}
+
+	return 0;
+}
+
+int nvme_wait_all(struct nvme_wait *w, int nr, nvme_wait_progress_fn fn,
+		  void *arg)
+{
+	struct nvme_wait_uevent_arg ua = { .w = w, .nr = nr };
+	_cleanup_fd_ int ufd = -1;
+	struct pollfd pfd;
+	int i, ret;
+
+	ufd = nvme_wait_uevent_open();
+	pfd.fd = ufd;
+	pfd.events = POLLIN;
+
+	nvme_sigint_received = false;
+
+	while (true) {
+		uint64_t now = nvme_wait_now();
+		uint64_t next = UINT64_MAX;
+		int timeout;
+
+		for (i = 0; i < nr; i++) {
+			if (w[i].done)
+				continue;
+
+			if (w[i].next_poll_ns <= now &&
+			    nvme_wait_poll(&w[i], now, ufd >= 0)) {
+				ret = fn ? fn(&w[i], arg) : 0;
+				if (ret)
+					return ret;
+			}
+
+			if (!w[i].done && w[i].next_poll_ns < next)
+				next = w[i].next_poll_ns;
+		}
+
+		if (next == UINT64_MAX)
+			break;
+
+		now = nvme_wait_now();
+		timeout = next > now ? (next - now + NSEC_PER_MSEC - 1) /
+			NSEC_PER_MSEC : 0;
+
+		ret = poll(&pfd, ufd >= 0 ? 1 : 0, timeout);
+		if (nvme_sigint_received)
+			return -EINTR;
+		if (ret > 0)
+			nvme_wait_uevent_read(ufd, nvme_wait_uevent, &ua);
+	}
+
+	return 0;
+}
+
+/* reads the sysfs attribute @attr of the namespace @name of controller @ctrl */
+static long nvme_wait_ns_attr(const char *ctrl, const char *name,
+			      const char *attr)
+{
+	_cleanup_free_ char *path = NULL;
+	char buf[32] = { 0 };
+	FILE *f;
+	long val = -1;
+
+	if (asprintf(&path, NVME_WAIT_SYSFS_CTRL "/%s/%s/%s", ctrl, name,
+		     attr) < 0)
+		return -1;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fgets(buf, sizeof(buf), f))
+		val = strtol(buf, NULL, 0);
+	fclose(f);
+
+	return val;
+}
+
+/*
+ * The namespaces of a controller show up in its sysfs directory, as nvmeXnY
+ * or as the nvmeXcYnZ path of a multipath namespace.
+ */
+static int nvme_wait_ns_missing(const char *ctrl, const __u32 *nsids, int nr,
+				bool *found)
+{
+	_cleanup_free_ char *path = NULL;
+	struct dirent *d;
+	int missing = 0, i;
+	DIR *dir;
+	long nsid;
+
+	if (asprintf(&path, NVME_WAIT_SYSFS_CTRL "/%s", ctrl) < 0)
+		return -ENOMEM;
+
+	dir = opendir(path);
+	if (!dir)
+		return -errno;
+
+	while ((d = readdir(dir))) {
+		if (strncmp(d->d_name, "nvme", 4) || !strchr(d->d_name + 4, 'n'))
+			continue;
+
+		nsid = nvme_wait_ns_attr(ctrl, d->d_name, "nsid");
+		for (i = 0; nsid > 0 && i < nr; i++)
+			if (nsids[i] == nsid)
+				found[i] = true;
+	}
+	closedir(dir);
+
+	for (i = 0; i < nr; i++)
+		if (!found[i])
+			missing++;
+
+	return missing;
+}
+
+int nvme_wait_namespaces(int ufd, const char *ctrl, const __u32 *nsids,
+			 int nr, unsigned int timeout_ms)
+{
+	_cleanup_free_ bool *found = NULL;
+	uint64_t end = nvme_wait_now() + timeout_ms * NSEC_PER_MSEC;
+	struct pollfd pfd = { .fd = ufd, .events = POLLIN };
+	uint64_t now;
+	int missing, timeout;
+
+	found = calloc(nr, sizeof(*found));
+	if (!found)
+		return -ENOMEM;
+
+	nvme_sigint_received = false;
+
+	while ((missing = nvme_wait_ns_missing(ctrl, nsids, nr, found)) > 0) {
+		now = nvme_wait_now();
+		if (now >= end)
+			return -ETIMEDOUT;
+
+		timeout = (end - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC;
+		if (ufd < 0 && timeout > NVME_WAIT_NS_INTERVAL_MS)
+			timeout = NVME_WAIT_NS_INTERVAL_MS;
+
+		poll(&pfd, ufd >= 0 ? 1 : 0, timeout);
+		if (nvme_sigint_received)
+			return -EINTR;
+
+		/* any uevent may be the one, the sysfs state tells */
+		nvme_wait_uevent_read(ufd, NULL, NULL);
+	}
+
+	return missing;
+}
+
+int nvme_wait_countdown(unsigned int seconds)
+{
+	uint64_t end = nvme_wait_now() + seconds * 1000ULL * NSEC_PER_MSEC;
+	uint64_t now;
+
+	nvme_sigint_received = false;
+
+	while ((now = nvme_wait_now()) < end) {
+		poll(NULL, 0, (end - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+		if (nvme_sigint_received)
+			return -EINTR;
+	}
+
+	return 0;
+}
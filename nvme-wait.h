@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _NVME_WAIT_H
+#define _NVME_WAIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libnvme.h>
+
+/*
+ * Completion wait engine for long running background operations.
+ *
+ * Any number of operations on any number of controllers can be waited on
+ * from one thread. The status log of each operation is polled with an
+ * interval derived from the observed progress rate, and a kernel uevent
+ * for the controller (NVME_AEN, namespace rescan) triggers an immediate
+ * poll. Without access to the uevent socket only polling is used.
+ */
+
+enum nvme_wait_op {
+	NVME_WAIT_SELF_TEST,
+	NVME_WAIT_SANITIZE,
+};
+
+struct nvme_wait {
+	/* set by the caller */
+	struct nvme_transport_handle *hdl;
+	enum nvme_wait_op op;
+	unsigned int stall_ms;		/* give up without progress, 0 never */
+
+	/* updated by the engine */
+	bool done;
+	int err;			/* 0, NVMe status or negative errno */
+	int progress;			/* percent */
+	unsigned int result;		/* self-test result or sanitize status */
+	uint64_t start_ns;
+	uint64_t eta_ns;		/* estimated time left, 0 unknown */
+	unsigned int polls;
+	unsigned int events;
+
+	/* engine internal */
+	int instance;
+	bool seen_running;
+	unsigned int interval_ms;
+	uint64_t next_poll_ns;
+	uint64_t progress_ns;
+	uint64_t estimate_ns;
+};
+
+/*
+ * Called after every poll whose progress changed and once when an
+ * operation finished. Returning non zero stops waiting.
+ */
+typedef int (*nvme_wait_progress_fn)(struct nvme_wait *w, void *arg);
+
+int nvme_wait_init(struct nvme_wait *w, struct nvme_transport_handle *hdl,
+		   enum nvme_wait_op op);
+int nvme_wait_all(struct nvme_wait *w, int nr, nvme_wait_progress_fn fn,
+		  void *arg);
+const char *nvme_wait_op_str(enum nvme_wait_op op);
+int nvme_wait_countdown(unsigned int seconds);
+
+/*
+ * Opens a non-blocking NETLINK_KOBJECT_UEVENT socket listening to the
+ * kernel uevents. Returns the socket or a negative errno.
+ */
+int nvme_wait_uevent_open(void);
+
+/*
+ * Waits up to @timeout_ms for the namespaces @nsids to show up on the
+ * controller @ctrl (nvmeX), checking its sysfs directory again on every
+ * uevent. @ufd comes from nvme_wait_uevent_open(), called before the
+ * namespace scan is triggered so that no event is missed; with a negative
+ * @ufd the directory is checked periodically. Returns 0 once all of them
+ * are present.
+ */
+int nvme_wait_namespaces(int ufd, const char *ctrl, const __u32 *nsids,
+			 int nr, unsigned int timeout_ms);
+
+/*
+ * Reads the kernel uevents queued on @ufd and calls @fn for each of them,
+ * with @msg holding its NUL separated "KEY=value" strings. Returns once
+ * the socket is drained, or the non zero return of @fn. Without @fn the
+ * events are only drained.
+ */
+typedef int (*nvme_wait_uevent_fn)(const char *msg, size_t len, void *arg);
+
+int nvme_wait_uevent_read(int ufd, nvme_wait_uevent_fn fn, void *arg);
+
+#endif /* _NVME_WAIT_H */
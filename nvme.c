@@ -56,14 +56,23 @@
 
 #include "common.h"
 #include "nvme.h"
+#include "nvme-capture.h"
+#include "nvme-fw-rollout.h"
+#include "nvme-ioq.h"
 #include "nvme-print.h"
+#include "nvme-scrub.h"
+#include "nvme-telemetry-diff.h"
+#include "nvme-telemetry-monitor.h"
+#include "nvme-wait.h"
 #include "plugin.h"
 #include "util/base64.h"
 #include "util/crc32.h"
+#include "util/extent.h"
 #include "util/argconfig.h"
 #include "util/suffix.h"
 #include "logging.h"
 #include "util/sighdl.h"
+#include "util/statefile.h"
 #include "fabrics.h"
 #define CREATE_CMD
 #include "nvme-builtin.h"
@@ -222,12 +231,15 @@ static const char *namespace_id_desired = "identifier of desired namespace";
 static const char *namespace_id_optional = "optional namespace attached to controller";
 static const char *nssf = "NVMe Security Specific Field";
 static const char *prinfo = "PI and check field";
+static const char *queue_depth = "number of commands kept in flight";
 static const char *rae = "Retain an Asynchronous Event";
 static const char *raw_directive = "show directive in binary format";
 static const char *raw_dump = "dump output in binary format";
 static const char *raw_identify = "show identify in binary format";
 static const char *raw_log = "show log in binary format";
 static const char *raw_output = "output in binary format";
+static const char *range_file = "file with one range per line (start and count), filefrag -v output or binary records";
+static const char *range_unit = "unit of the range file in bytes, logical blocks if not set";
 static const char *ref_tag = "reference tag for end-to-end PI";
 static const char *raw_use = "use binary output";
 static const char *rtype = "reservation type";
@@ -376,6 +388,14 @@ static int parse_args(int argc, char *argv[], const char *desc,
 	return 0;
 }
 
+static void set_transport_handle_hooks(struct nvme_transport_handle *hdl)
+{
+	nvme_transport_handle_set_submit_entry(hdl, nvme_submit_entry);
+	nvme_transport_handle_set_submit_exit(hdl, nvme_submit_exit);
+	nvme_transport_handle_set_decide_retry(hdl, nvme_decide_retry);
+	nvme_set_retry_policy(hdl);
+}
+
 int parse_and_open(struct nvme_global_ctx **ctx,
 		   struct nvme_transport_handle **hdl, int argc, char **argv,
 		   const char *desc, struct argconfig_commandline_options *opts)
@@ -399,9 +419,7 @@ int parse_and_open(struct nvme_global_ctx **ctx,
 		return -ENXIO;
 	}
 
-	nvme_transport_handle_set_submit_entry(hdl_new, nvme_submit_entry);
-	nvme_transport_handle_set_submit_exit(hdl_new , nvme_submit_exit);
-	nvme_transport_handle_set_decide_retry(hdl_new, nvme_decide_retry);
+	set_transport_handle_hooks(hdl_new);
 	nvme_set_dry_run(ctx_new, argconfig_parse_seen(opts, "dry-run"));
 
 	*ctx = ctx_new;
@@ -431,6 +449,8 @@ int open_exclusive(struct nvme_global_ctx **ctx,
 		return -ENXIO;
 	}
 
+	set_transport_handle_hooks(hdl_new);
+
 	*ctx = ctx_new;
 	*hdl = hdl_new;
 	return 0;
@@ -837,16 +857,16 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 	const char *dgen = "Pick which telemetry data area to report. Default is 3 to fetch areas 1-3. Valid options are 1, 2, 3, 4.";
 	const char *mcda = "Host-init Maximum Created Data Area. Valid options are 0 ~ 4 "
 		"If given, This option will override dgen. 0 : controller determines data area";
+	const char *manifest = "Also write a block hash manifest to <output-file>.blocks";
 
 	_cleanup_free_ struct nvme_telemetry_log *log = NULL;
 	_cleanup_free_ struct nvme_id_ctrl *id_ctrl = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	_cleanup_fd_ int output = -1;
-	int err = 0;
+	struct nvme_capture_file output;
+	unsigned int output_flags;
+	int err = 0, ret;
 	size_t total_size = 0;
-	__u8 *data_ptr = NULL;
-	int data_written = 0, data_remaining = 0;
 	nvme_print_flags_t flags;
 	bool da4_support = false,
 	host_behavior_changed = false;
@@ -858,6 +878,7 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 		int	data_area;
 		bool	rae;
 		__u8	mcda;
+		bool	manifest;
 	};
 	struct config cfg = {
 		.file_name	= NULL,
@@ -866,6 +887,7 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 		.data_area	= 3,
 		.rae		= false,
 		.mcda		= 0xff,
+		.manifest	= false,
 	};
 
 	NVME_ARGS(opts,
@@ -874,7 +896,8 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 		  OPT_FLAG("controller-init", 'c', &cfg.ctrl_init, cgen),
 		  OPT_UINT("data-area",       'd', &cfg.data_area, dgen),
 		  OPT_FLAG("rae",             'r', &cfg.rae,       rae),
-		  OPT_BYTE("mcda",            'm', &cfg.mcda,      mcda));
+		  OPT_BYTE("mcda",            'm', &cfg.mcda,      mcda),
+		  OPT_FLAG("manifest",          0, &cfg.manifest,  manifest));
 
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
@@ -928,16 +951,22 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 		}
 	}
 
-	output = open(cfg.file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	/* the unused, zero filled parts of the data areas are left as holes */
+	output_flags = NVME_CAPTURE_SPARSE | NVME_CAPTURE_SYNC;
+	if (cfg.manifest)
+		output_flags |= NVME_CAPTURE_MANIFEST;
+	err = nvme_capture_file_open(&output, cfg.file_name, output_flags);
+	if (err) {
 		nvme_show_error("Failed to open output file %s: %s!",
-				cfg.file_name, strerror(errno));
-		return output;
+				cfg.file_name, strerror(-err));
+		return err;
 	}
 
 	log = nvme_alloc(sizeof(*log));
-	if (!log)
+	if (!log) {
+		nvme_capture_file_close(&output);
 		return -ENOMEM;
+	}
 
 	if (cfg.ctrl_init)
 		err = __get_telemetry_log_ctrl(hdl, cfg.rae, cfg.data_area,
@@ -950,6 +979,7 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 					       &total_size, &log, da4_support);
 
 	if (err) {
+		nvme_capture_file_close(&output);
 		nvme_show_err("get-telemetry-log", err);
 		if (err > 0)
 			fprintf(stderr, "Failed to acquire telemetry log %d!\n",
@@ -957,32 +987,12 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 		return err;
 	}
 
-	data_written = 0;
-	data_remaining = total_size;
-	data_ptr = (__u8 *)log;
-
-	while (data_remaining) {
-		data_written = write(output, data_ptr, data_remaining);
-		if (data_written < 0) {
-			err = -errno;
-			nvme_show_error("ERROR: %s: : write failed with error : %s",
-					__func__, strerror(errno));
-			break;
-		} else if (data_written <= data_remaining) {
-			data_remaining -= data_written;
-			data_ptr += data_written;
-		} else {
-			/* Unexpected overwrite */
-			fprintf(stderr, "Failure: Unexpected telemetry log overwrite - data_remaining = 0x%x, data_written = 0x%x\n",
-					data_remaining, data_written);
-			err = -1;
-			break;
-		}
-	}
-
-	if (fsync(output) < 0) {
-		nvme_show_error("ERROR : %s: : fsync : %s", __func__, strerror(errno));
-		return -1;
+	err = nvme_capture_file_write(&output, log, total_size);
+	ret = nvme_capture_file_close(&output);
+	if (err || ret) {
+		nvme_show_error("ERROR: %s: : write failed with error : %s",
+				__func__, strerror(-(err ? err : ret)));
+		return err ? err : ret;
 	}
 
 	if (host_behavior_changed) {
@@ -997,6 +1007,344 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd,
 	return err;
 }
 
+static int telemetry_diff(int argc, char **argv, struct command *acmd,
+			  struct plugin *plugin)
+{
+	const char *desc = "Compare two telemetry log captures of a device, e.g. taken\n"
+		"before and after an incident, without decoding them: shows the\n"
+		"header changes and the changed regions of the data areas present\n"
+		"in both.";
+	const char *block_size = "granularity of the changed regions in bytes, default 512";
+
+	struct nvme_tdiff d = { 0 };
+	nvme_print_flags_t flags;
+	int err;
+
+	struct config {
+		__u32	block_size;
+	};
+	struct config cfg = {
+		.block_size	= NVME_TDIFF_DEFAULT_BLOCK,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("block-size", 'b', &cfg.block_size, block_size));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(nvme_cfg.output_format, &flags);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (argc - optind != 2) {
+		nvme_show_error("Please provide the two telemetry log files to compare");
+		return -EINVAL;
+	}
+
+	if (!cfg.block_size) {
+		nvme_show_error("Invalid block size");
+		return -EINVAL;
+	}
+
+	err = nvme_tdiff_open(&d, argv[optind], argv[optind + 1]);
+	if (err)
+		return err;
+
+	d.block = cfg.block_size;
+	err = nvme_tdiff_compare(&d);
+	if (err)
+		nvme_show_error("telemetry-diff: %s", strerror(-err));
+	else
+		nvme_tdiff_show(&d, flags == JSON);
+
+	nvme_tdiff_close(&d);
+	return err;
+}
+
+static void telemetry_monitor_report(struct nvme_tmon *m, struct nvme_tmon_ctrl *c,
+				     const char *path, uint64_t size, int err)
+{
+	if (err) {
+		nvme_show_err(c->name, err);
+		return;
+	}
+
+	printf("%s: %s: captured %" PRIu64 " bytes to %s\n", c->name, c->sn,
+	       size, path);
+	fflush(stdout);
+}
+
+/* the names of all controllers if none were given */
+static int telemetry_monitor_ctrls(struct nvme_global_ctx *ctx, char ***names)
+{
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	nvme_host_t h;
+	char **n;
+	int err, nr = 0;
+
+	*names = NULL;
+	err = nvme_scan_topology(ctx, NULL, NULL);
+	if (err < 0)
+		return err;
+
+	nvme_for_each_host(ctx, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c) {
+				n = realloc(*names, (nr + 1) * sizeof(*n));
+				if (!n)
+					return -ENOMEM;
+				*names = n;
+				n[nr++] = (char *)nvme_ctrl_get_name(c);
+			}
+
+	return nr;
+}
+
+struct telemetry_monitor_state {
+	struct nvme_global_ctx	*ctx;
+	__u32			data_area;
+	bool			*etdas;
+	bool			all;	/* new controllers are watched too */
+};
+
+/* a controller which was just added may still be resetting */
+#define TELEMETRY_MONITOR_OPEN_TRIES	10
+#define TELEMETRY_MONITOR_OPEN_DELAY_MS	500
+
+static int telemetry_monitor_open(struct nvme_tmon *m, int i, bool retry)
+{
+	struct telemetry_monitor_state *t = m->priv;
+	struct nvme_tmon_ctrl *c = &m->ctrl[i];
+	int err, tries = retry ? TELEMETRY_MONITOR_OPEN_TRIES : 1;
+
+	t->etdas[i] = false;
+	while (true) {
+		c->hdl = NULL;
+		err = nvme_open(t->ctx, c->name, &c->hdl);
+		if (!err) {
+			set_transport_handle_hooks(c->hdl);
+			err = nvme_tmon_ctrl_init(c);
+		}
+		if (!err)
+			break;
+		if (c->hdl)
+			nvme_close(c->hdl);
+		c->hdl = NULL;
+		if (--tries <= 0 || err == -EOPNOTSUPP || nvme_sigint_received)
+			break;
+		usleep(TELEMETRY_MONITOR_OPEN_DELAY_MS * 1000);
+	}
+
+	if (err) {
+		/* a controller without telemetry is not watched */
+		if (err == -EOPNOTSUPP)
+			fprintf(stderr, "%s: no telemetry support\n", c->name);
+		else
+			nvme_show_err(c->name, err);
+		return err;
+	}
+
+	/* data area 4 is only reported with ETDAS set */
+	if (t->data_area == 4 && c->da4 && nvme_set_etdas(c->hdl, &t->etdas[i]))
+		fprintf(stderr, "%s: Failed to set ETDAS bit\n", c->name);
+
+	return 0;
+}
+
+static int telemetry_monitor_add(struct nvme_tmon *m, const char *name,
+				 bool retry)
+{
+	struct telemetry_monitor_state *t = m->priv;
+	struct nvme_tmon_ctrl *ctrl;
+	bool *etdas;
+	int err;
+
+	ctrl = realloc(m->ctrl, (m->nr + 1) * sizeof(*ctrl));
+	if (!ctrl)
+		return -ENOMEM;
+	m->ctrl = ctrl;
+	etdas = realloc(t->etdas, (m->nr + 1) * sizeof(*etdas));
+	if (!etdas)
+		return -ENOMEM;
+	t->etdas = etdas;
+
+	memset(&m->ctrl[m->nr], 0, sizeof(*ctrl));
+	m->ctrl[m->nr].name = strdup(name);
+	if (!m->ctrl[m->nr].name)
+		return -ENOMEM;
+
+	err = telemetry_monitor_open(m, m->nr, retry);
+	if (err) {
+		free((char *)m->ctrl[m->nr].name);
+		return err;
+	}
+	m->nr++;
+
+	return 0;
+}
+
+/*
+ * A controller which reconnected under a name already watched is opened
+ * again, its old handle is gone. Any other is added if all are watched.
+ */
+static void telemetry_monitor_added(struct nvme_tmon *m, const char *name)
+{
+	struct telemetry_monitor_state *t = m->priv;
+	struct nvme_tmon_ctrl *c;
+	int i;
+
+	for (i = 0; i < m->nr; i++)
+		if (!strcmp(m->ctrl[i].name, name))
+			break;
+
+	if (i == m->nr) {
+		if (!t->all || telemetry_monitor_add(m, name, true))
+			return;
+		printf("%s: %s: watching for telemetry\n", name,
+		       m->ctrl[m->nr - 1].sn);
+		fflush(stdout);
+		return;
+	}
+
+	c = &m->ctrl[i];
+	nvme_close(c->hdl);
+	if (!telemetry_monitor_open(m, i, true)) {
+		printf("%s: %s: reconnected\n", c->name, c->sn);
+		fflush(stdout);
+		return;
+	}
+
+	/* the controller is gone for good, stop watching it */
+	free((char *)c->name);
+	memmove(c, c + 1, (m->nr - i - 1) * sizeof(*c));
+	memmove(&t->etdas[i], &t->etdas[i + 1],
+		(m->nr - i - 1) * sizeof(*t->etdas));
+	m->nr--;
+}
+
+static int telemetry_monitor(int argc, char **argv, struct command *acmd,
+			     struct plugin *plugin)
+{
+	const char *desc = "Watch controllers for controller-initiated telemetry\n"
+		"and capture the log as soon as a controller reports new data, with\n"
+		"its serial number, firmware, time and reason identifier. Watches\n"
+		"all controllers if none are given, including those added while\n"
+		"running, runs until interrupted.";
+	const char *dir = "directory to store the captures in";
+	const char *dgen = "data areas to capture, 1 to 4, default 3";
+	const char *min_interval = "seconds between two captures of a controller, default 3600";
+	const char *manifest = "also write a block hash manifest of every capture";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_free_ char **names = NULL;
+	struct telemetry_monitor_state t = { 0 };
+	struct nvme_tmon m = { 0 };
+	int err, i, nr;
+
+	struct config {
+		char	*dir;
+		__u32	data_area;
+		__u32	min_interval;
+		bool	manifest;
+	};
+	struct config cfg = {
+		.dir		= NULL,
+		.data_area	= 3,
+		.min_interval	= 3600,
+		.manifest	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FILE("output-dir",    'O', &cfg.dir,          dir),
+		  OPT_UINT("data-area",     'd', &cfg.data_area,    dgen),
+		  OPT_UINT("min-interval",  'i', &cfg.min_interval, min_interval),
+		  OPT_FLAG("manifest",        0, &cfg.manifest,     manifest));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	if (!cfg.dir) {
+		nvme_show_error("Please provide an output directory!");
+		return -EINVAL;
+	}
+	if (cfg.data_area < 1 || cfg.data_area > 4) {
+		nvme_show_error("Invalid data area %u", cfg.data_area);
+		return -EINVAL;
+	}
+
+	ctx = nvme_create_global_ctx(stdout, log_level);
+	if (!ctx)
+		return -ENOMEM;
+
+	nr = argc - optind;
+	if (!nr) {
+		nr = telemetry_monitor_ctrls(ctx, &names);
+		if (nr < 0) {
+			nvme_show_error("Failed to scan topology: %s", nvme_strerror(-nr));
+			return nr;
+		}
+		t.all = true;
+	}
+	if (!nr) {
+		nvme_show_error("no controllers found");
+		return -ENODEV;
+	}
+
+	t.ctx = ctx;
+	t.data_area = cfg.data_area;
+	m.priv = &t;
+
+	for (i = 0; i < nr; i++) {
+		err = telemetry_monitor_add(&m, names ? names[i] : argv[optind + i],
+					    false);
+		if (err == -ENOMEM)
+			goto close;
+	}
+
+	if (!m.nr) {
+		err = -ENODEV;
+		goto close;
+	}
+
+	m.dir = cfg.dir;
+	m.da = cfg.data_area;
+	m.min_interval = cfg.min_interval;
+	m.manifest = cfg.manifest;
+	m.report = telemetry_monitor_report;
+	m.added = telemetry_monitor_added;
+
+	printf("watching %d controllers for telemetry\n", m.nr);
+	fflush(stdout);
+
+	err = nvme_tmon_run(&m);
+	if (err == -EINTR)
+		err = 0;
+
+	for (i = 0; i < m.nr; i++)
+		printf("%s: %u captures, %u notices, %u failures\n", m.ctrl[i].name,
+		       m.ctrl[i].captures, m.ctrl[i].events, m.ctrl[i].failures);
+
+close:
+	for (i = 0; i < m.nr; i++) {
+		bool changed;
+
+		if (t.etdas[i])
+			nvme_clear_etdas(m.ctrl[i].hdl, &changed);
+		nvme_close(m.ctrl[i].hdl);
+		free((char *)m.ctrl[i].name);
+	}
+	free(m.ctrl);
+	free(t.etdas);
+
+	return err;
+}
+
 static int get_endurance_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Retrieves endurance groups log page and prints the log.";
@@ -1204,86 +1552,367 @@ static int get_supported_log_pages(int argc, char **argv, struct command *acmd,
 	return err;
 }
 
-static int get_error_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+/* serial number without the space padding, "-" if there is none */
+static void nvme_ctrl_sn(struct nvme_id_ctrl *ctrl, char *sn)
 {
-	const char *desc = "Retrieve specified number of "
-		"error log entries from a given device "
-		"in either decoded format (default) or binary.";
-	const char *log_entries = "number of entries to retrieve";
-	const char *raw = "dump in binary format";
+	int len = sizeof(ctrl->sn);
 
-	_cleanup_free_ struct nvme_error_log_page *err_log = NULL;
-	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
-	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	struct nvme_id_ctrl ctrl = { 0 };
-	nvme_print_flags_t flags;
-	int err = -1;
+	while (len && (ctrl->sn[len - 1] == ' ' || !ctrl->sn[len - 1]))
+		len--;
+	memcpy(sn, ctrl->sn, len);
+	sn[len] = '\0';
 
-	struct config {
-		__u32	log_entries;
-		bool	raw_binary;
-	};
+	if (!len)
+		strcpy(sn, "-");
+}
 
-	struct config cfg = {
-		.log_entries	= 64,
-		.raw_binary	= false,
-	};
+#define ERR_STATE_MAGIC		"nvme-error-log 2"
 
-	NVME_ARGS(opts,
-		  OPT_UINT("log-entries",  'e', &cfg.log_entries,   log_entries),
-		  OPT_FLAG("raw-binary",   'b', &cfg.raw_binary,    raw));
+/* the highest error count reported for a controller */
+struct err_state {
+	char	sn[21];
+	__u16	cntlid;
+	__u64	count;
+};
 
-	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
-	if (err)
-		return err;
+struct err_watch {
+	struct nvme_transport_handle *hdl;
+	const char	*state_file;
+	struct err_state *st;
+	int		nr;
+	int		idx;
+	__u32		max;		/* ELPE + 1 */
+	__u32		first;		/* entries reported without a checkpoint */
+	nvme_print_flags_t flags;
+};
 
-	err = validate_output_format(nvme_cfg.output_format, &flags);
-	if (err < 0) {
-		nvme_show_error("Invalid output format");
-		return err;
-	}
+/* "<serial>\t<cntlid>\t<count>", the serial number may contain spaces */
+static int err_state_parse(char *line, struct err_state *e)
+{
+	unsigned long cntlid;
+	char *p, *end;
 
-	if (cfg.raw_binary)
-		flags = BINARY;
+	p = strchr(line, '\t');
+	if (!p || p == line || p - line >= sizeof(e->sn))
+		return -EBADMSG;
+	memcpy(e->sn, line, p - line);
+	e->sn[p - line] = '\0';
 
-	if (!cfg.log_entries) {
-		nvme_show_error("non-zero log-entries is required param");
-		return -1;
-	}
+	errno = 0;
+	cntlid = strtoul(++p, &end, 10);
+	if (end == p || *end != '\t' || cntlid > UINT16_MAX)
+		return -EBADMSG;
+	e->cntlid = cntlid;
 
-	err = nvme_identify_ctrl(hdl, &ctrl);
-	if (err < 0) {
-		nvme_show_perror("identify controller");
-		return err;
-	} else if (err) {
-		nvme_show_error("could not identify controller");
-		return err;
-	}
+	p = end + 1;
+	e->count = strtoull(p, &end, 10);
+	if (end == p || *end != '\n' || errno)
+		return -EBADMSG;
 
-	cfg.log_entries = min(cfg.log_entries, ctrl.elpe + 1);
-	err_log = nvme_alloc(cfg.log_entries * sizeof(struct nvme_error_log_page));
-	if (!err_log)
-		return -ENOMEM;
+	return 0;
+}
 
-	err = nvme_get_log_error(hdl, NVME_NSID_ALL, cfg.log_entries, err_log);
-	if (err) {
-		nvme_show_err("error log", err);
-		return err;
+static int err_state_load(struct err_watch *w)
+{
+	struct err_state e, *st;
+	char line[64];
+	FILE *f;
+	int err = 0;
+
+	f = fopen(w->state_file, "r");
+	if (!f)
+		return errno == ENOENT ? 0 : -errno;
+
+	if (!fgets(line, sizeof(line), f) ||
+	    strncmp(line, ERR_STATE_MAGIC, strlen(ERR_STATE_MAGIC))) {
+		err = -EBADMSG;
+		goto out;
 	}
 
-	nvme_show_error_log(err_log, cfg.log_entries,
-			    nvme_transport_handle_get_name(hdl), flags);
+	while (fgets(line, sizeof(line), f)) {
+		err = err_state_parse(line, &e);
+		if (err)
+			goto out;
 
+		st = realloc(w->st, (w->nr + 1) * sizeof(*st));
+		if (!st) {
+			err = -ENOMEM;
+			goto out;
+		}
+		w->st = st;
+		w->st[w->nr++] = e;
+	}
+out:
+	fclose(f);
 	return err;
 }
 
-static int get_fw_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+static int err_state_save(struct err_watch *w)
 {
-	const char *desc = "Retrieve the firmware log for the "
-		"specified device in either decoded format (default) or binary.";
+	_cleanup_free_ char *buf = NULL;
+	size_t len;
+	FILE *f;
+	int i;
 
-	_cleanup_free_ struct nvme_firmware_slot *fw_log = NULL;
-	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -errno;
+
+	fprintf(f, ERR_STATE_MAGIC "\n");
+	for (i = 0; i < w->nr; i++)
+		fprintf(f, "%s\t%u\t%llu\n", w->st[i].sn, w->st[i].cntlid,
+			(unsigned long long)w->st[i].count);
+
+	if (fclose(f))
+		return -errno;
+
+	return nvme_state_file_write(w->state_file, buf, len);
+}
+
+/* looks up the checkpoint of the controller, adding it if it is new */
+static int err_state_find(struct err_watch *w, struct nvme_id_ctrl *ctrl,
+			  bool *found)
+{
+	struct err_state *st;
+	char sn[sizeof(st->sn)];
+	int i;
+
+	nvme_ctrl_sn(ctrl, sn);
+	for (i = 0; i < w->nr; i++) {
+		if (!strcmp(w->st[i].sn, sn) &&
+		    w->st[i].cntlid == le16_to_cpu(ctrl->cntlid)) {
+			w->idx = i;
+			*found = true;
+			return 0;
+		}
+	}
+
+	st = realloc(w->st, (w->nr + 1) * sizeof(*st));
+	if (!st)
+		return -ENOMEM;
+	w->st = st;
+	w->idx = w->nr++;
+	strcpy(st[w->idx].sn, sn);
+	st[w->idx].cntlid = le16_to_cpu(ctrl->cntlid);
+	st[w->idx].count = 0;
+	*found = false;
+
+	return 0;
+}
+
+/*
+ * Reports the entries with an error count above the checkpoint. The newest
+ * entry comes first, so its error count tells how many entries are needed
+ * to cover the gap and only those are read. Entries which arrive meanwhile
+ * widen the gap and the read is repeated. If the gap is larger than what
+ * the log could hold the missing entries are reported as lost.
+ */
+static int err_watch_poll(struct err_watch *w, bool checkpoint)
+{
+	_cleanup_free_ struct nvme_error_log_page *log = NULL;
+	const char *devname = nvme_transport_handle_get_name(w->hdl);
+	struct err_state *st = &w->st[w->idx];
+	__u32 need = 1, want, n;
+	__u64 count, gap;
+	int err;
+
+	log = nvme_alloc(w->max * sizeof(*log));
+	if (!log)
+		return -ENOMEM;
+
+	while (true) {
+		err = nvme_get_log_error(w->hdl, NVME_NSID_ALL, need, log);
+		if (err)
+			return err;
+
+		count = le64_to_cpu(log[0].error_count);
+		if (count < st->count) {
+			fprintf(stderr, "%s: error count went back from %llu to %llu\n",
+				devname, (unsigned long long)st->count,
+				(unsigned long long)count);
+			st->count = 0;
+			checkpoint = false;
+		}
+
+		gap = count - st->count;
+		want = min(gap, checkpoint ? w->max : w->first);
+		if (want <= need)
+			break;
+		need = want;
+	}
+
+	for (n = 0; n < need && n < gap; n++) {
+		if (le64_to_cpu(log[n].error_count) <= st->count)
+			break;
+	}
+
+	if (checkpoint && gap > n)
+		fprintf(stderr, "%s: %llu error log entries lost\n", devname,
+			(unsigned long long)(gap - n));
+
+	if (n)
+		nvme_show_error_log(log, n, devname, w->flags);
+
+	st->count = count;
+
+	return 0;
+}
+
+static int err_watch_run(struct err_watch *w, struct nvme_id_ctrl *ctrl,
+			 unsigned int interval)
+{
+	bool checkpoint = false;
+	int err;
+
+	if (w->state_file) {
+		err = err_state_load(w);
+		if (err == -EBADMSG) {
+			nvme_show_error("state file %s is not an error log checkpoint, remove it to start over",
+					w->state_file);
+			return err;
+		}
+		if (err) {
+			nvme_show_error("state file %s: %s", w->state_file,
+					strerror(-err));
+			return err;
+		}
+	}
+
+	err = err_state_find(w, ctrl, &checkpoint);
+	if (err)
+		return err;
+
+	while (true) {
+		err = err_watch_poll(w, checkpoint);
+		if (err) {
+			nvme_show_err("error log", err);
+			return err;
+		}
+		checkpoint = true;
+
+		if (w->state_file) {
+			err = err_state_save(w);
+			if (err) {
+				nvme_show_error("state file %s: %s",
+						w->state_file, strerror(-err));
+				return err;
+			}
+		}
+
+		if (!interval)
+			return 0;
+
+		fflush(stdout);
+		if (nvme_wait_countdown(interval))
+			return 0;
+	}
+}
+
+static int get_error_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Retrieve specified number of "
+		"error log entries from a given device "
+		"in either decoded format (default) or binary.";
+	const char *log_entries = "number of entries to retrieve";
+	const char *raw = "dump in binary format";
+	const char *state_file = "report only the entries added since the "
+		"checkpoint in this file and update it";
+	const char *watch = "poll the log every <seconds> and report new entries";
+
+	_cleanup_free_ struct nvme_error_log_page *err_log = NULL;
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	struct nvme_id_ctrl ctrl = { 0 };
+	nvme_print_flags_t flags;
+	int err = -1;
+
+	struct config {
+		__u32	log_entries;
+		bool	raw_binary;
+		char	*state_file;
+		__u32	watch;
+	};
+
+	struct config cfg = {
+		.log_entries	= 64,
+		.raw_binary	= false,
+		.state_file	= "",
+		.watch		= 0,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("log-entries",  'e', &cfg.log_entries,   log_entries),
+		  OPT_FLAG("raw-binary",   'b', &cfg.raw_binary,    raw),
+		  OPT_FILE("state-file",   'S', &cfg.state_file,    state_file),
+		  OPT_UINT("watch",        'w', &cfg.watch,         watch));
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(nvme_cfg.output_format, &flags);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (cfg.raw_binary)
+		flags = BINARY;
+
+	if (!cfg.log_entries) {
+		nvme_show_error("non-zero log-entries is required param");
+		return -1;
+	}
+
+	err = nvme_identify_ctrl(hdl, &ctrl);
+	if (err < 0) {
+		nvme_show_perror("identify controller");
+		return err;
+	} else if (err) {
+		nvme_show_error("could not identify controller");
+		return err;
+	}
+
+	cfg.log_entries = min(cfg.log_entries, ctrl.elpe + 1);
+
+	if (strlen(cfg.state_file) || cfg.watch) {
+		struct err_watch w = {
+			.hdl		= hdl,
+			.state_file	= strlen(cfg.state_file) ?
+					  cfg.state_file : NULL,
+			.max		= ctrl.elpe + 1,
+			.first		= cfg.log_entries,
+			.flags		= flags,
+		};
+
+		err = err_watch_run(&w, &ctrl, cfg.watch);
+		free(w.st);
+		return err;
+	}
+
+	err_log = nvme_alloc(cfg.log_entries * sizeof(struct nvme_error_log_page));
+	if (!err_log)
+		return -ENOMEM;
+
+	err = nvme_get_log_error(hdl, NVME_NSID_ALL, cfg.log_entries, err_log);
+	if (err) {
+		nvme_show_err("error log", err);
+		return err;
+	}
+
+	nvme_show_error_log(err_log, cfg.log_entries,
+			    nvme_transport_handle_get_name(hdl), flags);
+
+	return err;
+}
+
+static int get_fw_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Retrieve the firmware log for the "
+		"specified device in either decoded format (default) or binary.";
+
+	_cleanup_free_ struct nvme_firmware_slot *fw_log = NULL;
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	nvme_print_flags_t flags;
 	int err;
@@ -1540,67 +2169,383 @@ static int get_pred_lat_event_agg_log(int argc, char **argv,
 	return err;
 }
 
-static int get_persistent_event_log(int argc, char **argv,
-		struct command *command, struct plugin *plugin)
+#define PEL_STATE_MAGIC		"nvme-pel 1"
+#define PEL_ETS_MASK		0xffffffffffffULL
+
+/*
+ * Checkpoint of the incremental persistent event log reader: the last event
+ * already reported, identified by its offset, length, type and timestamp,
+ * and the number of events reported so far.
+ */
+struct pel_state {
+	char	sn[21];
+	__u16	cntlid;
+	__u16	gen;
+	__u64	offset;
+	__u32	len;
+	__u8	etype;
+	__u64	ets;
+	__u64	seq;
+	bool	valid;
+};
+
+static int pel_state_load(const char *file, struct pel_state *st)
 {
-	const char *desc = "Retrieve Persistent Event log info for "
-		"the given device in either decoded format(default), json or binary.";
-	const char *action = "action the controller shall take during "
-		"processing this persistent log page command.";
-	const char *log_len = "number of bytes to retrieve";
+	unsigned long long offset, ets, seq;
+	unsigned int cntlid, gen, len, etype;
+	char line[32];
+	size_t n;
+	FILE *f;
+	int err = 0;
 
-	_cleanup_free_ struct nvme_persistent_event_log *pevent = NULL;
-	struct nvme_persistent_event_log *pevent_collected = NULL;
-	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
-	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
-	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	nvme_print_flags_t flags;
-	void *pevent_log_info;
-	int err;
+	f = fopen(file, "r");
+	if (!f)
+		return errno == ENOENT ? 0 : -errno;
 
-	struct config {
-		__u8	action;
-		__u32	log_len;
-		bool	raw_binary;
-	};
+	if (!fgets(line, sizeof(line), f) ||
+	    strncmp(line, PEL_STATE_MAGIC, strlen(PEL_STATE_MAGIC))) {
+		err = -EBADMSG;
+		goto out;
+	}
 
-	struct config cfg = {
-		.action		= 0xff,
-		.log_len	= 0,
-		.raw_binary	= false,
-	};
+	/* the rest of the line, the serial number may contain spaces */
+	if (!fgets(line, sizeof(line), f) || strncmp(line, "sn ", 3) ||
+	    (n = strcspn(line + 3, "\n")) >= sizeof(st->sn) ||
+	    line[3 + n] != '\n') {
+		err = -EBADMSG;
+		goto out;
+	}
+	memcpy(st->sn, line + 3, n);
+	st->sn[n] = '\0';
 
-	NVME_ARGS(opts,
-		  OPT_BYTE("action",       'a', &cfg.action,        action),
-		  OPT_UINT("log_len",	 'l', &cfg.log_len,	  log_len),
-		  OPT_FLAG("raw-binary",   'b', &cfg.raw_binary,    raw_use));
+	if (fscanf(f, "cntlid %u\ngen %u\noffset %llu\nlen %u\n"
+		   "etype %u\nets %llu\nseq %llu\n", &cntlid, &gen,
+		   &offset, &len, &etype, &ets, &seq) != 7) {
+		err = -EBADMSG;
+		goto out;
+	}
 
-	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	st->cntlid = cntlid;
+	st->gen = gen;
+	st->offset = offset;
+	st->len = len;
+	st->etype = etype;
+	st->ets = ets;
+	st->seq = seq;
+	st->valid = true;
+out:
+	fclose(f);
+	return err;
+}
+
+static int pel_state_save(const char *file, struct pel_state *st)
+{
+	_cleanup_free_ char *buf = NULL;
+	size_t len;
+	FILE *f;
+
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -errno;
+
+	fprintf(f, PEL_STATE_MAGIC "\n");
+	fprintf(f, "sn %s\ncntlid %u\ngen %u\noffset %llu\nlen %u\netype %u\n"
+		"ets %llu\nseq %llu\n", st->sn, st->cntlid, st->gen,
+		(unsigned long long)st->offset, st->len, st->etype,
+		(unsigned long long)st->ets, (unsigned long long)st->seq);
+
+	if (fclose(f))
+		return -errno;
+
+	return nvme_state_file_write(file, buf, len);
+}
+
+static int pel_read(struct nvme_transport_handle *hdl, __u64 lpo, void *buf,
+		    __u32 len, __u32 xfer)
+{
+	struct nvme_passthru_cmd cmd;
+
+	nvme_init_get_log_persistent_event(&cmd, NVME_PEVENT_LOG_READ, buf, len);
+	nvme_init_get_log_lpo(&cmd, lpo);
+
+	return nvme_get_log(hdl, &cmd, false, xfer);
+}
+
+/* checks that the last reported event is still where it was left */
+static int pel_state_match(struct nvme_transport_handle *hdl,
+			   struct pel_state *st, __u32 xfer, bool *match)
+{
+	_cleanup_free_ void *buf = NULL;
+	struct nvme_persistent_event_entry *e;
+	__u64 lpo = st->offset & ~3ULL;
+	__u32 skip = st->offset - lpo;
+	__u32 len = (skip + sizeof(*e) + 3) & ~3U;
+	int err;
+
+	buf = nvme_alloc(len);
+	if (!buf)
+		return -ENOMEM;
+
+	err = pel_read(hdl, lpo, buf, len, xfer);
 	if (err)
 		return err;
 
-	err = validate_output_format(nvme_cfg.output_format, &flags);
-	if (err < 0) {
-		nvme_show_error("Invalid output format");
-		return err;
+	e = buf + skip;
+	*match = e->etype == st->etype && le64_to_cpu(e->ets) == st->ets &&
+		 e->ehl + 3 + le16_to_cpu(e->el) == st->len;
+
+	return 0;
+}
+
+/* offset behind the last reported event in @buf, 0 if it is not there */
+static __u64 pel_find_last(void *buf, __u64 off, __u64 end,
+			   struct pel_state *st)
+{
+	struct nvme_persistent_event_entry *e;
+	__u64 found = 0;
+	__u32 elen;
+
+	for (; off + sizeof(*e) <= end; off += elen) {
+		e = buf + off;
+		elen = e->ehl + 3 + le16_to_cpu(e->el);
+		if (off + elen > end)
+			break;
+		if (e->etype == st->etype && elen == st->len &&
+		    le64_to_cpu(e->ets) == st->ets)
+			found = off + elen;
 	}
 
-	if (cfg.raw_binary)
-		flags = BINARY;
+	return found;
+}
 
-	pevent = nvme_alloc(sizeof(*pevent));
-	if (!pevent)
+/*
+ * Reports the events added since the checkpoint in @state_file. While the
+ * generation number is unchanged and the last reported event is still at
+ * its offset, only the log behind it is read. Otherwise the whole log is
+ * read and the events newer than the checkpoint timestamp are reported;
+ * events sharing its millisecond are new if they follow the last reported
+ * one, or if that one is gone.
+ */
+static int pel_incremental(struct nvme_transport_handle *hdl,
+			   const char *state_file, nvme_print_flags_t flags)
+{
+	_cleanup_free_ struct nvme_persistent_event_log *hdr = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	_cleanup_free_ void *tail = NULL;
+	_cleanup_free_ void *out = NULL;
+	struct nvme_persistent_event_entry *e;
+	struct pel_state st = { 0 };
+	__u32 xfer, len = 0, pos, elen, n = 0;
+	__u64 tll, start, lpo, off, last = 0, last_ets, ets;
+	bool resume = false, filter;
+	char sn[sizeof(st.sn)];
+	int err, ret;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
 		return -ENOMEM;
 
-	err = nvme_get_log_persistent_event(hdl, cfg.action, pevent,
-					    sizeof(*pevent));
+	err = nvme_identify_ctrl(hdl, ctrl);
 	if (err) {
-		nvme_show_err("persistent event log", err);
+		nvme_show_err("identify controller", err);
 		return err;
 	}
 
-	if (cfg.action == NVME_PEVENT_LOG_RELEASE_CTX) {
-		printf("Releasing Persistent Event Log Context\n");
+	xfer = nvme_capture_ctrl_max_chunk(ctrl);
+	nvme_ctrl_sn(ctrl, sn);
+
+	err = pel_state_load(state_file, &st);
+	if (!err && st.valid && (strcmp(st.sn, sn) ||
+				 st.cntlid != le16_to_cpu(ctrl->cntlid)))
+		err = -ESTALE;
+	if (err == -ESTALE || err == -EBADMSG) {
+		nvme_show_error("state file %s does not belong to this controller, remove it to start over",
+				state_file);
+		return err;
+	}
+	if (err) {
+		nvme_show_error("state file %s: %s", state_file, strerror(-err));
+		return err;
+	}
+
+	hdr = nvme_alloc(sizeof(*hdr));
+	if (!hdr)
+		return -ENOMEM;
+
+	err = nvme_get_log_persistent_event(hdl, NVME_PEVENT_LOG_EST_CTX_AND_READ,
+					    hdr, sizeof(*hdr));
+	if (err > 0) {
+		/* a reporting context left behind by an interrupted reader */
+		nvme_get_log_persistent_event(hdl, NVME_PEVENT_LOG_RELEASE_CTX,
+					      hdr, sizeof(*hdr));
+		err = nvme_get_log_persistent_event(hdl,
+				NVME_PEVENT_LOG_EST_CTX_AND_READ, hdr, sizeof(*hdr));
+	}
+	if (err) {
+		nvme_show_err("persistent event log", err);
+		return err;
+	}
+
+	tll = le64_to_cpu(hdr->tll);
+	start = sizeof(*hdr);
+
+	if (st.valid && st.gen == le16_to_cpu(hdr->gen_number) &&
+	    st.offset >= start && st.offset + st.len <= tll) {
+		err = pel_state_match(hdl, &st, xfer, &resume);
+		if (err)
+			goto release;
+		if (resume)
+			start = st.offset + st.len;
+	}
+
+	/* the log page offset has to be dword aligned */
+	lpo = start & ~3ULL;
+	if (tll > lpo)
+		len = (tll - lpo + 3) & ~3ULL;
+
+	out = nvme_alloc(sizeof(*hdr) + len);
+	if (!out) {
+		err = -ENOMEM;
+		goto release;
+	}
+	memcpy(out, hdr, sizeof(*hdr));
+
+	if (len) {
+		tail = nvme_alloc(len);
+		if (!tail) {
+			err = -ENOMEM;
+			goto release;
+		}
+		err = pel_read(hdl, lpo, tail, len, xfer);
+	}
+
+release:
+	ret = nvme_get_log_persistent_event(hdl, NVME_PEVENT_LOG_RELEASE_CTX,
+					    hdr, sizeof(*hdr));
+	if (!err)
+		err = ret;
+	if (err) {
+		nvme_show_err("persistent event log", err);
+		return err;
+	}
+
+	filter = st.valid && !resume;
+	last_ets = st.ets & PEL_ETS_MASK;
+	if (filter && tail)
+		last = pel_find_last(tail, start - lpo, tll - lpo, &st);
+
+	pos = sizeof(*hdr);
+	for (off = start - lpo; tail && off + sizeof(*e) <= tll - lpo;
+	     off += elen) {
+		e = tail + off;
+		elen = e->ehl + 3 + le16_to_cpu(e->el);
+		if (off + elen > tll - lpo)
+			break;
+
+		ets = le64_to_cpu(e->ets) & PEL_ETS_MASK;
+		if (!filter || ets > last_ets ||
+		    (ets == last_ets && off >= last)) {
+			memcpy(out + pos, e, elen);
+			pos += elen;
+			n++;
+		}
+
+		st.offset = lpo + off;
+		st.len = elen;
+		st.etype = e->etype;
+		st.ets = le64_to_cpu(e->ets);
+	}
+
+	if (n) {
+		struct nvme_persistent_event_log *log = out;
+
+		log->tnev = cpu_to_le32(n);
+		log->tll = cpu_to_le64(pos);
+		nvme_show_persistent_event_entries(out, pos, st.seq,
+				nvme_transport_handle_get_name(hdl), flags);
+	}
+
+	strcpy(st.sn, sn);
+	st.cntlid = le16_to_cpu(ctrl->cntlid);
+	st.gen = le16_to_cpu(hdr->gen_number);
+	st.seq += n;
+
+	err = pel_state_save(state_file, &st);
+	if (err)
+		nvme_show_error("state file %s: %s", state_file, strerror(-err));
+
+	return err;
+}
+
+static int get_persistent_event_log(int argc, char **argv,
+		struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Retrieve Persistent Event log info for "
+		"the given device in either decoded format(default), json or binary.";
+	const char *action = "action the controller shall take during "
+		"processing this persistent log page command.";
+	const char *log_len = "number of bytes to retrieve";
+	const char *state_file = "report only the events added since the "
+		"checkpoint in this file and update it";
+
+	_cleanup_free_ struct nvme_persistent_event_log *pevent = NULL;
+	struct nvme_persistent_event_log *pevent_collected = NULL;
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	nvme_print_flags_t flags;
+	void *pevent_log_info;
+	int err;
+
+	struct config {
+		__u8	action;
+		__u32	log_len;
+		bool	raw_binary;
+		char	*state_file;
+	};
+
+	struct config cfg = {
+		.action		= 0xff,
+		.log_len	= 0,
+		.raw_binary	= false,
+		.state_file	= "",
+	};
+
+	NVME_ARGS(opts,
+		  OPT_BYTE("action",       'a', &cfg.action,        action),
+		  OPT_UINT("log_len",	 'l', &cfg.log_len,	  log_len),
+		  OPT_FLAG("raw-binary",   'b', &cfg.raw_binary,    raw_use),
+		  OPT_FILE("state-file",   'S', &cfg.state_file,    state_file));
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(nvme_cfg.output_format, &flags);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (cfg.raw_binary)
+		flags = BINARY;
+
+	if (strlen(cfg.state_file))
+		return pel_incremental(hdl, cfg.state_file, flags);
+
+	pevent = nvme_alloc(sizeof(*pevent));
+	if (!pevent)
+		return -ENOMEM;
+
+	err = nvme_get_log_persistent_event(hdl, cfg.action, pevent,
+					    sizeof(*pevent));
+	if (err) {
+		nvme_show_err("persistent event log", err);
+		return err;
+	}
+
+	if (cfg.action == NVME_PEVENT_LOG_RELEASE_CTX) {
+		printf("Releasing Persistent Event Log Context\n");
 		return 0;
 	}
 
@@ -3163,6 +4108,102 @@ static int parse_lba_num_si(struct nvme_transport_handle *hdl, const char *opt,
 	return 0;
 }
 
+/* the LBA format of block size @bs without metadata */
+static int ns_mgmt_bs_to_flbas(struct nvme_transport_handle *hdl, __u64 bs,
+			       __u8 *flbas)
+{
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	int err, i;
+
+	if ((bs & (~bs + 1)) != bs) {
+		nvme_show_error(
+		    "Invalid value for block size (%"PRIu64"). Block size must be a power of two",
+		    (uint64_t)bs);
+		return -EINVAL;
+	}
+
+	ns = nvme_alloc(sizeof(*ns));
+	if (!ns)
+		return -ENOMEM;
+
+	err = nvme_identify_ns(hdl, NVME_NSID_ALL, ns);
+	if (err) {
+		if (err > 0)
+			fprintf(stderr, "identify failed\n");
+		nvme_show_err("identify-namespace", err);
+		return err;
+	}
+	for (i = 0; i <= ns->nlbaf; ++i) {
+		if ((1 << ns->lbaf[i].ds) == bs && ns->lbaf[i].ms == 0) {
+			*flbas = i;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* the NSZE and NCAP alignment the controller requires for LBA format @flbas */
+static int ns_mgmt_granularity(struct nvme_transport_handle *hdl, __u8 flbas,
+			       __u64 *align_nsze, __u64 *align_ncap)
+{
+	_cleanup_free_ struct nvme_id_ns_granularity_list *gr_list = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *id = NULL;
+	struct nvme_id_ns_granularity_desc *desc;
+	int index = flbas;
+	int err;
+
+	id = nvme_alloc(sizeof(*id));
+	if (!id)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(hdl, id);
+	if (err) {
+		if (err > 0)
+			fprintf(stderr, "identify controller failed\n");
+		nvme_show_err("identify-controller", err);
+		return err;
+	}
+
+	if (!(id->ctratt & NVME_CTRL_CTRATT_NAMESPACE_GRANULARITY))
+		return 0;
+
+	gr_list = nvme_alloc(sizeof(*gr_list));
+	if (!gr_list)
+		return -ENOMEM;
+
+	if (nvme_identify_ns_granularity(hdl, gr_list))
+		return 0;
+
+	/* FIXME: add a proper bitmask to libnvme */
+	if (!(le32_to_cpu(gr_list->attributes) & 1)) {
+		/* Only the first descriptor is valid */
+		index = 0;
+	} else if (index > gr_list->num_descriptors) {
+		/*
+		 * The descriptor will contain only zeroes
+		 * so we don't need to read it.
+		 */
+		return 0;
+	}
+	desc = &gr_list->entry[index];
+
+	if (desc->nszegran) {
+		print_info("enforce nsze alignment to %"PRIx64
+			   " because of namespace granularity requirements\n",
+			   le64_to_cpu(desc->nszegran));
+		*align_nsze = le64_to_cpu(desc->nszegran);
+	}
+	if (desc->ncapgran) {
+		print_info("enforce ncap alignment to %"PRIx64
+			   " because of namespace granularity requirements\n",
+			   le64_to_cpu(desc->ncapgran));
+		*align_ncap = le64_to_cpu(desc->ncapgran);
+	}
+
+	return 0;
+}
+
 static int create_ns(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Send a namespace management command "
@@ -3193,10 +4234,7 @@ static int create_ns(int argc, char **argv, struct command *acmd, struct plugin
 
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	_cleanup_free_ struct nvme_ns_mgmt_host_sw_specified *data = NULL;
-	_cleanup_free_ struct nvme_id_ns_granularity_list *gr_list = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
-	_cleanup_free_ struct nvme_id_ctrl *id = NULL;
-	_cleanup_free_ struct nvme_id_ns *ns = NULL;
 	__u64 align_nsze = 1 << 20; /* Default 1 MiB */
 	__u64 align_ncap = align_nsze;
 	struct nvme_passthru_cmd cmd;
@@ -3287,32 +4325,9 @@ static int create_ns(int argc, char **argv, struct command *acmd, struct plugin
 		return -EINVAL;
 	}
 	if (cfg.bs) {
-		if ((cfg.bs & (~cfg.bs + 1)) != cfg.bs) {
-			nvme_show_error(
-			    "Invalid value for block size (%"PRIu64"). Block size must be a power of two",
-			    (uint64_t)cfg.bs);
-			return -EINVAL;
-		}
-
-
-		ns = nvme_alloc(sizeof(*ns));
-		if (!ns)
-			return -ENOMEM;
-
-		err = nvme_identify_ns(hdl, NVME_NSID_ALL, ns);
-		if (err) {
-			if (err > 0)
-				fprintf(stderr, "identify failed\n");
-			nvme_show_err("identify-namespace", err);
+		err = ns_mgmt_bs_to_flbas(hdl, cfg.bs, &cfg.flbas);
+		if (err)
 			return err;
-		}
-		for (i = 0; i <= ns->nlbaf; ++i) {
-			if ((1 << ns->lbaf[i].ds) == cfg.bs && ns->lbaf[i].ms == 0) {
-				cfg.flbas = i;
-				break;
-			}
-		}
-
 	}
 	if (cfg.flbas == 0xff) {
 		fprintf(stderr, "FLBAS corresponding to block size %"PRIu64" not found\n",
@@ -3322,56 +4337,10 @@ static int create_ns(int argc, char **argv, struct command *acmd, struct plugin
 		return -EINVAL;
 	}
 
-	id = nvme_alloc(sizeof(*id));
-	if (!id)
-		return -ENOMEM;
-
-	err = nvme_identify_ctrl(hdl, id);
-	if (err) {
-		if (err > 0)
-			fprintf(stderr, "identify controller failed\n");
-		nvme_show_err("identify-controller", err);
+	err = ns_mgmt_granularity(hdl, cfg.flbas, &align_nsze, &align_ncap);
+	if (err)
 		return err;
-	}
-
-	if (id->ctratt & NVME_CTRL_CTRATT_NAMESPACE_GRANULARITY) {
-		gr_list = nvme_alloc(sizeof(*gr_list));
-		if (!gr_list)
-			return -ENOMEM;
-
-		if (!nvme_identify_ns_granularity(hdl, gr_list)) {
-			struct nvme_id_ns_granularity_desc *desc;
-			int index = cfg.flbas;
-
-			/* FIXME: add a proper bitmask to libnvme */
-			if (!(le32_to_cpu(gr_list->attributes) & 1)) {
-				/* Only the first descriptor is valid */
-				index = 0;
-			} else if (index > gr_list->num_descriptors) {
-				/*
-				 * The descriptor will contain only zeroes
-				 * so we don't need to read it.
-				 */
-				goto parse_lba;
-			}
-			desc = &gr_list->entry[index];
-
-			if (desc->nszegran) {
-				print_info("enforce nsze alignment to %"PRIx64
-					   " because of namespace granularity requirements\n",
-					   le64_to_cpu(desc->nszegran));
-				align_nsze = le64_to_cpu(desc->nszegran);
-			}
-			if (desc->ncapgran) {
-				print_info("enforce ncap alignment to %"PRIx64
-					   " because of namespace granularity requirements\n",
-					   le64_to_cpu(desc->ncapgran));
-				align_ncap = le64_to_cpu(desc->ncapgran);
-			}
-		}
-	}
 
-parse_lba:
 	err = parse_lba_num_si(hdl, "nsze", cfg.nsze_si, cfg.flbas, &cfg.nsze, align_nsze);
 	if (err)
 		return err;
@@ -3421,44 +4390,309 @@ parse_lba:
 	return err;
 }
 
-static bool nvme_match_device_filter(nvme_subsystem_t s,
-		nvme_ctrl_t c, nvme_ns_t ns, void *f_args)
+static int provision_ns(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
-	char *devname = f_args;
-	nvme_ns_t n;
-
-	if (ns && !strcmp(devname, nvme_ns_get_name(ns)))
-		return true;
-
-	if (c) {
-		s = nvme_ctrl_get_subsystem(c);
-		nvme_ctrl_for_each_ns(c, n) {
-			if (!strcmp(devname, nvme_ns_get_name(n)))
-				return true;
-		}
-	}
-	if (s) {
-		nvme_subsystem_for_each_ns(s, n) {
-			if (!strcmp(devname, nvme_ns_get_name(n)))
-				return true;
-		}
-	}
-
-	return false;
-}
+	const char *desc = "Create a number of namespaces, attach them to a list of "
+		"controllers and wait for their block devices. The namespaces are "
+		"created and attached back to back, followed by a single namespace "
+		"rescan.";
+	const char *count = "number of namespaces to create";
+	const char *size = "comma separated namespace sizes in standard SI units, the "
+		"last one is used for the remaining namespaces (default: the "
+		"unallocated capacity split evenly)";
+	const char *flbas = "Formatted LBA size (FLBAS), if entering this value ignore \'block-size\' field";
+	const char *bs = "target block size, specify only if \'FLBAS\' value not entered";
+	const char *nmic = "multipath and sharing capabilities (NMIC), shared by default "
+		"when attaching to several controllers";
+	const char *csi = "command set identifier (CSI)";
+	const char *cont = "comma separated controller id list (default: this controller)";
+	const char *wait = "seconds to wait for the namespaces to appear, 0 to not wait";
 
-static int list_subsys(int argc, char **argv, struct command *acmd,
-		struct plugin *plugin)
-{
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	_cleanup_free_ struct nvme_ns_mgmt_host_sw_specified *data = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_free_ struct nvme_ctrl_list *cntlist = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *id = NULL;
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	_cleanup_free_ __u64 *nsze = NULL;
+	_cleanup_free_ __u32 *nsids = NULL;
+	_cleanup_free_ char *sizes = NULL;
+	_cleanup_fd_ int ufd = -1;
+	__u64 align_nsze = 1 << 20, align_ncap = 1 << 20;
+	struct timeval start, created, attached, ready;
+	__u16 list[NVME_ID_CTRL_LIST_MAX];
+	struct nvme_passthru_cmd cmd;
 	nvme_print_flags_t flags;
-	const char *desc = "Retrieve information for subsystems";
-	nvme_scan_filter_t filter = NULL;
-	char *devname;
-	int err;
-	int nsid = NVME_NSID_ALL;
-
-	NVME_ARGS(opts);
+	unsigned int i, nr = 0;
+	bool local = false;
+	int err, ret, num;
+	char *tok, *save;
+	__u64 blocks = 0, align;
+	__u32 lba_size;
+	__u8 lbaf;
+
+	struct config {
+		__u32	count;
+		char	*size;
+		__u8	flbas;
+		__u64	bs;
+		__u8	nmic;
+		__u8	csi;
+		char	*cntlist;
+		__u32	wait;
+	};
+
+	struct config cfg = {
+		.count		= 1,
+		.size		= "",
+		.flbas		= 0xff,
+		.nmic		= 0xff,
+		.cntlist	= "",
+		.wait		= 30,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("count",        'n', &cfg.count,   count),
+		  OPT_LIST("size",         's', &cfg.size,    size),
+		  OPT_BYTE("flbas",        'f', &cfg.flbas,   flbas),
+		  OPT_SUFFIX("block-size", 'b', &cfg.bs,      bs),
+		  OPT_BYTE("nmic",         'm', &cfg.nmic,    nmic),
+		  OPT_BYTE("csi",          'y', &cfg.csi,     csi),
+		  OPT_LIST("controllers",  'c', &cfg.cntlist, cont),
+		  OPT_UINT("wait",         'w', &cfg.wait,    wait));
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(nvme_cfg.output_format, &flags);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (nvme_transport_handle_is_blkdev(hdl)) {
+		nvme_show_error("%s: a block device opened (dev: %s)", acmd->name,
+				nvme_transport_handle_get_name(hdl));
+		return -EINVAL;
+	}
+
+	if (!cfg.count) {
+		nvme_show_error("%s: count must not be zero", acmd->name);
+		return -EINVAL;
+	}
+
+	if (cfg.flbas != 0xff && cfg.bs) {
+		nvme_show_error(
+		    "Invalid specification of both FLBAS and Block Size, please specify only one");
+		return -EINVAL;
+	}
+	if (cfg.bs) {
+		err = ns_mgmt_bs_to_flbas(hdl, cfg.bs, &cfg.flbas);
+		if (err)
+			return err;
+		if (cfg.flbas == 0xff) {
+			nvme_show_error("FLBAS corresponding to block size %"PRIu64" not found",
+					(uint64_t)cfg.bs);
+			return -EINVAL;
+		}
+	}
+	if (cfg.flbas == 0xff)
+		cfg.flbas = 0;
+
+	id = nvme_alloc(sizeof(*id));
+	ns = nvme_alloc(sizeof(*ns));
+	cntlist = nvme_alloc(sizeof(*cntlist));
+	data = nvme_alloc(sizeof(*data));
+	nsze = calloc(cfg.count, sizeof(*nsze));
+	nsids = calloc(cfg.count, sizeof(*nsids));
+	if (!id || !ns || !cntlist || !data || !nsze || !nsids)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(hdl, id);
+	if (!err)
+		err = nvme_identify_ns(hdl, NVME_NSID_ALL, ns);
+	if (err) {
+		nvme_show_err("identify", err);
+		return err;
+	}
+
+	err = ns_mgmt_granularity(hdl, cfg.flbas, &align_nsze, &align_ncap);
+	if (err)
+		return err;
+
+	num = argconfig_parse_comma_sep_array_u16(cfg.cntlist, list,
+						  ARRAY_SIZE(list));
+	if (num < 0) {
+		nvme_show_error("%s: controller id list is malformed", acmd->name);
+		return -EINVAL;
+	}
+	if (!num) {
+		list[0] = le16_to_cpu(id->cntlid);
+		num = 1;
+	}
+	for (i = 0; i < num; i++)
+		if (list[i] == le16_to_cpu(id->cntlid))
+			local = true;
+	nvme_init_ctrl_list(cntlist, num, list);
+
+	if (cfg.nmic == 0xff)
+		cfg.nmic = num > 1 ? NVME_NS_NMIC_SHARED : 0;
+
+	/* the sizes given, the last one repeated */
+	sizes = strdup(cfg.size);
+	if (!sizes)
+		return -ENOMEM;
+	for (tok = strtok_r(sizes, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (nr == cfg.count)
+			break;
+		blocks = 0;
+		err = parse_lba_num_si(hdl, "size", tok, cfg.flbas, &blocks,
+				       align_nsze);
+		if (err)
+			return err;
+		nsze[nr++] = blocks;
+	}
+	if (!nr) {
+		nvme_id_ns_flbas_to_lbaf_inuse(cfg.flbas, &lbaf);
+		lba_size = 1 << ns->lbaf[lbaf].ds;
+		blocks = (__u64)int128_to_double(id->unvmcap) / cfg.count /
+			lba_size;
+		/* the granularities are in bytes */
+		align = (max(align_nsze, align_ncap) + lba_size - 1) / lba_size;
+		blocks -= blocks % align;
+	}
+	for (; nr < cfg.count; nr++)
+		nsze[nr] = blocks;
+
+	for (i = 0; i < cfg.count; i++) {
+		if (!nsze[i]) {
+			nvme_show_error("%s: namespace %u would be empty", acmd->name,
+					i + 1);
+			return -EINVAL;
+		}
+	}
+
+	if (nvme_cfg.dry_run) {
+		for (i = 0; i < cfg.count; i++)
+			printf("namespace %u: %"PRIu64" blocks, flbas %u, nmic %u\n",
+			       i + 1, (uint64_t)nsze[i], cfg.flbas, cfg.nmic);
+		return 0;
+	}
+
+	/* before anything is attached, to catch all uevents of the scan */
+	if (local && cfg.wait)
+		ufd = nvme_wait_uevent_open();
+
+	gettimeofday(&start, NULL);
+
+	for (nr = 0; nr < cfg.count; nr++) {
+		memset(data, 0, sizeof(*data));
+		data->nsze = cpu_to_le64(nsze[nr]);
+		data->ncap = cpu_to_le64(nsze[nr]);
+		data->flbas = cfg.flbas;
+		data->nmic = cfg.nmic;
+
+		nvme_init_ns_mgmt_create(&cmd, cfg.csi, data);
+		err = nvme_submit_admin_passthru(hdl, &cmd);
+		if (err) {
+			nvme_show_error("%s: creating namespace %u failed", acmd->name,
+					nr + 1);
+			ns_mgmt_show_status(hdl, err, "create-ns", 0);
+			break;
+		}
+		nsids[nr] = cmd.result;
+	}
+	gettimeofday(&created, NULL);
+
+	/* the namespaces created so far are attached even after a failure */
+	for (i = 0; i < nr; i++) {
+		nvme_init_ns_attach_ctrls(&cmd, nsids[i], cntlist);
+		ret = nvme_submit_admin_passthru(hdl, &cmd);
+		if (ret) {
+			ns_mgmt_show_status(hdl, ret, "attach-ns", nsids[i]);
+			if (!err)
+				err = ret;
+			nsids[i] = 0;
+		}
+	}
+	gettimeofday(&attached, NULL);
+
+	if (local) {
+		ret = nvme_ns_rescan(hdl);
+		if (ret < 0)
+			nvme_show_error("Namespace Rescan: %s", nvme_strerror(ret));
+	}
+
+	for (i = 0; i < nr; i++)
+		if (nsids[i])
+			printf("nsid %u: %"PRIu64" blocks\n", nsids[i],
+			       (uint64_t)nsze[i]);
+	printf("created %u namespaces in %llu ms, attached in %llu ms\n", nr,
+	       elapsed_utime(start, created) / 1000,
+	       elapsed_utime(created, attached) / 1000);
+
+	if (!local || !cfg.wait)
+		return err;
+
+	/* failed attachments left a zero in the list, which never matches */
+	for (i = 0, num = 0; i < nr; i++)
+		if (nsids[i])
+			nsids[num++] = nsids[i];
+
+	ret = nvme_wait_namespaces(ufd, nvme_transport_handle_get_name(hdl),
+				   nsids, num, cfg.wait * 1000);
+	gettimeofday(&ready, NULL);
+	if (ret) {
+		nvme_show_error("waiting for the namespaces: %s",
+				nvme_strerror(-ret));
+		return err ? err : ret;
+	}
+	printf("namespaces ready after %llu ms\n",
+	       elapsed_utime(start, ready) / 1000);
+
+	return err;
+}
+
+static bool nvme_match_device_filter(nvme_subsystem_t s,
+		nvme_ctrl_t c, nvme_ns_t ns, void *f_args)
+{
+	char *devname = f_args;
+	nvme_ns_t n;
+
+	if (ns && !strcmp(devname, nvme_ns_get_name(ns)))
+		return true;
+
+	if (c) {
+		s = nvme_ctrl_get_subsystem(c);
+		nvme_ctrl_for_each_ns(c, n) {
+			if (!strcmp(devname, nvme_ns_get_name(n)))
+				return true;
+		}
+	}
+	if (s) {
+		nvme_subsystem_for_each_ns(s, n) {
+			if (!strcmp(devname, nvme_ns_get_name(n)))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static int list_subsys(int argc, char **argv, struct command *acmd,
+		struct plugin *plugin)
+{
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	nvme_print_flags_t flags;
+	const char *desc = "Retrieve information for subsystems";
+	nvme_scan_filter_t filter = NULL;
+	char *devname;
+	int err;
+	int nsid = NVME_NSID_ALL;
+
+	NVME_ARGS(opts);
 
 	err = parse_args(argc, argv, desc, opts);
 	if (err)
@@ -4500,82 +5734,50 @@ static int list_secondary_ctrl(int argc, char **argv, struct command *acmd, stru
 	return err;
 }
 
-static int sleep_self_test(unsigned int seconds)
+static int show_wait_progress(struct nvme_wait *w, void *arg)
 {
-	nvme_sigint_received = false;
-
-	sleep(seconds);
+	static const char spin[] = {'-', '\\', '|', '/' };
 
-	if (nvme_sigint_received) {
-		printf("\nInterrupted device self-test operation by SIGINT\n");
-		return -SIGINT;
-	}
+	if (w->done && !w->err)
+		printf("\r[%.*s] %3d%%\n", 50, dash, 100);
+	else if (w->done)
+		printf("\n");
+	else
+		printf("\r[%.*s%c%.*s] %3d%%", w->progress / 2, dash,
+		       spin[w->polls % 4], 49 - w->progress / 2, space,
+		       w->progress);
+	fflush(stdout);
 
 	return 0;
 }
 
-static int wait_self_test(struct nvme_transport_handle *hdl)
+static int wait_op(struct nvme_transport_handle *hdl, enum nvme_wait_op op)
 {
-	static const char spin[] = {'-', '\\', '|', '/' };
-	_cleanup_free_ struct nvme_self_test_log *log = NULL;
-	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
-	int err, i = 0, p = 0, cnt = 0;
-	int wthr;
-
-	ctrl = nvme_alloc(sizeof(*ctrl));
-	if (!ctrl)
-		return -ENOMEM;
-
-	log = nvme_alloc(sizeof(*log));
-	if (!log)
-		return -ENOMEM;
+	struct nvme_wait w;
+	int err;
 
-	err = nvme_identify_ctrl(hdl, ctrl);
+	err = nvme_wait_init(&w, hdl, op);
 	if (err) {
-		nvme_show_error("identify-ctrl: %s", nvme_strerror(err));
+		nvme_show_err("identify-ctrl", err);
 		return err;
 	}
 
-	wthr = le16_to_cpu(ctrl->edstt) * 60 / 100 + 60;
-
-	printf("Waiting for self test completion...\n");
-	while (true) {
-		printf("\r[%.*s%c%.*s] %3d%%", p / 2, dash, spin[i % 4], 49 - p / 2, space, p);
-		fflush(stdout);
-		err = sleep_self_test(1);
-		if (err)
-			return err;
-
-		err = nvme_get_log_device_self_test(hdl, log);
-		if (err) {
-			printf("\n");
-			nvme_show_err("self test log\n", err);
-			return err;
-		}
-
-		if (++cnt > wthr) {
-			nvme_show_error("no progress for %d seconds, stop waiting", wthr);
-			return -EIO;
-		}
-
-		if (log->completion == 0 && p > 0) {
-			printf("\r[%.*s] %3d%%\n", 50, dash, 100);
-			break;
-		}
-
-		if (log->completion < p) {
-			printf("\n");
-				nvme_show_error("progress broken");
-				return -EIO;
-		} else if (log->completion != p) {
-			p = log->completion;
-			cnt = 0;
-		}
-
-		i++;
+	printf("Waiting for %s completion...\n", nvme_wait_op_str(op));
+	err = nvme_wait_all(&w, 1, show_wait_progress, NULL);
+	if (err == -EINTR) {
+		printf("\nInterrupted %s wait by SIGINT\n", nvme_wait_op_str(op));
+		return err;
 	}
+	if (err)
+		return err;
 
-	return 0;
+	if (w.err == -ETIMEDOUT)
+		nvme_show_error("no progress for %u seconds, stop waiting",
+				w.stall_ms / 1000);
+	else if (w.err)
+		nvme_show_err(nvme_wait_op_str(op), w.err);
+
+	return w.err;
 }
 
 static void abort_self_test(struct nvme_transport_handle *hdl, __u32 nsid)
@@ -4659,7 +5861,7 @@ static int device_self_test(int argc, char **argv, struct command *acmd, struct
 			printf("no self test running\n");
 		} else {
 			if (cfg.wait)
-				err = wait_self_test(hdl);
+				err = wait_op(hdl, NVME_WAIT_SELF_TEST);
 			else
 				printf("progress %d%%\n", log->completion);
 		}
@@ -4684,7 +5886,7 @@ static int device_self_test(int argc, char **argv, struct command *acmd, struct
 		printf("Host-Initiated Refresh started\n");
 
 	if (cfg.wait && cfg.stc != NVME_ST_CODE_ABORT)
-		err = wait_self_test(hdl);
+		err = wait_op(hdl, NVME_WAIT_SELF_TEST);
 
 check_abort:
 	if (err == -EINTR)
@@ -4693,6 +5895,99 @@ check_abort:
 	return err;
 }
 
+static int show_wait_status(struct nvme_wait *w, void *arg)
+{
+	const char *name = nvme_transport_handle_get_name(w->hdl);
+	const char *op = nvme_wait_op_str(w->op);
+
+	if (!w->done)
+		printf("%s: %s %3d%%, %llu seconds left\n", name, op, w->progress,
+		       (unsigned long long)(w->eta_ns / 1000000000ULL));
+	else if (w->err == -ETIMEDOUT)
+		printf("%s: %s made no progress for %u seconds\n", name, op,
+		       w->stall_ms / 1000);
+	else if (w->err)
+		nvme_show_err(name, w->err);
+	else
+		printf("%s: %s completed, result %#x\n", name, op, w->result);
+	fflush(stdout);
+
+	return 0;
+}
+
+static int wait_cmd(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Wait for the device self-test or sanitize operations "
+		"running on one or more devices to finish.";
+	const char *op = "operation to wait for: self-test or sanitize";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_free_ struct nvme_transport_handle **hdls = NULL;
+	_cleanup_free_ struct nvme_wait *w = NULL;
+	int err, i, nr;
+
+	struct config {
+		__u8	op;
+	};
+
+	struct config cfg = {
+		.op	= NVME_WAIT_SELF_TEST,
+	};
+
+	OPT_VALS(ops) = {
+		VAL_BYTE("self-test", NVME_WAIT_SELF_TEST),
+		VAL_BYTE("sanitize", NVME_WAIT_SANITIZE),
+		VAL_END()
+	};
+
+	NVME_ARGS(opts,
+		  OPT_BYTE("op", 'O', &cfg.op, op, ops));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	nr = argc - optind;
+	if (nr < 1) {
+		nvme_show_error("no device specified");
+		argconfig_print_help(desc, opts);
+		return -EINVAL;
+	}
+
+	ctx = nvme_create_global_ctx(stdout, log_level);
+	hdls = calloc(nr, sizeof(*hdls));
+	w = calloc(nr, sizeof(*w));
+	if (!ctx || !hdls || !w)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		err = nvme_open(ctx, argv[optind + i], &hdls[i]);
+		if (err) {
+			nvme_show_error("%s: %s", argv[optind + i],
+					nvme_strerror(-err));
+			goto close;
+		}
+		set_transport_handle_hooks(hdls[i]);
+
+		err = nvme_wait_init(&w[i], hdls[i], cfg.op);
+		if (err) {
+			nvme_show_err(argv[optind + i], err);
+			goto close;
+		}
+	}
+
+	err = nvme_wait_all(w, nr, show_wait_status, NULL);
+	for (i = 0; !err && i < nr; i++)
+		err = w[i].err;
+
+close:
+	for (i = 0; i < nr; i++)
+		if (hdls[i])
+			nvme_close(hdls[i]);
+
+	return err;
+}
+
 static int self_test_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Retrieve the self-test log for the given device and given test "
@@ -5186,30 +6481,197 @@ static int fw_download(int argc, char **argv, struct command *acmd, struct plugi
 	return err;
 }
 
-static char *nvme_fw_status_reset_type(__u16 status)
+static int fw_rollout(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
-	switch (status & 0x7ff) {
-	case NVME_SC_FW_NEEDS_CONV_RESET:
-		return "conventional";
-	case NVME_SC_FW_NEEDS_SUBSYS_RESET:
-		return "subsystem";
-	case NVME_SC_FW_NEEDS_RESET:
-		return "any controller";
-	default:
-		return "unknown";
-	}
-}
+	const char *desc = "Download a firmware image to one or more controllers "
+		"concurrently and commit it in waves. Controllers whose download "
+		"failed are not committed, the others are. The next wave is only "
+		"committed after all controllers of the previous wave passed a "
+		"health check (SMART critical warning clear and the new slot "
+		"active, or to be activated at the next reset).";
+	const char *fw = "firmware file (required)";
+	const char *xfer = "transfer chunk size limit, default derived from FWUG and MDTS";
+	const char *qd = "firmware download commands in flight per controller";
+	const char *jobs = "controllers to download to concurrently";
+	const char *slot = "[0-7]: firmware slot for commit action";
+	const char *action = "[0-3]: commit action";
+	const char *wave = "controllers committed per wave, default all";
+	const char *wave_delay = "seconds to wait after each wave before the health check";
+	const char *ignore_ovr = "ignore overwrite errors";
 
-static bool fw_commit_support_mud(struct nvme_transport_handle *hdl)
-{
-	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
-	int err;
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_free_ struct nvme_fw_rollout_dev *devs = NULL;
+	struct nvme_fw_rollout_cfg rcfg = { 0 };
+	_cleanup_fd_ int fw_fd = -1;
+	void *image = MAP_FAILED;
+	struct stat sb;
+	int err, i, nr;
 
-	ctrl = nvme_alloc(sizeof(*ctrl));
-	if (!ctrl)
-		return false;
+	struct config {
+		char		*fw;
+		__u32		xfer;
+		__u32		qd;
+		__u32		jobs;
+		__u8		slot;
+		__u8		action;
+		__u32		wave;
+		__u32		wave_delay;
+		bool		ignore_ovr;
+	};
 
-	err = nvme_identify_ctrl(hdl, ctrl);
+	struct config cfg = {
+		.fw		= "",
+		.xfer		= 0,
+		.qd		= 1,
+		.jobs		= 16,
+		.slot		= 0,
+		.action		= NVME_FW_COMMIT_CA_REPLACE_AND_ACTIVATE,
+		.wave		= 0,
+		.wave_delay	= 0,
+		.ignore_ovr	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FILE("fw",         'f', &cfg.fw,         fw),
+		  OPT_UINT("xfer",       'x', &cfg.xfer,       xfer),
+		  OPT_UINT("queue-depth", 'q', &cfg.qd,        qd),
+		  OPT_UINT("jobs",       'j', &cfg.jobs,       jobs),
+		  OPT_BYTE("slot",       's', &cfg.slot,       slot),
+		  OPT_BYTE("action",     'a', &cfg.action,     action),
+		  OPT_UINT("wave",       'W', &cfg.wave,       wave),
+		  OPT_UINT("wave-delay", 'D', &cfg.wave_delay, wave_delay),
+		  OPT_FLAG("ignore-ovr", 'i', &cfg.ignore_ovr, ignore_ovr));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	nr = argc - optind;
+	if (nr < 1) {
+		nvme_show_error("no device specified");
+		argconfig_print_help(desc, opts);
+		return -EINVAL;
+	}
+
+	if (cfg.slot > 7) {
+		nvme_show_error("invalid slot:%d", cfg.slot);
+		return -EINVAL;
+	}
+	if (cfg.action > NVME_FW_COMMIT_CA_REPLACE_AND_ACTIVATE_IMMEDIATE) {
+		nvme_show_error("invalid action:%d", cfg.action);
+		return -EINVAL;
+	}
+	if (cfg.xfer % 4096) {
+		nvme_show_error("xfer must be a multiple of 4096");
+		return -EINVAL;
+	}
+
+	fw_fd = open(cfg.fw, O_RDONLY);
+	if (fw_fd < 0) {
+		nvme_show_error("Failed to open firmware file %s: %s", cfg.fw, strerror(errno));
+		return -EINVAL;
+	}
+
+	if (fstat(fw_fd, &sb) < 0) {
+		nvme_show_perror("fstat");
+		return -errno;
+	}
+
+	if ((sb.st_size & 0x3) || sb.st_size == 0 || sb.st_size > UINT32_MAX) {
+		nvme_show_error("Invalid size:%lld for f/w image", (long long)sb.st_size);
+		return -EINVAL;
+	}
+
+	image = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fw_fd, 0);
+	if (image == MAP_FAILED) {
+		nvme_show_perror("mmap");
+		return -errno;
+	}
+
+	ctx = nvme_create_global_ctx(stdout, log_level);
+	devs = calloc(nr, sizeof(*devs));
+	if (!ctx || !devs) {
+		err = -ENOMEM;
+		goto unmap;
+	}
+
+	for (i = 0; i < nr; i++) {
+		devs[i].name = argv[optind + i];
+		err = nvme_open(ctx, devs[i].name, &devs[i].hdl);
+		if (err) {
+			nvme_show_error("%s: %s", devs[i].name, nvme_strerror(-err));
+			goto close;
+		}
+		set_transport_handle_hooks(devs[i].hdl);
+	}
+
+	rcfg = (struct nvme_fw_rollout_cfg) {
+		.image		= image,
+		.size		= sb.st_size,
+		.xfer		= cfg.xfer,
+		.qd		= cfg.qd,
+		.jobs		= cfg.jobs,
+		.slot		= cfg.slot,
+		.action		= cfg.action,
+		.wave		= cfg.wave,
+		.wave_delay	= cfg.wave_delay,
+		.ignore_ovr	= cfg.ignore_ovr,
+	};
+
+	/* the controllers which did download it are committed regardless */
+	err = nvme_fw_rollout_download(devs, nr, &rcfg);
+	if (err != -EINTR) {
+		int ret = nvme_fw_rollout_commit(devs, nr, &rcfg);
+
+		if (!err)
+			err = ret;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct nvme_fw_rollout_dev *d = &devs[i];
+
+		printf("%s: %s, %u byte chunks, download %llu ms%s\n",
+		       d->name, nvme_fw_rollout_state_str(d->state), d->xfer,
+		       (unsigned long long)(d->download_ns / 1000000),
+		       d->reset_required ? ", reset required" : "");
+		if (d->err)
+			nvme_show_err(d->name, d->err);
+	}
+
+close:
+	for (i = 0; i < nr; i++)
+		if (devs[i].hdl)
+			nvme_close(devs[i].hdl);
+unmap:
+	munmap(image, sb.st_size);
+
+	return err;
+}
+
+static char *nvme_fw_status_reset_type(__u16 status)
+{
+	switch (status & 0x7ff) {
+	case NVME_SC_FW_NEEDS_CONV_RESET:
+		return "conventional";
+	case NVME_SC_FW_NEEDS_SUBSYS_RESET:
+		return "subsystem";
+	case NVME_SC_FW_NEEDS_RESET:
+		return "any controller";
+	default:
+		return "unknown";
+	}
+}
+
+static bool fw_commit_support_mud(struct nvme_transport_handle *hdl)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	int err;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return false;
+
+	err = nvme_identify_ctrl(hdl, ctrl);
 
 	if (err)
 		nvme_show_error("identify-ctrl: %s", nvme_strerror(err));
@@ -5414,6 +6876,13 @@ static int ns_rescan(int argc, char **argv, struct command *acmd, struct plugin
 	return err;
 }
 
+static bool sanitize_action_starts(__u8 sanact)
+{
+	return sanact == NVME_SANITIZE_SANACT_START_BLOCK_ERASE ||
+		sanact == NVME_SANITIZE_SANACT_START_OVERWRITE ||
+		sanact == NVME_SANITIZE_SANACT_START_CRYPTO_ERASE;
+}
+
 static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Send a sanitize command.";
@@ -5425,6 +6894,7 @@ static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plug
 	const char *sanact_desc = "Sanitize action: 1 = Exit failure mode, 2 = Start block erase,"
 				"3 = Start overwrite, 4 = Start crypto erase, 5 = Exit media verification";
 	const char *ovrpat_desc = "Overwrite pattern.";
+	const char *wait = "Wait for the sanitize operation to finish";
 
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
@@ -5440,6 +6910,7 @@ static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plug
 		__u8	sanact;
 		__u32	ovrpat;
 		bool	emvs;
+		bool	wait;
 	};
 
 	struct config cfg = {
@@ -5450,6 +6921,7 @@ static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plug
 		.sanact		= 0,
 		.ovrpat		= 0,
 		.emvs		= false,
+		.wait		= false,
 	};
 
 	OPT_VALS(sanact) = {
@@ -5468,7 +6940,8 @@ static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plug
 		  OPT_FLAG("ause",       'u', &cfg.ause,       ause_desc),
 		  OPT_BYTE("sanact",     'a', &cfg.sanact,     sanact_desc, sanact),
 		  OPT_UINT("ovrpat",     'p', &cfg.ovrpat,     ovrpat_desc),
-		  OPT_FLAG("emvs",       'e', &cfg.emvs,       emvs_desc));
+		  OPT_FLAG("emvs",       'e', &cfg.emvs,       emvs_desc),
+		  OPT_FLAG("wait",       'w', &cfg.wait,       wait));
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
@@ -5522,6 +6995,9 @@ static int sanitize_cmd(int argc, char **argv, struct command *acmd, struct plug
 		return err;
 	}
 
+	if (cfg.wait && sanitize_action_starts(cfg.sanact))
+		err = wait_op(hdl, NVME_WAIT_SANITIZE);
+
 	return err;
 }
 
@@ -5534,6 +7010,7 @@ static int sanitize_ns_cmd(int argc, char **argv, struct command *acmd,
 	const char *sanact_desc = "Sanitize action: 1 = Exit failure mode,\n"
 		"4 = Start a crypto erase namespace sanitize operation,\n"
 		"5 = Exit media verification state";
+	const char *wait = "Wait for the sanitize operation to finish";
 
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl =
 		NULL;
@@ -5547,12 +7024,14 @@ static int sanitize_ns_cmd(int argc, char **argv, struct command *acmd,
 		bool	ause;
 		__u8	sanact;
 		bool	emvs;
+		bool	wait;
 	};
 
 	struct config cfg = {
 		.ause		= false,
 		.sanact		= 0,
 		.emvs		= false,
+		.wait		= false,
 	};
 
 	OPT_VALS(sanact) = {
@@ -5567,7 +7046,8 @@ static int sanitize_ns_cmd(int argc, char **argv, struct command *acmd,
 	NVME_ARGS(opts,
 		  OPT_FLAG("ause",   'u', &cfg.ause,   ause_desc),
 		  OPT_BYTE("sanact", 'a', &cfg.sanact, sanact_desc, sanact),
-		  OPT_FLAG("emvs",   'e', &cfg.emvs,   emvs_desc));
+		  OPT_FLAG("emvs",   'e', &cfg.emvs,   emvs_desc),
+		  OPT_FLAG("wait",   'w', &cfg.wait,   wait));
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
@@ -5608,6 +7088,9 @@ static int sanitize_ns_cmd(int argc, char **argv, struct command *acmd,
 		return err;
 	}
 
+	if (cfg.wait && sanitize_action_starts(cfg.sanact))
+		err = wait_op(hdl, NVME_WAIT_SANITIZE);
+
 	return err;
 }
 
@@ -6653,7 +8136,10 @@ static int format_cmd(int argc, char **argv, struct command *acmd, struct plugin
 			"WARNING: Format may irrevocably delete this device's data.\n"
 			"You have 10 seconds to press Ctrl-C to cancel this operation.\n\n"
 			"Use the force [--force] option to suppress this warning.\n");
-		sleep(10);
+		if (nvme_wait_countdown(10)) {
+			fprintf(stderr, "Format cancelled\n");
+			return -EINTR;
+		}
 		fprintf(stderr, "Sending format operation ...\n");
 	}
 
@@ -7448,6 +8934,184 @@ static int write_zeroes(int argc, char **argv,
 	return err;
 }
 
+struct range_batch {
+	struct nvme_extent_list	*list;
+	size_t			idx;	/* next extent */
+	__u64			off;	/* blocks of that extent already sent */
+	__u32			nsid;
+	__u32			max_ranges;
+	__u64			max_range_nlb;
+	__u64			max_nlb;	/* per command, 0 unlimited */
+	__u64			cmds;
+	__u64			ranges;
+	__u64			blocks;
+	const char		*name;
+};
+
+/* takes the next piece of the extent list honoring the per range limit */
+static bool range_batch_next(struct range_batch *b, __u64 total, __u64 *slba,
+			     __u64 *nlb, __u32 *attr)
+{
+	struct nvme_extent *e;
+
+	if (b->idx >= b->list->nr)
+		return false;
+	if (b->max_nlb && total >= b->max_nlb)
+		return false;
+
+	e = &b->list->ext[b->idx];
+	*slba = e->slba + b->off;
+	*attr = e->attr;
+	*nlb = min(e->nlb - b->off, b->max_range_nlb);
+	if (b->max_nlb)
+		*nlb = min(*nlb, b->max_nlb - total);
+
+	b->off += *nlb;
+	if (b->off == e->nlb) {
+		b->idx++;
+		b->off = 0;
+	}
+
+	return true;
+}
+
+static int range_batch_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			    void *buf, int err)
+{
+	struct range_batch *b = q->priv;
+
+	if (err)
+		nvme_show_err(b->name, err);
+
+	return err;
+}
+
+static int range_file_parse(struct nvme_transport_handle *hdl, __u32 nsid,
+			    const char *path, __u32 unit, bool sort,
+			    struct nvme_extent_list *list)
+{
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	__u8 lbaf;
+	int err;
+
+	err = nvme_extent_parse_file(list, path);
+	if (err) {
+		nvme_show_error("failed to read range file %s: %s", path,
+				nvme_strerror(-err));
+		return err;
+	}
+
+	if (unit)
+		list->unit = unit;
+
+	if (list->unit) {
+		ns = nvme_alloc(sizeof(*ns));
+		if (!ns)
+			return -ENOMEM;
+
+		err = nvme_identify_ns(hdl, nsid, ns);
+		if (err) {
+			nvme_show_err("identify namespace", err);
+			return err;
+		}
+
+		nvme_id_ns_flbas_to_lbaf_inuse(ns->flbas, &lbaf);
+		err = nvme_extent_scale(list, list->unit, 1 << ns->lbaf[lbaf].ds);
+		if (err) {
+			nvme_show_error("range file extents are not aligned to the logical block size");
+			return err;
+		}
+	}
+
+	nvme_extent_coalesce(list, sort);
+	if (!list->nr) {
+		nvme_show_error("No range definition provided");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_comma_list_len(const char *list)
+{
+	int n = 1;
+
+	if (!list || !*list)
+		return 0;
+
+	while ((list = strchr(list, ','))) {
+		list++;
+		n++;
+	}
+
+	return n;
+}
+
+struct dsm_batch {
+	struct range_batch	b;
+	bool			idr;
+	bool			idw;
+	bool			ad;
+};
+
+static int dsm_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		    void *buf)
+{
+	struct dsm_batch *d = q->priv;
+	struct nvme_dsm_range *r = buf;
+	__u64 slba, nlb, total = 0;
+	__u32 attr, n = 0;
+
+	while (n < d->b.max_ranges &&
+	       range_batch_next(&d->b, total, &slba, &nlb, &attr)) {
+		r[n].cattr = cpu_to_le32(attr);
+		r[n].nlb = cpu_to_le32(nlb);
+		r[n].slba = cpu_to_le64(slba);
+		total += nlb;
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+	nvme_init_dsm(cmd, d->b.nsid, n, d->idr, d->idw, d->ad, buf,
+		      n * sizeof(*r));
+	d->b.cmds++;
+	d->b.ranges += n;
+	d->b.blocks += total;
+
+	return 1;
+}
+
+/*
+ * DMRL, DMRSL and DMSL of the NVM command set limit the ranges per command,
+ * the blocks per range and the blocks per command. Zero means no limit.
+ */
+static void dsm_get_limits(struct nvme_transport_handle *hdl,
+			   struct range_batch *b)
+{
+	_cleanup_free_ struct nvme_id_ctrl_nvm *ctrl_nvm = NULL;
+	struct nvme_passthru_cmd cmd;
+
+	b->max_ranges = 256;
+	b->max_range_nlb = UINT32_MAX;
+	b->max_nlb = 0;
+
+	ctrl_nvm = nvme_alloc(sizeof(*ctrl_nvm));
+	if (!ctrl_nvm)
+		return;
+
+	nvme_init_identify_csi_ctrl(&cmd, NVME_CSI_NVM, ctrl_nvm);
+	if (nvme_submit_admin_passthru(hdl, &cmd))
+		return;
+
+	if (ctrl_nvm->dmrl)
+		b->max_ranges = ctrl_nvm->dmrl;
+	if (le32_to_cpu(ctrl_nvm->dmrsl))
+		b->max_range_nlb = le32_to_cpu(ctrl_nvm->dmrsl);
+	b->max_nlb = le64_to_cpu(ctrl_nvm->dmsl);
+}
+
 static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "The Dataset Management command is used by the host to\n"
@@ -7464,13 +9128,14 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	_cleanup_free_ struct nvme_dsm_range *dsm = NULL;
-	struct nvme_passthru_cmd cmd;
-	__u32 ctx_attrs[256] = {0,};
-	__u32 nlbs[256] = {0,};
-	__u64 slbas[256] = {0,};
+	_cleanup_free_ __u32 *ctx_attrs = NULL;
+	_cleanup_free_ __u32 *nlbs = NULL;
+	_cleanup_free_ __u64 *slbas = NULL;
+	struct nvme_extent_list list = { 0 };
+	struct dsm_batch d = { 0 };
+	struct nvme_ioq q = { 0 };
 	nvme_print_flags_t flags;
-	uint16_t nc, nb, ns;
+	int nc, nb, ns, max, i;
 	int err;
 
 	struct config {
@@ -7482,6 +9147,9 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 		bool	idw;
 		bool	idr;
 		__u32	cdw11;
+		char	*range_file;
+		__u32	range_unit;
+		__u32	qd;
 	};
 
 	struct config cfg = {
@@ -7493,6 +9161,9 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 		.idw		= false,
 		.idr		= false,
 		.cdw11		= 0,
+		.range_file	= "",
+		.range_unit	= 0,
+		.qd		= 8,
 	};
 
 	NVME_ARGS(opts,
@@ -7503,7 +9174,10 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 		  OPT_FLAG("ad",           'd', &cfg.ad,           ad),
 		  OPT_FLAG("idw",          'w', &cfg.idw,          idw),
 		  OPT_FLAG("idr",          'r', &cfg.idr,          idr),
-		  OPT_UINT("cdw11",        'c', &cfg.cdw11,        cdw11));
+		  OPT_UINT("cdw11",        'c', &cfg.cdw11,        cdw11),
+		  OPT_FILE("range-file",   'f', &cfg.range_file,   range_file),
+		  OPT_UINT("range-unit",   'u', &cfg.range_unit,   range_unit),
+		  OPT_UINT("queue-depth",  'q', &cfg.qd,           queue_depth));
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
@@ -7519,19 +9193,6 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 		return err;
 	}
 
-	nc = argconfig_parse_comma_sep_array_u32(cfg.ctx_attrs, ctx_attrs, ARRAY_SIZE(ctx_attrs));
-	nb = argconfig_parse_comma_sep_array_u32(cfg.blocks, nlbs, ARRAY_SIZE(nlbs));
-	ns = argconfig_parse_comma_sep_array_u64(cfg.slbas, slbas, ARRAY_SIZE(slbas));
-	if ((nb != ns) ||
-	    (argconfig_parse_seen(opts, "ctx-attrs") && nb != nc)) {
-		nvme_show_error("No valid range definition provided");
-		return -EINVAL;
-	}
-	if (!nb || nb > 256) {
-		nvme_show_error("No range definition provided");
-		return -EINVAL;
-	}
-
 	if (!cfg.namespace_id) {
 		err = nvme_get_nsid(hdl, &cfg.namespace_id);
 		if (err < 0) {
@@ -7539,27 +9200,654 @@ static int dsm(int argc, char **argv, struct command *acmd, struct plugin *plugi
 			return err;
 		}
 	}
+
+	if (strlen(cfg.range_file)) {
+		if (strlen(cfg.blocks) || strlen(cfg.slbas) || strlen(cfg.ctx_attrs)) {
+			nvme_show_error("--range-file can not be combined with range lists");
+			return -EINVAL;
+		}
+
+		err = range_file_parse(hdl, cfg.namespace_id, cfg.range_file,
+				       cfg.range_unit, true, &list);
+		if (err)
+			goto free;
+	} else {
+		max = max(parse_comma_list_len(cfg.blocks),
+			  parse_comma_list_len(cfg.slbas));
+		ctx_attrs = calloc(max + 1, sizeof(*ctx_attrs));
+		nlbs = calloc(max + 1, sizeof(*nlbs));
+		slbas = calloc(max + 1, sizeof(*slbas));
+		if (!ctx_attrs || !nlbs || !slbas)
+			return -ENOMEM;
+
+		nc = argconfig_parse_comma_sep_array_u32(cfg.ctx_attrs, ctx_attrs, max);
+		nb = argconfig_parse_comma_sep_array_u32(cfg.blocks, nlbs, max);
+		ns = argconfig_parse_comma_sep_array_u64(cfg.slbas, slbas, max);
+		if ((nb != ns) ||
+		    (argconfig_parse_seen(opts, "ctx-attrs") && nb != nc)) {
+			nvme_show_error("No valid range definition provided");
+			return -EINVAL;
+		}
+		if (nb <= 0) {
+			nvme_show_error("No range definition provided");
+			return -EINVAL;
+		}
+
+		for (i = 0; i < nb; i++) {
+			err = nvme_extent_add(&list, slbas[i], nlbs[i], ctx_attrs[i]);
+			if (err)
+				goto free;
+		}
+	}
+
 	if (cfg.cdw11) {
 		cfg.ad = NVME_GET(cfg.cdw11, DSM_CDW11_AD);
 		cfg.idw = NVME_GET(cfg.cdw11, DSM_CDW11_IDW);
 		cfg.idr = NVME_GET(cfg.cdw11, DSM_CDW11_IDR);
 	}
 
-	dsm = nvme_alloc(sizeof(*dsm) * nb);
-	if (!dsm)
+	d.b.list = &list;
+	d.b.nsid = cfg.namespace_id;
+	d.b.name = "data-set management";
+	d.idr = cfg.idr;
+	d.idw = cfg.idw;
+	d.ad = cfg.ad;
+	dsm_get_limits(hdl, &d.b);
+
+	q.hdl = hdl;
+	q.depth = cfg.qd;
+	q.buf_size = d.b.max_ranges * sizeof(struct nvme_dsm_range);
+	q.prep = dsm_prep;
+	q.done = range_batch_done;
+	q.priv = &d;
+
+	err = nvme_ioq_run(&q);
+	if (err)
+		goto free;
+
+	if (d.b.cmds > 1)
+		printf("NVMe DSM: success, %llu commands, %llu ranges, %llu blocks\n",
+		       (unsigned long long)d.b.cmds,
+		       (unsigned long long)d.b.ranges,
+		       (unsigned long long)d.b.blocks);
+	else
+		printf("NVMe DSM: success\n");
+
+free:
+	nvme_extent_free(&list);
+	return err;
+}
+
+enum wipe_method {
+	WIPE_AUTO,
+	WIPE_NSZ,
+	WIPE_WZ_DEAC,
+	WIPE_DSM,
+	WIPE_WZ,
+};
+
+static const char *wipe_method_str(enum wipe_method m)
+{
+	switch (m) {
+	case WIPE_NSZ:
+		return "Write Zeroes with Namespace Zeroes";
+	case WIPE_WZ_DEAC:
+		return "Write Zeroes with Deallocate";
+	case WIPE_DSM:
+		return "Dataset Management Deallocate";
+	case WIPE_WZ:
+		return "Write Zeroes";
+	default:
+		return "auto";
+	}
+}
+
+struct wipe {
+	/* first, dsm_prep() is handed the wipe as its batch */
+	struct dsm_batch	d;
+	__u16			control;
+	__u32			lba_size;
+	__u64			total;
+	__u64			done;
+	__u64			start_ns;
+	__u64			progress_ns;
+	bool			progress;
+};
+
+static __u64 wipe_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double wipe_mbps(struct wipe *w)
+{
+	__u64 ns = wipe_now_ns() - w->start_ns;
+
+	return ns ? (double)w->done * w->lba_size * 1000 / ns : 0;
+}
+
+static void show_wipe_progress(struct wipe *w)
+{
+	int progress = w->total ? w->done * 100 / w->total : 100;
+
+	printf("\r[%.*s%.*s] %3d%% %llu/%llu blocks, %.1f MB/s",
+	       progress / 2, dash, 50 - progress / 2, space, progress,
+	       (unsigned long long)w->done, (unsigned long long)w->total,
+	       wipe_mbps(w));
+	fflush(stdout);
+}
+
+static int wz_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		   void *buf)
+{
+	struct wipe *w = q->priv;
+	__u64 slba, nlb;
+	__u32 attr;
+
+	if (!range_batch_next(&w->d.b, 0, &slba, &nlb, &attr))
+		return 0;
+
+	nvme_init_write_zeros(cmd, w->d.b.nsid, slba, nlb - 1, w->control,
+			      0, 0, 0);
+	w->d.b.cmds++;
+	w->d.b.ranges++;
+	w->d.b.blocks += nlb;
+
+	return 1;
+}
+
+static int wipe_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		     void *buf, int err)
+{
+	struct wipe *w = q->priv;
+	struct nvme_dsm_range *r = buf;
+	__u32 i, nr;
+	__u64 now;
+
+	if (err) {
+		nvme_show_err(w->d.b.name, err);
+		return err;
+	}
+
+	if (cmd->opcode == nvme_cmd_dsm) {
+		nr = (cmd->cdw10 & 0xff) + 1;
+		for (i = 0; i < nr; i++)
+			w->done += le32_to_cpu(r[i].nlb);
+	} else {
+		w->done += (cmd->cdw12 & 0xffff) + 1;
+	}
+
+	now = wipe_now_ns();
+	if (w->progress && now - w->progress_ns >= 1000000000ULL) {
+		w->progress_ns = now;
+		show_wipe_progress(w);
+	}
+
+	return 0;
+}
+
+/*
+ * Deallocate is only a hint, even with DLFEAT reporting zeroes. Reads a
+ * sample of blocks spread over the extents and fails if any is not zero.
+ */
+static int wipe_check_zeroes(struct nvme_transport_handle *hdl, __u32 nsid,
+			     struct nvme_extent_list *list, __u32 len,
+			     __u32 lba_size)
+{
+	_cleanup_free_ __u8 *buf = NULL;
+	struct nvme_passthru_cmd cmd;
+	__u64 total = nvme_extent_blocks(list), pos, off;
+	unsigned int i, nr = min(total, (__u64)64);
+	size_t e;
+	int err;
+
+	buf = nvme_alloc(len);
+	if (!buf)
 		return -ENOMEM;
 
-	nvme_init_dsm_range(dsm, ctx_attrs, nlbs, slbas, nb);
-	nvme_init_dsm(&cmd, cfg.namespace_id, nb, cfg.idr, cfg.idw, cfg.ad, dsm,
-		      sizeof(*dsm) * nb);
-	err = nvme_submit_io_passthru(hdl, &cmd);
+	for (i = 0; i < nr; i++) {
+		pos = nr > 1 ? i * (total - 1) / (nr - 1) : 0;
+		for (e = 0, off = pos; off >= list->ext[e].nlb; e++)
+			off -= list->ext[e].nlb;
+
+		nvme_init_read(&cmd, nsid, list->ext[e].slba + off, 0, 0, 0, 0,
+			       buf, len, NULL, 0);
+		err = nvme_submit_io_passthru(hdl, &cmd);
+		if (err)
+			return err;
+
+		if (buf[0] || memcmp(buf, buf + 1, lba_size - 1))
+			return -ENODATA;
+	}
+
+	return 0;
+}
+
+static int wipe_run(struct nvme_transport_handle *hdl, struct wipe *w,
+		    enum wipe_method method, unsigned int qd)
+{
+	struct nvme_ioq q = { 0 };
+	int err;
+
+	w->d.b.idx = 0;
+	w->d.b.off = 0;
+	w->d.b.cmds = 0;
+	w->d.b.ranges = 0;
+	w->d.b.blocks = 0;
+	w->done = 0;
+
+	q.hdl = hdl;
+	q.depth = qd;
+	q.done = wipe_done;
+	q.priv = w;
+
+	if (method == WIPE_DSM) {
+		w->d.b.name = "data-set management";
+		w->d.ad = true;
+		dsm_get_limits(hdl, &w->d.b);
+		q.buf_size = w->d.b.max_ranges * sizeof(struct nvme_dsm_range);
+		q.prep = dsm_prep;
+	} else {
+		w->d.b.name = "write-zeroes";
+		w->d.b.max_ranges = 1;
+		w->d.b.max_nlb = 0;
+		q.prep = wz_prep;
+	}
+
+	w->start_ns = wipe_now_ns();
+	w->progress_ns = w->start_ns;
+	err = nvme_ioq_run(&q);
+	if (w->progress) {
+		show_wipe_progress(w);
+		printf("\n");
+	}
+
+	return err;
+}
+
+static int wipe_cmd(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Zero a whole namespace or a list of ranges with the\n"
+		"cheapest mechanism the namespace supports: Namespace Zeroes,\n"
+		"Write Zeroes with Deallocate, Dataset Management Deallocate\n"
+		"checked by reading back a sample, or plain Write Zeroes.";
+	const char *block_count = "number of blocks to zero, 0 for the rest of the namespace";
+	const char *method = "auto|nsz|wz-deac|dsm|wz";
+	const char *force = "do not ask for confirmation";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	_cleanup_free_ struct nvme_id_ctrl_nvm *ctrl_nvm = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	struct nvme_extent_list list = { 0 };
+	struct nvme_passthru_cmd cmd;
+	struct wipe w = { 0 };
+	__u64 wzsl = 65536, wzdsl;
+	__u16 oncs;
+	__u32 len;
+	__u8 lbaf;
+	bool zeroes, whole;
+	int err;
+
+	struct config {
+		__u32	nsid;
+		__u64	start_block;
+		__u64	block_count;
+		char	*range_file;
+		__u32	range_unit;
+		__u32	qd;
+		__u8	method;
+		bool	force;
+	};
+
+	struct config cfg = {
+		.nsid		= 0,
+		.start_block	= 0,
+		.block_count	= 0,
+		.range_file	= "",
+		.range_unit	= 0,
+		.qd		= 32,
+		.method		= WIPE_AUTO,
+		.force		= false,
+	};
+
+	OPT_VALS(methods) = {
+		VAL_BYTE("auto", WIPE_AUTO),
+		VAL_BYTE("nsz", WIPE_NSZ),
+		VAL_BYTE("wz-deac", WIPE_WZ_DEAC),
+		VAL_BYTE("dsm", WIPE_DSM),
+		VAL_BYTE("wz", WIPE_WZ),
+		VAL_END()
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("namespace-id",  'n', &cfg.nsid,        namespace_desired),
+		  OPT_SUFFIX("start-block", 's', &cfg.start_block, start_block),
+		  OPT_SUFFIX("block-count", 'c', &cfg.block_count, block_count),
+		  OPT_FILE("range-file",    'f', &cfg.range_file,  range_file),
+		  OPT_UINT("range-unit",    'u', &cfg.range_unit,  range_unit),
+		  OPT_UINT("queue-depth",   'q', &cfg.qd,          queue_depth),
+		  OPT_BYTE("method",        'm', &cfg.method,      method, methods),
+		  OPT_FLAG("force",           0, &cfg.force,       force));
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = open_fallback_chardev(ctx, cfg.nsid, &hdl);
+	if (err)
+		return err;
+
+	if (!cfg.nsid) {
+		err = nvme_get_nsid(hdl, &cfg.nsid);
+		if (err < 0) {
+			nvme_show_error("get-namespace-id: %s", nvme_strerror(err));
+			return err;
+		}
+	}
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	ns = nvme_alloc(sizeof(*ns));
+	ctrl_nvm = nvme_alloc(sizeof(*ctrl_nvm));
+	if (!ctrl || !ns || !ctrl_nvm)
+		return -ENOMEM;
+
+	err = nvme_identify_ctrl(hdl, ctrl);
+	if (err) {
+		nvme_show_err("identify controller", err);
+		return err;
+	}
+
+	err = nvme_identify_ns(hdl, cfg.nsid, ns);
+	if (err) {
+		nvme_show_err("identify namespace", err);
+		return err;
+	}
+
+	oncs = le16_to_cpu(ctrl->oncs);
+	nvme_id_ns_flbas_to_lbaf_inuse(ns->flbas, &lbaf);
+	w.lba_size = 1 << ns->lbaf[lbaf].ds;
+	len = w.lba_size;
+	if (ns->flbas & NVME_NS_FLBAS_META_EXT)
+		len += le16_to_cpu(ns->lbaf[lbaf].ms);
+
+	/* WZSL and WZDSL are in units of the minimum memory page size */
+	wzdsl = wzsl;
+	nvme_init_identify_csi_ctrl(&cmd, NVME_CSI_NVM, ctrl_nvm);
+	if (!nvme_submit_admin_passthru(hdl, &cmd)) {
+		if (ctrl_nvm->wzsl && ctrl_nvm->wzsl < 32)
+			wzsl = min(wzsl, (4096ULL << ctrl_nvm->wzsl) / w.lba_size);
+		wzdsl = wzsl;
+		if ((oncs & NVME_CTRL_ONCS_WRITE_ZEROES_DEALLOCATE) &&
+		    ctrl_nvm->wzdsl && ctrl_nvm->wzdsl < 32)
+			wzdsl = min((__u64)65536,
+				    (4096ULL << ctrl_nvm->wzdsl) / w.lba_size);
+	}
+
+	if (strlen(cfg.range_file)) {
+		if (cfg.start_block || cfg.block_count) {
+			nvme_show_error("--range-file can not be combined with a block range");
+			return -EINVAL;
+		}
+
+		err = range_file_parse(hdl, cfg.nsid, cfg.range_file,
+				       cfg.range_unit, true, &list);
+		if (err)
+			goto free;
+	} else {
+		if (cfg.start_block >= le64_to_cpu(ns->nsze)) {
+			nvme_show_error("start block beyond the namespace size");
+			return -EINVAL;
+		}
+		if (!cfg.block_count)
+			cfg.block_count = le64_to_cpu(ns->nsze) - cfg.start_block;
+
+		err = nvme_extent_add(&list, cfg.start_block, cfg.block_count, 0);
+		if (err)
+			goto free;
+	}
+
+	/* Namespace Zeroes ignores the range, it is for all of the namespace */
+	whole = list.nr == 1 && !list.ext[0].slba &&
+		list.ext[0].nlb == le64_to_cpu(ns->nsze);
+	if (cfg.method == WIPE_NSZ && !whole) {
+		nvme_show_error("--method=nsz zeroes the whole namespace, not a block range");
+		err = -EINVAL;
+		goto free;
+	}
+
+	zeroes = (ns->dlfeat & NVME_NS_DLFEAT_RB) == NVME_NS_DLFEAT_RB_ALL_0S;
+	if (cfg.method == WIPE_AUTO) {
+		if ((oncs & NVME_CTRL_ONCS_NAMESPACE_ZEROES) &&
+		    (oncs & NVME_CTRL_ONCS_WRITE_ZEROES) && whole)
+			cfg.method = WIPE_NSZ;
+		else if ((oncs & NVME_CTRL_ONCS_WRITE_ZEROES) && zeroes &&
+			 (ns->dlfeat & NVME_NS_DLFEAT_WRITE_ZEROES))
+			cfg.method = WIPE_WZ_DEAC;
+		else if ((oncs & NVME_CTRL_ONCS_DSM) && zeroes)
+			cfg.method = WIPE_DSM;
+		else if (oncs & NVME_CTRL_ONCS_WRITE_ZEROES)
+			cfg.method = WIPE_WZ;
+		else {
+			nvme_show_error("%s supports neither Write Zeroes nor deallocating to zeroes",
+					nvme_transport_handle_get_name(hdl));
+			err = -EOPNOTSUPP;
+			goto free;
+		}
+	}
+
+	if (!cfg.force) {
+		fprintf(stderr, "You are about to zero %llu blocks of %s, namespace %#x.\n",
+			(unsigned long long)nvme_extent_blocks(&list),
+			nvme_transport_handle_get_name(hdl), cfg.nsid);
+		fprintf(stderr,
+			"WARNING: This irrevocably deletes the data of these blocks.\n"
+			"You have 10 seconds to press Ctrl-C to cancel this operation.\n\n"
+			"Use the force [--force] option to suppress this warning.\n");
+		if (nvme_wait_countdown(10)) {
+			fprintf(stderr, "Wipe cancelled\n");
+			err = -EINTR;
+			goto free;
+		}
+	}
+
+	w.d.b.list = &list;
+	w.d.b.nsid = cfg.nsid;
+	w.total = nvme_extent_blocks(&list);
+	w.progress = isatty(STDOUT_FILENO);
+	if (ns->dps & NVME_NS_DPS_PI_MASK)
+		w.control |= NVME_IO_PRINFO_PRACT;
+
+	if (cfg.method == WIPE_NSZ) {
+		nvme_init_write_zeros(&cmd, cfg.nsid, 0, 0,
+				      w.control | NVME_IO_NSZ |
+				      (zeroes ? NVME_IO_DEAC : 0), 0, 0, 0);
+		w.start_ns = wipe_now_ns();
+		err = nvme_submit_io_passthru(hdl, &cmd);
+		if (err) {
+			nvme_show_err("write-zeroes", err);
+			goto free;
+		}
+		w.d.b.cmds = 1;
+		w.done = w.total;
+		/* the controller may zero just the one block instead */
+		if (!(cmd.result & 0x1)) {
+			fprintf(stderr, "Namespace Zeroes not applied, using Write Zeroes\n");
+			cfg.method = zeroes && (ns->dlfeat & NVME_NS_DLFEAT_WRITE_ZEROES) ?
+				WIPE_WZ_DEAC : WIPE_WZ;
+		}
+	}
+
+	if (cfg.method == WIPE_WZ_DEAC) {
+		w.control |= NVME_IO_DEAC;
+		w.d.b.max_range_nlb = wzdsl;
+	} else if (cfg.method == WIPE_WZ) {
+		w.d.b.max_range_nlb = wzsl;
+	}
+
+	if (cfg.method != WIPE_NSZ) {
+		err = wipe_run(hdl, &w, cfg.method, cfg.qd);
+		if (err)
+			goto free;
+	}
+
+	if (cfg.method == WIPE_DSM) {
+		err = wipe_check_zeroes(hdl, cfg.nsid, &list, len, w.lba_size);
+		if (err == -ENODATA && (oncs & NVME_CTRL_ONCS_WRITE_ZEROES)) {
+			fprintf(stderr, "Deallocated blocks do not read as zeroes, using Write Zeroes\n");
+			cfg.method = WIPE_WZ;
+			w.d.b.max_range_nlb = wzsl;
+			err = wipe_run(hdl, &w, cfg.method, cfg.qd);
+		} else if (err == -ENODATA) {
+			nvme_show_error("Deallocated blocks do not read as zeroes");
+		} else if (err) {
+			nvme_show_err("read", err);
+		}
+		if (err)
+			goto free;
+	}
+
+	printf("NVMe Wipe: %llu blocks zeroed with %s, %llu commands in %.1f s, %.1f MB/s\n",
+	       (unsigned long long)w.total, wipe_method_str(cfg.method),
+	       (unsigned long long)w.d.b.cmds,
+	       (double)(wipe_now_ns() - w.start_ns) / 1000000000ULL,
+	       wipe_mbps(&w));
+
+free:
+	nvme_extent_free(&list);
+	return err;
+}
+
+struct copy_batch {
+	struct range_batch		b;
+	struct nvme_passthru_cmd	tmpl;
+	__u64				sdlba;
+	__u8				format;
+};
+
+static int copy_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+		     void *buf)
+{
+	struct copy_batch *c = q->priv;
+	struct nvme_copy_range *f0 = buf;
+	struct nvme_copy_range_f1 *f1 = buf;
+	__u64 slba, nlb, total = 0;
+	__u32 attr, n = 0;
+
+	while (n < c->b.max_ranges &&
+	       range_batch_next(&c->b, total, &slba, &nlb, &attr)) {
+		if (c->format == 1) {
+			memset(&f1[n], 0, sizeof(f1[n]));
+			f1[n].slba = cpu_to_le64(slba);
+			f1[n].nlb = cpu_to_le16(nlb - 1);
+		} else {
+			memset(&f0[n], 0, sizeof(f0[n]));
+			f0[n].slba = cpu_to_le64(slba);
+			f0[n].nlb = cpu_to_le16(nlb - 1);
+		}
+		total += nlb;
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+	*cmd = c->tmpl;
+	cmd->addr = (__u64)(uintptr_t)buf;
+	cmd->data_len = n * (c->format == 1 ? sizeof(*f1) : sizeof(*f0));
+	cmd->cdw10 = c->sdlba & 0xffffffff;
+	cmd->cdw11 = c->sdlba >> 32;
+	cmd->cdw12 &= ~(NVME_COPY_CDW12_NR_MASK << NVME_COPY_CDW12_NR_SHIFT);
+	cmd->cdw12 |= NVME_FIELD_ENCODE(n - 1, NVME_COPY_CDW12_NR_SHIFT,
+					NVME_COPY_CDW12_NR_MASK);
+
+	/* the destination is written back to back in the order of the list */
+	c->sdlba += total;
+	c->b.cmds++;
+	c->b.ranges += n;
+	c->b.blocks += total;
+
+	return 1;
+}
+
+/*
+ * MSRC, MSSRL and MCL of the namespace limit the ranges per command, the
+ * blocks per range and the blocks per command.
+ */
+static int copy_get_limits(struct nvme_transport_handle *hdl, __u32 nsid,
+			   struct range_batch *b)
+{
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	int err;
+
+	ns = nvme_alloc(sizeof(*ns));
+	if (!ns)
+		return -ENOMEM;
+
+	err = nvme_identify_ns(hdl, nsid, ns);
 	if (err) {
-		nvme_show_err("data-set management", err);
+		nvme_show_err("identify namespace", err);
 		return err;
 	}
 
-	printf("NVMe DSM: success\n");
+	b->max_ranges = ns->msrc + 1;
+	b->max_range_nlb = le16_to_cpu(ns->mssrl) ? le16_to_cpu(ns->mssrl) :
+		UINT16_MAX + 1;
+	b->max_nlb = le32_to_cpu(ns->mcl);
+
+	return 0;
+}
+
+static int copy_range_file(struct nvme_transport_handle *hdl,
+			   struct nvme_passthru_cmd *tmpl, __u32 nsid,
+			   __u64 sdlba, __u8 format, const char *path,
+			   __u32 unit, __u32 qd)
+{
+	struct nvme_extent_list list = { 0 };
+	struct copy_batch c = { 0 };
+	struct nvme_ioq q = { 0 };
+	int err;
+
+	err = copy_get_limits(hdl, nsid, &c.b);
+	if (err)
+		return err;
+
+	err = range_file_parse(hdl, nsid, path, unit, false, &list);
+	if (err)
+		goto free;
+
+	c.b.list = &list;
+	c.b.nsid = nsid;
+	c.b.name = "NVMe Copy";
+	c.tmpl = *tmpl;
+	c.sdlba = sdlba;
+	c.format = format;
+
+	q.hdl = hdl;
+	q.depth = qd;
+	q.buf_size = c.b.max_ranges * sizeof(struct nvme_copy_range_f1);
+	q.prep = copy_prep;
+	q.done = range_batch_done;
+	q.priv = &c;
 
+	err = nvme_ioq_run(&q);
+	if (err)
+		goto free;
+
+	if (c.b.cmds > 1)
+		printf("NVMe Copy: success, %llu commands, %llu ranges, %llu blocks\n",
+		       (unsigned long long)c.b.cmds,
+		       (unsigned long long)c.b.ranges,
+		       (unsigned long long)c.b.blocks);
+	else
+		nvme_show_key_value("NVMe Copy", "success");
+
+free:
+	nvme_extent_free(&list);
 	return err;
 }
 
@@ -7634,6 +9922,9 @@ static int copy_cmd(int argc, char **argv, struct command *acmd, struct plugin *
 		__u8	format;
 		__u64	lbst;
 		bool	stc;
+		char	*range_file;
+		__u32	range_unit;
+		__u32	qd;
 	};
 
 	struct config cfg = {
@@ -7658,6 +9949,9 @@ static int copy_cmd(int argc, char **argv, struct command *acmd, struct plugin *
 		.format		= 0,
 		.lbst		= 0,
 		.stc		= false,
+		.range_file	= "",
+		.range_unit	= 0,
+		.qd		= 8,
 	};
 
 	NVME_ARGS(opts,
@@ -7681,12 +9975,49 @@ static int copy_cmd(int argc, char **argv, struct command *acmd, struct plugin *
 		  OPT_SHRT("dir-spec",               'S', &cfg.dspec,		d_dspec),
 		  OPT_BYTE("format",                 'F', &cfg.format,		d_format),
 		  OPT_SUFFIX("storage-tag",			 't', &cfg.lbst,		storage_tag),
-		  OPT_FLAG("storage-tag-check",		 'c', &cfg.stc,			storage_tag_check));
+		  OPT_FLAG("storage-tag-check",		 'c', &cfg.stc,			storage_tag_check),
+		  OPT_FILE("range-file",             0,   &cfg.range_file,	range_file),
+		  OPT_UINT("range-unit",             0,   &cfg.range_unit,	range_unit),
+		  OPT_UINT("queue-depth",            'q', &cfg.qd,		queue_depth));
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
 		return err;
 
+	if (strlen(cfg.range_file)) {
+		if (strlen(cfg.nlbs) || strlen(cfg.slbas) || strlen(cfg.snsids) ||
+		    strlen(cfg.sopts) || strlen(cfg.eilbrts) ||
+		    strlen(cfg.elbats) || strlen(cfg.elbatms)) {
+			nvme_show_error("--range-file can not be combined with range lists");
+			return -EINVAL;
+		}
+		if (cfg.format > 1) {
+			nvme_show_error("--range-file supports formats 0 and 1 only");
+			return -EINVAL;
+		}
+
+		if (!cfg.nsid) {
+			err = nvme_get_nsid(hdl, &cfg.nsid);
+			if (err < 0) {
+				nvme_show_error("get-namespace-id: %s", nvme_strerror(err));
+				return err;
+			}
+		}
+
+		/* tags and directives are the same for every command */
+		nvme_init_copy(&cmd, cfg.nsid, cfg.sdlba, 1, cfg.format,
+			       cfg.prinfor, cfg.prinfow, 0, cfg.dtype, cfg.stc,
+			       cfg.stc, cfg.fua, cfg.lr, 0, cfg.dspec, NULL);
+		err = init_pi_tags(hdl, &cmd, cfg.nsid, cfg.ilbrt, cfg.lbst,
+				   cfg.lbat, cfg.lbatm);
+		if (err != 0 && err != -ENAVAIL)
+			return err;
+
+		return copy_range_file(hdl, &cmd, cfg.nsid, cfg.sdlba,
+				       cfg.format, cfg.range_file,
+				       cfg.range_unit, cfg.qd);
+	}
+
 	nb = argconfig_parse_comma_sep_array_u16(cfg.nlbs, nlbs,
 						 ARRAY_SIZE(nlbs));
 	ns = argconfig_parse_comma_sep_array_u64(cfg.slbas, slbas,
@@ -8627,6 +10958,268 @@ static int verify_cmd(int argc, char **argv, struct command *acmd, struct plugin
 	return err;
 }
 
+static int show_scrub_progress(struct nvme_scrub *s, void *arg)
+{
+	int progress = s->total ? s->done * 100 / s->total : 100;
+
+	printf("\r[%.*s%.*s] %3d%% %llu/%llu blocks, %u failing ranges",
+	       progress / 2, dash, 50 - progress / 2, space, progress,
+	       (unsigned long long)s->done, (unsigned long long)s->total,
+	       s->nr_errors);
+	fflush(stdout);
+
+	return 0;
+}
+
+static int scrub_report(struct nvme_scrub *s, const char *path)
+{
+	_cleanup_file_ FILE *f = NULL;
+	unsigned int i;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	fprintf(f, "# slba nlb, failing Verify ranges of namespace %u\n",
+		s->nsid);
+	for (i = 0; i < s->nr_errors; i++)
+		fprintf(f, "%llu %u # %s\n",
+			(unsigned long long)s->errors[i].slba,
+			s->errors[i].nlb,
+			nvme_status_to_string(s->errors[i].status, false));
+
+	return fflush(f) ? -errno : 0;
+}
+
+static int scrub_lba_status(struct nvme_scrub *s, nvme_print_flags_t flags)
+{
+	_cleanup_free_ void *buf = NULL;
+	struct nvme_passthru_cmd cmd;
+	__u32 mndw = (NVME_LOG_PAGE_PDU_SIZE >> 2) - 1;
+	unsigned int i;
+	int err;
+
+	buf = nvme_alloc(NVME_LOG_PAGE_PDU_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < s->nr_errors; i++) {
+		struct nvme_scrub_error *e = &s->errors[i];
+
+		nvme_init_get_lba_status(&cmd, s->nsid, e->slba, mndw,
+					 NVME_LBA_STATUS_ATYPE_TRACKED,
+					 min(e->nlb, (__u32)UINT16_MAX), buf);
+		err = nvme_submit_admin_passthru(s->hdl, &cmd);
+		if (err) {
+			nvme_show_err("get lba status", err);
+			return err;
+		}
+
+		nvme_show_lba_status(buf, NVME_LOG_PAGE_PDU_SIZE, flags);
+	}
+
+	return 0;
+}
+
+static int scrub_cmd(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Verify a whole namespace or a list of ranges in the background.\n"
+		"Verify commands of up to the Verify Size Limit are kept in flight\n"
+		"and throttled to the given rate; ranges failing to verify are\n"
+		"reported at the end. With a state file an interrupted scrub is\n"
+		"resumed by running the same command again.";
+	const char *block_count = "number of blocks to verify, 0 for the rest of the namespace";
+	const char *iops = "maximum Verify commands per second, 0 for no limit";
+	const char *bandwidth = "maximum bytes verified per second, 0 for no limit";
+	const char *state_file = "checkpoint file used to resume an interrupted scrub";
+	const char *report = "write failing ranges to this file, usable as --range-file";
+	const char *lba_status = "issue Get LBA Status for each failing range";
+	const char *force_unit_access_verify =
+	    "force device to commit cached data before performing the verify operation";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	struct nvme_extent_list list = { 0 };
+	struct nvme_scrub s = { 0 };
+	nvme_print_flags_t flags;
+	__u16 control = 0;
+	unsigned int i;
+	int err;
+
+	struct config {
+		__u32	nsid;
+		__u64	start_block;
+		__u64	block_count;
+		char	*range_file;
+		__u32	range_unit;
+		__u32	qd;
+		__u64	iops;
+		__u64	bandwidth;
+		char	*state_file;
+		char	*report;
+		bool	lba_status;
+		bool	limited_retry;
+		bool	force_unit_access;
+	};
+
+	struct config cfg = {
+		.nsid			= 0,
+		.start_block		= 0,
+		.block_count		= 0,
+		.range_file		= "",
+		.range_unit		= 0,
+		.qd			= 4,
+		.iops			= 0,
+		.bandwidth		= 0,
+		.state_file		= "",
+		.report			= "",
+		.lba_status		= false,
+		.limited_retry		= false,
+		.force_unit_access	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("namespace-id",      'n', &cfg.nsid,              namespace_desired),
+		  OPT_SUFFIX("start-block",     's', &cfg.start_block,       start_block),
+		  OPT_SUFFIX("block-count",     'c', &cfg.block_count,       block_count),
+		  OPT_FILE("range-file",        'f', &cfg.range_file,        range_file),
+		  OPT_UINT("range-unit",        'u', &cfg.range_unit,        range_unit),
+		  OPT_UINT("queue-depth",       'q', &cfg.qd,                queue_depth),
+		  OPT_SUFFIX("iops",            'I', &cfg.iops,              iops),
+		  OPT_SUFFIX("bandwidth",       'B', &cfg.bandwidth,         bandwidth),
+		  OPT_FILE("state-file",        'S', &cfg.state_file,        state_file),
+		  OPT_FILE("report",            'r', &cfg.report,            report),
+		  OPT_FLAG("lba-status",        'L', &cfg.lba_status,        lba_status),
+		  OPT_FLAG("limited-retry",     'l', &cfg.limited_retry,     limited_retry),
+		  OPT_FLAG("force-unit-access", 'F', &cfg.force_unit_access, force_unit_access_verify));
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = open_fallback_chardev(ctx, cfg.nsid, &hdl);
+	if (err)
+		return err;
+
+	err = validate_output_format(nvme_cfg.output_format, &flags);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (!cfg.nsid) {
+		err = nvme_get_nsid(hdl, &cfg.nsid);
+		if (err < 0) {
+			nvme_show_error("get-namespace-id: %s", nvme_strerror(err));
+			return err;
+		}
+	}
+
+	if (strlen(cfg.range_file)) {
+		if (cfg.start_block || cfg.block_count) {
+			nvme_show_error("--range-file can not be combined with a block range");
+			return -EINVAL;
+		}
+
+		err = range_file_parse(hdl, cfg.nsid, cfg.range_file,
+				       cfg.range_unit, true, &list);
+		if (err)
+			goto free;
+	} else {
+		if (!cfg.block_count) {
+			ns = nvme_alloc(sizeof(*ns));
+			if (!ns)
+				return -ENOMEM;
+
+			err = nvme_identify_ns(hdl, cfg.nsid, ns);
+			if (err) {
+				nvme_show_err("identify namespace", err);
+				return err;
+			}
+
+			if (cfg.start_block >= le64_to_cpu(ns->nsze)) {
+				nvme_show_error("start block beyond the namespace size");
+				return -EINVAL;
+			}
+			cfg.block_count = le64_to_cpu(ns->nsze) - cfg.start_block;
+		}
+
+		err = nvme_extent_add(&list, cfg.start_block, cfg.block_count, 0);
+		if (err)
+			goto free;
+	}
+
+	err = nvme_scrub_init(&s, hdl, cfg.nsid, &list);
+	if (err) {
+		nvme_show_err("identify namespace", err);
+		goto free;
+	}
+
+	if (cfg.limited_retry)
+		control |= NVME_IO_LR;
+	if (cfg.force_unit_access)
+		control |= NVME_IO_FUA;
+	nvme_init_verify(&s.tmpl, cfg.nsid, 0, 0, control, 0, NULL, 0, NULL, 0);
+
+	s.depth = cfg.qd;
+	s.iops = cfg.iops;
+	s.bps = cfg.bandwidth;
+	s.state_file = strlen(cfg.state_file) ? cfg.state_file : NULL;
+	if (flags == NORMAL && isatty(STDOUT_FILENO))
+		s.progress = show_scrub_progress;
+
+	err = nvme_scrub_run(&s);
+	if (s.progress)
+		printf("\n");
+	if (err == -ESTALE || err == -EBADMSG) {
+		nvme_show_error("state file %s does not belong to this scrub, remove it to start over",
+				cfg.state_file);
+		goto free;
+	}
+	if (err == -EINTR) {
+		printf("Scrub interrupted after %llu of %llu blocks\n",
+		       (unsigned long long)s.done, (unsigned long long)s.total);
+		goto free;
+	}
+	if (err) {
+		nvme_show_err("verify", err);
+		goto free;
+	}
+
+	if (s.resumed)
+		printf("Resumed at block %llu of %llu\n",
+		       (unsigned long long)s.resumed,
+		       (unsigned long long)s.total);
+	printf("NVMe Scrub: verified %llu blocks with %llu commands, %u failing ranges\n",
+	       (unsigned long long)s.verified, (unsigned long long)s.cmds,
+	       s.nr_errors);
+	for (i = 0; i < s.nr_errors; i++)
+		printf("  slba %llu nlb %u: %s\n",
+		       (unsigned long long)s.errors[i].slba, s.errors[i].nlb,
+		       nvme_status_to_string(s.errors[i].status, false));
+
+	if (strlen(cfg.report)) {
+		err = scrub_report(&s, cfg.report);
+		if (err) {
+			nvme_show_error("failed to write %s: %s", cfg.report,
+					nvme_strerror(-err));
+			goto free;
+		}
+	}
+
+	if (cfg.lba_status)
+		err = scrub_lba_status(&s, flags);
+
+	/* failing ranges are reported like a failing single Verify */
+	if (!err && s.nr_errors)
+		err = s.errors[0].status;
+free:
+	nvme_scrub_free(&s);
+	nvme_extent_free(&list);
+	return err;
+}
+
 static int sec_recv(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Obtain results of one or more\n"
@@ -8707,6 +11300,219 @@ static int sec_recv(int argc, char **argv, struct command *acmd, struct plugin *
 	return err;
 }
 
+struct lba_scan {
+	struct range_batch		b;
+	struct nvme_extent_list		cont;	/* rest of incomplete ranges */
+	struct nvme_extent_list		map;
+	__u32				mndw;
+	__u8				atype;
+};
+
+static int lba_scan_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			 void *buf)
+{
+	struct lba_scan *l = q->priv;
+	struct nvme_extent *e;
+	__u64 slba, nlb;
+	__u32 attr;
+
+	if (l->cont.nr) {
+		e = &l->cont.ext[--l->cont.nr];
+		slba = e->slba;
+		nlb = e->nlb;
+	} else if (!range_batch_next(&l->b, 0, &slba, &nlb, &attr)) {
+		return 0;
+	}
+
+	nvme_init_get_lba_status(cmd, l->b.nsid, slba, l->mndw, l->atype, nlb,
+				 buf);
+	l->b.cmds++;
+
+	return 1;
+}
+
+static int lba_scan_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			 void *buf, int err)
+{
+	struct lba_scan *l = q->priv;
+	struct nvme_lba_status *status = buf;
+	__u64 slba = cmd->cdw10 | (__u64)cmd->cdw11 << 32;
+	__u64 end = slba + (cmd->cdw13 & 0xffff), last = 0;
+	__u32 i, nlsd;
+
+	if (err) {
+		nvme_show_err("get lba status", err);
+		return err;
+	}
+
+	nlsd = min(le32_to_cpu(status->nlsd),
+		   (cmd->data_len - sizeof(*status)) / sizeof(status->descs[0]));
+	for (i = 0; i < nlsd; i++) {
+		struct nvme_lba_status_desc *d = &status->descs[i];
+
+		err = nvme_extent_add(&l->map, le64_to_cpu(d->dslba),
+				      le32_to_cpu(d->nlb), d->status);
+		if (err)
+			return err;
+		last = le64_to_cpu(d->dslba) + le32_to_cpu(d->nlb);
+	}
+
+	/* more descriptors than fit into the buffer, continue after the last */
+	if (status->cmpc == NVME_LBA_STATUS_CMPC_INCOMPLETE && nlsd &&
+	    last > slba && last < end) {
+		err = nvme_extent_add(&l->cont, last, end - last, 0);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* adds the ranges the LBA Status Information log recommends to check */
+static int lba_scan_log_ranges(struct nvme_transport_handle *hdl, __u32 nsid,
+			       struct nvme_extent_list *list, __u8 *atype)
+{
+	_cleanup_free_ struct nvme_lba_status_log *log = NULL;
+	struct nvme_lbas_ns_element *ne;
+	__u32 len, i, j, off;
+	int err;
+
+	err = nvme_get_log_lba_status(hdl, false, 0, &len, sizeof(__u32));
+	if (err)
+		return err;
+
+	len = le32_to_cpu(len);
+	if (len < sizeof(*log))
+		return 0;
+
+	log = nvme_alloc(len);
+	if (!log)
+		return -ENOMEM;
+
+	err = nvme_get_log_lba_status(hdl, false, 0, log, len);
+	if (err)
+		return err;
+
+	off = sizeof(*log);
+	for (i = 0; i < le32_to_cpu(log->nlslne); i++) {
+		if (off + sizeof(*ne) > len)
+			break;
+		ne = (void *)log + off;
+		off += sizeof(*ne) + le32_to_cpu(ne->nlrd) * sizeof(ne->lba_rd[0]);
+		if (le32_to_cpu(ne->neid) != nsid || off > len)
+			continue;
+
+		if (!*atype)
+			*atype = ne->ratype;
+		for (j = 0; j < le32_to_cpu(ne->nlrd); j++) {
+			err = nvme_extent_add(list,
+					      le64_to_cpu(ne->lba_rd[j].rslba),
+					      le32_to_cpu(ne->lba_rd[j].rnlb), 0);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+static int lba_scan_write_map(struct nvme_extent_list *map, const char *path)
+{
+	_cleanup_file_ FILE *file = NULL;
+	FILE *f = stdout;
+	size_t i;
+
+	if (path) {
+		file = fopen(path, "w");
+		if (!file)
+			return -errno;
+		f = file;
+	}
+
+	fprintf(f, "# slba nlb, LBA status descriptors\n");
+	for (i = 0; i < map->nr; i++)
+		fprintf(f, "%llu %llu # status %#x\n",
+			(unsigned long long)map->ext[i].slba,
+			(unsigned long long)map->ext[i].nlb, map->ext[i].attr);
+
+	return fflush(f) ? -errno : 0;
+}
+
+static int get_lba_status_scan(struct nvme_transport_handle *hdl, __u32 nsid,
+			       __u64 slba, __u8 atype, bool from_log,
+			       const char *map_file, __u32 qd)
+{
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	struct nvme_extent_list list = { 0 };
+	struct lba_scan l = { 0 };
+	struct nvme_ioq q = { 0 };
+	int err;
+
+	if (from_log) {
+		err = lba_scan_log_ranges(hdl, nsid, &list, &atype);
+		if (err) {
+			nvme_show_err("lba status log page", err);
+			goto free;
+		}
+		nvme_extent_coalesce(&list, true);
+	} else {
+		ns = nvme_alloc(sizeof(*ns));
+		if (!ns)
+			return -ENOMEM;
+
+		err = nvme_identify_ns(hdl, nsid, ns);
+		if (err) {
+			nvme_show_err("identify namespace", err);
+			return err;
+		}
+		if (slba < le64_to_cpu(ns->nsze))
+			err = nvme_extent_add(&list, slba,
+					      le64_to_cpu(ns->nsze) - slba, 0);
+		if (err)
+			goto free;
+	}
+
+	if (!atype)
+		atype = NVME_LBA_STATUS_ATYPE_TRACKED;
+
+	l.b.list = &list;
+	l.b.nsid = nsid;
+	l.b.max_ranges = 1;
+	l.b.max_range_nlb = UINT16_MAX;
+	l.mndw = (NVME_LOG_PAGE_PDU_SIZE >> 2) - 1;
+	l.atype = atype;
+
+	q.hdl = hdl;
+	q.admin = true;
+	q.depth = qd;
+	q.buf_size = NVME_LOG_PAGE_PDU_SIZE;
+	q.prep = lba_scan_prep;
+	q.done = lba_scan_done;
+	q.priv = &l;
+
+	err = nvme_ioq_run(&q);
+	if (err)
+		goto free;
+
+	nvme_extent_coalesce(&l.map, true);
+	err = lba_scan_write_map(&l.map, map_file);
+	if (err) {
+		nvme_show_error("failed to write %s: %s", map_file,
+				nvme_strerror(-err));
+		goto free;
+	}
+
+	if (map_file)
+		printf("LBA status scan: %llu commands, %zu ranges, %llu blocks\n",
+		       (unsigned long long)l.b.cmds, l.map.nr,
+		       (unsigned long long)nvme_extent_blocks(&l.map));
+free:
+	nvme_extent_free(&l.map);
+	nvme_extent_free(&l.cont);
+	nvme_extent_free(&list);
+	return err;
+}
+
 static int get_lba_status(int argc, char **argv, struct command *acmd,
 		struct plugin *plugin)
 {
@@ -8719,6 +11525,9 @@ static int get_lba_status(int argc, char **argv, struct command *acmd,
 		"the controller uses in determining the LBA Status Descriptors to return.";
 	const char *rl =
 	    "Range Length(RL) specifies the length of the range of contiguous LBAs beginning at SLBA";
+	const char *scan = "scan the namespace from SLBA to its end and print a range file";
+	const char *from_log = "scan the ranges of the LBA Status Information log";
+	const char *map_file = "write the range file of a scan to this file";
 
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
@@ -8734,6 +11543,10 @@ static int get_lba_status(int argc, char **argv, struct command *acmd,
 		__u32	mndw;
 		__u8	atype;
 		__u16	rl;
+		bool	scan;
+		bool	from_log;
+		char	*map_file;
+		__u32	qd;
 	};
 
 	struct config cfg = {
@@ -8742,6 +11555,10 @@ static int get_lba_status(int argc, char **argv, struct command *acmd,
 		.mndw		= 0,
 		.atype		= 0,
 		.rl		= 0,
+		.scan		= false,
+		.from_log	= false,
+		.map_file	= "",
+		.qd		= 8,
 	};
 
 	NVME_ARGS(opts,
@@ -8749,7 +11566,11 @@ static int get_lba_status(int argc, char **argv, struct command *acmd,
 		  OPT_SUFFIX("start-lba",  's', &cfg.slba,          slba),
 		  OPT_UINT("max-dw",       'm', &cfg.mndw,          mndw),
 		  OPT_BYTE("action",       'a', &cfg.atype,         atype),
-		  OPT_SHRT("range-len",    'l', &cfg.rl,            rl));
+		  OPT_SHRT("range-len",    'l', &cfg.rl,            rl),
+		  OPT_FLAG("scan",         'S', &cfg.scan,          scan),
+		  OPT_FLAG("from-log",     'L', &cfg.from_log,      from_log),
+		  OPT_FILE("map-file",     'M', &cfg.map_file,      map_file),
+		  OPT_UINT("queue-depth",  'q', &cfg.qd,            queue_depth));
 
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
@@ -8761,6 +11582,21 @@ static int get_lba_status(int argc, char **argv, struct command *acmd,
 		return err;
 	}
 
+	if (cfg.scan || cfg.from_log) {
+		if (!cfg.namespace_id) {
+			err = nvme_get_nsid(hdl, &cfg.namespace_id);
+			if (err < 0) {
+				nvme_show_error("get-namespace-id: %s", nvme_strerror(err));
+				return err;
+			}
+		}
+
+		return get_lba_status_scan(hdl, cfg.namespace_id, cfg.slba,
+					   cfg.atype, cfg.from_log,
+					   strlen(cfg.map_file) ? cfg.map_file : NULL,
+					   cfg.qd);
+	}
+
 	if (!cfg.atype) {
 		nvme_show_error("action type (--action) has to be given");
 		return -EINVAL;
@@ -11116,6 +13952,13 @@ int main(int argc, char **argv)
 	if (err)
 		return err;
 
+	err = nvme_trace_setup();
+	if (err) {
+		nvme_show_error("failed to set up command trace: %s",
+				nvme_strerror(-err));
+		return 1;
+	}
+
 	err = handle_plugin(argc - 1, &argv[1], nvme.extensions);
 	if (err == -ENOTTY)
 		general_help(&builtin, NULL);
@@ -6,13 +6,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 #include <linux/fs.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
+#include "nvme-ioq.h"
 #include "nvme-print.h"
+#include "nvme-wait.h"
+#include "util/json.h"
+#include "util/mem.h"
+#include "util/types.h"
 
 #define CREATE_CMD
 #include "fdp.h"
@@ -584,3 +592,849 @@ static int fdp_feature(int argc, char **argv, struct command *acmd, struct plugi
 	       (cfg.disable) ? "disabling" : "enabling", cfg.endgid, cfg.fdpcidx);
 	return err;
 }
+
+/* event types counted per sample, host events first */
+static const struct {
+	__u8		type;
+	const char	*name;
+} fdp_sample_events[] = {
+	{ NVME_FDP_EVENT_RUNFW,		"runfw" },
+	{ NVME_FDP_EVENT_RUTLE,		"rutle" },
+	{ NVME_FDP_EVENT_RESET,		"reset" },
+	{ NVME_FDP_EVENT_PID,		"pid" },
+	{ NVME_FDP_EVENT_REALLOC,	"realloc" },
+	{ NVME_FDP_EVENT_MODIFY,	"modify" },
+};
+
+#define FDP_SAMPLE_EVENTS	ARRAY_SIZE(fdp_sample_events)
+
+/* the Data Placement directive type */
+#define FDP_DTYPE		2
+
+struct fdp_sample_ruh {
+	__u16		pid;
+	__u16		ruhid;
+	__u64		ruamw;
+	__u64		ru_blocks;	/* reclaim unit blocks used */
+	__u64		host_blocks;	/* written by the workload */
+	__u64		host_new;	/* written since the last sample */
+	__u64		last_ru_blocks;
+	__u64		last_host_blocks;
+};
+
+/*
+ * Periodic snapshots of the FDP statistics, the reclaim unit handle status
+ * and the events, reported as the difference to the previous snapshot.
+ *
+ * The media bytes written are only reported per endurance group. What a
+ * reclaim unit handle consumed is derived from its Reclaim Unit Available
+ * Media Writes: the decrease while a reclaim unit is being filled, plus
+ * the rest of the old and the start of the new unit when the handle moves
+ * on to another reclaim unit.
+ */
+struct fdp_sampler {
+	struct nvme_transport_handle *hdl;
+	nvme_print_flags_t	flags;
+	__u16			egid;
+	__u32			nsid;
+	__u32			lba_size;
+	__u64			runs;		/* reclaim unit size in blocks */
+	struct fdp_sample_ruh	*ruhs;
+	unsigned int		nr_ruhs;
+	long double		hbmw0;
+	long double		mbmw0;
+	long double		hbmw;
+	long double		mbmw;
+	long double		mbe;
+	__u64			event_ts;
+	unsigned int		events[FDP_SAMPLE_EVENTS];
+	struct timeval		start;
+};
+
+static int fdp_sampler_ruh_status(struct fdp_sampler *s,
+				  struct nvme_fdp_ruh_status **status)
+{
+	struct nvme_fdp_ruh_status hdr;
+	struct nvme_passthru_cmd cmd;
+	size_t len;
+	int err;
+
+	nvme_init_fdp_reclaim_unit_handle_status(&cmd, s->nsid, &hdr,
+						 sizeof(hdr));
+	err = nvme_submit_io_passthru(s->hdl, &cmd);
+	if (err)
+		return err;
+
+	len = sizeof(hdr) + le16_to_cpu(hdr.nruhsd) *
+		sizeof(struct nvme_fdp_ruh_status_desc);
+	*status = malloc(len);
+	if (!*status)
+		return -ENOMEM;
+
+	nvme_init_fdp_reclaim_unit_handle_status(&cmd, s->nsid, *status, len);
+	err = nvme_submit_io_passthru(s->hdl, &cmd);
+	if (err) {
+		free(*status);
+		*status = NULL;
+	}
+
+	return err;
+}
+
+/* the size of the reclaim units of the FDP configuration in use */
+static __u64 fdp_sampler_runs(struct fdp_sampler *s)
+{
+	_cleanup_free_ struct nvme_fdp_config_log *log = NULL;
+	struct nvme_fdp_config_log hdr;
+	struct nvme_fdp_config_desc *conf;
+	__u64 result;
+	unsigned int idx, i;
+	void *p;
+
+	if (nvme_get_features(s->hdl, NVME_NSID_ALL, NVME_FEAT_FID_FDP,
+			      NVME_GET_FEATURES_SEL_CURRENT, s->egid, 0, NULL,
+			      0, &result) || !(result & 0x1))
+		return 0;
+	idx = (result >> 8) & 0xff;
+
+	if (nvme_get_log_fdp_configurations(s->hdl, s->egid, 0, &hdr,
+					    sizeof(hdr)))
+		return 0;
+
+	log = malloc(le32_to_cpu(hdr.size));
+	if (!log || nvme_get_log_fdp_configurations(s->hdl, s->egid, 0, log,
+						   le32_to_cpu(hdr.size)))
+		return 0;
+
+	p = log->configs;
+	for (i = 0; i <= le16_to_cpu(log->n); i++) {
+		conf = p;
+		if (p + sizeof(*conf) > (void *)log + le32_to_cpu(hdr.size))
+			return 0;
+		if (i == idx)
+			return le64_to_cpu(conf->runs) / s->lba_size;
+		p += le16_to_cpu(conf->size);
+	}
+
+	return 0;
+}
+
+static int fdp_sampler_events(struct fdp_sampler *s, bool count)
+{
+	struct nvme_fdp_events_log events;
+	struct nvme_fdp_event *e;
+	__u64 ts, last = s->event_ts;
+	unsigned int i, j, n;
+	int host, err;
+
+	for (host = 0; host < 2; host++) {
+		err = nvme_get_log_fdp_events(s->hdl, s->egid, host, 0, &events,
+					      sizeof(events));
+		if (err)
+			return err;
+
+		n = min(le32_to_cpu(events.n), ARRAY_SIZE(events.events));
+		for (i = 0; i < n; i++) {
+			e = &events.events[i];
+			ts = int48_to_long(e->ts.timestamp);
+			if (ts <= s->event_ts)
+				continue;
+			last = max(last, ts);
+
+			for (j = 0; count && j < FDP_SAMPLE_EVENTS; j++)
+				if (fdp_sample_events[j].type == e->type)
+					s->events[j]++;
+		}
+	}
+
+	s->event_ts = last;
+
+	return 0;
+}
+
+static int fdp_sampler_init(struct fdp_sampler *s)
+{
+	_cleanup_free_ struct nvme_fdp_ruh_status *status = NULL;
+	struct nvme_fdp_stats_log stats;
+	struct nvme_id_ns ns;
+	unsigned int i;
+	__u8 lbaf;
+	int err;
+
+	err = nvme_identify_ns(s->hdl, s->nsid, &ns);
+	if (err)
+		return err;
+
+	nvme_id_ns_flbas_to_lbaf_inuse(ns.flbas, &lbaf);
+	s->lba_size = 1 << ns.lbaf[lbaf].ds;
+	if (!s->egid)
+		s->egid = le16_to_cpu(ns.endgid);
+
+	err = fdp_sampler_ruh_status(s, &status);
+	if (err)
+		return err;
+
+	s->nr_ruhs = le16_to_cpu(status->nruhsd);
+	s->ruhs = calloc(s->nr_ruhs, sizeof(*s->ruhs));
+	if (!s->ruhs)
+		return -ENOMEM;
+
+	for (i = 0; i < s->nr_ruhs; i++) {
+		s->ruhs[i].pid = le16_to_cpu(status->ruhss[i].pid);
+		s->ruhs[i].ruhid = le16_to_cpu(status->ruhss[i].ruhid);
+		s->ruhs[i].ruamw = le64_to_cpu(status->ruhss[i].ruamw);
+	}
+
+	s->runs = fdp_sampler_runs(s);
+
+	err = nvme_get_log_fdp_stats(s->hdl, s->egid, 0, &stats, sizeof(stats));
+	if (err)
+		return err;
+
+	s->hbmw0 = s->hbmw = int128_to_double(stats.hbmw);
+	s->mbmw0 = s->mbmw = int128_to_double(stats.mbmw);
+	s->mbe = int128_to_double(stats.mbe);
+
+	/* only events after the start are counted */
+	err = fdp_sampler_events(s, false);
+	if (err)
+		return err;
+
+	gettimeofday(&s->start, NULL);
+
+	return 0;
+}
+
+static struct fdp_sample_ruh *fdp_sampler_find(struct fdp_sampler *s,
+					       __u16 pid)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->nr_ruhs; i++)
+		if (s->ruhs[i].pid == pid)
+			return &s->ruhs[i];
+
+	return NULL;
+}
+
+static double fdp_waf(long double media, long double host)
+{
+	return host > 0 ? (double)(media / host) : 0;
+}
+
+static void fdp_sampler_print(struct fdp_sampler *s, double t,
+			      long double host, long double media,
+			      long double erased)
+{
+	struct json_object *root, *events, *ruhs, *ruh;
+	struct fdp_sample_ruh *r;
+	__u64 ru, written;
+	unsigned int i;
+
+	if (s->flags == JSON) {
+		root = json_create_object();
+		json_object_add_value_double(root, "time", t);
+		json_object_add_value_double(root, "host_bytes", (double)host);
+		json_object_add_value_double(root, "media_bytes", (double)media);
+		json_object_add_value_double(root, "media_erased_bytes",
+					     (double)erased);
+		json_object_add_value_double(root, "waf", fdp_waf(media, host));
+		json_object_add_value_double(root, "total_waf",
+					     fdp_waf(s->mbmw - s->mbmw0,
+						     s->hbmw - s->hbmw0));
+
+		events = json_create_object();
+		for (i = 0; i < FDP_SAMPLE_EVENTS; i++)
+			json_object_add_value_uint(events,
+						   fdp_sample_events[i].name,
+						   s->events[i]);
+		json_object_add_value_object(root, "events", events);
+
+		ruhs = json_create_array();
+		for (i = 0; i < s->nr_ruhs; i++) {
+			r = &s->ruhs[i];
+			ruh = json_create_object();
+			json_object_add_value_uint(ruh, "pid", r->pid);
+			json_object_add_value_uint(ruh, "ruhid", r->ruhid);
+			json_object_add_value_uint64(ruh, "ruamw", r->ruamw);
+			json_object_add_value_uint64(ruh, "ru_bytes",
+				(r->ru_blocks - r->last_ru_blocks) * s->lba_size);
+			json_object_add_value_uint64(ruh, "host_bytes",
+				(r->host_blocks - r->last_host_blocks) * s->lba_size);
+			json_array_add_value_object(ruhs, ruh);
+		}
+		json_object_add_value_array(root, "ruhs", ruhs);
+
+		json_print_object_line(root);
+		json_free_object(root);
+		fflush(stdout);
+		return;
+	}
+
+	printf("[%9.1fs] host %10.1f MiB  media %10.1f MiB  waf %5.2f (total %5.2f)",
+	       t, (double)(host / (1 << 20)), (double)(media / (1 << 20)),
+	       fdp_waf(media, host),
+	       fdp_waf(s->mbmw - s->mbmw0, s->hbmw - s->hbmw0));
+	for (i = 0; i < FDP_SAMPLE_EVENTS; i++)
+		if (s->events[i])
+			printf("  %s %u", fdp_sample_events[i].name,
+			       s->events[i]);
+	printf("\n");
+
+	for (i = 0; i < s->nr_ruhs; i++) {
+		r = &s->ruhs[i];
+		ru = r->ru_blocks - r->last_ru_blocks;
+		written = r->host_blocks - r->last_host_blocks;
+		if (!ru && !written)
+			continue;
+
+		printf("    pid %#06x ruh %3u  ru %10.1f MiB", r->pid, r->ruhid,
+		       (double)ru * s->lba_size / (1 << 20));
+		if (written)
+			printf("  host %10.1f MiB  ru/host %5.2f",
+			       (double)written * s->lba_size / (1 << 20),
+			       (double)ru / written);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+static int fdp_sampler_sample(struct fdp_sampler *s)
+{
+	_cleanup_free_ struct nvme_fdp_ruh_status *status = NULL;
+	long double hbmw, mbmw, mbe;
+	struct nvme_fdp_stats_log stats;
+	struct fdp_sample_ruh *r;
+	struct timeval now;
+	unsigned int i;
+	__u64 ruamw;
+	int err;
+
+	err = nvme_get_log_fdp_stats(s->hdl, s->egid, 0, &stats, sizeof(stats));
+	if (err)
+		return err;
+
+	err = fdp_sampler_ruh_status(s, &status);
+	if (err)
+		return err;
+
+	memset(s->events, 0, sizeof(s->events));
+	err = fdp_sampler_events(s, true);
+	if (err)
+		return err;
+
+	for (i = 0; i < le16_to_cpu(status->nruhsd); i++) {
+		r = fdp_sampler_find(s, le16_to_cpu(status->ruhss[i].pid));
+		if (!r)
+			continue;
+
+		ruamw = le64_to_cpu(status->ruhss[i].ruamw);
+		if (ruamw <= r->ruamw)
+			r->ru_blocks += r->ruamw - ruamw;
+		else
+			r->ru_blocks += r->ruamw + (s->runs > ruamw ?
+						    s->runs - ruamw : 0);
+		r->ruamw = ruamw;
+	}
+
+	hbmw = int128_to_double(stats.hbmw);
+	mbmw = int128_to_double(stats.mbmw);
+	mbe = int128_to_double(stats.mbe);
+
+	gettimeofday(&now, NULL);
+	fdp_sampler_print(s, elapsed_utime(s->start, now) / 1e6,
+			  hbmw - s->hbmw, mbmw - s->mbmw, mbe - s->mbe);
+
+	s->hbmw = hbmw;
+	s->mbmw = mbmw;
+	s->mbe = mbe;
+	for (i = 0; i < s->nr_ruhs; i++) {
+		s->ruhs[i].last_ru_blocks = s->ruhs[i].ru_blocks;
+		s->ruhs[i].last_host_blocks = s->ruhs[i].host_blocks;
+	}
+
+	return 0;
+}
+
+static int fdp_sample(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Sample the FDP statistics, reclaim unit handle status and events\n"
+			   "periodically and show the write amplification of each interval";
+	const char *egid = "Endurance group identifier (default: of the namespace)";
+	const char *namespace_id = "Namespace identifier";
+	const char *interval = "seconds between samples";
+	const char *count = "number of samples, 0 until interrupted";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	struct fdp_sampler s = { 0 };
+	unsigned int i;
+	int err;
+
+	struct config {
+		__u16	egid;
+		__u32	nsid;
+		__u32	interval;
+		__u32	count;
+		char	*output_format;
+	};
+
+	struct config cfg = {
+		.interval	= 1,
+		.output_format	= "normal",
+	};
+
+	OPT_ARGS(opts) = {
+		OPT_UINT("endgrp-id",    'e', &cfg.egid,          egid),
+		OPT_UINT("namespace-id", 'n', &cfg.nsid,          namespace_id),
+		OPT_UINT("interval",     'i', &cfg.interval,      interval),
+		OPT_UINT("count",        'c', &cfg.count,         count),
+		OPT_FMT("output-format", 'o', &cfg.output_format, output_format),
+		OPT_END()
+	};
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(cfg.output_format, &s.flags);
+	if (err < 0)
+		return err;
+	if (s.flags != JSON && s.flags != NORMAL) {
+		nvme_show_error("only normal and json output are supported");
+		return -EINVAL;
+	}
+
+	if (!cfg.nsid) {
+		err = nvme_get_nsid(hdl, &cfg.nsid);
+		if (err < 0) {
+			perror("get-namespace-id");
+			return err;
+		}
+	}
+
+	s.hdl = hdl;
+	s.egid = cfg.egid;
+	s.nsid = cfg.nsid;
+	err = fdp_sampler_init(&s);
+	if (err) {
+		nvme_show_err("fdp sample", err);
+		goto free;
+	}
+
+	for (i = 0; !cfg.count || i < cfg.count; i++) {
+		if (nvme_wait_countdown(cfg.interval ? cfg.interval : 1))
+			break;
+
+		err = fdp_sampler_sample(&s);
+		if (err) {
+			nvme_show_err("fdp sample", err);
+			break;
+		}
+	}
+
+free:
+	free(s.ruhs);
+
+	return err;
+}
+
+/*
+ * The writes run on their own threads, the samples are taken by the main
+ * thread so the log pages they read do not hold up the writes. The
+ * completions only count the written blocks.
+ */
+struct fdp_write {
+	struct fdp_sampler	s;
+	__u16			*pids;
+	unsigned int		nr_pids;
+	__u64			*next;		/* per handle, blocks into its region */
+	__u64			region;		/* blocks per handle */
+	__u64			slba;
+	__u32			nlb;
+	bool			random;
+	void			*data;
+	__u64			total;		/* blocks left to write */
+	__u64			written;
+	unsigned int		rr;
+	unsigned int		seed;
+	bool			stop;		/* a sample failed */
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	bool			finished;
+	int			err;
+};
+
+static int fdp_write_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			  void *buf)
+{
+	struct fdp_write *w = q->priv;
+	unsigned int h = w->rr++ % w->nr_pids;
+	__u64 off;
+	__u32 nlb;
+
+	if (!w->total || __atomic_load_n(&w->stop, __ATOMIC_RELAXED))
+		return 0;
+
+	nlb = min((__u64)w->nlb, w->total);
+	if (w->random) {
+		off = (__u64)rand_r(&w->seed) << 31 | rand_r(&w->seed);
+		off = off % (w->region / w->nlb) * w->nlb;
+	} else {
+		off = w->next[h];
+		w->next[h] = off + w->nlb >= w->region ? 0 : off + w->nlb;
+	}
+	nlb = min((__u64)nlb, w->region - off);
+
+	/* the directive type sits in the upper control bits of cdw12 */
+	nvme_init_write(cmd, w->s.nsid, w->slba + h * w->region + off, nlb - 1,
+			FDP_DTYPE << 4, w->pids[h], 0, 0, w->data,
+			nlb * w->s.lba_size, NULL, 0);
+	w->total -= nlb;
+
+	return 1;
+}
+
+static int fdp_write_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			  void *buf, int err)
+{
+	struct fdp_write *w = q->priv;
+	struct fdp_sample_ruh *r;
+	__u32 nlb = (cmd->cdw12 & 0xffff) + 1;
+
+	if (err) {
+		nvme_show_err("fdp write", err);
+		return err;
+	}
+
+	r = fdp_sampler_find(&w->s, cmd->cdw13 >> 16);
+	if (r)
+		__atomic_fetch_add(&r->host_new, nlb, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&w->written, nlb, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static void *fdp_write_thread(void *arg)
+{
+	struct nvme_ioq *q = arg;
+	struct fdp_write *w = q->priv;
+	int err;
+
+	err = nvme_ioq_run(q);
+
+	pthread_mutex_lock(&w->lock);
+	w->err = err;
+	w->finished = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static int fdp_write_sample(struct fdp_write *w)
+{
+	struct fdp_sample_ruh *r;
+	unsigned int i;
+
+	for (i = 0; i < w->s.nr_ruhs; i++) {
+		r = &w->s.ruhs[i];
+		r->host_blocks += __atomic_exchange_n(&r->host_new, 0,
+						      __ATOMIC_RELAXED);
+	}
+
+	return fdp_sampler_sample(&w->s);
+}
+
+/* samples every @interval seconds until the writes finished */
+static void fdp_write_summary(struct fdp_write *w)
+{
+	struct fdp_sampler *s = &w->s;
+	struct json_object *root;
+	double waf = fdp_waf(s->mbmw - s->mbmw0, s->hbmw - s->hbmw0);
+
+	if (s->flags == JSON) {
+		root = json_create_object();
+		json_object_add_value_uint64(root, "written_blocks", w->written);
+		json_object_add_value_uint64(root, "written_bytes",
+					     w->written * s->lba_size);
+		json_object_add_value_double(root, "total_waf", waf);
+		json_print_object_line(root);
+		json_free_object(root);
+		fflush(stdout);
+		return;
+	}
+
+	printf("wrote %"PRIu64" blocks, write amplification %.2f\n",
+	       (uint64_t)w->written, waf);
+}
+
+static int fdp_write_run(struct fdp_write *w, struct nvme_ioq *q,
+			 __u32 interval)
+{
+	struct timespec deadline, now;
+	pthread_t thread;
+	int err = 0;
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+
+	err = pthread_create(&thread, NULL, fdp_write_thread, q);
+	if (err) {
+		err = -err;
+		goto out;
+	}
+
+	pthread_mutex_lock(&w->lock);
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	while (!w->finished) {
+		deadline.tv_sec += interval;
+		while (!w->finished &&
+		       pthread_cond_timedwait(&w->cond, &w->lock,
+					      &deadline) != ETIMEDOUT)
+			;
+		if (w->finished || err)
+			continue;
+
+		pthread_mutex_unlock(&w->lock);
+		err = fdp_write_sample(w);
+		if (err) {
+			nvme_show_err("fdp sample", err);
+			__atomic_store_n(&w->stop, true, __ATOMIC_RELAXED);
+		}
+
+		/* a slow sample delays the next one rather than bunching them */
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (now.tv_sec > deadline.tv_sec)
+			deadline = now;
+		pthread_mutex_lock(&w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(thread, NULL);
+	if (!err)
+		err = w->err;
+out:
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+
+	return err;
+}
+
+static int fdp_write(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Write the namespace with placement identifiers at a high queue depth,\n"
+			   "sampling the FDP statistics to show the write amplification";
+	const char *namespace_id = "Namespace identifier";
+	const char *egid = "Endurance group identifier (default: of the namespace)";
+	const char *pids = "comma separated placement identifiers (default: all handles)";
+	const char *size = "bytes to write in total (default: the LBA range once)";
+	const char *block_size = "bytes per write";
+	const char *start_lba = "first LBA of the written range";
+	const char *lba_range = "blocks written, split evenly between the placement identifiers\n"
+				"(default: up to the end of the namespace)";
+	const char *random = "write random offsets instead of sequentially";
+	const char *queue_depth = "writes kept in flight";
+	const char *interval = "seconds between samples";
+	const char *force = "do not ask before overwriting the namespace";
+
+	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
+	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
+	_cleanup_free_ __u32 *pid_list = NULL;
+	struct fdp_write w = { 0 };
+	struct nvme_ioq q = { 0 };
+	struct nvme_id_ns ns;
+	unsigned int i;
+	__u64 nsze;
+	int err;
+
+	struct config {
+		__u32	nsid;
+		__u16	egid;
+		char	*pids;
+		__u64	size;
+		__u64	block_size;
+		__u64	start_lba;
+		__u64	lba_range;
+		bool	random;
+		__u32	qd;
+		__u32	interval;
+		bool	force;
+		char	*output_format;
+	};
+
+	struct config cfg = {
+		.pids		= "",
+		.block_size	= 128 * 1024,
+		.qd		= 32,
+		.interval	= 1,
+		.output_format	= "normal",
+	};
+
+	OPT_ARGS(opts) = {
+		OPT_UINT("namespace-id", 'n', &cfg.nsid,          namespace_id),
+		OPT_UINT("endgrp-id",    'e', &cfg.egid,          egid),
+		OPT_LIST("pids",         'p', &cfg.pids,          pids),
+		OPT_SUFFIX("size",       's', &cfg.size,          size),
+		OPT_SUFFIX("block-size", 'b', &cfg.block_size,    block_size),
+		OPT_SUFFIX("start-lba",  'S', &cfg.start_lba,     start_lba),
+		OPT_SUFFIX("lba-range",  'R', &cfg.lba_range,     lba_range),
+		OPT_FLAG("random",       'r', &cfg.random,        random),
+		OPT_UINT("queue-depth",  'q', &cfg.qd,            queue_depth),
+		OPT_UINT("interval",     'i', &cfg.interval,      interval),
+		OPT_FLAG("force",        'f', &cfg.force,         force),
+		OPT_FMT("output-format", 'o', &cfg.output_format, output_format),
+		OPT_END()
+	};
+
+	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(cfg.output_format, &w.s.flags);
+	if (err < 0)
+		return err;
+	if (w.s.flags != JSON && w.s.flags != NORMAL) {
+		nvme_show_error("only normal and json output are supported");
+		return -EINVAL;
+	}
+
+	if (!cfg.nsid) {
+		err = nvme_get_nsid(hdl, &cfg.nsid);
+		if (err < 0) {
+			perror("get-namespace-id");
+			return err;
+		}
+	}
+
+	w.s.hdl = hdl;
+	w.s.egid = cfg.egid;
+	w.s.nsid = cfg.nsid;
+	err = fdp_sampler_init(&w.s);
+	if (err) {
+		nvme_show_err("fdp write", err);
+		goto free;
+	}
+
+	err = nvme_identify_ns(hdl, cfg.nsid, &ns);
+	if (err) {
+		nvme_show_status(err);
+		goto free;
+	}
+	nsze = le64_to_cpu(ns.nsze);
+
+	if (strlen(cfg.pids)) {
+		pid_list = calloc(w.s.nr_ruhs, sizeof(*pid_list));
+		if (!pid_list) {
+			err = -ENOMEM;
+			goto free;
+		}
+		err = argconfig_parse_comma_sep_array_u32(cfg.pids, pid_list,
+							  w.s.nr_ruhs);
+		if (err <= 0) {
+			nvme_show_error("invalid placement identifiers '%s'",
+					cfg.pids);
+			err = -EINVAL;
+			goto free;
+		}
+		w.nr_pids = err;
+
+		/* the writes would fail with an Invalid Placement Handle */
+		for (i = 0; i < w.nr_pids; i++) {
+			if (pid_list[i] > 0xffff ||
+			    !fdp_sampler_find(&w.s, pid_list[i])) {
+				nvme_show_error("placement identifier %#x is not a reclaim unit handle of namespace %#x",
+						pid_list[i], cfg.nsid);
+				err = -EINVAL;
+				goto free;
+			}
+		}
+	} else {
+		w.nr_pids = w.s.nr_ruhs;
+	}
+
+	w.pids = calloc(w.nr_pids, sizeof(*w.pids));
+	w.next = calloc(w.nr_pids, sizeof(*w.next));
+	if (!w.pids || !w.next) {
+		err = -ENOMEM;
+		goto free;
+	}
+	for (i = 0; i < w.nr_pids; i++)
+		w.pids[i] = pid_list ? pid_list[i] : w.s.ruhs[i].pid;
+
+	w.nlb = cfg.block_size / w.s.lba_size;
+	w.slba = cfg.start_lba;
+	if (!w.nlb || w.nlb > 65536 || cfg.block_size % w.s.lba_size) {
+		nvme_show_error("invalid block size %"PRIu64, (uint64_t)cfg.block_size);
+		err = -EINVAL;
+		goto free;
+	}
+	if (w.slba >= nsze) {
+		nvme_show_error("start LBA beyond the end of the namespace");
+		err = -EINVAL;
+		goto free;
+	}
+
+	w.region = (cfg.lba_range ? min(cfg.lba_range, nsze - w.slba) :
+		    nsze - w.slba) / w.nr_pids;
+	if (w.region < w.nlb) {
+		nvme_show_error("LBA range too small for %u placement identifiers",
+				w.nr_pids);
+		err = -EINVAL;
+		goto free;
+	}
+	w.total = cfg.size ? cfg.size / w.s.lba_size : w.region * w.nr_pids;
+	w.random = cfg.random;
+	w.seed = time(NULL);
+
+	w.data = nvme_alloc(w.nlb * w.s.lba_size);
+	if (!w.data) {
+		err = -ENOMEM;
+		goto free;
+	}
+	/* incompressible data, the same for all writes */
+	for (i = 0; i < w.nlb * w.s.lba_size / sizeof(int); i++)
+		((int *)w.data)[i] = rand_r(&w.seed);
+
+	if (!cfg.force) {
+		fprintf(stderr, "You are about to overwrite %"PRIu64" blocks of %s, namespace %#x.\n",
+			(uint64_t)(w.region * w.nr_pids),
+			nvme_transport_handle_get_name(hdl), cfg.nsid);
+		fprintf(stderr,
+			"WARNING: This irrevocably deletes the data of these blocks.\n"
+			"You have 10 seconds to press Ctrl-C to cancel this operation.\n\n"
+			"Use the force [--force] option to suppress this warning.\n");
+		if (nvme_wait_countdown(10)) {
+			fprintf(stderr, "Write cancelled\n");
+			err = -EINTR;
+			goto free;
+		}
+	}
+
+	gettimeofday(&w.s.start, NULL);
+
+	q.hdl = hdl;
+	q.depth = cfg.qd;
+	q.prep = fdp_write_prep;
+	q.done = fdp_write_done;
+	q.priv = &w;
+
+	/* other transports do not take commands from several threads */
+	if (nvme_transport_handle_is_direct(hdl))
+		err = fdp_write_run(&w, &q, cfg.interval ? cfg.interval : 1);
+	else
+		err = nvme_ioq_run(&q);
+
+	/* the rest since the last sample */
+	if (!fdp_write_sample(&w))
+		fdp_write_summary(&w);
+
+free:
+	free(w.data);
+	free(w.next);
+	free(w.pids);
+	free(w.s.ruhs);
+
+	return err;
+}
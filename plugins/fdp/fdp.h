@@ -17,6 +17,8 @@ PLUGIN(NAME("fdp", "Manage Flexible Data Placement enabled devices", NVME_VERSIO
 		ENTRY("update", "Update a reclaim unit handle", fdp_update)
 		ENTRY("set-events", "Enable or disable events", fdp_set_events)
 		ENTRY("feature", "Show, enable or disable FDP configuration", fdp_feature)
+		ENTRY("sample", "Sample statistics and write amplification over time", fdp_sample)
+		ENTRY("write", "Write with placement identifiers and show the write amplification", fdp_write)
 	)
 );
 
@@ -12,6 +12,7 @@
 #include "plugin.h"
 #include "linux/types.h"
 #include "nvme-print.h"
+#include "nvme-latency.h"
 
 #define CREATE_CMD
 #include "intel-nvme.h"
@@ -1025,6 +1026,116 @@ static void show_lat_stats(int write)
 	}
 }
 
+struct intel_lat_sample {
+	struct nvme_transport_handle *hdl;
+	bool write;
+	__u16 maj;
+};
+
+static int intel_lat_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct intel_lat_sample *p = s->priv;
+	union {
+		struct intel_lat_stats nand;
+		struct optane_lat_stats optane;
+		__u8 raw[NAND_LAT_STATS_LEN];
+	} log;
+	unsigned int i;
+	int err;
+
+	err = nvme_get_log_simple(p->hdl, p->write ? 0xc2 : 0xc1, &log,
+				  sizeof(log));
+	if (err)
+		return err;
+	if (log.nand.maj != p->maj)
+		return -EPROTO;
+
+	for (i = 0; i < s->hist.nr; i++)
+		count[i] = p->maj == 1000 ? log.optane.data[i] : log.nand.data[i];
+
+	return 0;
+}
+
+/*
+ * The 3.0 buckets are the groups of json_lat_stats_3_0(): 0-1ms in steps
+ * of 32us, 1-32ms in steps of 1ms, 32ms-1s in steps of 32ms, 1-2s, 2-4s
+ * and 4s+.
+ */
+static int intel_lat_hist(struct nvme_lat_hist *h, __u16 maj, bool write)
+{
+	__u32 *thresholds = write ? v1000_bucket.write : v1000_bucket.read;
+	unsigned int i;
+	int err;
+
+	switch (maj) {
+	case 3:
+		err = nvme_lat_hist_alloc(h, 97);
+		if (err)
+			return err;
+		i = nvme_lat_hist_linear(h, 0, 32, 0, 32);
+		i = nvme_lat_hist_linear(h, i, 31, 1024, 1024);
+		i = nvme_lat_hist_linear(h, i, 31, 32768, 32768);
+		i = nvme_lat_hist_linear(h, i, 1, 1048576, 1048576);
+		i = nvme_lat_hist_linear(h, i, 1, 2097152, 2097152);
+		break;
+	case 4:
+		err = nvme_lat_hist_alloc(h, 1216);
+		if (err)
+			return err;
+		for (i = 0; i < h->nr; i++)
+			h->edge_us[i] = lat_stats_log_scale(i);
+		break;
+	case 1000:
+		err = nvme_lat_hist_alloc(h, OPTANE_V1000_BUCKET_LEN);
+		if (err)
+			return err;
+		for (i = 0; i < h->nr; i++)
+			h->edge_us[i] = thresholds[i];
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	h->edge_us[h->nr] = NVME_LAT_INF;
+
+	return 0;
+}
+
+static int intel_lat_stats_sample(struct nvme_transport_handle *hdl, bool write,
+				  bool json, __u32 interval, __u32 count)
+{
+	struct intel_lat_sample p = {
+		.hdl	= hdl,
+		.write	= write,
+		.maj	= media_version[MEDIA_MAJOR_IDX],
+	};
+	struct nvme_lat_sampler s = { 0 };
+	int err;
+
+	err = intel_lat_hist(&s.hist, p.maj, write);
+	if (err) {
+		nvme_show_error("Unsupported revision (%u.%u)",
+				media_version[MEDIA_MAJOR_IDX],
+				media_version[MEDIA_MINOR_IDX]);
+		return err;
+	}
+
+	s.name = write ? "Write" : "Read";
+	s.interval = interval;
+	s.count = count;
+	/* the optane statistics are deleted every time the log is read */
+	s.cleared = p.maj == 1000;
+	s.json = json;
+	s.sample = intel_lat_sample;
+	s.priv = &p;
+
+	err = nvme_lat_sampler_run(&s);
+	if (err)
+		nvme_show_err("lat-stats", err);
+	nvme_lat_hist_free(&s.hist);
+
+	return err;
+}
+
 static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	__u8 data[NAND_LAT_STATS_LEN];
@@ -1038,11 +1149,16 @@ static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct
 	const char *json = "Dump output in json format";
 #endif /* CONFIG_JSONC */
 	const char *write = "Get write statistics (read default)";
+	const char *interval = "sample the log every <interval> seconds and show the "
+			       "latency percentiles of each interval";
+	const char *count = "number of samples, 0 until interrupted";
 
 	struct config {
 		bool raw_binary;
 		bool json;
 		bool write;
+		__u32 interval;
+		__u32 count;
 	};
 
 	struct config cfg = {
@@ -1051,6 +1167,8 @@ static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct
 	OPT_ARGS(opts) = {
 		OPT_FLAG("write",	'w', &cfg.write,	write),
 		OPT_FLAG("raw-binary",	'b', &cfg.raw_binary,	raw),
+		OPT_UINT("interval",	'i', &cfg.interval,	interval),
+		OPT_UINT("count",	'c', &cfg.count,	count),
 		OPT_FLAG_JSON("json",	'j', &cfg.json,		json),
 		OPT_END()
 	};
@@ -1105,6 +1223,10 @@ static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct
 		       sizeof(struct intel_lat_stats));
 	}
 
+	if (cfg.interval)
+		return intel_lat_stats_sample(hdl, cfg.write, cfg.json,
+					      cfg.interval, cfg.count);
+
 	if (cfg.json)
 		json_lat_stats(cfg.write);
 	else if (!cfg.raw_binary)
@@ -13,6 +13,7 @@
 #include "plugin.h"
 #include "linux/types.h"
 #include "nvme-print.h"
+#include "nvme-latency.h"
 
 #define CREATE_CMD
 #include "memblaze-nvme.h"
@@ -964,6 +965,68 @@ int io_latency_histogram(char *file, char *buf, int print, int logid)
 	return 1;
 }
 
+struct mb_lat_sample {
+	struct nvme_transport_handle *hdl;
+	__u8 lid;
+	unsigned int type;		/* lat-stats-print-x: read, write, trim */
+};
+
+static int mb_lat_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct mb_lat_sample *p = s->priv;
+	unsigned int stats[LOG_PAGE_SIZE / sizeof(unsigned int)];
+	unsigned int i;
+	int err;
+
+	err = nvme_get_log_simple(p->hdl, p->lid, stats, sizeof(stats));
+	if (err)
+		return err;
+	if (stats[1] != 1 || stats[0] != 0)
+		return -EPROTO;
+
+	for (i = 0; i < s->hist.nr; i++)
+		count[i] = stats[2 + i];
+
+	return 0;
+}
+
+/* the buckets printed by io_latency_histogram() for revision 1.0 */
+static int mb_lat_hist(struct nvme_lat_hist *h)
+{
+	unsigned int i;
+	int err;
+
+	err = nvme_lat_hist_alloc(h, 98);
+	if (err)
+		return err;
+
+	i = nvme_lat_hist_linear(h, 0, 32, 0, 32);
+	i = nvme_lat_hist_linear(h, i, 31, 1000, 1000);
+	i = nvme_lat_hist_linear(h, i, 31, 32000, 32000);
+	i = nvme_lat_hist_linear(h, i, 3, 1000000, 1000000);
+	h->edge_us[h->nr] = NVME_LAT_INF;
+
+	return 0;
+}
+
+static int mb_lat_stats_sample(struct nvme_lat_sampler *s, struct mb_lat_sample *p,
+			       __u32 interval, __u32 count, bool json)
+{
+	int err;
+
+	s->interval = interval;
+	s->count = count;
+	s->json = json;
+	s->priv = p;
+
+	err = nvme_lat_sampler_run(s);
+	if (err)
+		nvme_show_err("lat-stats", err);
+	nvme_lat_hist_free(&s->hist);
+
+	return err;
+}
+
 static int mb_lat_stats_log_print(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	char stats[LOG_PAGE_SIZE];
@@ -976,9 +1039,18 @@ static int mb_lat_stats_log_print(int argc, char **argv, struct command *acmd, s
 
 	const char *desc = "Get Latency Statistics log and show it.";
 	const char *write = "Get write statistics (read default)";
+	const char *interval = "sample the log every <interval> seconds and show the "
+			       "latency percentiles of each interval";
+	const char *count = "number of samples, 0 until interrupted";
+#ifdef CONFIG_JSONC
+	const char *json = "show the samples in json format";
+#endif /* CONFIG_JSONC */
 
 	struct config {
 		bool  write;
+		__u32 interval;
+		__u32 count;
+		bool  json;
 	};
 	struct config cfg = {
 		.write = 0,
@@ -986,6 +1058,9 @@ static int mb_lat_stats_log_print(int argc, char **argv, struct command *acmd, s
 
 	OPT_ARGS(opts) = {
 		OPT_FLAG("write", 'w', &cfg.write, write),
+		OPT_UINT("interval", 'i', &cfg.interval, interval),
+		OPT_UINT("count", 'c', &cfg.count, count),
+		OPT_FLAG_JSON("json", 'j', &cfg.json, json),
 		OPT_END()
 	};
 
@@ -993,6 +1068,22 @@ static int mb_lat_stats_log_print(int argc, char **argv, struct command *acmd, s
 	if (err)
 		return err;
 
+	if (cfg.interval) {
+		struct mb_lat_sample p = {
+			.hdl = hdl,
+			.lid = cfg.write ? 0xc2 : 0xc1,
+		};
+		struct nvme_lat_sampler s = {
+			.name = cfg.write ? "Write" : "Read",
+			.sample = mb_lat_sample,
+		};
+
+		err = mb_lat_hist(&s.hist);
+		if (err)
+			return err;
+		return mb_lat_stats_sample(&s, &p, cfg.interval, cfg.count, cfg.json);
+	}
+
 	err = nvme_get_log_simple(hdl, cfg.write ? 0xc2 : 0xc1, &stats, sizeof(stats));
 	if (!err)
 		io_latency_histogram(cfg.write ? f2 : f1, stats, DO_PRINT_FLAG,
@@ -1904,12 +1995,46 @@ static void latency_stats_print(struct latency_stats *log, const char *devname)
 	}
 }
 
+/* the bucket edges of latency_stats_v2_0_print() */
+static const __u64 mb_lat_v2_edges_us[33] = {
+	0, 50, 100, 150, 200, 300, 400, 500, 600, 700, 800, 900,
+	1000, 5000, 10000, 20000, 50000, 100000, 200000, 300000, 400000,
+	500000, 600000, 700000, 800000, 900000, 1000000, 2000000, 3000000,
+	4000000, 5000000, 8000000, NVME_LAT_INF,
+};
+
+static int mb_lat_v2_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct mb_lat_sample *p = s->priv;
+	struct latency_stats log = {0};
+	unsigned int i;
+	int err;
+
+	err = nvme_get_log_simple(p->hdl, LID_LATENCY_STATISTICS, &log, sizeof(log));
+	if (err)
+		return err;
+	if (log.v2_0.major_version != 2 || log.v2_0.minor_version != 0)
+		return -EPROTO;
+
+	for (i = 0; i < s->hist.nr; i++)
+		count[i] = p->type == 2 ? log.v2_0.bucket_trim_data[i] :
+			   p->type == 1 ? log.v2_0.bucket_write_data[i] :
+			   log.v2_0.bucket_read_data[i];
+
+	return 0;
+}
+
 static int mb_get_latency_stats(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	// Get the configuration
 
 	struct config {
 		bool raw_binary;
+		__u32 interval;
+		__u32 count;
+		bool write;
+		bool trim;
+		bool json;
 	};
 
 	struct config cfg = {0};
@@ -1919,6 +2044,26 @@ static int mb_get_latency_stats(int argc, char **argv, struct command *acmd, str
 			'b',
 			&cfg.raw_binary,
 			"dump the whole log buffer in binary format"),
+		OPT_UINT("interval",
+			'i',
+			&cfg.interval,
+			"sample the log every <interval> seconds and show the latency percentiles of each interval"),
+		OPT_UINT("count",
+			'c',
+			&cfg.count,
+			"number of samples, 0 until interrupted"),
+		OPT_FLAG("write",
+			'w',
+			&cfg.write,
+			"sample the write commands (read default)"),
+		OPT_FLAG("trim",
+			't',
+			&cfg.trim,
+			"sample the trim commands (read default)"),
+		OPT_FLAG_JSON("json",
+			'j',
+			&cfg.json,
+			"show the samples in json format"),
 		OPT_END()};
 
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
@@ -1929,6 +2074,25 @@ static int mb_get_latency_stats(int argc, char **argv, struct command *acmd, str
 	if (err)
 		return err;
 
+	// Sample the log
+
+	if (cfg.interval) {
+		struct mb_lat_sample p = {
+			.hdl = hdl,
+			.type = cfg.trim ? 2 : cfg.write ? 1 : 0,
+		};
+		struct nvme_lat_sampler s = {
+			.name = cfg.trim ? "Trim" : cfg.write ? "Write" : "Read",
+			.sample = mb_lat_v2_sample,
+		};
+
+		err = nvme_lat_hist_alloc(&s.hist, ARRAY_SIZE(mb_lat_v2_edges_us) - 1);
+		if (err)
+			return err;
+		memcpy(s.hist.edge_us, mb_lat_v2_edges_us, sizeof(mb_lat_v2_edges_us));
+		return mb_lat_stats_sample(&s, &p, cfg.interval, cfg.count, cfg.json);
+	}
+
 	// Get log
 
 	struct latency_stats log = {0};
@@ -18,16 +18,20 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
-#include <libgen.h>
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/utsname.h>
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
 #include <limits.h>
 #include "linux/types.h"
 #include "nvme-print.h"
+#include "nvme-capture.h"
+#include "nvme-latency.h"
+#include "nvme-wait.h"
+#include "util/bundle.h"
 #include "util/cleanup.h"
 #include "util/utils.h"
 
@@ -111,11 +115,23 @@ struct MICRON_WORKLOAD_LOG_HDR {
 	unsigned int uiLength;
 };
 
-static void WriteData(__u8 *data, __u32 len, const char *dir, const char *file, const char *msg)
+/* with a bundle @dir is the directory of the member inside the package */
+static void WriteData(struct nvme_bundle *b, __u8 *data, __u32 len, const char *dir,
+		      const char *file, const char *msg)
 {
 	char tempFolder[8192] = { 0 };
 	FILE *fpOutFile = NULL;
 
+	if (b) {
+		if (*dir)
+			sprintf(tempFolder, "%s/%s", dir, file);
+		else
+			sprintf(tempFolder, "%s", file);
+		if (nvme_bundle_append(b, tempFolder, data, len))
+			printf("Failed to write %s data to %s\n", msg, tempFolder);
+		return;
+	}
+
 	sprintf(tempFolder, "%s/%s", dir, file);
 	fpOutFile = fopen(tempFolder, "ab+");
 	if (fpOutFile) {
@@ -229,166 +245,6 @@ static enum eDriveModel GetDriveModel(int idx)
 	return eModel;
 }
 
-static int ZipAndRemoveDir(char *strDirName, char *strFileName)
-{
-	int  err = 0;
-	char strBuffer[PATH_MAX];
-	int  nRet;
-	bool is_tgz = false;
-	struct stat sb;
-
-	if (strstr(strFileName, ".tar.gz") || strstr(strFileName, ".tgz")) {
-		sprintf(strBuffer, "tar -zcf \"%s\" \"%s\"", strFileName, strDirName);
-		is_tgz = true;
-	} else {
-		sprintf(strBuffer, "zip -r \"%s\" \"%s\" >temp.txt 2>&1", strFileName,
-				strDirName);
-	}
-
-	err = EINVAL;
-	nRet = system(strBuffer);
-
-	/* check if log file is created, if not print error message */
-	if (nRet < 0 || (stat(strFileName, &sb) == -1)) {
-		if (is_tgz)
-			sprintf(strBuffer, "check if tar and gzip commands are installed");
-		else
-			sprintf(strBuffer, "check if zip command is installed");
-
-		fprintf(stderr, "Failed to create log data package, %s!\n", strBuffer);
-	}
-
-	sprintf(strBuffer, "rm -f -R \"%s\" >temp.txt 2>&1", strDirName);
-	nRet = system(strBuffer);
-	if (nRet < 0)
-		printf("Failed to remove temporary files!\n");
-
-	err = system("rm -f temp.txt");
-	return err;
-}
-
-static int SetupDebugDataDirectories(char *strSN, char *strFilePath,
-					 char *strMainDirName, char *strOSDirName,
-					 char *strCtrlDirName)
-{
-	int err = 0;
-	char strAppend[250];
-	struct stat st;
-	char *fileLocation = NULL;
-	char *fileName;
-	int length = 0;
-	int nIndex = 0;
-	char *strTemp = NULL;
-	int j;
-	int k = 0;
-	int i = 0;
-
-	if (strchr(strFilePath, '/')) {
-		fileName = strrchr(strFilePath, '\\');
-		if (!fileName)
-			fileName = strrchr(strFilePath, '/');
-
-		if (fileName) {
-			if (!strcmp(fileName, "/"))
-				goto exit_status;
-
-			while (strFilePath[nIndex] != '\0') {
-				if ('\\' == strFilePath[nIndex] && '\\' == strFilePath[nIndex + 1])
-					goto exit_status;
-				nIndex++;
-			}
-
-			length = (int)strlen(strFilePath) - (int)strlen(fileName);
-
-			if (fileName == strFilePath)
-				length = 1;
-
-			fileLocation = (char *)malloc(length + 1);
-			if (!fileLocation)
-				goto exit_status;
-			strncpy(fileLocation, strFilePath, length);
-			fileLocation[length] = '\0';
-
-			while (fileLocation[k] != '\0') {
-				if (fileLocation[k] == '\\')
-					fileLocation[k] = '/';
-				k++;
-			}
-
-			length = (int)strlen(fileLocation);
-
-			if (':' == fileLocation[length - 1]) {
-				strTemp = (char *)malloc(length + 2);
-				if (!strTemp) {
-					free(fileLocation);
-					goto exit_status;
-				}
-				strcpy(strTemp, fileLocation);
-				strcat(strTemp, "/");
-				free(fileLocation);
-
-				length = (int)strlen(strTemp);
-				fileLocation = (char *)malloc(length + 1);
-				if (!fileLocation) {
-					free(strTemp);
-					goto exit_status;
-				}
-
-				memcpy(fileLocation, strTemp, length + 1);
-				free(strTemp);
-			}
-
-			if (stat(fileLocation, &st)) {
-				free(fileLocation);
-				goto exit_status;
-			}
-			free(fileLocation);
-		} else {
-			goto exit_status;
-		}
-	}
-
-	nIndex = 0;
-	for (i = 0; i < (int)strlen(strSN); i++) {
-		if (strSN[i] != ' ' && strSN[i] != '\n' && strSN[i] != '\t' && strSN[i] != '\r')
-			strMainDirName[nIndex++] = strSN[i];
-	}
-	strMainDirName[nIndex] = '\0';
-
-	j = 1;
-	while (mkdir(strMainDirName, 0777) < 0) {
-		if (errno != EEXIST) {
-			err = -1;
-			goto exit_status;
-		}
-		strMainDirName[nIndex] = '\0';
-		sprintf(strAppend, "-%d", j);
-		strcat(strMainDirName, strAppend);
-		j++;
-	}
-
-	if (strOSDirName) {
-		sprintf(strOSDirName, "%s/%s", strMainDirName, "OS");
-		if (mkdir(strOSDirName, 0777) < 0) {
-			rmdir(strMainDirName);
-			err = -1;
-			goto exit_status;
-		}
-	}
-	if (strCtrlDirName) {
-		sprintf(strCtrlDirName, "%s/%s", strMainDirName, "Controller");
-		if (mkdir(strCtrlDirName, 0777) < 0) {
-			if (strOSDirName)
-				rmdir(strOSDirName);
-			rmdir(strMainDirName);
-			err = -1;
-		}
-	}
-
-exit_status:
-	return err;
-}
-
 static int GetLogPageSize(struct nvme_transport_handle *hdl, unsigned char ucLogID, int *nLogSize)
 {
 	int err = 0;
@@ -2102,63 +1958,37 @@ out:
 	return err;
 }
 
-static void GetDriveInfo(const char *strOSDirName, int nFD,
+static void GetDriveInfo(struct nvme_bundle *b, int nFD,
 						 struct nvme_id_ctrl *ctrlp)
 {
-	FILE *fpOutFile = NULL;
-	char tempFile[256] = { 0 };
-	char strBuffer[1024] = { 0 };
 	char model[41] = { 0 };
 	char serial[21] = { 0 };
 	char fwrev[9] = { 0 };
-	char *strPDir = strdup(strOSDirName);
-	char *strDest = dirname(strPDir);
-
-	sprintf(tempFile, "%s/%s", strDest, "drive-info.txt");
-	fpOutFile = fopen(tempFile, "w+");
-	if (!fpOutFile) {
-		printf("Failed to create %s\n", tempFile);
-		free(strPDir);
-		return;
-	}
 
 	strncpy(model, ctrlp->mn, 40);
 	strncpy(serial, ctrlp->sn, 20);
 	strncpy(fwrev, ctrlp->fr, 8);
 
-	sprintf(strBuffer,
-			"********************\nDrive Info\n********************\n");
-
-	fprintf(fpOutFile, "%s", strBuffer);
-	sprintf(strBuffer,
-			"%-20s : /dev/nvme%d\n%-20s : %s\n%-20s : %-20s\n%-20s : %-20s\n",
-			"Device Name", nFD,
-			"Model No", (char *)model,
-			"Serial No", (char *)serial, "FW-Rev", (char *)fwrev);
-
-	fprintf(fpOutFile, "%s", strBuffer);
-
-	sprintf(strBuffer,
-			"\n********************\nPCI Info\n********************\n");
-
-	fprintf(fpOutFile, "%s", strBuffer);
-
-	sprintf(strBuffer,
-			"%-22s : %04X\n%-22s : %04X\n",
-			"VendorId", vendor_id, "DeviceId", device_id);
-	fprintf(fpOutFile, "%s", strBuffer);
-	fclose(fpOutFile);
-	free(strPDir);
+	nvme_bundle_printf(b, "drive-info.txt",
+			   "********************\nDrive Info\n********************\n");
+	nvme_bundle_printf(b, "drive-info.txt",
+			   "%-20s : /dev/nvme%d\n%-20s : %s\n%-20s : %-20s\n%-20s : %-20s\n",
+			   "Device Name", nFD,
+			   "Model No", (char *)model,
+			   "Serial No", (char *)serial, "FW-Rev", (char *)fwrev);
+	nvme_bundle_printf(b, "drive-info.txt",
+			   "\n********************\nPCI Info\n********************\n");
+	nvme_bundle_printf(b, "drive-info.txt",
+			   "%-22s : %04X\n%-22s : %04X\n",
+			   "VendorId", vendor_id, "DeviceId", device_id);
 }
 
-static void GetTimestampInfo(const char *strOSDirName)
+static void GetTimestampInfo(struct nvme_bundle *b)
 {
 	__u8 outstr[1024];
 	time_t t;
 	struct tm *tmp;
 	size_t num;
-	char *strPDir;
-	char *strDest;
 
 	t = time(NULL);
 	tmp = localtime(&t);
@@ -2168,30 +1998,28 @@ static void GetTimestampInfo(const char *strOSDirName)
 	num = strftime((char *)outstr, sizeof(outstr),
 				   "Timestamp (UTC): %a, %d %b %Y %T %z", tmp);
 	num += sprintf((char *)(outstr + num), "\nPackage Version: 1.4");
-	if (num) {
-		strPDir = strdup(strOSDirName);
-		strDest = dirname(strPDir);
-		WriteData(outstr, num, strDest, "timestamp_info.txt", "timestamp");
-		free(strPDir);
-	}
+	if (num)
+		WriteData(b, outstr, num, "", "timestamp_info.txt", "timestamp");
 }
 
-static void GetCtrlIDDInfo(const char *dir, struct nvme_id_ctrl *ctrlp)
+static void GetCtrlIDDInfo(struct nvme_bundle *b, const char *dir, struct nvme_id_ctrl *ctrlp)
 {
-	WriteData((__u8 *)ctrlp, sizeof(*ctrlp), dir,
+	WriteData(b, (__u8 *)ctrlp, sizeof(*ctrlp), dir,
 			  "nvme_controller_identify_data.bin", "id-ctrl");
 }
 
-static void GetSmartlogData(struct nvme_transport_handle *hdl, const char *dir)
+static void GetSmartlogData(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			    const char *dir)
 {
 	struct nvme_smart_log smart_log;
 
 	if (!nvme_get_log_smart(hdl, NVME_NSID_ALL, &smart_log))
-		WriteData((__u8 *)&smart_log, sizeof(smart_log), dir,
+		WriteData(b, (__u8 *)&smart_log, sizeof(smart_log), dir,
 			  "smart_data.bin", "smart log");
 }
 
-static void GetErrorlogData(struct nvme_transport_handle *hdl, int entries, const char *dir)
+static void GetErrorlogData(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			    int entries, const char *dir)
 {
 	int logSize = entries * sizeof(struct nvme_error_log_page);
 	struct nvme_error_log_page *error_log =
@@ -2201,13 +2029,14 @@ static void GetErrorlogData(struct nvme_transport_handle *hdl, int entries, cons
 		return;
 
 	if (!nvme_get_log_error(hdl, NVME_NSID_ALL, entries, error_log))
-		WriteData((__u8 *)error_log, logSize, dir,
+		WriteData(b, (__u8 *)error_log, logSize, dir,
 			  "error_information_log.bin", "error log");
 
 	free(error_log);
 }
 
-static void GetGenericLogs(struct nvme_transport_handle *hdl, const char *dir)
+static void GetGenericLogs(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			   const char *dir)
 {
 	struct nvme_self_test_log self_test_log;
 	struct nvme_firmware_slot fw_log;
@@ -2220,17 +2049,17 @@ static void GetGenericLogs(struct nvme_transport_handle *hdl, const char *dir)
 
 	/* get self test log */
 	if (!nvme_get_log_device_self_test(hdl, &self_test_log))
-		WriteData((__u8 *)&self_test_log, sizeof(self_test_log), dir,
+		WriteData(b, (__u8 *)&self_test_log, sizeof(self_test_log), dir,
 			  "drive_self_test.bin", "self test log");
 
 	/* get fw slot info log */
 	if (!nvme_get_log_fw_slot(hdl, false, &fw_log))
-		WriteData((__u8 *)&fw_log, sizeof(fw_log), dir,
+		WriteData(b, (__u8 *)&fw_log, sizeof(fw_log), dir,
 			  "firmware_slot_info_log.bin", "firmware log");
 
 	/* get effects log */
 	if (!nvme_get_log_cmd_effects(hdl, NVME_CSI_NVM, &effects))
-		WriteData((__u8 *)&effects, sizeof(effects), dir,
+		WriteData(b, (__u8 *)&effects, sizeof(effects), dir,
 			  "command_effects_log.bin", "effects log");
 
 	/* get persistent event log */
@@ -2254,58 +2083,68 @@ static void GetGenericLogs(struct nvme_transport_handle *hdl, const char *dir)
 	err = nvme_get_log_persistent_event(hdl, NVME_PEVENT_LOG_READ,
 						pevent_log_info, log_len);
 	if (!err)
-		WriteData((__u8 *)pevent_log_info, log_len, dir,
+		WriteData(b, (__u8 *)pevent_log_info, log_len, dir,
 			  "persistent_event_log.bin", "persistent event log");
 }
 
-static void GetNSIDDInfo(struct nvme_transport_handle *hdl, const char *dir, int nsid)
+static void GetNSIDDInfo(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			 const char *dir, int nsid)
 {
 	char file[PATH_MAX] = { 0 };
 	struct nvme_id_ns ns;
 
 	if (!nvme_identify_ns(hdl, nsid, &ns)) {
 		sprintf(file, "identify_namespace_%d_data.bin", nsid);
-		WriteData((__u8 *)&ns, sizeof(ns), dir, file, "id-ns");
+		WriteData(b, (__u8 *)&ns, sizeof(ns), dir, file, "id-ns");
+	}
+}
+
+static void BundleFile(struct nvme_bundle *b, const char *name, const char *path)
+{
+	char buf[4096];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to read \"%s\"\n", path);
+		return;
 	}
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		nvme_bundle_append(b, name, buf, len);
+	close(fd);
 }
 
-static void GetOSConfig(const char *strOSDirName)
+static void GetOSConfig(struct nvme_bundle *b)
 {
-	FILE *fpOSConfig = NULL;
-	char strBuffer[1024];
-	char strFileName[PATH_MAX];
+	const char *name = "OS/os_config.txt";
+	struct utsname uts;
 	int i;
 
 	struct {
 		char *strcmdHeader;
-		char *strCommand;
+		char *strFile;
 	} cmdArray[] = {
-		{ (char *)"SYSTEM INFORMATION", (char *)"uname -a >> %s" },
-		{ (char *)"LINUX KERNEL MODULE INFORMATION", (char *)"lsmod >> %s" },
-		{ (char *)"LINUX SYSTEM MEMORY INFORMATION", (char *)"cat /proc/meminfo >> %s" },
-		{ (char *)"SYSTEM INTERRUPT INFORMATION", (char *)"cat /proc/interrupts >> %s" },
-		{ (char *)"CPU INFORMATION", (char *)"cat /proc/cpuinfo >> %s" },
-		{ (char *)"IO MEMORY MAP INFORMATION", (char *)"cat /proc/iomem >> %s" },
-		{ (char *)"MAJOR NUMBER AND DEVICE GROUP", (char *)"cat /proc/devices >> %s" },
-		{ (char *)"KERNEL DMESG", (char *)"dmesg >> %s" },
-		{ (char *)"/VAR/LOG/MESSAGES", (char *)"cat /var/log/messages >> %s" }
+		{ (char *)"SYSTEM INFORMATION", NULL },
+		{ (char *)"LINUX KERNEL MODULE INFORMATION", (char *)"/proc/modules" },
+		{ (char *)"LINUX SYSTEM MEMORY INFORMATION", (char *)"/proc/meminfo" },
+		{ (char *)"SYSTEM INTERRUPT INFORMATION", (char *)"/proc/interrupts" },
+		{ (char *)"CPU INFORMATION", (char *)"/proc/cpuinfo" },
+		{ (char *)"IO MEMORY MAP INFORMATION", (char *)"/proc/iomem" },
+		{ (char *)"MAJOR NUMBER AND DEVICE GROUP", (char *)"/proc/devices" },
 	};
 
-	sprintf(strFileName, "%s/%s", strOSDirName, "os_config.txt");
-
-	for (i = 0; i < 7; i++) {
-		fpOSConfig = fopen(strFileName, "a+");
-		if (fpOSConfig) {
-			fprintf(fpOSConfig,
-				"\n\n\n\n%s\n-----------------------------------------------\n",
-				cmdArray[i].strcmdHeader);
-			fclose(fpOSConfig);
-			fpOSConfig = NULL;
-		}
-		snprintf(strBuffer, sizeof(strBuffer) - 1,
-				 cmdArray[i].strCommand, strFileName);
-		if (system(strBuffer))
-			fprintf(stderr, "Failed to send \"%s\"\n", strBuffer);
+	for (i = 0; i < (int)ARRAY_SIZE(cmdArray); i++) {
+		nvme_bundle_printf(b, name,
+				   "\n\n\n\n%s\n-----------------------------------------------\n",
+				   cmdArray[i].strcmdHeader);
+		if (cmdArray[i].strFile)
+			BundleFile(b, name, cmdArray[i].strFile);
+		else if (!uname(&uts))
+			nvme_bundle_printf(b, name, "%s %s %s %s %s\n", uts.sysname,
+					   uts.nodename, uts.release, uts.version,
+					   uts.machine);
 	}
 }
 
@@ -2368,7 +2207,8 @@ static int micron_telemetry_log(struct nvme_transport_handle *hdl, __u8 type, __
 	return err;
 }
 
-static int GetTelemetryData(struct nvme_transport_handle *hdl, const char *dir)
+static int GetTelemetryData(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			    const char *dir)
 {
 	unsigned char *buffer = NULL;
 	int i, err, logSize = 0;
@@ -2385,7 +2225,7 @@ static int GetTelemetryData(struct nvme_transport_handle *hdl, const char *dir)
 		err = micron_telemetry_log(hdl, tmap[i].log, &buffer, &logSize, 0);
 		if (!err && logSize > 0 && buffer) {
 			sprintf(msg, "telemetry log: 0x%X", tmap[i].log);
-			WriteData(buffer, logSize, dir, tmap[i].file, msg);
+			WriteData(b, buffer, logSize, dir, tmap[i].file, msg);
 		}
 		free(buffer);
 		buffer = NULL;
@@ -2394,7 +2234,8 @@ static int GetTelemetryData(struct nvme_transport_handle *hdl, const char *dir)
 	return err;
 }
 
-static int GetFeatureSettings(struct nvme_transport_handle *hdl, const char *dir)
+static int GetFeatureSettings(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+			      const char *dir)
 {
 	unsigned char *bufp, buf[4096] = { 0 };
 	int i, err, len, errcnt = 0;
@@ -2431,9 +2272,9 @@ static int GetFeatureSettings(struct nvme_transport_handle *hdl, const char *dir
 				&attrVal);
 		if (!err) {
 			sprintf(msg, "feature: 0x%X", fmap[i].id);
-			WriteData((__u8 *)&attrVal, sizeof(attrVal), dir, fmap[i].file, msg);
+			WriteData(b, (__u8 *)&attrVal, sizeof(attrVal), dir, fmap[i].file, msg);
 			if (bufp)
-				WriteData(bufp, len, dir, fmap[i].file, msg);
+				WriteData(b, bufp, len, dir, fmap[i].file, msg);
 		} else {
 			fprintf(stderr, "Feature 0x%x data not retrieved, error %d (ignored)!\n",
 					fmap[i].id, err);
@@ -2993,29 +2834,26 @@ static int micron_latency_stats_track(int argc, char **argv, struct command *acm
 }
 
 
-static int micron_latency_stats_logs(int argc, char **argv, struct command *acmd,
-					 struct plugin *plugin)
-{
 #define  LATENCY_LOG_ENTRIES 16
-	struct latency_log_entry {
-		uint64_t   timestamp;
-		uint32_t   latency;
-		uint32_t   cmdtag;
+struct latency_log_entry {
+	uint64_t   timestamp;
+	uint32_t   latency;
+	uint32_t   cmdtag;
 	union {
 		struct {
-				uint32_t opcode:8;
-		uint32_t fuse:2;
-		uint32_t rsvd1:4;
-		uint32_t psdt:2;
-		uint32_t cid:16;
+			uint32_t opcode:8;
+			uint32_t fuse:2;
+			uint32_t rsvd1:4;
+			uint32_t psdt:2;
+			uint32_t cid:16;
 		};
-			uint32_t   dw0;
+		uint32_t   dw0;
 	};
 	uint32_t nsid;
 	uint32_t slba_low;
 	uint32_t slba_high;
 	union {
-			struct {
+		struct {
 			uint32_t nlb:16;
 			uint32_t rsvd2:9;
 			uint32_t deac:1;
@@ -3023,18 +2861,54 @@ static int micron_latency_stats_logs(int argc, char **argv, struct command *acmd
 			uint32_t fua:1;
 			uint32_t lr:1;
 		};
-			uint32_t   dw12;
+		uint32_t   dw12;
 	};
-		uint32_t   dsm;
-		uint32_t   rfu[6];
-	} log[LATENCY_LOG_ENTRIES];
+	uint32_t   dsm;
+	uint32_t   rfu[6];
+};
+
+/* prints the entries logged after @since, returns the newest timestamp */
+static uint64_t micron_latency_log_print(struct latency_log_entry *log, uint64_t since)
+{
+	uint64_t last = since;
+
+	for (int i = 0; i < LATENCY_LOG_ENTRIES; i++) {
+		if (since && log[i].timestamp <= since)
+			continue;
+		if (log[i].timestamp > last)
+			last = log[i].timestamp;
+		printf("%"PRIu64",%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+			   log[i].timestamp, log[i].latency, log[i].cmdtag, log[i].opcode,
+			   log[i].fuse, log[i].psdt, log[i].cid, log[i].nsid,
+			   log[i].slba_low, log[i].slba_high, log[i].nlb,
+			   log[i].deac, log[i].prinfo, log[i].fua, log[i].lr);
+	}
+	fflush(stdout);
+
+	return last;
+}
+
+static int micron_latency_stats_logs(int argc, char **argv, struct command *acmd,
+					 struct plugin *plugin)
+{
+	struct latency_log_entry log[LATENCY_LOG_ENTRIES];
 	enum eDriveModel model = UNKNOWN_MODEL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	int err = -1;
 	const char *desc = "Display Latency tracking log information";
+	const char *interval = "read the log every <interval> seconds and show the new entries";
+	const char *count = "number of reads, 0 until interrupted";
+	uint64_t last;
+
+	struct {
+		__u32 interval;
+		__u32 count;
+	} cfg = { 0 };
 
 	OPT_ARGS(opts) = {
+		OPT_UINT("interval", 'i', &cfg.interval, interval),
+		OPT_UINT("count", 'c', &cfg.count, count),
 		OPT_END()
 	};
 
@@ -3051,13 +2925,95 @@ static int micron_latency_stats_logs(int argc, char **argv, struct command *acmd
 	/* print header and each log entry */
 	printf("Timestamp, Latency, CmdTag, Opcode, Fuse, Psdt, Cid, Nsid, Slba_L, Slba_H, Nlb, ");
 	printf("DEAC, PRINFO, FUA, LR\n");
-	for (int i = 0; i < LATENCY_LOG_ENTRIES; i++)
-		printf("%"PRIu64",%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
-			   log[i].timestamp, log[i].latency, log[i].cmdtag, log[i].opcode,
-			   log[i].fuse, log[i].psdt, log[i].cid, log[i].nsid,
-			   log[i].slba_low, log[i].slba_high, log[i].nlb,
-			   log[i].deac, log[i].prinfo, log[i].fua, log[i].lr);
-	printf("\n");
+	last = micron_latency_log_print(log, 0);
+	if (!cfg.interval) {
+		printf("\n");
+		return err;
+	}
+
+	/* the log keeps the last entries, only the ones not seen yet are shown */
+	for (__u32 i = 0; !cfg.count || i < cfg.count; i++) {
+		if (nvme_wait_countdown(cfg.interval))
+			break;
+		err = nvme_get_log_simple(hdl, 0xD1, &log, sizeof(log));
+		if (err) {
+			if (err < 0)
+				printf("Unable to retrieve latency stats log the drive\n");
+			break;
+		}
+		last = micron_latency_log_print(log, last);
+	}
+	return err;
+}
+
+#define LATENCY_BUCKET_COUNT 32
+#define LATENCY_BUCKET_RSVD  32
+struct micron_latency_stats {
+	uint64_t version; /* major << 32 | minior */
+	uint64_t all_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
+	uint64_t read_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
+	uint64_t write_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
+	uint64_t trim_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
+	uint32_t reserved[255]; /* round up to 4K */
+};
+
+/* the bucket edges of the thresholds of micron_latency_stats_info() */
+static const uint64_t micron_latency_edges_us[LATENCY_BUCKET_COUNT + 1] = {
+	0, 50, 100, 150, 200, 300, 400, 500, 600, 700, 800, 900,
+	1000, 5000, 10000, 20000, 50000, 100000, 200000, 300000, 400000,
+	500000, 600000, 700000, 800000, 900000, 1000000, 2000000, 3000000,
+	4000000, 5000000, 8000000, NVME_LAT_INF,
+};
+
+struct micron_latency_sample {
+	struct nvme_transport_handle *hdl;
+	size_t offset;		/* of the counters of the command type */
+};
+
+static int micron_latency_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct micron_latency_sample *p = s->priv;
+	struct micron_latency_stats log;
+	int err;
+
+	err = nvme_get_log_simple(p->hdl, 0xD0, &log, sizeof(log));
+	if (err)
+		return err;
+
+	memcpy(count, (__u8 *)&log + p->offset, LATENCY_BUCKET_COUNT * sizeof(*count));
+
+	return 0;
+}
+
+static int micron_latency_stats_sample(struct nvme_transport_handle *hdl,
+				       uint64_t *cmd_stats, struct micron_latency_stats *log,
+				       const char *cmd_str, __u32 interval, __u32 count,
+				       bool json)
+{
+	struct micron_latency_sample p = {
+		.hdl = hdl,
+		.offset = (__u8 *)cmd_stats - (__u8 *)log,
+	};
+	struct nvme_lat_sampler s = {
+		.name = cmd_str,
+		.interval = interval,
+		.count = count,
+		.json = json,
+		.sample = micron_latency_sample,
+		.priv = &p,
+	};
+	int err;
+
+	err = nvme_lat_hist_alloc(&s.hist, LATENCY_BUCKET_COUNT);
+	if (err)
+		return err;
+	memcpy(s.hist.edge_us, micron_latency_edges_us, sizeof(micron_latency_edges_us));
+
+	err = nvme_lat_sampler_run(&s);
+	if (err)
+		nvme_show_err("latency-stats", err);
+	nvme_lat_hist_free(&s.hist);
+
 	return err;
 }
 
@@ -3066,20 +3022,17 @@ static int micron_latency_stats_info(int argc, char **argv, struct command *acmd
 {
 	const char *desc = "display command latency statistics";
 	const char *cmdstr = "command to display stats - all|read|write|trim, default is all";
+	const char *interval = "sample the log every <interval> seconds and show the "
+			       "latency percentiles of each interval";
+	const char *count = "number of samples, 0 until interrupted";
+#ifdef CONFIG_JSONC
+	const char *json = "show the samples in json format";
+#endif /* CONFIG_JSONC */
 	int err = 0;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	enum eDriveModel model = UNKNOWN_MODEL;
-	#define LATENCY_BUCKET_COUNT 32
-	#define LATENCY_BUCKET_RSVD  32
-	struct micron_latency_stats {
-		uint64_t version; /* major << 32 | minior */
-		uint64_t all_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
-		uint64_t read_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
-		uint64_t write_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
-		uint64_t trim_cmds[LATENCY_BUCKET_COUNT + LATENCY_BUCKET_RSVD];
-		uint32_t reserved[255]; /* round up to 4K */
-	} log;
+	struct micron_latency_stats log;
 
 	struct latency_thresholds {
 		uint32_t start;
@@ -3099,6 +3052,9 @@ static int micron_latency_stats_info(int argc, char **argv, struct command *acmd
 
 	struct {
 		char *command;
+		__u32 interval;
+		__u32 count;
+		bool json;
 	} opt = {
 		.command = "all"
 	};
@@ -3108,6 +3064,9 @@ static int micron_latency_stats_info(int argc, char **argv, struct command *acmd
 
 	OPT_ARGS(opts) = {
 		OPT_STRING("command", 'c', "command", &opt.command, cmdstr),
+		OPT_UINT("interval", 'i', &opt.interval, interval),
+		OPT_UINT("count", 'n', &opt.count, count),
+		OPT_FLAG_JSON("json", 'j', &opt.json, json),
 		OPT_END()
 	};
 
@@ -3128,6 +3087,10 @@ static int micron_latency_stats_info(int argc, char **argv, struct command *acmd
 		return -1;
 	}
 
+	if (opt.interval)
+		return micron_latency_stats_sample(hdl, cmd_stats, &log, cmd_str,
+						   opt.interval, opt.count, opt.json);
+
 	memset(&log, 0, sizeof(log));
 	err = nvme_get_log_simple(hdl, 0xD0, &log, sizeof(log));
 	if (err) {
@@ -3469,14 +3432,44 @@ static int get_common_log(struct nvme_transport_handle *hdl, uint8_t id, uint8_t
 	return ret;
 }
 
-static int GetOcpEnhancedTelemetryLog(struct nvme_transport_handle *hdl, const char *dir, int nLogID)
+struct micron_ocp_capture {
+	struct nvme_transport_handle *hdl;
+	struct nvme_bundle *b;
+	const char *dir;
+	const char *file;
+	int log;
+};
+
+static int OcpTelemetryFetch(struct nvme_capture *c, void *buf, uint64_t off, uint32_t len)
+{
+	struct micron_ocp_capture *ocp = c->priv;
+
+	return NVMEGetLogPage(ocp->hdl, ocp->log, buf, len, off);
+}
+
+static int OcpTelemetryWrite(struct nvme_capture *c, const void *buf, uint64_t off, uint32_t len)
+{
+	struct micron_ocp_capture *ocp = c->priv;
+
+	WriteData(ocp->b, (__u8 *)buf, len, ocp->dir, ocp->file, ocp->file);
+	return 0;
+}
+
+static int GetOcpEnhancedTelemetryLog(struct nvme_bundle *b, struct nvme_transport_handle *hdl,
+				      const char *dir, int nLogID)
 {
 	int err = 0;
 	unsigned char *pTelemetryDataHeader = 0;
 	unsigned int nallocSize = 0;
 	unsigned int nOffset = 0;
-	unsigned char *pTelemetryBuffer = 0;
 	unsigned int usAreaLastBlock[4] = {0};
+	struct micron_ocp_capture ocp = {
+		.hdl = hdl,
+		.b = b,
+		.dir = dir,
+		.log = nLogID,
+	};
+	struct nvme_capture c;
 	bool bTeleheaderWrite = true;
 	/* Enable ETDAS */
 	unsigned int uiBufferSize = 512;
@@ -3517,8 +3510,16 @@ static int GetOcpEnhancedTelemetryLog(struct nvme_transport_handle *hdl, const c
 						(pTelemetryDataHeader[n + 1] << 8) |
 						pTelemetryDataHeader[n];
 
+	if (nLogID == NVME_LOG_LID_TELEMETRY_HOST)
+		ocp.file = "nvme_host_telemetry_log.bin";
+	else
+		ocp.file = "nvme_controller_telemetry_log.bin";
+
 	for (int nArea = 0; nArea <= 3; nArea++) {
-		if (nArea != 0)
+		/* a data area which is not present ends before the previous one */
+		if (nArea != 0 && usAreaLastBlock[nArea] < usAreaLastBlock[nArea - 1])
+			nallocSize = 0;
+		else if (nArea != 0)
 			nallocSize = (usAreaLastBlock[nArea] - usAreaLastBlock[nArea - 1]) * 512;
 		else
 			nallocSize = usAreaLastBlock[nArea] * 512;
@@ -3530,58 +3531,28 @@ static int GetOcpEnhancedTelemetryLog(struct nvme_transport_handle *hdl, const c
 			continue;
 		}
 
-		pTelemetryBuffer = (unsigned char *)calloc(nallocSize, 1);
-		if (!pTelemetryBuffer) {
-			printf(
-				"Unable to allocate buffer of size 0x%X bytes for Data Area %d"
-				, nallocSize, (nArea + 1)
-			);
-			nOffset += nallocSize;
-			continue;
+		if (bTeleheaderWrite) {
+			WriteData(b, pTelemetryDataHeader, 512, dir, ocp.file, ocp.file);
+			bTeleheaderWrite = false;
 		}
-		/* Fetch the Data */
-		err = NVMEGetLogPage(hdl, nLogID, pTelemetryBuffer, nallocSize, nOffset);
 
-		if (err != 0) {
+		/* failed chunks are zero filled to keep the data area offsets */
+		nvme_capture_init(&c, hdl);
+		c.offset = nOffset;
+		c.size = nallocSize;
+		c.skip_errors = true;
+		c.fetch = OcpTelemetryFetch;
+		c.write = OcpTelemetryWrite;
+		c.priv = &ocp;
+		err = nvme_capture_run(&c);
+		if (c.failed)
 			printf(
-				"Failed to fetch telemetry data of size : %u from offset : %u!\n"
-				, nallocSize, nOffset
+				"Failed to fetch %u chunks of telemetry data of size : %u from offset : %u!\n"
+				, c.failed, nallocSize, nOffset
 			);
-			free(pTelemetryBuffer);
-			pTelemetryBuffer = NULL;
-			nOffset += nallocSize;
-			continue;
-		}
 
 		/* Increment the Offset value */
 		nOffset += nallocSize;
-
-		if ((nArea + 1) <= 4) {
-			char strBuffer[256] = { 0 };
-
-			if (nLogID == NVME_LOG_LID_TELEMETRY_HOST) {
-				sprintf(strBuffer, "%s", "nvme_host_telemetry_log.bin");
-				if (bTeleheaderWrite) {
-					WriteData(pTelemetryDataHeader, 512, dir,
-						"nvme_host_telemetry_log.bin", strBuffer);
-					bTeleheaderWrite = false;
-				}
-				WriteData(pTelemetryBuffer, nallocSize, dir,
-					"nvme_host_telemetry_log.bin", strBuffer);
-			} else if (nLogID == NVME_LOG_LID_TELEMETRY_CTRL) {
-				sprintf(strBuffer, "%s", "nvme_controller_telemetry_log.bin");
-				if (bTeleheaderWrite) {
-					WriteData(pTelemetryDataHeader, 512, dir,
-						"nvme_controller_telemetry_log.bin", strBuffer);
-					bTeleheaderWrite = false;
-				}
-				WriteData(pTelemetryBuffer, nallocSize, dir,
-					"nvme_controller_telemetry_log.bin", strBuffer);
-			}
-		}
-
-		free(pTelemetryBuffer);
-		pTelemetryBuffer = NULL;
 	}
 	// free mem of header, all areas
 	free(pTelemetryDataHeader);
@@ -3595,9 +3566,8 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 {
 	int err = -EINVAL;
 	int ctrlIdx, telemetry_option = 0;
-	char strOSDirName[1024];
-	char strCtrlDirName[1024];
-	char strMainDirName[256];
+	const char *strCtrlDirName = "Controller";
+	struct nvme_bundle *b = NULL;
 	unsigned int *puiIDDBuf;
 	unsigned int uiMask;
 	struct nvme_id_ctrl ctrl;
@@ -3720,7 +3690,7 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 			printf("Log data file must be specified. ie -p=logfile.bin\n");
 		else
 			printf(
-				"Log data file must be specified. ie -p=logfile.zip or -p=logfile.tgz|logfile.tar.gz\n"
+				"Log data file must be specified. ie -p=logfile.zip or -p=logfile.tgz|logfile.tar.gz|logfile.tar\n"
 			);
 		goto out;
 	}
@@ -3750,7 +3720,7 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 				   cfg.data_area);
 		if (!err && logSize > 0 && buffer) {
 			sprintf(msg, "telemetry log: 0x%X", cfg.log);
-			WriteData(buffer, logSize, dir, cfg.package, msg);
+			WriteData(NULL, buffer, logSize, dir, cfg.package, msg);
 			free(buffer);
 		}
 		goto out;
@@ -3769,37 +3739,42 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 	sn[j] = '\0';
 	strcpy(ctrl.sn, sn);
 
-	SetupDebugDataDirectories(ctrl.sn, cfg.package, strMainDirName, strOSDirName,
-										strCtrlDirName);
+	/* the logs are streamed into the package below a directory named by the SN */
+	err = nvme_bundle_open(&b, cfg.package, ctrl.sn);
+	if (err) {
+		fprintf(stderr, "Failed to create log data package %s: %s\n",
+			cfg.package, strerror(-err));
+		goto out;
+	}
 
-	GetTimestampInfo(strOSDirName);
-	GetCtrlIDDInfo(strCtrlDirName, &ctrl);
-	GetOSConfig(strOSDirName);
-	GetDriveInfo(strOSDirName, ctrlIdx, &ctrl);
+	GetTimestampInfo(b);
+	GetCtrlIDDInfo(b, strCtrlDirName, &ctrl);
+	GetOSConfig(b);
+	GetDriveInfo(b, ctrlIdx, &ctrl);
 
 	for (int i = 1; i <= ctrl.nn; i++)
-		GetNSIDDInfo(hdl, strCtrlDirName, i);
+		GetNSIDDInfo(b, hdl, strCtrlDirName, i);
 
-	GetSmartlogData(hdl, strCtrlDirName);
-	GetErrorlogData(hdl, ctrl.elpe, strCtrlDirName);
-	GetGenericLogs(hdl, strCtrlDirName);
+	GetSmartlogData(b, hdl, strCtrlDirName);
+	GetErrorlogData(b, hdl, ctrl.elpe, strCtrlDirName);
+	GetGenericLogs(b, hdl, strCtrlDirName);
 	/* pull if telemetry log data is supported */
 	if ((ctrl.lpa & 0x8) == 0x8) {
 		if (eModel == M51BY) {
-			err = GetOcpEnhancedTelemetryLog(hdl, strCtrlDirName,
+			err = GetOcpEnhancedTelemetryLog(b, hdl, strCtrlDirName,
 								NVME_LOG_LID_TELEMETRY_HOST);
 			if (err != 0)
 				printf("Failed to fetch the host telemetry log");
 
-			err = GetOcpEnhancedTelemetryLog(hdl, strCtrlDirName,
+			err = GetOcpEnhancedTelemetryLog(b, hdl, strCtrlDirName,
 								NVME_LOG_LID_TELEMETRY_CTRL);
 			if (err != 0)
 				printf("Failed to fetch the controller telemetry log");
 		} else {
-			GetTelemetryData(hdl, strCtrlDirName);
+			GetTelemetryData(b, hdl, strCtrlDirName);
 		}
 	}
-	GetFeatureSettings(hdl, strCtrlDirName);
+	GetFeatureSettings(b, hdl, strCtrlDirName);
 
 	if (eModel != M5410 && eModel != M5407) {
 		memcpy(&aVendorLogs[c_logs_index], aM51XXLogs, sizeof(aM51XXLogs));
@@ -3931,7 +3906,7 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 			maxSize = aVendorLogs[i].nMaxSize - bSize;
 			while (!err && maxSize > 0 && ((unsigned int *)dataBuffer)[0] != 0xdeadbeef) {
 				sprintf(msg, "log 0x%x", aVendorLogs[i].ucLogPage);
-				WriteData(dataBuffer, bSize, strCtrlDirName, aVendorLogs[i].strFileName, msg);
+				WriteData(b, dataBuffer, bSize, strCtrlDirName, aVendorLogs[i].strFileName, msg);
 				err = nvme_get_log_simple(hdl,
 					  aVendorLogs[i].ucLogPage,
 					  dataBuffer, bSize);
@@ -3944,14 +3919,17 @@ static int micron_internal_logs(int argc, char **argv, struct command *acmd,
 
 		if (!err && dataBuffer && ((unsigned int *)dataBuffer)[0] != 0xdeadbeef) {
 			sprintf(msg, "log 0x%x", aVendorLogs[i].ucLogPage);
-			WriteData(dataBuffer, bSize, strCtrlDirName, aVendorLogs[i].strFileName, msg);
+			WriteData(b, dataBuffer, bSize, strCtrlDirName, aVendorLogs[i].strFileName, msg);
 		}
 
 		free(dataBuffer);
 		dataBuffer = NULL;
 	}
 
-	err = ZipAndRemoveDir(strMainDirName, cfg.package);
+	err = nvme_bundle_close(b);
+	if (err)
+		fprintf(stderr, "Failed to create log data package %s: %s\n",
+			cfg.package, strerror(-err));
 out:
 	return err;
 }
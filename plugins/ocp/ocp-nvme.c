@@ -15,6 +15,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "nvme.h"
@@ -29,6 +32,7 @@
 #include "ocp-clear-features.h"
 #include "ocp-fw-activation-history.h"
 #include "ocp-telemetry-decode.h"
+#include "ocp-telemetry-diff.h"
 #include "ocp-hardware-component-log.h"
 #include "ocp-print.h"
 #include "ocp-types.h"
@@ -1366,47 +1370,118 @@ static int get_c9_log_page_data(struct nvme_transport_handle *hdl,
 	return 0;
 }
 
-int parse_ocp_telemetry_log(struct ocp_telemetry_parse_options *options)
+/*
+ * The logs are mapped instead of read, a decode only touches the data
+ * areas it prints. The mapping is private and writable so that the
+ * decoder may treat it as its own buffer.
+ */
+static __u8 *ocp_map_log(const char *path, size_t *size)
 {
-	int status = 0;
-	long telemetry_buffer_size = 0;
-	long string_buffer_size = 0;
-	enum nvme_print_flags fmt;
+	struct stat st;
+	void *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		nvme_show_error("Failed to open %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	madvise(buf, st.st_size, MADV_WILLNEED);
+	*size = st.st_size;
+
+	return buf;
+}
+
+static struct {
+	char *path;
+	size_t size;
+} ocp_string_map;
+
+static void ocp_unmap_string_log(void)
+{
+	if (pstring_buffer) {
+		ocp_string_log_index_free();
+		munmap(pstring_buffer, ocp_string_map.size);
+		pstring_buffer = NULL;
+	}
+	free(ocp_string_map.path);
+	ocp_string_map.path = NULL;
+}
+
+/* a string log shared by several captures is mapped and indexed once */
+static int ocp_map_string_log(const char *path)
+{
+	if (pstring_buffer && !strcmp(ocp_string_map.path, path))
+		return 0;
+
+	ocp_unmap_string_log();
+
+	ocp_string_map.path = strdup(path);
+	if (!ocp_string_map.path)
+		return -ENOMEM;
+
+	pstring_buffer = ocp_map_log(path, &ocp_string_map.size);
+	if (!pstring_buffer) {
+		nvme_show_error("Failed to read string-log.\n");
+		free(ocp_string_map.path);
+		ocp_string_map.path = NULL;
+		return -1;
+	}
+	ocp_string_log_index_build(pstring_buffer, ocp_string_map.size);
+
+	return 0;
+}
+
+static int ocp_decode_telemetry_file(struct ocp_telemetry_parse_options *options,
+				     enum nvme_print_flags fmt)
+{
+	size_t size = 0;
 	unsigned char log_id;
 
-	if (options->telemetry_log) {
-		if (strstr((const char *)options->telemetry_log, "bin")) {
-			/* Read the data from the telemetry binary file */
-			ptelemetry_buffer =
-				read_binary_file(NULL, (const char *)options->telemetry_log,
-						 &telemetry_buffer_size, 1);
-			if (ptelemetry_buffer == NULL) {
-				nvme_show_error("Failed to read telemetry-log.\n");
-				return -1;
-			}
-		}
-	} else {
-		nvme_show_error("telemetry-log is empty.\n");
+	ptelemetry_buffer = ocp_map_log(options->telemetry_log, &size);
+	if (!ptelemetry_buffer) {
+		nvme_show_error("Failed to read telemetry-log.\n");
 		return -1;
 	}
 
 	log_id = ptelemetry_buffer[0];
 	if ((log_id != NVME_LOG_LID_TELEMETRY_HOST) && (log_id != NVME_LOG_LID_TELEMETRY_CTRL)) {
 		nvme_show_error("Invalid LogPageId [0x%02X]\n", log_id);
+		munmap(ptelemetry_buffer, size);
+		ptelemetry_buffer = NULL;
 		return -1;
 	}
 
-	if (options->string_log) {
-		/* Read the data from the string binary file */
-		if (strstr((const char *)options->string_log, "bin")) {
-			pstring_buffer = read_binary_file(NULL, (const char *)options->string_log,
-							  &string_buffer_size, 1);
-			if (pstring_buffer == NULL) {
-				nvme_show_error("Failed to read string-log.\n");
-				return -1;
-			}
-		}
-	} else {
+	ocp_show_telemetry_log(options, fmt);
+
+	munmap(ptelemetry_buffer, size);
+	ptelemetry_buffer = NULL;
+
+	return 0;
+}
+
+int parse_ocp_telemetry_log(struct ocp_telemetry_parse_options *options)
+{
+	int status = 0;
+	enum nvme_print_flags fmt;
+
+	if (!options->telemetry_log) {
+		nvme_show_error("telemetry-log is empty.\n");
+		return -1;
+	}
+
+	if (!options->string_log) {
 		nvme_show_error("string-log is empty.\n");
 		return -1;
 	}
@@ -1417,9 +1492,117 @@ int parse_ocp_telemetry_log(struct ocp_telemetry_parse_options *options)
 		return status;
 	}
 
-	ocp_show_telemetry_log(options, fmt);
+	status = ocp_map_string_log(options->string_log);
+	if (status)
+		return status;
 
-	return 0;
+	status = ocp_decode_telemetry_file(options, fmt);
+	ocp_unmap_string_log();
+
+	return status;
+}
+
+static bool ocp_is_telemetry_log(const char *path)
+{
+	unsigned char log_id;
+	bool ret = false;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (read(fd, &log_id, 1) == 1)
+		ret = log_id == NVME_LOG_LID_TELEMETRY_HOST ||
+		      log_id == NVME_LOG_LID_TELEMETRY_CTRL;
+	close(fd);
+
+	return ret;
+}
+
+static int ocp_bin_filter(const struct dirent *d)
+{
+	size_t len = strlen(d->d_name);
+
+	return len > 4 && !strcmp(d->d_name + len - 4, ".bin");
+}
+
+/*
+ * Decodes every telemetry capture in @dir, the string logs and other files
+ * in there are skipped. Without a string log given, a capture named
+ * <name>-telemetry.bin is decoded with <name>-string.bin, as saved by a
+ * live retrieval. Each decode is written next to its capture.
+ */
+static int ocp_decode_telemetry_dir(struct ocp_telemetry_parse_options *options,
+				    const char *dir)
+{
+	struct ocp_telemetry_parse_options capture = *options;
+	const char *suffix = "telemetry.bin";
+	struct dirent **entries;
+	enum nvme_print_flags fmt;
+	int i, n, err, status = 0, decoded = 0;
+
+	err = validate_output_format(options->output_format, &fmt);
+	if (err < 0) {
+		nvme_show_error("Invalid output format\n");
+		return err;
+	}
+
+	n = scandir(dir, &entries, ocp_bin_filter, alphasort);
+	if (n < 0) {
+		err = -errno;
+		nvme_show_error("Failed to scan %s: %s", dir, strerror(-err));
+		return err;
+	}
+
+	for (i = 0; i < n; i++) {
+		_cleanup_free_ char *path = NULL, *output = NULL, *string_log = NULL;
+		const char *name = entries[i]->d_name;
+		size_t len = strlen(name);
+
+		if (asprintf(&path, "%s/%s", dir, name) < 0 ||
+		    asprintf(&output, "%s/%.*s", dir, (int)(len - 4), name) < 0) {
+			status = -ENOMEM;
+			break;
+		}
+
+		if (!ocp_is_telemetry_log(path))
+			continue;
+
+		if (!options->string_log) {
+			if (len < strlen(suffix) ||
+			    strcmp(name + len - strlen(suffix), suffix) ||
+			    asprintf(&string_log, "%s/%.*s%s", dir,
+				     (int)(len - strlen(suffix)), name, "string.bin") < 0) {
+				nvme_show_error("No string-log for %s", path);
+				status = -1;
+				continue;
+			}
+		}
+
+		err = ocp_map_string_log(string_log ? string_log : options->string_log);
+		if (err) {
+			status = err;
+			continue;
+		}
+
+		capture.telemetry_log = path;
+		capture.output_file = output;
+		err = ocp_decode_telemetry_file(&capture, fmt);
+		if (err)
+			status = err;
+		else
+			decoded++;
+	}
+
+	for (i = 0; i < n; i++)
+		free(entries[i]);
+	free(entries);
+	ocp_unmap_string_log();
+
+	nvme_show_result("%d telemetry logs decoded.", decoded);
+
+	return status;
 }
 
 static int ocp_telemetry_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
@@ -1438,6 +1621,8 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *acmd, struct
 			"e.g. '-a 4 for Data Areas 1, 2, 3, and 4.';\n";
 
 	const char *telemetry_type = "Telemetry Type; 'host', 'host0', 'host1' or 'controller'";
+	const char *telemetry_dir = "Directory of telemetry log binaries to decode without a device";
+	const char *jobs = "Number of decode threads, default one per CPU";
 
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
@@ -1447,7 +1632,8 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *acmd, struct
 	char sn[21] = {0,};
 	struct nvme_id_ctrl ctrl;
 	bool is_support_telemetry_controller;
-	struct ocp_telemetry_parse_options opt;
+	struct ocp_telemetry_parse_options opt = { 0 };
+	char *dir = NULL;
 	int tele_type = 0;
 	int tele_area = 0;
 	char file_path_telemetry[PATH_MAX], file_path_string[PATH_MAX];
@@ -1462,9 +1648,30 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *acmd, struct
 		OPT_FMT("output-format", 'o', &opt.output_format, output_format),
 		OPT_INT("data-area", 'a', &opt.data_area, data_area),
 		OPT_STR("telemetry-type", 't', &opt.telemetry_type, telemetry_type),
+		OPT_FILE("telemetry-dir", 'D', &dir, telemetry_dir),
+		OPT_INT("jobs", 'j', &opt.jobs, jobs),
 		OPT_END()
 	};
 
+	err = argconfig_parse(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	/* existing logs are decoded without opening a device */
+	if (dir || (opt.telemetry_log && opt.string_log && optind >= argc)) {
+		if (!opt.output_format)
+			opt.output_format = DEFAULT_OUTPUT_FORMAT_JSON;
+		if (!opt.telemetry_type)
+			opt.telemetry_type = "host";
+		if (!opt.data_area)
+			opt.data_area = DATA_AREA_1;
+		if (dir)
+			return ocp_decode_telemetry_dir(&opt, dir);
+		if (!opt.output_file)
+			opt.output_file = DEFAULT_TELEMETRY_LOG;
+		return parse_ocp_telemetry_log(&opt);
+	}
+
 	err = parse_and_open(&ctx, &hdl, argc, argv, desc, opts);
 	if (err)
 		return err;
@@ -1616,6 +1823,89 @@ out:
 	return err;
 }
 
+static int ocp_telemetry_diff_cmd(int argc, char **argv, struct command *acmd,
+				  struct plugin *plugin)
+{
+	const char *desc = "Compare two OCP telemetry log captures of a device: the\n"
+		"statistics which changed with their deltas, the events added to\n"
+		"the event FIFOs and the changed regions of the data areas.";
+	const char *string_log = "String log binary for the statistic and event names; 'C9.bin'";
+	const char *block_size = "granularity of the changed regions in bytes, default 512";
+	const char *output_format = "output format normal|json";
+
+	struct nvme_tdiff d = { 0 };
+	struct json_object *root = NULL;
+	char *format = "normal";
+	char *strings = NULL;
+	__u32 block = NVME_TDIFF_DEFAULT_BLOCK;
+	nvme_print_flags_t fmt;
+	int err;
+
+	OPT_ARGS(opts) = {
+		OPT_STR("string-log", 's', &strings, string_log),
+		OPT_UINT("block-size", 'b', &block, block_size),
+		OPT_FMT("output-format", 'o', &format, output_format),
+		OPT_END()
+	};
+
+	err = argconfig_parse(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(format, &fmt);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (argc - optind != 2) {
+		nvme_show_error("Please provide the two telemetry log files to compare");
+		return -EINVAL;
+	}
+
+	if (!block) {
+		nvme_show_error("Invalid block size");
+		return -EINVAL;
+	}
+
+	if (strings) {
+		err = ocp_map_string_log(strings);
+		if (err)
+			return err;
+	}
+
+	err = nvme_tdiff_open(&d, argv[optind], argv[optind + 1]);
+	if (err)
+		goto unmap;
+
+	d.block = block;
+	err = nvme_tdiff_compare(&d);
+	if (err) {
+		nvme_show_error("telemetry-diff: %s", strerror(-err));
+		goto close;
+	}
+
+	if (fmt == JSON)
+		root = json_create_object();
+
+	nvme_tdiff_print(&d, root);
+	err = ocp_telemetry_diff(&d, root);
+	if (root) {
+		if (!err) {
+			json_print_object(root, NULL);
+			printf("\n");
+		}
+		json_free_object(root);
+	}
+
+close:
+	nvme_tdiff_close(&d);
+unmap:
+	ocp_unmap_string_log();
+
+	return err;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
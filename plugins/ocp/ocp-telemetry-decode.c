@@ -4,6 +4,9 @@
  * Authors: Jeff Lien <jeff.lien@wdc.com>,
  */
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
@@ -523,127 +526,220 @@ int get_telemetry_das_offset_and_size(
 	return 0;
 }
 
-int get_statistic_id_ascii_string(int identifier, char *description)
+/*
+ * Open addressing indexes over the three string tables of the string log,
+ * built once per loaded string log so that decoding a telemetry log with
+ * many events does not rescan the tables for every description. The slots
+ * hold the table entry number plus one, 0 marks a free slot. On a
+ * duplicate identifier the first table entry wins, as with a table scan.
+ */
+struct ocp_string_slot {
+	__u32 key;
+	__u32 entry;
+};
+
+struct ocp_string_index {
+	struct ocp_string_slot *slot;
+	__u32 mask;
+	const __u8 *table;
+	size_t nr;
+	size_t entry_size;
+	__u32 (*key)(const void *entry);
+};
+
+static struct {
+	const __u8 *buf;
+	size_t size;
+	struct ocp_string_index sits, ests, vu_ests;
+} ocp_strings;
+
+static __u32 ocp_sits_key(const void *entry)
 {
-	if (!pstring_buffer || !description)
-		return -1;
+	const struct nvme_ocp_statistics_identifier_string_table *e = entry;
 
-	struct nvme_ocp_telemetry_string_header *pocp_ts_header =
-		(struct nvme_ocp_telemetry_string_header *)pstring_buffer;
+	return le16_to_cpu(e->vs_statistic_identifier);
+}
 
-	//Calculating the sizes of the tables. Note: Data is present in the form of DWORDS,
-	//So multiplying with sizeof(DWORD)
-	unsigned long long sits_table_size = (pocp_ts_header->sitsz) * SIZE_OF_DWORD;
+static __u32 ocp_ests_key(const void *entry)
+{
+	const struct nvme_ocp_event_string_table *e = entry;
 
-	//Calculating number of entries present in all 3 tables
-	int sits_entries = (int)sits_table_size /
-		sizeof(struct nvme_ocp_statistics_identifier_string_table);
+	return e->debug_event_class << 16 | le16_to_cpu(e->event_identifier);
+}
 
-	for (int sits_entry = 0; sits_entry < sits_entries; sits_entry++) {
-		struct nvme_ocp_statistics_identifier_string_table
-			*peach_statistic_entry =
-			(struct nvme_ocp_statistics_identifier_string_table *)
-			(pstring_buffer + (pocp_ts_header->sits * SIZE_OF_DWORD) +
-			(sits_entry *
-			sizeof(struct nvme_ocp_statistics_identifier_string_table)));
+static __u32 ocp_vu_ests_key(const void *entry)
+{
+	const struct nvme_ocp_vu_event_string_table *e = entry;
 
-		if (identifier == (int)peach_statistic_entry->vs_statistic_identifier) {
-			char *pdescription = (char *)(pstring_buffer +
-				(pocp_ts_header->ascts * SIZE_OF_DWORD) +
-				(peach_statistic_entry->ascii_id_offset *
-				SIZE_OF_DWORD));
+	return e->debug_event_class << 16 | le16_to_cpu(e->vu_event_identifier);
+}
 
-			memcpy(description, pdescription,
-			       peach_statistic_entry->ascii_id_length + 1);
+static inline __u32 ocp_string_hash(__u32 key, __u32 mask)
+{
+	return (key * 0x9e3779b1U >> 8) & mask;
+}
 
-			return 0;
-		}
+static void ocp_string_index_init(struct ocp_string_index *idx, __u64 start,
+				  __u64 dwords, size_t entry_size,
+				  __u32 (*key)(const void *entry))
+{
+	__u64 off = start * SIZE_OF_DWORD, len = dwords * SIZE_OF_DWORD;
+	__u32 size = 16, pos;
+	size_t i;
+
+	memset(idx, 0, sizeof(*idx));
+	idx->entry_size = entry_size;
+	idx->key = key;
+
+	if (off > ocp_strings.size || len > ocp_strings.size - off)
+		return;
+
+	idx->table = ocp_strings.buf + off;
+	idx->nr = len / entry_size;
+	if (!idx->nr || idx->nr > UINT32_MAX / 4)
+		return;
+
+	while (size < idx->nr * 2)
+		size <<= 1;
+
+	/* without an index the lookups fall back to a table scan */
+	idx->slot = calloc(size, sizeof(*idx->slot));
+	if (!idx->slot)
+		return;
+	idx->mask = size - 1;
+
+	for (i = 0; i < idx->nr; i++) {
+		__u32 k = key(idx->table + i * entry_size);
+
+		for (pos = ocp_string_hash(k, idx->mask); idx->slot[pos].entry;
+		     pos = (pos + 1) & idx->mask)
+			if (idx->slot[pos].key == k)
+				break;
+		if (idx->slot[pos].entry)
+			continue;
+		idx->slot[pos].key = k;
+		idx->slot[pos].entry = i + 1;
 	}
+}
 
-	// If ASCII string isn't found, see in our internal Map
-	// for 2.5 Spec defined strings
-	if (identifier <= 0x1D) {
-		strcpy(description, statistic_identifiers_map[identifier].description);
-		return 0;
+static const void *ocp_string_index_find(const struct ocp_string_index *idx, __u32 key)
+{
+	__u32 pos;
+	size_t i;
+
+	if (!idx->slot) {
+		for (i = 0; i < idx->nr; i++)
+			if (idx->key(idx->table + i * idx->entry_size) == key)
+				return idx->table + i * idx->entry_size;
+		return NULL;
 	}
 
-	return -1;
+	for (pos = ocp_string_hash(key, idx->mask); idx->slot[pos].entry;
+	     pos = (pos + 1) & idx->mask)
+		if (idx->slot[pos].key == key)
+			return idx->table + (idx->slot[pos].entry - 1) * idx->entry_size;
+
+	return NULL;
 }
 
-int get_event_id_ascii_string(int identifier, int debug_event_class, char *description)
+void ocp_string_log_index_free(void)
 {
-	if (pstring_buffer == NULL)
-		return -1;
+	free(ocp_strings.sits.slot);
+	free(ocp_strings.ests.slot);
+	free(ocp_strings.vu_ests.slot);
+	memset(&ocp_strings, 0, sizeof(ocp_strings));
+}
 
-	struct nvme_ocp_telemetry_string_header *pocp_ts_header =
-		(struct nvme_ocp_telemetry_string_header *)pstring_buffer;
+void ocp_string_log_index_build(const __u8 *buf, size_t size)
+{
+	const struct nvme_ocp_telemetry_string_header *hdr =
+		(const struct nvme_ocp_telemetry_string_header *)buf;
+
+	ocp_string_log_index_free();
+	if (!buf || size < sizeof(*hdr))
+		return;
+
+	ocp_strings.buf = buf;
+	ocp_strings.size = size;
+
+	ocp_string_index_init(&ocp_strings.sits, le64_to_cpu(hdr->sits),
+			      le64_to_cpu(hdr->sitsz),
+			      sizeof(struct nvme_ocp_statistics_identifier_string_table),
+			      ocp_sits_key);
+	ocp_string_index_init(&ocp_strings.ests, le64_to_cpu(hdr->ests),
+			      le64_to_cpu(hdr->estsz),
+			      sizeof(struct nvme_ocp_event_string_table),
+			      ocp_ests_key);
+	ocp_string_index_init(&ocp_strings.vu_ests, le64_to_cpu(hdr->vu_ests),
+			      le64_to_cpu(hdr->vu_estsz),
+			      sizeof(struct nvme_ocp_vu_event_string_table),
+			      ocp_vu_ests_key);
+}
 
-	//Calculating the sizes of the tables. Note: Data is present in the form of DWORDS,
-	//So multiplying with sizeof(DWORD)
-	unsigned long long ests_table_size = (pocp_ts_header->estsz) * SIZE_OF_DWORD;
+/*
+ * The three table entry layouts share the ASCII id length at byte 3 and
+ * the offset into the ASCII table at bytes 11:4.
+ */
+static int ocp_string_copy(const struct ocp_string_index *idx, __u32 key,
+			   char *description)
+{
+	const struct nvme_ocp_event_string_table *e;
+	const struct nvme_ocp_telemetry_string_header *hdr;
+	__u64 off;
+	size_t len;
 
-	//Calculating number of entries present in all 3 tables
-	int ests_entries = (int)ests_table_size / sizeof(struct nvme_ocp_event_string_table);
+	if (!pstring_buffer || !description)
+		return -1;
 
-	for (int ests_entry = 0; ests_entry < ests_entries; ests_entry++) {
-		struct nvme_ocp_event_string_table *peach_event_entry =
-			(struct nvme_ocp_event_string_table *)
-			(pstring_buffer + (pocp_ts_header->ests * SIZE_OF_DWORD) +
-			(ests_entry * sizeof(struct nvme_ocp_event_string_table)));
+	/* a string log loaded without an explicit build has no size bound */
+	if (ocp_strings.buf != pstring_buffer)
+		ocp_string_log_index_build(pstring_buffer, SIZE_MAX);
 
-		if (identifier == (int)peach_event_entry->event_identifier &&
-			debug_event_class == (int)peach_event_entry->debug_event_class) {
-			char *pdescription = (char *)(pstring_buffer +
-				(pocp_ts_header->ascts * SIZE_OF_DWORD) +
-				(peach_event_entry->ascii_id_offset * SIZE_OF_DWORD));
+	e = ocp_string_index_find(idx, key);
+	if (!e)
+		return -1;
 
-			memcpy(description, pdescription,
-			       peach_event_entry->ascii_id_length + 1);
-			return 0;
-		}
-	}
+	hdr = (const struct nvme_ocp_telemetry_string_header *)pstring_buffer;
+	off = (le64_to_cpu(hdr->ascts) + le64_to_cpu(e->ascii_id_offset)) *
+		SIZE_OF_DWORD;
+	len = e->ascii_id_length + 1;
+	if (off > ocp_strings.size || len > ocp_strings.size - off)
+		return -1;
 
-	return -1;
+	memcpy(description, pstring_buffer + off, len);
+
+	return 0;
 }
 
-int get_vu_event_id_ascii_string(int identifier, int debug_event_class, char *description)
+int get_statistic_id_ascii_string(int identifier, char *description)
 {
-	if (pstring_buffer == NULL)
-		return -1;
+	if (!ocp_string_copy(&ocp_strings.sits, (__u32)identifier, description))
+		return 0;
 
-	struct nvme_ocp_telemetry_string_header *pocp_ts_header =
-		(struct nvme_ocp_telemetry_string_header *)pstring_buffer;
-
-	//Calculating the sizes of the tables. Note: Data is present in the form of DWORDS,
-	//So multiplying with sizeof(DWORD)
-	unsigned long long vuests_table_size = (pocp_ts_header->vu_estsz) * SIZE_OF_DWORD;
-
-	//Calculating number of entries present in all 3 tables
-	int vu_ests_entries = (int)vuests_table_size /
-		sizeof(struct nvme_ocp_vu_event_string_table);
-
-	for (int vu_ests_entry = 0; vu_ests_entry < vu_ests_entries; vu_ests_entry++) {
-		struct nvme_ocp_vu_event_string_table *peach_vu_event_entry =
-			(struct nvme_ocp_vu_event_string_table *)
-			(pstring_buffer + (pocp_ts_header->vu_ests * SIZE_OF_DWORD) +
-			(vu_ests_entry * sizeof(struct nvme_ocp_vu_event_string_table)));
-
-		if (identifier == (int)peach_vu_event_entry->vu_event_identifier &&
-			debug_event_class ==
-				(int)peach_vu_event_entry->debug_event_class) {
-			char *pdescription = (char *)(pstring_buffer +
-				(pocp_ts_header->ascts * SIZE_OF_DWORD) +
-				(peach_vu_event_entry->ascii_id_offset * SIZE_OF_DWORD));
-
-			memcpy(description, pdescription,
-			       peach_vu_event_entry->ascii_id_length + 1);
-			return 0;
-		}
+	// If ASCII string isn't found, see in our internal Map
+	// for 2.5 Spec defined strings
+	if (description && identifier >= 0 && identifier <= 0x1D) {
+		strcpy(description, statistic_identifiers_map[identifier].description);
+		return 0;
 	}
 
 	return -1;
 }
 
+int get_event_id_ascii_string(int identifier, int debug_event_class, char *description)
+{
+	return ocp_string_copy(&ocp_strings.ests,
+			       (__u32)debug_event_class << 16 | (__u16)identifier,
+			       description);
+}
+
+int get_vu_event_id_ascii_string(int identifier, int debug_event_class, char *description)
+{
+	return ocp_string_copy(&ocp_strings.vu_ests,
+			       (__u32)debug_event_class << 16 | (__u16)identifier,
+			       description);
+}
+
 int parse_ocp_telemetry_string_log(int event_fifo_num, int identifier, int debug_event_class,
 	enum ocp_telemetry_string_tables string_table, char *description)
 {
@@ -1008,9 +1104,7 @@ int parse_event_fifo(unsigned int fifo_num, unsigned char *pfifo_start,
 
 	int status = 0, ret = 0;
 	unsigned int event_fifo_number = fifo_num + 1;
-	char *description = (char *)malloc((40 + 1) * sizeof(char));
-
-	memset(description, 0, sizeof(40));
+	char description[40 + 1] = { 0 };
 
 	status =
 		parse_ocp_telemetry_string_log(event_fifo_number, 0, 0, EVENT_STRING, description);
@@ -1174,7 +1268,7 @@ int parse_event_fifo(unsigned int fifo_num, unsigned char *pfifo_start,
 					pevent_descriptor->debug_event_class_type,
 					pevent_descriptor->event_id,
 					pevent_descriptor->event_data_size);
-				goto free_desc;
+				return ret;
 			}
 
 			if (pevent_descriptor_obj != NULL && pevent_fifo_array != NULL)
@@ -1253,11 +1347,37 @@ int parse_event_fifo(unsigned int fifo_num, unsigned char *pfifo_start,
 		json_object_add_value_array(pevent_fifos_object, event_fifo_name,
 			pevent_fifo_array);
 
-free_desc:
-	free(description);
 	return ret;
 }
 
+/* returns 1 if event FIFO @fifo_no is in the data area of @poffsets */
+static int ocp_event_fifo_locate(struct nvme_ocp_telemetry_offsets *poffsets, int fifo_no,
+				 __u8 **pfifo_start, __u64 *fifo_size)
+{
+	__u8 *pda1_header_offset = ptelemetry_buffer + poffsets->da1_start_offset;//512
+	__u8 *pda2_offset = ptelemetry_buffer + poffsets->da2_start_offset;
+	struct nvme_ocp_header_in_da1 *pda1_header = (struct nvme_ocp_header_in_da1 *)
+		pda1_header_offset;
+	__u8 fifo_da = pda1_header->event_fifo_da[fifo_no];
+	//Data is present in the form of DWORDS, So multiplying with sizeof(DWORD)
+	__u64 fifo_offset = pda1_header->fifo_offsets[fifo_no].event_fifo_start * SIZE_OF_DWORD;
+
+	if (fifo_da != poffsets->data_area)
+		return 0;
+
+	if (fifo_da == 1)
+		*pfifo_start = pda1_header_offset + fifo_offset;
+	else if (fifo_da == 2)
+		*pfifo_start = pda2_offset + fifo_offset;
+	else {
+		nvme_show_error("Unsupported Data Area:[%d]", poffsets->data_area);
+		return -1;
+	}
+	*fifo_size = pda1_header->fifo_offsets[fifo_no].event_fifo_size * SIZE_OF_DWORD;
+
+	return 1;
+}
+
 int parse_event_fifos(struct json_object *root, struct nvme_ocp_telemetry_offsets *poffsets,
 	FILE *fp)
 {
@@ -1271,46 +1391,23 @@ int parse_event_fifos(struct json_object *root, struct nvme_ocp_telemetry_offset
 	if (root != NULL)
 		pevent_fifos_object = json_create_object();
 
-	__u8 *pda1_header_offset = ptelemetry_buffer + poffsets->da1_start_offset;//512
-	__u8 *pda2_offset = ptelemetry_buffer + poffsets->da2_start_offset;
-	struct nvme_ocp_header_in_da1 *pda1_header = (struct nvme_ocp_header_in_da1 *)
-		pda1_header_offset;
-	struct nvme_ocp_event_fifo_data event_fifo[MAX_NUM_FIFOS];
-
-	for (int fifo_num = 0; fifo_num < MAX_NUM_FIFOS; fifo_num++) {
-		event_fifo[fifo_num].event_fifo_num = fifo_num;
-		event_fifo[fifo_num].event_fifo_da = pda1_header->event_fifo_da[fifo_num];
-		event_fifo[fifo_num].event_fifo_start =
-			pda1_header->fifo_offsets[fifo_num].event_fifo_start;
-		event_fifo[fifo_num].event_fifo_size =
-			pda1_header->fifo_offsets[fifo_num].event_fifo_size;
-	}
-
 	//Parse all the FIFOs DA wise
 	for (int fifo_no = 0; fifo_no < MAX_NUM_FIFOS; fifo_no++) {
-		if (event_fifo[fifo_no].event_fifo_da == poffsets->data_area) {
-			__u64 fifo_offset =
-				(event_fifo[fifo_no].event_fifo_start  * SIZE_OF_DWORD);
-			__u64 fifo_size =
-				(event_fifo[fifo_no].event_fifo_size  * SIZE_OF_DWORD);
-			__u8 *pfifo_start = NULL;
-
-			if (event_fifo[fifo_no].event_fifo_da == 1)
-				pfifo_start = pda1_header_offset + fifo_offset;
-			else if (event_fifo[fifo_no].event_fifo_da == 2)
-				pfifo_start = pda2_offset + fifo_offset;
-			else {
-				nvme_show_error("Unsupported Data Area:[%d]", poffsets->data_area);
-				return -1;
-			}
+		__u8 *pfifo_start = NULL;
+		__u64 fifo_size = 0;
+		int ret = ocp_event_fifo_locate(poffsets, fifo_no, &pfifo_start, &fifo_size);
+
+		if (ret < 0)
+			return -1;
+		if (!ret)
+			continue;
 
-			int status = parse_event_fifo(fifo_no, pfifo_start, pevent_fifos_object,
-						      pstring_buffer, poffsets, fifo_size, fp);
+		int status = parse_event_fifo(fifo_no, pfifo_start, pevent_fifos_object,
+					      pstring_buffer, poffsets, fifo_size, fp);
 
-			if (status != 0) {
-				nvme_show_error("Failed to parse Event FIFO. status:%d\n", status);
-				return -1;
-			}
+		if (status != 0) {
+			nvme_show_error("Failed to parse Event FIFO. status:%d\n", status);
+			return -1;
 		}
 	}
 
@@ -1559,6 +1656,197 @@ int parse_statistics(struct json_object *root, struct nvme_ocp_telemetry_offsets
 	return 0;
 }
 
+/*
+ * The statistics and each event FIFO of a data area only read the
+ * telemetry and string logs, so they are decoded by a pool of worker
+ * threads, each into its own JSON object or text buffer. The results are
+ * merged in the order of a sequential decode, the output does not depend
+ * on the number of workers.
+ */
+struct ocp_decode_task {
+	struct nvme_ocp_telemetry_offsets offsets;
+	int fifo;			/* -1 for the statistics */
+	__u8 *pfifo_start;
+	__u64 fifo_size;
+	struct json_object *obj;
+	char *text;
+	size_t len;
+	int status;
+};
+
+struct ocp_decode_pool {
+	struct ocp_decode_task *task;
+	int nr;
+	int next;
+	bool json;
+	pthread_mutex_t lock;
+};
+
+static void ocp_decode_task_run(struct ocp_decode_task *t, bool json)
+{
+	FILE *fp = NULL;
+
+	if (json) {
+		t->obj = json_create_object();
+	} else {
+		fp = open_memstream(&t->text, &t->len);
+		if (!fp) {
+			t->status = -ENOMEM;
+			return;
+		}
+	}
+
+	if (t->fifo < 0)
+		t->status = parse_statistics(t->obj, &t->offsets, fp);
+	else
+		t->status = parse_event_fifo(t->fifo, t->pfifo_start, t->obj, pstring_buffer,
+					     &t->offsets, t->fifo_size, fp);
+
+	if (fp && fclose(fp) && !t->status)
+		t->status = -ENOMEM;
+}
+
+static void *ocp_decode_worker(void *arg)
+{
+	struct ocp_decode_pool *pool = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if (i >= pool->nr)
+			break;
+		ocp_decode_task_run(&pool->task[i], pool->json);
+	}
+
+	return NULL;
+}
+
+static void ocp_decode_pool_run(struct ocp_decode_pool *pool, int jobs)
+{
+	pthread_t *threads = NULL;
+	int i, started = 0;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > pool->nr)
+		jobs = pool->nr;
+
+	pthread_mutex_init(&pool->lock, NULL);
+
+	if (jobs > 1)
+		threads = calloc(jobs - 1, sizeof(*threads));
+
+	/* a worker which failed to start only leaves more work to the others */
+	for (i = 0; threads && i < jobs - 1; i++) {
+		if (pthread_create(&threads[i], NULL, ocp_decode_worker, pool))
+			break;
+		started++;
+	}
+
+	ocp_decode_worker(pool);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	free(threads);
+}
+
+static void ocp_decode_merge_object(struct json_object *dst, struct json_object *src)
+{
+	json_object_object_foreach(src, key, val)
+		json_object_object_add(dst, key, json_object_get(val));
+}
+
+/* the statistics task of a data area is followed by its event FIFO tasks */
+static void ocp_decode_task_merge(struct ocp_decode_task *t, struct json_object *root,
+				  struct json_object **pevent_fifos_object, FILE *out)
+{
+	bool da1 = t->offsets.data_area == 1;
+
+	if (root && t->fifo < 0) {
+		ocp_decode_merge_object(root, t->obj);
+		*pevent_fifos_object = json_create_object();
+		json_object_add_value_array(root, da1 ? STR_DA_1_EVENT_FIFO_INFO :
+					    STR_DA_2_EVENT_FIFO_INFO, *pevent_fifos_object);
+	} else if (root) {
+		ocp_decode_merge_object(*pevent_fifos_object, t->obj);
+	} else if (t->fifo < 0) {
+		fprintf(out, STR_LINE);
+		fprintf(out, "%s\n", da1 ? STR_DA_1_STATS : STR_DA_2_STATS);
+		fprintf(out, STR_LINE);
+		fwrite(t->text, 1, t->len, out);
+		fprintf(out, STR_LINE);
+		fprintf(out, "%s\n", da1 ? STR_DA_1_EVENT_FIFO_INFO : STR_DA_2_EVENT_FIFO_INFO);
+		fprintf(out, STR_LINE);
+	} else {
+		fwrite(t->text, 1, t->len, out);
+	}
+}
+
+int ocp_telemetry_decode_data_areas(struct json_object *root,
+				    struct nvme_ocp_telemetry_offsets *poffsets,
+				    int data_area, int jobs, FILE *fp)
+{
+	struct ocp_decode_task task[2 * (MAX_NUM_FIFOS + 1)];
+	struct ocp_decode_pool pool = { .task = task, .json = root != NULL };
+	struct json_object *pevent_fifos_object = NULL;
+	FILE *out = fp ? fp : stdout;
+	int last_da = data_area == 2 ? 2 : 1;
+	int da, fifo_no, i, ret, status = 0;
+
+	/* the workers must not race to build the string log index */
+	if (pstring_buffer && ocp_strings.buf != pstring_buffer)
+		ocp_string_log_index_build(pstring_buffer, SIZE_MAX);
+
+	memset(task, 0, sizeof(task));
+	for (da = 1; da <= last_da; da++) {
+		task[pool.nr].offsets = *poffsets;
+		task[pool.nr].offsets.data_area = da;
+		task[pool.nr++].fifo = -1;
+
+		for (fifo_no = 0; fifo_no < MAX_NUM_FIFOS; fifo_no++) {
+			struct ocp_decode_task *t = &task[pool.nr];
+
+			t->offsets = *poffsets;
+			t->offsets.data_area = da;
+			t->fifo = fifo_no;
+			ret = ocp_event_fifo_locate(&t->offsets, fifo_no, &t->pfifo_start,
+						    &t->fifo_size);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				pool.nr++;
+		}
+	}
+
+	ocp_decode_pool_run(&pool, jobs);
+
+	for (i = 0; i < pool.nr; i++) {
+		struct ocp_decode_task *t = &task[i];
+
+		if (!status && t->status) {
+			if (t->fifo < 0)
+				nvme_show_error("status: %d\n", t->status);
+			else
+				nvme_show_error("Failed to parse Event FIFO. status:%d\n",
+						t->status);
+			status = -1;
+		}
+
+		if (!status)
+			ocp_decode_task_merge(t, root, &pevent_fifos_object, out);
+
+		if (t->obj)
+			json_free_object(t->obj);
+		free(t->text);
+	}
+
+	return status;
+}
+
 int print_ocp_telemetry_normal(struct ocp_telemetry_parse_options *options)
 {
 	int status = 0;
@@ -1636,44 +1924,11 @@ int print_ocp_telemetry_normal(struct ocp_telemetry_parse_options *options)
 			generic_structure_parser(pda1_smart_ext_offset, smart_extended,
 					     ARRAY_SIZE(smart_extended), NULL, 0, fp);
 
-			fprintf(fp, STR_LINE);
-			fprintf(fp, "%s\n", STR_DA_1_STATS);
-			fprintf(fp, STR_LINE);
-
-			status = parse_statistics(NULL, &offsets, fp);
-			if (status != 0) {
-				nvme_show_error("status: %d\n", status);
-				return -1;
-			}
-
-			fprintf(fp, STR_LINE);
-			fprintf(fp, "%s\n", STR_DA_1_EVENT_FIFO_INFO);
-			fprintf(fp, STR_LINE);
-			status = parse_event_fifos(NULL, &offsets, fp);
+			status = ocp_telemetry_decode_data_areas(NULL, &offsets, options->data_area,
+								 options->jobs, fp);
 			if (status != 0)
 				return -1;
 
-			//Set the DA to 2
-			if (options->data_area == 2) {
-				offsets.data_area = 2;
-				fprintf(fp, STR_LINE);
-				fprintf(fp, "%s\n", STR_DA_2_STATS);
-				fprintf(fp, STR_LINE);
-				status = parse_statistics(NULL, &offsets, fp);
-
-				if (status != 0) {
-					nvme_show_error("status: %d\n", status);
-					return -1;
-				}
-
-				fprintf(fp, STR_LINE);
-				fprintf(fp, "%s\n", STR_DA_2_EVENT_FIFO_INFO);
-				fprintf(fp, STR_LINE);
-				status = parse_event_fifos(NULL, &offsets, fp);
-				if (status != 0)
-					return -1;
-			}
-
 			fprintf(fp, STR_LINE);
 			fclose(fp);
 		} else {
@@ -1742,42 +1997,11 @@ int print_ocp_telemetry_normal(struct ocp_telemetry_parse_options *options)
 		generic_structure_parser(pda1_smart_ext_offset, smart_extended,
 			ARRAY_SIZE(smart_extended), NULL, 0, NULL);
 
-		printf(STR_LINE);
-		printf("%s\n", STR_DA_1_STATS);
-		printf(STR_LINE);
-		status = parse_statistics(NULL, &offsets, NULL);
-		if (status != 0) {
-			nvme_show_error("status: %d\n", status);
-			return -1;
-		}
-
-		printf(STR_LINE);
-		printf("%s\n", STR_DA_1_EVENT_FIFO_INFO);
-		printf(STR_LINE);
-		status = parse_event_fifos(NULL, &offsets, NULL);
+		status = ocp_telemetry_decode_data_areas(NULL, &offsets, options->data_area,
+							 options->jobs, NULL);
 		if (status != 0)
 			return -1;
 
-		//Set the DA to 2
-		if (options->data_area == 2) {
-			offsets.data_area = 2;
-			printf(STR_LINE);
-			printf("%s\n", STR_DA_2_STATS);
-			printf(STR_LINE);
-			status = parse_statistics(NULL, &offsets, NULL);
-			if (status != 0) {
-				nvme_show_error("status: %d\n", status);
-				return -1;
-			}
-
-			printf(STR_LINE);
-			printf("%s\n", STR_DA_2_EVENT_FIFO_INFO);
-			printf(STR_LINE);
-			status = parse_event_fifos(NULL, &offsets, NULL);
-			if (status != 0)
-				return -1;
-		}
-
 		printf(STR_LINE);
 	}
 
@@ -1849,34 +2073,12 @@ int print_ocp_telemetry_json(struct ocp_telemetry_parse_options *options)
 			     ext_smart_obj, 0, NULL);
 	json_object_add_value_object(da1_header, STR_SMART_HEALTH_INTO_EXTENDED, ext_smart_obj);
 
-	//Data Area 1 Statistics
-	status = parse_statistics(root, &offsets, NULL);
-	if (status != 0) {
-		nvme_show_error("status: %d\n", status);
-		return -1;
-	}
-
-	//Data Area 1 Event FIFOs
-	status = parse_event_fifos(root, &offsets, NULL);
+	//Data Area 1 and 2 Statistics and Event FIFOs
+	status = ocp_telemetry_decode_data_areas(root, &offsets, options->data_area,
+						 options->jobs, NULL);
 	if (status != 0)
 		return -1;
 
-	if (options->data_area == 2) {
-		//Set the DA to 2
-		offsets.data_area = 2;
-		//Data Area 2 Statistics
-		status = parse_statistics(root, &offsets, NULL);
-		if (status != 0) {
-			nvme_show_error("status: %d\n", status);
-			return -1;
-		}
-
-		//Data Area 2 Event FIFOs
-		status = parse_event_fifos(root, &offsets, NULL);
-		if (status != 0)
-			return -1;
-	}
-
 	if (options->output_file != NULL) {
 		const char *json_string = json_object_to_json_string(root);
 		sprintf(file_path, "%s.%s", options->output_file, "json");
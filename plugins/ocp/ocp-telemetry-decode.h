@@ -876,6 +876,7 @@ struct __packed ocp_telemetry_parse_options {
 	char *output_format;
 	int data_area;
 	char *telemetry_type;
+	int jobs;
 };
 
 struct __packed nvme_ocp_telemetry_reason_id
@@ -1341,6 +1342,22 @@ int parse_event_fifo(unsigned int fifo_num, unsigned char *pfifo_start,
  */
 int print_ocp_telemetry_normal(struct ocp_telemetry_parse_options *options);
 
+/**
+ * @brief decodes the statistics and event FIFOs of data area 1, and of
+ * data area 2 if requested, on a pool of worker threads
+ *
+ * @param root, json root object pointer, NULL for text output
+ * @param poffsets, telemetry offsets pointer
+ * @param data_area, last data area to decode
+ * @param jobs, number of worker threads, 0 for one per CPU
+ * @param fp, output file pointer for text output, NULL for stdout
+ *
+ * @return 0 success
+ */
+int ocp_telemetry_decode_data_areas(struct json_object *root,
+				    struct nvme_ocp_telemetry_offsets *poffsets,
+				    int data_area, int jobs, FILE *fp);
+
 /**
  * @brief parses event fifos data to text or json formats
  *
@@ -1348,6 +1365,19 @@ int print_ocp_telemetry_normal(struct ocp_telemetry_parse_options *options);
  */
 int print_ocp_telemetry_json(struct ocp_telemetry_parse_options *options);
 
+/**
+ * @brief indexes the string tables of a loaded string log
+ *
+ * @param buf, string log buffer
+ * @param size, string log size in bytes
+ */
+void ocp_string_log_index_build(const __u8 *buf, size_t size);
+
+/**
+ * @brief releases the string log index
+ */
+void ocp_string_log_index_free(void);
+
 /**
  * @brief gets statistic id ascii string
  *
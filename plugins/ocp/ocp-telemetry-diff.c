@@ -0,0 +1,452 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "nvme.h"
+#include "libnvme.h"
+#include "util/types.h"
+#include "util/json.h"
+
+#include "ocp-telemetry-decode.h"
+#include "ocp-telemetry-diff.h"
+
+/* a data area of a capture, or the statistics or an event FIFO in it */
+struct ocp_diff_range {
+	const __u8 *buf;
+	__u64 len;
+};
+
+struct ocp_diff_capture {
+	const struct nvme_tdiff_log *log;
+	const struct nvme_ocp_header_in_da1 *hdr;
+	struct ocp_diff_range da[3];	/* [0] unused */
+};
+
+struct ocp_diff_stat {
+	__u8 da;
+	__u16 id;
+	__u8 ns_info;
+	__u32 size;
+	const __u8 *data;
+};
+
+struct ocp_diff_event {
+	const __u8 *buf;
+	__u32 len;
+};
+
+static int ocp_diff_sub(const struct ocp_diff_range *r, __u64 start, __u64 len,
+			struct ocp_diff_range *sub)
+{
+	if (start > r->len || len > r->len - start)
+		return -EINVAL;
+
+	sub->buf = r->buf + start;
+	sub->len = len;
+
+	return 0;
+}
+
+static int ocp_diff_capture_init(struct ocp_diff_capture *c,
+				 const struct nvme_tdiff_log *log)
+{
+	struct nvme_ocp_telemetry_offsets offsets = { 0 };
+	int da;
+
+	memset(c, 0, sizeof(*c));
+	c->log = log;
+
+	if (get_telemetry_das_offset_and_size((void *)log->buf, &offsets))
+		return -EINVAL;
+
+	/* the data area boundaries were checked against the file size */
+	for (da = 1; da <= 2 && da <= log->last_da; da++) {
+		c->da[da].buf = log->buf + (da == 1 ? offsets.da1_start_offset :
+					    offsets.da2_start_offset);
+		c->da[da].len = da == 1 ? offsets.da1_size : offsets.da2_size;
+	}
+
+	if (c->da[1].len < sizeof(*c->hdr)) {
+		fprintf(stderr, "%s: data area 1 has no OCP header\n", log->path);
+		return -EINVAL;
+	}
+	c->hdr = (const void *)c->da[1].buf;
+
+	return 0;
+}
+
+static int ocp_diff_stat_key_cmp(const struct ocp_diff_stat *x,
+				 const struct ocp_diff_stat *y)
+{
+	if (x->da != y->da)
+		return x->da - y->da;
+	if (x->id != y->id)
+		return x->id - y->id;
+	return x->ns_info - y->ns_info;
+}
+
+static int ocp_diff_stat_cmp(const void *a, const void *b)
+{
+	const struct ocp_diff_stat *x = a, *y = b;
+	int cmp = ocp_diff_stat_key_cmp(x, y);
+
+	/* repeated statistics pair up in the order of the log */
+	if (cmp)
+		return cmp;
+	return x->data < y->data ? -1 : x->data > y->data;
+}
+
+static int ocp_diff_stats_collect(const struct ocp_diff_capture *c,
+				  struct ocp_diff_stat **stats, int *nr)
+{
+	const struct nvme_ocp_telemetry_statistic_descriptor *desc;
+	struct ocp_diff_range r;
+	struct ocp_diff_stat *s;
+	__u64 start, len, off;
+	int da, alloc = 0;
+	__u32 size;
+
+	*stats = NULL;
+	*nr = 0;
+
+	for (da = 1; da <= 2; da++) {
+		if (!c->da[da].len)
+			continue;
+
+		start = (da == 1 ? le64_to_cpu(c->hdr->da1_statistic_start) :
+			 le64_to_cpu(c->hdr->da2_statistic_start)) * SIZE_OF_DWORD;
+		len = (da == 1 ? le64_to_cpu(c->hdr->da1_statistic_size) :
+		       le64_to_cpu(c->hdr->da2_statistic_size)) * SIZE_OF_DWORD;
+		if (ocp_diff_sub(&c->da[da], start, len, &r)) {
+			fprintf(stderr, "%s: statistics outside of data area %d\n",
+				c->log->path, da);
+			return -EINVAL;
+		}
+
+		for (off = 0; off + sizeof(*desc) <= r.len; off += sizeof(*desc) + size) {
+			desc = (const void *)(r.buf + off);
+			if (le16_to_cpu(desc->statistic_id) == STATISTICS_RESERVED_ID)
+				break;
+
+			size = le16_to_cpu(desc->statistic_data_size) * SIZE_OF_DWORD;
+			if (size > r.len - off - sizeof(*desc))
+				break;
+
+			if (*nr == alloc) {
+				alloc = alloc ? alloc * 2 : 64;
+				s = realloc(*stats, alloc * sizeof(*s));
+				if (!s)
+					return -ENOMEM;
+				*stats = s;
+			}
+
+			s = &(*stats)[(*nr)++];
+			s->da = da;
+			s->id = le16_to_cpu(desc->statistic_id);
+			s->ns_info = ((const __u8 *)desc)[3];
+			s->size = size;
+			s->data = (const __u8 *)desc + sizeof(*desc);
+		}
+	}
+
+	qsort(*stats, *nr, sizeof(**stats), ocp_diff_stat_cmp);
+
+	return 0;
+}
+
+static uint64_t ocp_diff_stat_value(const struct ocp_diff_stat *s)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = s->size - 1; i >= 0; i--)
+		v = v << 8 | s->data[i];
+
+	return v;
+}
+
+static void ocp_diff_stat_show(const struct ocp_diff_stat *b,
+			       const struct ocp_diff_stat *a,
+			       struct json_object *stats)
+{
+	const struct ocp_diff_stat *s = a ? a : b;
+	const char *state = !b ? "added" : !a ? "removed" : "changed";
+	char description[256 + 1] = "";
+	bool value = (!a || a->size <= 8) && (!b || b->size <= 8);
+	uint64_t before = b ? ocp_diff_stat_value(b) : 0;
+	uint64_t after = a ? ocp_diff_stat_value(a) : 0;
+	struct json_object *obj;
+
+	get_statistic_id_ascii_string(s->id, description);
+
+	if (!stats) {
+		printf("%-2u 0x%04x %-8s %-32s", s->da, s->id, state, description);
+		if (value && a && b)
+			printf(" %20" PRIu64 " %20" PRIu64 " %+21" PRId64 "\n",
+			       before, after, (int64_t)(after - before));
+		else if (value)
+			printf(" %20" PRIu64 "\n", a ? after : before);
+		else
+			printf(" %u -> %u bytes\n", b ? b->size : 0, a ? a->size : 0);
+		return;
+	}
+
+	obj = json_create_object();
+	json_object_add_value_uint(obj, "data_area", s->da);
+	json_object_add_value_uint(obj, "statistic_id", s->id);
+	json_object_add_value_string(obj, "description", description);
+	if (s->ns_info & 0x80)
+		json_object_add_value_uint(obj, "nsid", s->ns_info & 0x7f);
+	json_object_add_value_string(obj, "state", state);
+	if (value && b)
+		json_object_add_value_uint64(obj, "before", before);
+	if (value && a)
+		json_object_add_value_uint64(obj, "after", after);
+	if (value && a && b)
+		json_object_add_value_int64(obj, "delta", (int64_t)(after - before));
+	if (!value) {
+		json_object_add_value_uint(obj, "before_size", b ? b->size : 0);
+		json_object_add_value_uint(obj, "after_size", a ? a->size : 0);
+	}
+	json_array_add_value_object(stats, obj);
+}
+
+static int ocp_diff_stats(const struct ocp_diff_capture *before,
+			  const struct ocp_diff_capture *after,
+			  struct json_object *root)
+{
+	struct ocp_diff_stat *b = NULL, *a = NULL;
+	struct json_object *stats = NULL;
+	int nb, na, i = 0, j = 0, cmp, changed = 0, err;
+
+	err = ocp_diff_stats_collect(before, &b, &nb);
+	if (!err)
+		err = ocp_diff_stats_collect(after, &a, &na);
+	if (err)
+		goto out;
+
+	if (root)
+		stats = json_create_array();
+	else
+		printf("\nChanged statistics\n%-2s %-6s %-8s %-32s %20s %20s %21s\n",
+		       "DA", "Id", "State", "Description", "before", "after", "delta");
+
+	while (i < nb || j < na) {
+		if (i == nb)
+			cmp = 1;
+		else if (j == na)
+			cmp = -1;
+		else
+			cmp = ocp_diff_stat_key_cmp(&b[i], &a[j]);
+
+		if (cmp < 0) {
+			ocp_diff_stat_show(&b[i++], NULL, stats);
+		} else if (cmp > 0) {
+			ocp_diff_stat_show(NULL, &a[j++], stats);
+		} else if (b[i].size != a[j].size ||
+			   memcmp(b[i].data, a[j].data, a[j].size)) {
+			ocp_diff_stat_show(&b[i++], &a[j++], stats);
+		} else {
+			i++;
+			j++;
+			continue;
+		}
+		changed++;
+	}
+
+	if (root)
+		json_object_add_value_array(root, "statistics", stats);
+	else if (!changed)
+		printf("none\n");
+out:
+	free(b);
+	free(a);
+
+	return err;
+}
+
+/* the events of FIFO @fifo, none if its data area is not in the capture */
+static int ocp_diff_events_collect(const struct ocp_diff_capture *c, int fifo,
+				   struct ocp_diff_event **events, int *nr)
+{
+	const struct nvme_ocp_telemetry_event_descriptor *desc;
+	const struct nvme_ocp_statistic_snapshot_evt_class_format *snap;
+	__u8 da = c->hdr->event_fifo_da[fifo];
+	struct ocp_diff_event *e;
+	struct ocp_diff_range r;
+	int alloc = 0;
+	__u64 off;
+	__u32 len;
+
+	*events = NULL;
+	*nr = 0;
+
+	if ((da != 1 && da != 2) || !c->da[da].len)
+		return 0;
+
+	if (ocp_diff_sub(&c->da[da],
+			 le64_to_cpu(c->hdr->fifo_offsets[fifo].event_fifo_start) * SIZE_OF_DWORD,
+			 le64_to_cpu(c->hdr->fifo_offsets[fifo].event_fifo_size) * SIZE_OF_DWORD,
+			 &r)) {
+		fprintf(stderr, "%s: event FIFO %d outside of data area %u\n",
+			c->log->path, fifo + 1, da);
+		return -EINVAL;
+	}
+
+	for (off = 0; off + sizeof(*desc) <= r.len; off += len) {
+		desc = (const void *)(r.buf + off);
+		if (desc->debug_event_class_type == RESERVED_CLASS_TYPE)
+			break;
+
+		if (desc->debug_event_class_type == STATISTIC_SNAPSHOT_CLASS_TYPE) {
+			if (off + sizeof(*snap) > r.len)
+				break;
+			snap = (const void *)desc;
+			len = sizeof(*snap) + le16_to_cpu(snap->stat_data_size) * SIZE_OF_DWORD;
+		} else {
+			len = sizeof(*desc) + desc->event_data_size * SIZE_OF_DWORD;
+		}
+		if (len > r.len - off)
+			break;
+
+		if (*nr == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			e = realloc(*events, alloc * sizeof(*e));
+			if (!e)
+				return -ENOMEM;
+			*events = e;
+		}
+		(*events)[*nr].buf = r.buf + off;
+		(*events)[(*nr)++].len = len;
+	}
+
+	return 0;
+}
+
+static bool ocp_diff_event_eq(const struct ocp_diff_event *x,
+			      const struct ocp_diff_event *y)
+{
+	return x->len == y->len && !memcmp(x->buf, y->buf, x->len);
+}
+
+/*
+ * The index of the first event of @a which is not in @b. The FIFO wraps,
+ * so the last event of @b, and the one before it to tell repeated events
+ * apart, is searched for from the end of @a; all events are new if the
+ * FIFO wrapped past it.
+ */
+static int ocp_diff_events_first_new(const struct ocp_diff_event *b, int nb,
+				     const struct ocp_diff_event *a, int na)
+{
+	int k;
+
+	if (!nb)
+		return 0;
+
+	for (k = na - 1; k >= 0; k--) {
+		if (!ocp_diff_event_eq(&a[k], &b[nb - 1]))
+			continue;
+		if (nb > 1 && k > 0 && !ocp_diff_event_eq(&a[k - 1], &b[nb - 2]))
+			continue;
+		return k + 1;
+	}
+
+	return 0;
+}
+
+static void ocp_diff_event_show(int fifo, const struct ocp_diff_event *e,
+				struct json_object *events)
+{
+	const struct nvme_ocp_telemetry_event_descriptor *desc = (const void *)e->buf;
+	const struct nvme_ocp_statistic_snapshot_evt_class_format *snap;
+	__u8 class = desc->debug_event_class_type;
+	char description[256 + 1] = "";
+	struct json_object *obj;
+	__u16 id;
+
+	if (class == STATISTIC_SNAPSHOT_CLASS_TYPE) {
+		snap = (const void *)desc;
+		id = le16_to_cpu(snap->stat_id);
+		get_statistic_id_ascii_string(id, description);
+	} else {
+		id = le16_to_cpu(desc->event_id);
+		if (class >= 0x80)
+			get_vu_event_id_ascii_string(id, class, description);
+		else
+			get_event_id_ascii_string(id, class, description);
+	}
+
+	if (!events) {
+		printf("%-4d 0x%02x %-24s 0x%04x %-32s %u\n", fifo + 1, class,
+		       telemetry_event_class_to_string(class), id, description,
+		       e->len);
+		return;
+	}
+
+	obj = json_create_object();
+	json_object_add_value_uint(obj, "event_fifo", fifo + 1);
+	json_object_add_value_uint(obj, "class", class);
+	json_object_add_value_string(obj, "class_name",
+				     telemetry_event_class_to_string(class));
+	json_object_add_value_uint(obj, "event_id", id);
+	json_object_add_value_string(obj, "description", description);
+	json_object_add_value_uint(obj, "size", e->len);
+	json_array_add_value_object(events, obj);
+}
+
+static int ocp_diff_events(const struct ocp_diff_capture *before,
+			   const struct ocp_diff_capture *after,
+			   struct json_object *root)
+{
+	struct json_object *events = NULL;
+	struct ocp_diff_event *b, *a;
+	int fifo, nb, na, i, nr = 0, err = 0;
+
+	if (root)
+		events = json_create_array();
+	else
+		printf("\nNew events\n%-4s %-4s %-24s %-6s %-32s %s\n", "FIFO",
+		       "Cls", "Class", "Id", "Description", "Size");
+
+	for (fifo = 0; fifo < MAX_NUM_FIFOS && !err; fifo++) {
+		a = NULL;
+		err = ocp_diff_events_collect(before, fifo, &b, &nb);
+		if (!err)
+			err = ocp_diff_events_collect(after, fifo, &a, &na);
+
+		if (!err) {
+			for (i = ocp_diff_events_first_new(b, nb, a, na); i < na; i++, nr++)
+				ocp_diff_event_show(fifo, &a[i], events);
+		}
+
+		free(b);
+		free(a);
+	}
+
+	if (root)
+		json_object_add_value_array(root, "new_events", events);
+	else if (!err && !nr)
+		printf("none\n");
+
+	return err;
+}
+
+int ocp_telemetry_diff(const struct nvme_tdiff *d, struct json_object *root)
+{
+	struct ocp_diff_capture before, after;
+	int err;
+
+	err = ocp_diff_capture_init(&before, &d->before);
+	if (!err)
+		err = ocp_diff_capture_init(&after, &d->after);
+	if (!err)
+		err = ocp_diff_stats(&before, &after, root);
+	if (!err)
+		err = ocp_diff_events(&before, &after, root);
+
+	return err;
+}
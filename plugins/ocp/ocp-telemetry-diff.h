@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef OCP_TELEMETRY_DIFF_H
+#define OCP_TELEMETRY_DIFF_H
+
+#include "nvme-telemetry-diff.h"
+
+struct json_object;
+
+/**
+ * @brief shows the statistics and events which changed between two OCP
+ *        telemetry captures opened with nvme_tdiff_open()
+ *
+ * Statistics are matched by identifier and namespace in data areas 1 and
+ * 2, those of up to 8 bytes are shown with their delta. Events are new
+ * when they follow the last events of the before capture in the same
+ * event FIFO. The names come from the string log if one is mapped.
+ *
+ * @param d, input the two mapped captures
+ * @param root, input json object to add to, text output if NULL
+ *
+ * @return 0 success
+ */
+int ocp_telemetry_diff(const struct nvme_tdiff *d, struct json_object *root);
+
+#endif /* OCP_TELEMETRY_DIFF_H */
@@ -20,6 +20,7 @@
 #include "plugin.h"
 #include "linux/types.h"
 #include "nvme-print.h"
+#include "nvme-latency.h"
 #include "util/cleanup.h"
 #include "util/types.h"
 
@@ -496,17 +497,118 @@ static void show_lat_stats_myrtle(struct sfx_lat_stats_myrtle *stats, int write)
 }
 
 
+struct sfx_lat_sample {
+	struct nvme_transport_handle *hdl;
+	bool write;
+	struct sfx_lat_status_ver ver;
+};
+
+static int sfx_lat_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct sfx_lat_sample *p = s->priv;
+	struct sfx_lat_stats stats;
+	__u32 *bucket;
+	unsigned int i;
+	int err;
+
+	err = nvme_get_log_simple(p->hdl, p->write ? 0xc3 : 0xc1,
+				  (void *)&stats, sizeof(stats));
+	if (err)
+		return err;
+	if (stats.ver.maj != p->ver.maj || stats.ver.min != p->ver.min)
+		return -EPROTO;
+
+	/* the bucket groups follow each other behind the version */
+	bucket = (__u32 *)((__u8 *)&stats + sizeof(stats.ver));
+	for (i = 0; i < s->hist.nr; i++)
+		count[i] = le32_to_cpu(bucket[i]);
+
+	return 0;
+}
+
+static int sfx_lat_hist(struct nvme_lat_hist *h, struct sfx_lat_status_ver *ver)
+{
+	unsigned int i, g;
+	int err;
+
+	if (ver->maj == VANDA_MAJOR_IDX && ver->min == VANDA_MINOR_IDX) {
+		err = nvme_lat_hist_alloc(h, 97);
+		if (err)
+			return err;
+		i = nvme_lat_hist_linear(h, 0, 32, 0, 32);
+		i = nvme_lat_hist_linear(h, i, 31, 1024, 1024);
+		i = nvme_lat_hist_linear(h, i, 31, 32768, 32768);
+		i = nvme_lat_hist_linear(h, i, 1, 1048576, 1048576);
+		i = nvme_lat_hist_linear(h, i, 1, 2097152, 2097152);
+	} else if (ver->maj == MYRTLE_MAJOR_IDX && ver->min == MYRTLE_MINOR_IDX) {
+		/* 0-127us in steps of 1us, then 64 buckets per doubling */
+		err = nvme_lat_hist_alloc(h, 19 * 64);
+		if (err)
+			return err;
+		i = nvme_lat_hist_linear(h, 0, 64, 0, 1);
+		for (g = 0; g < 18; g++)
+			i = nvme_lat_hist_linear(h, i, 64, 64ULL << g, 1ULL << g);
+	} else {
+		return -EOPNOTSUPP;
+	}
+	h->edge_us[h->nr] = NVME_LAT_INF;
+
+	return 0;
+}
+
+static int sfx_lat_stats_sample(struct nvme_transport_handle *hdl,
+				struct sfx_lat_status_ver *ver, bool write,
+				bool json, __u32 interval, __u32 count)
+{
+	struct sfx_lat_sample p = {
+		.hdl	= hdl,
+		.write	= write,
+		.ver	= *ver,
+	};
+	struct nvme_lat_sampler s = { 0 };
+	int err;
+
+	err = sfx_lat_hist(&s.hist, ver);
+	if (err) {
+		nvme_show_error("Invalid Version Maj %d Min %d", ver->maj, ver->min);
+		return err;
+	}
+
+	s.name = write ? "Write" : "Read";
+	s.interval = interval;
+	s.count = count;
+	s.json = json;
+	s.sample = sfx_lat_sample;
+	s.priv = &p;
+
+	err = nvme_lat_sampler_run(&s);
+	if (err)
+		nvme_show_err("lat-stats", err);
+	nvme_lat_hist_free(&s.hist);
+
+	return err;
+}
+
 static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	struct sfx_lat_stats stats;
 	char *desc = "Get ScaleFlux Latency Statistics log and show it.";
 	const char *raw = "dump output in binary format";
 	const char *write = "Get write statistics (read default)";
+	const char *interval = "sample the log every <interval> seconds and show the "
+			       "latency percentiles of each interval";
+	const char *count = "number of samples, 0 until interrupted";
+#ifdef CONFIG_JSONC
+	const char *json = "show the samples in json format";
+#endif /* CONFIG_JSONC */
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	struct config {
 		bool raw_binary;
 		bool write;
+		__u32 interval;
+		__u32 count;
+		bool json;
 	};
 	int err;
 
@@ -516,6 +618,9 @@ static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct
 	OPT_ARGS(opts) = {
 		OPT_FLAG("write",	   'w', &cfg.write,		 write),
 		OPT_FLAG("raw-binary", 'b', &cfg.raw_binary, raw),
+		OPT_UINT("interval",   'i', &cfg.interval,   interval),
+		OPT_UINT("count",      'c', &cfg.count,      count),
+		OPT_FLAG_JSON("json",  'j', &cfg.json,       json),
 		OPT_END()
 	};
 
@@ -525,6 +630,9 @@ static int get_lat_stats_log(int argc, char **argv, struct command *acmd, struct
 
 	err = nvme_get_log_simple(hdl, cfg.write ? 0xc3 : 0xc1,
 				  (void *)&stats, sizeof(stats));
+	if (!err && cfg.interval)
+		return sfx_lat_stats_sample(hdl, &stats.ver, cfg.write, cfg.json,
+					    cfg.interval, cfg.count);
 	if (!err) {
 		if ((stats.ver.maj == VANDA_MAJOR_IDX) && (stats.ver.min == VANDA_MINOR_IDX)) {
 			if (!cfg.raw_binary)
@@ -38,6 +38,7 @@
 #include "plugin.h"
 #include "linux/types.h"
 #include "nvme-print.h"
+#include "nvme-capture.h"
 #include <time.h>
 
 #define CREATE_CMD
@@ -1564,6 +1565,86 @@ static int vs_clr_pcie_correctable_errs(int argc, char **argv, struct command *a
 	return err;
 }
 
+struct seagate_tele_capture {
+	struct nvme_transport_handle *hdl;
+	__u32 nsid;
+	__u32 log_id;
+	bool raw;
+	int fd;
+};
+
+static int seagate_tele_fetch(struct nvme_capture *c, void *buf, uint64_t off,
+			      uint32_t len)
+{
+	struct seagate_tele_capture *t = c->priv;
+	struct nvme_passthru_cmd cmd;
+	int err;
+
+	nvme_init_get_log(&cmd, t->nsid, t->log_id, NVME_CSI_NVM, buf, len);
+	nvme_init_get_log_lpo(&cmd, off);
+	err = nvme_get_log(t->hdl, &cmd, true, NVME_LOG_PAGE_PDU_SIZE);
+	if (err > 0)
+		nvme_show_status(err);
+	else if (err < 0)
+		perror("log page");
+
+	return err;
+}
+
+static int seagate_tele_write(struct nvme_capture *c, const void *buf,
+			      uint64_t off, uint32_t len)
+{
+	struct seagate_tele_capture *t = c->priv;
+
+	if (t->raw) {
+		seaget_d_raw((unsigned char *)buf, len, t->fd);
+		return 0;
+	}
+
+	printf("\nBlock # :%d to %d\n", (int)(off / 512),
+	       (int)((off + len) / 512) - 1);
+	d((unsigned char *)buf, len, 16, 1);
+
+	return 0;
+}
+
+/*
+ * Reads the telemetry data blocks 1 to @blocks behind the header. A block
+ * range that cannot be read is output as zeros, so the following ranges
+ * stay at their offsets.
+ */
+static int seagate_tele_capture(struct nvme_transport_handle *hdl, __u32 nsid,
+				__u32 log_id, int blocks, bool raw, int fd)
+{
+	struct seagate_tele_capture t = {
+		.hdl	= hdl,
+		.nsid	= nsid,
+		.log_id	= log_id,
+		.raw	= raw,
+		.fd	= fd,
+	};
+	struct nvme_capture c;
+	int err;
+
+	nvme_capture_init(&c, NULL);
+	c.offset = 512;
+	c.size = (uint64_t)blocks * 512;
+	c.chunk = TELEMETRY_BLOCKS_TO_READ * 512;
+	/* nvme_get_log() splits the chunks into page sized transfers */
+	c.max_chunk = 0;
+	c.align = 512;
+	c.skip_errors = true;
+	c.fetch = seagate_tele_fetch;
+	c.write = seagate_tele_write;
+	c.priv = &t;
+
+	err = nvme_capture_run(&c);
+	if (err < 0)
+		fprintf(stderr, "telemetry capture: %s\n", strerror(-err));
+
+	return err ? err : c.status;
+}
+
 static int get_host_tele(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc =
@@ -1574,12 +1655,9 @@ static int get_host_tele(int argc, char **argv, struct command *acmd, struct plu
 		"0 - controller shall not update the Telemetry Host Initiated Data.";
 	const char *raw = "output in raw format";
 	struct nvme_temetry_log_hdr tele_log;
-	int blkCnt, maxBlk = 0, blksToGet;
+	int maxBlk = 0;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	struct nvme_passthru_cmd cmd;
-	unsigned char  *log;
-	__le64  offset = 0;
 	int err, dump_fd;
 
 	struct config {
@@ -1610,7 +1688,6 @@ static int get_host_tele(int argc, char **argv, struct command *acmd, struct plu
 				(void *)(&tele_log), sizeof(tele_log));
 	if (!err) {
 		maxBlk = tele_log.tele_data_area3;
-		offset += 512;
 
 		if (!cfg.raw_binary) {
 			printf("Device:%s log-id:%d namespace-id:%#x\n",
@@ -1628,52 +1705,9 @@ static int get_host_tele(int argc, char **argv, struct command *acmd, struct plu
 		perror("log page");
 	}
 
-	blkCnt = 0;
-
-	while (blkCnt < maxBlk) {
-		unsigned long long bytesToGet;
-
-		blksToGet = ((maxBlk - blkCnt) >= TELEMETRY_BLOCKS_TO_READ) ? TELEMETRY_BLOCKS_TO_READ : (maxBlk - blkCnt);
-
-		if (!blksToGet) {
-
-			return err;
-		}
-
-		bytesToGet = (unsigned long long)blksToGet * 512;
-		log = malloc(bytesToGet);
-
-		if (!log) {
-			fprintf(stderr, "could not alloc buffer for log\n");
-
-			return -EINVAL;
-		}
-
-		memset(log, 0, bytesToGet);
-
-		nvme_init_get_log(&cmd, cfg.namespace_id, cfg.log_id,
-				  NVME_CSI_NVM, log, bytesToGet);
-		nvme_init_get_log_lpo(&cmd, offset);
-		err = nvme_get_log(hdl, &cmd, true, NVME_LOG_PAGE_PDU_SIZE);
-		if (!err) {
-			offset += (__le64)bytesToGet;
-
-			if (!cfg.raw_binary) {
-				printf("\nBlock # :%d to %d\n", blkCnt + 1, blkCnt + blksToGet);
-
-				d((unsigned char *)log, bytesToGet, 16, 1);
-			} else
-				seaget_d_raw((unsigned char *)log, bytesToGet, dump_fd);
-		} else if (err > 0) {
-			nvme_show_status(err);
-		} else {
-			perror("log page");
-		}
-
-		blkCnt += blksToGet;
-
-		free(log);
-	}
+	if (!err)
+		err = seagate_tele_capture(hdl, cfg.namespace_id, cfg.log_id,
+					   maxBlk, cfg.raw_binary, dump_fd);
 
 	return err;
 }
@@ -1686,13 +1720,10 @@ static int get_ctrl_tele(int argc, char **argv, struct command *acmd, struct plu
 	const char *raw = "output in raw format";
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	struct nvme_passthru_cmd cmd;
 	int err, dump_fd;
 	struct nvme_temetry_log_hdr tele_log;
-	__le64  offset = 0;
 	__u16 log_id;
-	int blkCnt, maxBlk = 0, blksToGet;
-	unsigned char  *log;
+	int maxBlk = 0;
 
 	struct config {
 		__u32 namespace_id;
@@ -1720,7 +1751,6 @@ static int get_ctrl_tele(int argc, char **argv, struct command *acmd, struct plu
 				(void *)(&tele_log), sizeof(tele_log));
 	if (!err) {
 		maxBlk = tele_log.tele_data_area3;
-		offset += 512;
 
 		if (!cfg.raw_binary) {
 			printf("Device:%s namespace-id:%#x\n",
@@ -1737,49 +1767,9 @@ static int get_ctrl_tele(int argc, char **argv, struct command *acmd, struct plu
 		perror("log page");
 	}
 
-	blkCnt = 0;
-
-	while (blkCnt < maxBlk) {
-		unsigned long long bytesToGet;
-
-		blksToGet = ((maxBlk - blkCnt) >= TELEMETRY_BLOCKS_TO_READ) ? TELEMETRY_BLOCKS_TO_READ : (maxBlk - blkCnt);
-
-		if (!blksToGet)
-			return err;
-
-		bytesToGet = (unsigned long long)blksToGet * 512;
-		log = malloc(bytesToGet);
-
-		if (!log) {
-			fprintf(stderr, "could not alloc buffer for log\n");
-			return -EINVAL;
-		}
-
-		memset(log, 0, bytesToGet);
-
-		nvme_init_get_log(&cmd, cfg.namespace_id, log_id,
-				  NVME_CSI_NVM, log, bytesToGet);
-		nvme_init_get_log_lpo(&cmd, offset);
-		err = nvme_get_log(hdl, &cmd, true, NVME_LOG_PAGE_PDU_SIZE);
-		if (!err) {
-			offset += (__le64)bytesToGet;
-
-			if (!cfg.raw_binary) {
-				printf("\nBlock # :%d to %d\n", blkCnt + 1, blkCnt + blksToGet);
-
-				d((unsigned char *)log, bytesToGet, 16, 1);
-			} else
-				seaget_d_raw((unsigned char *)log, bytesToGet, dump_fd);
-		} else if (err > 0) {
-			nvme_show_status(err);
-		} else {
-			perror("log page");
-		}
-
-		blkCnt += blksToGet;
-
-		free(log);
-	}
+	if (!err)
+		err = seagate_tele_capture(hdl, cfg.namespace_id, log_id, maxBlk,
+					   cfg.raw_binary, dump_fd);
 
 
 	return err;
@@ -1801,15 +1791,12 @@ static int vs_internal_log(int argc, char **argv, struct command *acmd, struct p
 	const char *file = "dump file";
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	struct nvme_passthru_cmd cmd;
 	int err, dump_fd;
 	int flags = O_WRONLY | O_CREAT;
 	int mode = 0664;
 	struct nvme_temetry_log_hdr tele_log;
-	__le64  offset = 0;
 	__u16 log_id;
-	int blkCnt, maxBlk = 0, blksToGet;
-	unsigned char  *log;
+	int maxBlk = 0;
 
 	struct config {
 		__u32 namespace_id;
@@ -1845,7 +1832,6 @@ static int vs_internal_log(int argc, char **argv, struct command *acmd, struct p
 				(void *)(&tele_log), sizeof(tele_log));
 	if (!err) {
 		maxBlk = tele_log.tele_data_area3;
-		offset += 512;
 
 		seaget_d_raw((unsigned char *)(&tele_log), sizeof(tele_log), dump_fd);
 	} else if (err > 0) {
@@ -1854,48 +1840,10 @@ static int vs_internal_log(int argc, char **argv, struct command *acmd, struct p
 		perror("log page");
 	}
 
-	blkCnt = 0;
-
-	while (blkCnt < maxBlk) {
-		unsigned long long bytesToGet;
-
-		blksToGet = ((maxBlk - blkCnt) >= TELEMETRY_BLOCKS_TO_READ) ? TELEMETRY_BLOCKS_TO_READ : (maxBlk - blkCnt);
-
-		if (!blksToGet)
-			goto out;
-
-		bytesToGet = (unsigned long long)blksToGet * 512;
-		log = malloc(bytesToGet);
-
-		if (!log) {
-			fprintf(stderr, "could not alloc buffer for log\n");
-			err = EINVAL;
-			goto out;
-		}
-
-		memset(log, 0, bytesToGet);
-
-		nvme_init_get_log_lpo(&cmd, offset);
-		nvme_init_get_log(&cmd, cfg.namespace_id, log_id,
-				  NVME_CSI_NVM, log, bytesToGet);
-		nvme_init_get_log_lpo(&cmd, offset);
-		err = nvme_get_log(hdl, &cmd, true, NVME_LOG_PAGE_PDU_SIZE);
-		if (!err) {
-			offset += (__le64)bytesToGet;
-
-			seaget_d_raw((unsigned char *)log, bytesToGet, dump_fd);
+	if (!err)
+		err = seagate_tele_capture(hdl, cfg.namespace_id, log_id, maxBlk,
+					   true, dump_fd);
 
-		} else if (err > 0) {
-			nvme_show_status(err);
-		} else {
-			perror("log page");
-		}
-
-		blkCnt += blksToGet;
-
-		free(log);
-	}
-out:
 	if (strlen(cfg.file))
 		close(dump_fd);
 
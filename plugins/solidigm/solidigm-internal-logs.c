@@ -21,9 +21,10 @@
 #include "plugin.h"
 #include "nvme-print.h"
 #include "solidigm-util.h"
+#include "nvme-capture.h"
+#include "util/bundle.h"
 
 #define DWORD_SIZE 4
-#define LOG_FILE_PERMISSION 0644
 #define ATMOS_MODEL_PREFIX "SOLIDIGM SB5"
 
 enum log_type {
@@ -135,6 +136,7 @@ struct config {
 
 struct ilog {
 	struct config *cfg;
+	struct nvme_bundle *bundle;
 	int count;
 	struct nvme_id_ctrl id_ctrl;
 };
@@ -172,37 +174,65 @@ static void print_nlog_header(__u8 *buffer)
 #define INTERNAL_LOG_MAX_BYTE_TRANSFER 4096
 #define INTERNAL_LOG_MAX_DWORD_TRANSFER (INTERNAL_LOG_MAX_BYTE_TRANSFER / 4)
 
-static int cmd_dump_repeat(struct nvme_passthru_cmd *cmd, __u32 total_dw_size,
-			   int out_fd, struct nvme_transport_handle *hdl, bool force_max_transfer)
+struct dump_capture {
+	struct nvme_passthru_cmd cmd;
+	struct nvme_transport_handle *hdl;
+	struct nvme_bundle *b;
+	const char *name;
+	bool force_max_transfer;
+};
+
+static int dump_fetch(struct nvme_capture *c, void *buf, uint64_t off, uint32_t len)
 {
-	int err = 0;
+	struct dump_capture *d = c->priv;
+	struct nvme_passthru_cmd cmd = d->cmd;
 
-	while (total_dw_size > 0) {
-		size_t dword_tfer = min(INTERNAL_LOG_MAX_DWORD_TRANSFER, total_dw_size);
+	cmd.addr = (unsigned long)buf;
+	cmd.data_len = len;
+	cmd.cdw10 = d->force_max_transfer ? INTERNAL_LOG_MAX_DWORD_TRANSFER : len / 4;
+	cmd.cdw13 += off / 4;
 
-		cmd->cdw10 = force_max_transfer ? INTERNAL_LOG_MAX_DWORD_TRANSFER : dword_tfer;
-		cmd->data_len = dword_tfer * 4;
-		err = nvme_submit_admin_passthru(hdl, cmd);
-		if (err)
-			return err;
+	return nvme_submit_admin_passthru(d->hdl, &cmd);
+}
 
-		if (out_fd > 0) {
-			err = write(out_fd, (const void *)(uintptr_t)cmd->addr, cmd->data_len);
-			if (err < 0) {
-				perror("write failure");
-				return err;
-			}
-			err = 0;
-		}
-		total_dw_size -= dword_tfer;
-		cmd->cdw13 += dword_tfer;
-	}
+static int dump_write(struct nvme_capture *c, const void *buf, uint64_t off, uint32_t len)
+{
+	struct dump_capture *d = c->priv;
+	int err;
+
+	err = nvme_bundle_append(d->b, d->name, buf, len);
+	if (err)
+		fprintf(stderr, "write failure: %s\n", strerror(-err));
 	return err;
 }
 
-static int write_header(__u8 *buf, int fd, size_t amnt)
+/* appends @total_dw_size dwords starting at dword cdw13 of @cmd to the bundle member @name */
+static int cmd_dump_repeat(const struct nvme_passthru_cmd *cmd, __u32 total_dw_size,
+			   struct nvme_bundle *b, const char *name,
+			   struct nvme_transport_handle *hdl, bool force_max_transfer)
 {
-	if (write(fd, buf, amnt) < 0)
+	struct dump_capture d = {
+		.cmd = *cmd,
+		.hdl = hdl,
+		.b = b,
+		.name = name,
+		.force_max_transfer = force_max_transfer,
+	};
+	struct nvme_capture c;
+
+	nvme_capture_init(&c, NULL);
+	c.size = (uint64_t)total_dw_size * 4;
+	c.chunk = INTERNAL_LOG_MAX_BYTE_TRANSFER;
+	c.fetch = dump_fetch;
+	c.write = dump_write;
+	c.priv = &d;
+
+	return nvme_capture_run(&c);
+}
+
+static int write_header(__u8 *buf, struct nvme_bundle *b, const char *name, size_t amnt)
+{
+	if (nvme_bundle_append(b, name, buf, amnt))
 		return 1;
 	return 0;
 }
@@ -210,7 +240,9 @@ static int write_header(__u8 *buf, int fd, size_t amnt)
 static int read_header(struct nvme_passthru_cmd *cmd, struct nvme_transport_handle *hdl)
 {
 	memset((void *)(uintptr_t)cmd->addr, 0, INTERNAL_LOG_MAX_BYTE_TRANSFER);
-	return cmd_dump_repeat(cmd, INTERNAL_LOG_MAX_DWORD_TRANSFER, -1, hdl, false);
+	cmd->cdw10 = INTERNAL_LOG_MAX_DWORD_TRANSFER;
+	cmd->data_len = INTERNAL_LOG_MAX_BYTE_TRANSFER;
+	return nvme_submit_admin_passthru(hdl, cmd);
 }
 
 static int get_serial_number(char *str, struct nvme_transport_handle *hdl)
@@ -231,10 +263,8 @@ static int get_serial_number(char *str, struct nvme_transport_handle *hdl)
 
 static int ilog_dump_assert_logs(struct nvme_transport_handle *hdl, struct ilog *ilog)
 {
-	__u8 buf[INTERNAL_LOG_MAX_BYTE_TRANSFER];
 	__u8 head_buf[INTERNAL_LOG_MAX_BYTE_TRANSFER];
-	_cleanup_free_ char *file_path = NULL;
-	char file_name[] = "AssertLog.bin";
+	const char *file_name = "AssertLog.bin";
 	struct assert_dump_header *ad = (struct assert_dump_header *) head_buf;
 	struct nvme_passthru_cmd cmd = {
 		.opcode = 0xd2,
@@ -243,26 +273,18 @@ static int ilog_dump_assert_logs(struct nvme_transport_handle *hdl, struct ilog
 		.cdw12 = ASSERTLOG,
 		.cdw13 = 0,
 	};
-	int output, err;
+	int err;
 
 	err = read_header(&cmd, hdl);
 	if (err)
 		return err;
 
-	if (asprintf(&file_path, "%.*s/%s",
-		 (int) (sizeof(file_path) - sizeof(file_name) - 1),
-		 ilog->cfg->out_dir, file_name) < 0)
-		return -errno;
-	output = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, LOG_FILE_PERMISSION);
-	if (output < 0)
-		return -errno;
-	err = write_header((__u8 *)ad, output, ad->header.header_size * DWORD_SIZE);
+	err = write_header((__u8 *)ad, ilog->bundle, file_name,
+			   ad->header.header_size * DWORD_SIZE);
 	if (err) {
 		perror("write failure");
-		close(output);
 		return err;
 	}
-	cmd.addr = (unsigned long)(void *)buf;
 
 	if (ilog->cfg->verbose) {
 		printf("Assert Log, cores: %d log size: %d header size: %d\n", ad->header.numcores,
@@ -275,23 +297,19 @@ static int ilog_dump_assert_logs(struct nvme_transport_handle *hdl, struct ilog
 		if (!ad->core[i].assertvalid)
 			continue;
 		cmd.cdw13 = ad->core[i].coreoffset;
-		err = cmd_dump_repeat(&cmd, ad->core[i].assertsize, output,
-				      hdl, false);
-		if (err) {
-			close(output);
+		err = cmd_dump_repeat(&cmd, ad->core[i].assertsize, ilog->bundle,
+				      file_name, hdl, false);
+		if (err)
 			return err;
-		}
 	}
-	close(output);
-	printf("Successfully wrote Assert to %s\n", file_path);
+	printf("Successfully wrote Assert to %s\n", file_name);
 	return err;
 }
 
 static int ilog_dump_event_logs(struct nvme_transport_handle *hdl, struct ilog *ilog)
 {
-	__u8 buf[INTERNAL_LOG_MAX_BYTE_TRANSFER];
 	__u8 head_buf[INTERNAL_LOG_MAX_BYTE_TRANSFER];
-	_cleanup_free_ char *file_path = NULL;
+	const char *file_name = "EventLog.bin";
 	struct event_dump_header *ehdr = (struct event_dump_header *) head_buf;
 	struct nvme_passthru_cmd cmd = {
 		.opcode = 0xd2,
@@ -300,26 +318,17 @@ static int ilog_dump_event_logs(struct nvme_transport_handle *hdl, struct ilog *
 		.cdw12 = EVENTLOG,
 		.cdw13 = 0,
 	};
-	int output;
 	int core_num, err;
 
 	err = read_header(&cmd, hdl);
 	if (err)
 		return err;
-	if (asprintf(&file_path, "%s/EventLog.bin", ilog->cfg->out_dir))
-		return -errno;
-	output = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, LOG_FILE_PERMISSION);
-	if (output < 0)
-		return -errno;
-	err = write_header(head_buf, output, INTERNAL_LOG_MAX_BYTE_TRANSFER);
+	err = write_header(head_buf, ilog->bundle, file_name, INTERNAL_LOG_MAX_BYTE_TRANSFER);
 
 	core_num = ehdr->header.numcores;
 
-	if (err) {
-		close(output);
+	if (err)
 		return err;
-	}
-	cmd.addr = (unsigned long)(void *)buf;
 
 	if (ilog->cfg->verbose)
 		printf("Event Log, cores: %d log size: %d\n", core_num, ehdr->header.log_size * 4);
@@ -334,14 +343,11 @@ static int ilog_dump_event_logs(struct nvme_transport_handle *hdl, struct ilog *
 		}
 		cmd.cdw13 = ehdr->edumps[j].coreoffset;
 		err = cmd_dump_repeat(&cmd, ehdr->edumps[j].coresize,
-				output, hdl, false);
-		if (err) {
-			close(output);
+				ilog->bundle, file_name, hdl, false);
+		if (err)
 			return err;
-		}
 	}
-	close(output);
-	printf("Successfully wrote Events to %s\n", file_path);
+	printf("Successfully wrote Events to %s\n", file_name);
 	return err;
 }
 
@@ -366,7 +372,7 @@ static int ilog_dump_nlogs(struct nvme_transport_handle *hdl, struct ilog *ilog,
 	int err = 0;
 	__u32 count, core_num;
 	__u8 buf[INTERNAL_LOG_MAX_BYTE_TRANSFER];
-	_cleanup_free_ char *file_path = NULL;
+	const char *file_name = "NLog.bin";
 	struct nlog_dump_header_common *nlog_header = (struct nlog_dump_header_common *)buf;
 	struct nvme_passthru_cmd cmd = {
 		.opcode = 0xd2,
@@ -384,8 +390,6 @@ static int ilog_dump_nlogs(struct nvme_transport_handle *hdl, struct ilog *ilog,
 			__u32 raw;
 		};
 	} log_select;
-	int output;
-	bool is_open = false;
 	size_t header_size = 0;
 
 	log_select.selectCore = core < 0 ? 0 : core;
@@ -395,63 +399,31 @@ static int ilog_dump_nlogs(struct nvme_transport_handle *hdl, struct ilog *ilog,
 			cmd.cdw13 = 0;
 			cmd.cdw12 = log_select.raw;
 			err = read_header(&cmd, hdl);
-			if (err) {
-				if (is_open)
-					close(output);
+			if (err)
 				return err;
-			}
 			count = nlog_header->totalnlogs;
 			core_num = core < 0 ? nlog_header->corecount : 0;
-			if (!header_size) {
-				if (asprintf(&file_path, "%s/NLog.bin", ilog->cfg->out_dir) >= 0) {
-					output = open(file_path, O_WRONLY | O_CREAT | O_TRUNC,
-							LOG_FILE_PERMISSION);
-					if (output < 0)
-						return -errno;
-				} else
-					return -errno;
+			if (!header_size)
 				header_size = get_nlog_header_size(nlog_header);
-				is_open = true;
-			}
-			err = write_header(buf, output, header_size);
+			err = write_header(buf, ilog->bundle, file_name, header_size);
 			if (err)
 				break;
 			if (ilog->cfg->verbose)
 				print_nlog_header(buf);
 			cmd.cdw13 = 0x400;
 			err = cmd_dump_repeat(&cmd, nlog_header->nlogbytesize / 4,
-				output, hdl, true);
+				ilog->bundle, file_name, hdl, true);
 			if (err)
 				break;
 		} while (++log_select.selectNlog < count);
 		if (err)
 			break;
 	} while (++log_select.selectCore < core_num);
-	if (is_open) {
-		close(output);
-		printf("Successfully wrote Nlog to %s\n", file_path);
-	}
+	if (header_size)
+		printf("Successfully wrote Nlog to %s\n", file_name);
 	return err;
 }
 
-int ensure_dir(const char *parent_dir_name, const char *name)
-{
-	_cleanup_free_ char *file_path = NULL;
-	struct stat sb;
-
-	if (asprintf(&file_path, "%s/%s", parent_dir_name, name) < 0)
-		return -errno;
-
-	if (!(stat(file_path, &sb) == 0 && S_ISDIR(sb.st_mode))) {
-		if (mkdir(file_path, 777) != 0) {
-			perror(file_path);
-			return -errno;
-		}
-	}
-
-	return 0;
-}
-
 struct log {
 	__u8 id;
 	const char *desc;
@@ -459,33 +431,19 @@ struct log {
 	__u8 *buffer;
 };
 
-static int log_save(struct log *log, const char *parent_dir_name, const char *subdir_name,
+static int log_save(struct log *log, struct nvme_bundle *b, const char *subdir_name,
 		    const char *file_name, __u8 *buffer, size_t buf_size)
 {
-	_cleanup_fd_ int output = -1;
 	_cleanup_free_ char *file_path = NULL;
-	size_t bytes_remaining = 0;
-
-	ensure_dir(parent_dir_name, subdir_name);
-
-	if (asprintf(&file_path, "%s/%s/%s", parent_dir_name, subdir_name, file_name) < 0)
-		return -errno;
+	int err;
 
-	output = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, LOG_FILE_PERMISSION);
-	if (output < 0)
+	if (asprintf(&file_path, "%s/%s", subdir_name, file_name) < 0)
 		return -errno;
 
-	bytes_remaining = buf_size;
-
-	while (bytes_remaining) {
-		ssize_t bytes_written = write(output, buffer, bytes_remaining);
-
-		if (bytes_written < 0)
-			return -errno;
+	err = nvme_bundle_append(b, file_path, buffer, buf_size);
+	if (err)
+		return err;
 
-		bytes_remaining -= bytes_written;
-		buffer += bytes_written;
-	}
 	printf("Successfully wrote %s to %s\n", log->desc, file_path);
 	return 0;
 }
@@ -506,7 +464,7 @@ static int ilog_dump_identify_page(struct nvme_transport_handle *hdl,
 		     cns->id, nsid) < 0)
 		return -errno;
 
-	return log_save(cns, ilog->cfg->out_dir, "identify", filename, buff,
+	return log_save(cns, ilog->bundle, "identify", filename, buff,
 			sizeof(data));
 }
 
@@ -614,7 +572,7 @@ static int ilog_dump_telemetry(struct nvme_transport_handle *hdl, struct ilog *i
 	if (err)
 		return err;
 
-	err = log_save(&log, ilog->cfg->out_dir, "log_pages", file_name, log.buffer,
+	err = log_save(&log, ilog->bundle, "log_pages", file_name, log.buffer,
 		       log.buffer_size);
 	return err;
 }
@@ -698,7 +656,7 @@ static int ilog_dump_log_page(struct nvme_transport_handle *hdl, struct ilog *il
 	if (asprintf(&filename, "lid_0x%02x_lsp_0x00_lsi_0x0000.bin", lp->id) < 0)
 		return -errno;
 
-	return log_save(lp, ilog->cfg->out_dir, "log_pages", filename, buff, lp->buffer_size);
+	return log_save(lp, ilog->bundle, "log_pages", filename, buff, lp->buffer_size);
 }
 
 static int ilog_dump_no_lsp_log_pages(struct nvme_transport_handle *hdl, struct ilog *ilog)
@@ -815,7 +773,7 @@ static int ilog_dump_pel(struct nvme_transport_handle *hdl, struct ilog *ilog)
 	if (err)
 		return err;
 
-	err = log_save(&lp, ilog->cfg->out_dir, "log_pages", "lid_0x0d_lsp_0x00_lsi_0x0000.bin",
+	err = log_save(&lp, ilog->bundle, "log_pages", "lid_0x0d_lsp_0x00_lsi_0x0000.bin",
 		       pevent_log_full, lp.buffer_size);
 
 	nvme_get_log_persistent_event(hdl, NVME_PEVENT_LOG_RELEASE_CTX,
@@ -829,15 +787,12 @@ int solidigm_get_internal_log(int argc, char **argv, struct command *acmd,
 {
 	char sn_prefix[sizeof(((struct nvme_id_ctrl *)0)->sn)+1];
 	char date_str[sizeof("-YYYYMMDDHHMMSS")];
-	_cleanup_free_ char *full_folder = NULL;
 	_cleanup_free_ char *unique_folder = NULL;
 	_cleanup_free_ char *zip_name = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
-	char *initial_folder;
-	char *output_path;
 	struct ilog ilog = {0};
-	int err;
+	int err, ret;
 	enum log_type log_type = ALL;
 	char type_ALL[] = "ALL";
 	time_t current_time;
@@ -895,8 +850,6 @@ int solidigm_get_internal_log(int argc, char **argv, struct command *acmd,
 		return -errno;
 	}
 
-	initial_folder = cfg.out_dir;
-
 	err = get_serial_number(sn_prefix, hdl);
 	if (err)
 		return err;
@@ -905,17 +858,16 @@ int solidigm_get_internal_log(int argc, char **argv, struct command *acmd,
 	strftime(date_str, sizeof(date_str), "-%Y%m%d%H%M%S", localtime(&current_time));
 	if (asprintf(&unique_folder, "%s%s", sn_prefix, date_str) < 0)
 		return -errno;
-	if (asprintf(&full_folder, "%s/%s", cfg.out_dir, unique_folder) < 0)
+	if (asprintf(&zip_name, "%s/%s.zip", cfg.out_dir, unique_folder) < 0)
 		return -errno;
 
-	if (mkdir(full_folder, 0755) !=  0) {
-		perror("mkdir");
-		return -errno;
+	/* the logs are streamed into the zip, no folder is created */
+	err = nvme_bundle_open(&ilog.bundle, zip_name, NULL);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", zip_name, strerror(-err));
+		return err;
 	}
 
-	cfg.out_dir = full_folder;
-	output_path = full_folder;
-
 	/* Retrieve first logs that records actions to retrieve other logs */
 	if (log_type == ALL || log_type == HIT || log_type == EXTENDED) {
 		err = ilog_dump_telemetry(hdl, &ilog, log_type);
@@ -966,43 +918,21 @@ int solidigm_get_internal_log(int argc, char **argv, struct command *acmd,
 			perror("Error retrieving no LSP Log pages");
 	}
 
-	if (ilog.count > 0) {
-		int ret_cmd;
-		_cleanup_free_ char *cmd = NULL;
-		char *quiet = cfg.verbose ? "" : " -q";
-
-		if (asprintf(&zip_name, "%s.zip", unique_folder) < 0)
-			return -errno;
-
-		if (asprintf(&cmd, "cd \"%s\" && zip -MM -r \"../%s\" ./* %s", cfg.out_dir,
-			     zip_name, quiet) < 0) {
-			err = errno;
-			perror("Can't allocate string for zip command");
-			goto out;
-		}
-		printf("Compressing logs to %s\n", zip_name);
-		ret_cmd = system(cmd);
-		if (ret_cmd)
-			perror(cmd);
-		else {
-			output_path = zip_name;
-			if (asprintf(&cmd, "rm -rf %s", cfg.out_dir) < 0) {
-				err = errno;
-				perror("Can't allocate string for cleanup");
-				goto out;
-			}
-			if (system(cmd) != 0)
-				perror("Failed removing logs folder");
-		}
+	ret = nvme_bundle_close(ilog.bundle);
+	if (ret) {
+		fprintf(stderr, "Failed writing %s: %s\n", zip_name, strerror(-ret));
+		if (!err)
+			err = ret;
 	}
+	if (!ilog.count)
+		unlink(zip_name);
 
-out:
 	if (ilog.count == 0) {
 		if (err > 0)
 			nvme_show_status(err);
 
 	} else if ((ilog.count > 1) || cfg.verbose)
-		printf("Total: %d log files in %s/%s\n", ilog.count, initial_folder, output_path);
+		printf("Total: %d log files in %s\n", ilog.count, zip_name);
 
 	return err;
 }
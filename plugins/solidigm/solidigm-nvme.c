@@ -57,6 +57,11 @@ static int get_telemetry_log(int argc, char **argv, struct command *acmd, struct
 	return solidigm_get_telemetry_log(argc, argv, acmd, plugin);
 }
 
+static int telemetry_diff(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	return solidigm_telemetry_diff(argc, argv, acmd, plugin);
+}
+
 static int clear_fw_update_history(int argc, char **argv, struct command *acmd,
 				   struct plugin *plugin)
 {
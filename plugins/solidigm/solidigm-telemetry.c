@@ -22,6 +22,8 @@
 #include "solidigm-telemetry/header.h"
 #include "solidigm-telemetry/config.h"
 #include "solidigm-telemetry/data-area.h"
+#include "solidigm-telemetry/plan.h"
+#include "solidigm-telemetry/diff.h"
 #include "solidigm-util.h"
 
 static int read_file2buffer(char *file_name, char **buffer, size_t *length)
@@ -55,6 +57,12 @@ struct config {
 	char *jq_filter;
 };
 
+static void cleanup_plan_cache(struct sldm_plan_cache **cache)
+{
+	sldm_plan_cache_free(*cache);
+	*cache = NULL;
+}
+
 static void cleanup_json_object(struct json_object **jobj_ptr)
 {
 	json_free_object(*jobj_ptr);
@@ -76,6 +84,7 @@ int solidigm_get_telemetry_log(int argc, char **argv, struct command *acmd, stru
 	_cleanup_free_ struct nvme_telemetry_log *tlog = NULL;
 
 	__attribute__((cleanup(cleanup_json_object))) struct json_object *configuration = NULL;
+	__attribute__((cleanup(cleanup_plan_cache))) struct sldm_plan_cache *plans = NULL;
 
 	__attribute__((cleanup(cleanup_json_object))) struct json_object *root =
 		json_create_object();
@@ -156,6 +165,14 @@ int solidigm_get_telemetry_log(int argc, char **argv, struct command *acmd, stru
 			return err;
 		}
 		tl.configuration = configuration;
+
+		plans = sldm_plan_cache_new();
+		if (!plans) {
+			err = -ENOMEM;
+			nvme_show_status(err);
+			return err;
+		}
+		tl.plans = plans;
 	}
 
 	if (!has_binary_file) {
@@ -248,3 +265,101 @@ int solidigm_get_telemetry_log(int argc, char **argv, struct command *acmd, stru
 
 	return err;
 }
+
+int solidigm_telemetry_diff(int argc, char **argv, struct command *acmd, struct plugin *plugin)
+{
+	const char *desc = "Compare two Solidigm telemetry log captures of a device: the\n"
+		"Telemetry Objects which changed and the changed regions of the data\n"
+		"areas. With a configuration file also the fields which changed, with\n"
+		"their deltas, and the events added to the NLOGs.";
+	const char *cfile = "JSON configuration file";
+	const char *block_size = "granularity of the changed regions in bytes, default 512";
+	const char *output_format = "output format normal|json";
+
+	__attribute__((cleanup(cleanup_json_object))) struct json_object *configuration = NULL;
+	__attribute__((cleanup(cleanup_plan_cache))) struct sldm_plan_cache *plans = NULL;
+	struct nvme_tdiff d = { 0 };
+	struct json_object *root = NULL;
+	char *format = "normal";
+	char *cfg_file = NULL;
+	__u32 block = NVME_TDIFF_DEFAULT_BLOCK;
+	nvme_print_flags_t fmt;
+	int err;
+
+	OPT_ARGS(opts) = {
+		OPT_FILE("config-file",   'j', &cfg_file, cfile),
+		OPT_UINT("block-size",    'b', &block,    block_size),
+		OPT_FMT("output-format",  'o', &format,   output_format),
+		OPT_END()
+	};
+
+	err = argconfig_parse(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(format, &fmt);
+	if (err < 0) {
+		nvme_show_error("Invalid output format");
+		return err;
+	}
+
+	if (argc - optind != 2) {
+		nvme_show_error("Please provide the two telemetry log files to compare");
+		return -EINVAL;
+	}
+
+	if (!block) {
+		nvme_show_error("Invalid block size");
+		return -EINVAL;
+	}
+
+	if (cfg_file) {
+		_cleanup_free_ char *conf_str = NULL;
+		size_t length = 0;
+
+		err = read_file2buffer(cfg_file, &conf_str, &length);
+		if (err) {
+			nvme_show_status(err);
+			return err;
+		}
+		configuration = json_tokener_parse(conf_str);
+		if (!configuration) {
+			SOLIDIGM_LOG_WARNING("Failed to parse JSON configuration file %s",
+					     cfg_file);
+			return -EINVAL;
+		}
+
+		plans = sldm_plan_cache_new();
+		if (!plans)
+			return -ENOMEM;
+	}
+
+	err = nvme_tdiff_open(&d, argv[optind], argv[optind + 1]);
+	if (err)
+		return err;
+
+	d.block = block;
+	err = nvme_tdiff_compare(&d);
+	if (err) {
+		nvme_show_error("telemetry-diff: %s", strerror(-err));
+		goto close;
+	}
+
+	if (fmt == JSON)
+		root = json_create_object();
+
+	nvme_tdiff_print(&d, root);
+	err = sldm_telemetry_diff(&d, configuration, plans, root);
+	if (root) {
+		if (!err) {
+			json_print_object(root, NULL);
+			printf("\n");
+		}
+		json_free_object(root);
+	}
+
+close:
+	nvme_tdiff_close(&d);
+
+	return err;
+}
@@ -6,3 +6,4 @@
  */
 
 int solidigm_get_telemetry_log(int argc, char **argv, struct command *acmd, struct plugin *plugin);
+int solidigm_telemetry_diff(int argc, char **argv, struct command *acmd, struct plugin *plugin);
@@ -11,14 +11,11 @@
 #include "data-area.h"
 #include "config.h"
 #include "nlog.h"
+#include "plan.h"
 #include "skht.h"
 #include <ctype.h>
 
-#define SIGNED_int_PREFIX "int"
-#define SIGNED_INT_PREFIX "INT"
-
 #define MAX_WARNING_SIZE 1024
-#define MAX_ARRAY_RANK 16
 #define NLOG_HEADER_ID 101
 
 static bool uint8_array_try_string(const struct telemetry_log *tl,
@@ -126,171 +123,74 @@ static bool telemetry_log_get_value(const struct telemetry_log *tl,
 	return true;
 }
 
-int sldm_telemetry_structure_parse(const struct telemetry_log *tl,
-				   struct json_object *struct_def,
-				   uint64_t parent_offset_bit,
-				   struct json_object *output,
-				   struct json_object *metadata)
+static int telemetry_plan_exec(const struct telemetry_log *tl, const struct sldm_plan *plan,
+			       const struct sldm_plan_node *n, uint32_t array_rank,
+			       uint64_t parent_offset_bit, struct json_object *output,
+			       struct json_object *metadata)
 {
-	struct json_object *obj_arraySizeArray = NULL;
-	struct json_object *obj = NULL;
-	struct json_object *obj_memberList;
-	struct json_object *major_dimension = NULL;
 	struct json_object *sub_output;
-	struct json_object *obj_arraySizeIndicator = NULL;
-	bool force_array = false;
-	bool is_enumeration = false;
-	bool has_member_list;
-	const char *type = "";
-	const char *name;
-	size_t array_rank;
-	uint64_t offset_bit;
-	uint32_t size_bit;
 	uint64_t linear_array_pos_bit;
-	uint32_t array_size_dimension[MAX_ARRAY_RANK] = { 0 };
-
-	if (!json_object_object_get_ex(struct_def, "name", &obj)) {
-		SOLIDIGM_LOG_WARNING("Warning: Structure definition missing property 'name': %s",
-				     json_object_to_json_string(struct_def));
-		return  -1;
-	}
-
-	name = json_object_get_string(obj);
-
-	if (metadata) {
-		json_object_get(obj);
-		json_object_object_add(metadata, "objName", obj);
-	}
+	uint32_t array_size = n->dims[0];
 
-	if (json_object_object_get_ex(struct_def, "type", &obj))
-		type = json_object_get_string(obj);
-
-	if (!json_object_object_get_ex(struct_def, "offsetBit", &obj)) {
-		SOLIDIGM_LOG_WARNING(
-		    "Warning: Structure definition missing property 'offsetBit': %s",
-		    json_object_to_json_string(struct_def));
-		return  -1;
-	}
-
-	offset_bit = json_object_get_uint64(obj);
-
-	if (!json_object_object_get_ex(struct_def, "sizeBit", &obj)) {
-		SOLIDIGM_LOG_WARNING(
-		    "Warning: Structure definition missing property 'sizeBit': %s",
-		    json_object_to_json_string(struct_def));
-		return  -1;
+	if (metadata && n->name_obj) {
+		json_object_get(n->name_obj);
+		json_object_object_add(metadata, "objName", n->name_obj);
 	}
 
-	size_bit = (uint32_t)json_object_get_uint64(obj);
-
-	if (json_object_object_get_ex(struct_def, "enum", &obj))
-		is_enumeration = json_object_get_boolean(obj);
-
-	has_member_list = json_object_object_get_ex(struct_def,
-						    "memberList",
-						    &obj_memberList);
-
-	if (!json_object_object_get_ex(struct_def, "arraySize",
-				       &obj_arraySizeArray)) {
-		SOLIDIGM_LOG_WARNING(
-		    "Warning: Structure definition missing property 'arraySize': %s",
-		    json_object_to_json_string(struct_def));
-		return  -1;
-	}
-
-	array_rank = json_object_array_length(obj_arraySizeArray);
-	if (!array_rank) {
-		SOLIDIGM_LOG_WARNING(
-		    "Warning: Structure property 'arraySize' don't support flexible array: %s",
-		    json_object_to_json_string(struct_def));
-		return -1;
-	}
-	if (array_rank > MAX_ARRAY_RANK) {
-		SOLIDIGM_LOG_WARNING(
-		    "Warning: Structure property 'arraySize' don't support more than %d dimensions: %s",
-		    MAX_ARRAY_RANK, json_object_to_json_string(struct_def));
+	if (n->error) {
+		sldm_plan_warn(n);
 		return -1;
 	}
 
-	for (size_t i = 0; i < array_rank; i++) {
-		struct json_object *dimension = json_object_array_get_idx(obj_arraySizeArray, i);
+	// Look for the array size indicator property in the parent object (output)
+	if (n->indicator && output) {
+		struct json_object *parent_prop = NULL;
 
-		array_size_dimension[i] = json_object_get_int(dimension);
-		major_dimension = dimension;
-	}
-
-	// Check for arraySizeIndicator property to support dynamic array sizes
-	if (json_object_object_get_ex(struct_def, "arraySizeIndicator", &obj_arraySizeIndicator)) {
-		const char *indicator_name = json_object_get_string(obj_arraySizeIndicator);
-
-		force_array = true; // Force array output even if size is 1
-
-		// Look for the indicator property in the parent object (output)
-		if (indicator_name && output) {
-			struct json_object *parent_prop = NULL;
-
-			if (json_object_object_get_ex(output, indicator_name, &parent_prop)) {
-				// Get the dynamic array size from the parent property
-				uint32_t dynamic_size = json_object_get_int(parent_prop);
-
-				array_size_dimension[0] = dynamic_size;
-			}
-		}
+		if (json_object_object_get_ex(output, n->indicator, &parent_prop))
+			array_size = json_object_get_int(parent_prop);
 	}
 
 	if (array_rank > 1) {
-		uint32_t linear_pos_per_index = array_size_dimension[0];
-		uint32_t prev_index_offset_bit = 0;
+		uint64_t linear_pos_per_index = array_size;
+		uint64_t prev_index_offset_bit = 0;
 		struct json_object *dimension_output;
 
 		for (unsigned int i = 1; i < (array_rank - 1); i++)
-			linear_pos_per_index *= array_size_dimension[i];
+			linear_pos_per_index *= n->dims[i];
 
 		dimension_output = json_create_array();
 		if (json_object_get_type(output) == json_type_array)
 			json_object_array_add(output, dimension_output);
 		else
-			json_object_add_value_array(output, name, dimension_output);
-
-		/*
-		 * Make sure major_dimension object will not be
-		 * deleted from memory when deleted from array
-		 */
-		json_object_get(major_dimension);
-		json_object_array_del_idx(obj_arraySizeArray, array_rank - 1, 1);
+			json_object_add_value_array(output, n->name, dimension_output);
 
-		for (unsigned int i = 0 ; i < array_size_dimension[0]; i++) {
+		for (unsigned int i = 0 ; i < array_size; i++) {
 			struct json_object *sub_array = json_create_array();
-			uint64_t offset;
-
-			offset = parent_offset_bit + prev_index_offset_bit;
 
 			json_object_array_add(dimension_output, sub_array);
-			sldm_telemetry_structure_parse(tl, struct_def,
-						       offset, sub_array, NULL);
-			prev_index_offset_bit += linear_pos_per_index * size_bit;
+			telemetry_plan_exec(tl, plan, n, array_rank - 1,
+					    parent_offset_bit + prev_index_offset_bit,
+					    sub_array, NULL);
+			prev_index_offset_bit += linear_pos_per_index * n->size_bit;
 		}
 
-		json_object_array_put_idx(obj_arraySizeArray, array_rank - 1,
-					  major_dimension);
-
 		return 0;
 	}
 
 	linear_array_pos_bit = 0;
 	sub_output = output;
 
-	if (array_size_dimension[0] > 1 || force_array) {
+	if (array_size > 1 || n->force_array) {
 		// Check if this is a UINT8 array that should be treated as a string
-		if (json_object_is_type(output, json_type_object) &&
-		    (strcmp(type, "UINT8") == 0 || strcmp(type, "uint8_t") == 0) && !force_array) {
+		if (json_object_is_type(output, json_type_object) && n->is_uint8 &&
+		    !n->force_array) {
 			// Handle UINT8 arrays as strings
 			struct json_object *str_obj = NULL;
-			uint64_t offset = parent_offset_bit + offset_bit;
+			uint64_t offset = parent_offset_bit + n->offset_bit;
 
-			if (uint8_array_try_string(tl, offset, size_bit,
-						  array_size_dimension[0], &str_obj)) {
-				json_object_object_add(output, name, str_obj);
+			if (uint8_array_try_string(tl, offset, n->size_bit,
+						  array_size, &str_obj)) {
+				json_object_object_add(output, n->name, str_obj);
 				return 0;
 			}
 
@@ -302,55 +202,72 @@ int sldm_telemetry_structure_parse(const struct telemetry_log *tl,
 		if (json_object_is_type(output, json_type_array))
 			json_object_array_add(output, sub_output);
 		else
-			json_object_add_value_array(output, name, sub_output);
+			json_object_add_value_array(output, n->name, sub_output);
 	}
 
-	for (uint32_t j = 0; j < array_size_dimension[0]; j++) {
-		if (is_enumeration || !has_member_list) {
-			bool is_signed = !strncmp(type, SIGNED_int_PREFIX,
-					sizeof(SIGNED_int_PREFIX)-1) ||
-					!strncmp(type, SIGNED_INT_PREFIX,
-					sizeof(SIGNED_INT_PREFIX)-1);
+	for (uint32_t j = 0; j < array_size; j++) {
+		uint64_t offset = parent_offset_bit + n->offset_bit + linear_array_pos_bit;
+
+		if (n->is_value) {
 			struct json_object *val_obj;
-			uint64_t offset;
 
-			offset = parent_offset_bit + offset_bit + linear_array_pos_bit;
-			if (telemetry_log_get_value(tl, offset, size_bit, is_signed, &val_obj)) {
-				if (array_size_dimension[0] > 1 || force_array)
+			if (telemetry_log_get_value(tl, offset, n->size_bit, n->is_signed,
+						    &val_obj)) {
+				if (array_size > 1 || n->force_array)
 					json_object_array_put_idx(sub_output, j, val_obj);
 				else
-					json_object_object_add(sub_output, name, val_obj);
+					json_object_object_add(sub_output, n->name, val_obj);
 			} else {
 				SOLIDIGM_LOG_WARNING(
 				    "Warning: %s From property '%s', array index %u, structure definition: %s",
-				    json_object_get_string(val_obj), name, j,
-				    json_object_to_json_string(struct_def));
+				    json_object_get_string(val_obj), n->name, j,
+				    json_object_to_json_string(n->def));
 				json_free_object(val_obj);
 			}
 		} else {
 			struct json_object *sub_sub_output = json_object_new_object();
-			int num_members;
 
-			if (array_size_dimension[0] > 1 || force_array)
+			if (array_size > 1 || n->force_array)
 				json_object_array_put_idx(sub_output, j, sub_sub_output);
 			else
-				json_object_add_value_object(sub_output, name, sub_sub_output);
+				json_object_add_value_object(sub_output, n->name, sub_sub_output);
 
-			num_members = json_object_array_length(obj_memberList);
-			for (int k = 0; k < num_members; k++) {
-				struct json_object *member = json_object_array_get_idx(obj_memberList, k);
-				uint64_t offset;
+			for (uint32_t k = 0; k < n->nr_members; k++) {
+				const struct sldm_plan_node *member =
+					&plan->node[n->first_member + k];
 
-				offset = parent_offset_bit + offset_bit + linear_array_pos_bit;
-				sldm_telemetry_structure_parse(tl, member, offset,
-								  sub_sub_output, NULL);
+				telemetry_plan_exec(tl, plan, member, member->rank, offset,
+						    sub_sub_output, NULL);
 			}
 		}
-		linear_array_pos_bit += size_bit;
+		linear_array_pos_bit += n->size_bit;
 	}
 	return 0;
 }
 
+int sldm_telemetry_structure_parse(const struct telemetry_log *tl,
+				   struct json_object *struct_def,
+				   uint64_t parent_offset_bit,
+				   struct json_object *output,
+				   struct json_object *metadata)
+{
+	struct sldm_plan *plan, *tmp = NULL;
+	int err;
+
+	if (tl->plans)
+		plan = sldm_plan_cache_get(tl->plans, struct_def);
+	else
+		plan = tmp = sldm_plan_compile(struct_def);
+	if (!plan)
+		return -1;
+
+	err = telemetry_plan_exec(tl, plan, &plan->node[0], plan->node[0].rank,
+				  parent_offset_bit, output, metadata);
+
+	sldm_plan_free(tmp);
+	return err;
+}
+
 static int telemetry_log_data_area_get_offset(const struct telemetry_log *tl,
 					      enum nvme_telemetry_da da,
 					      uint32_t *offset, uint32_t *size)
@@ -391,7 +308,8 @@ static int telemetry_log_data_area_get_offset(const struct telemetry_log *tl,
 	return 0;
 }
 
-static int telemetry_log_nlog_parse(const struct telemetry_log *tl, struct json_object *formats,
+static int telemetry_log_nlog_parse(const struct telemetry_log *tl,
+				    const struct nlog_formats *formats,
 				    uint64_t nlog_file_offset,	uint64_t nlog_size,
 				    struct json_object *output, struct json_object *metadata)
 {
@@ -438,150 +356,204 @@ struct telemetry_object_header {
 	uint8_t Reserved[3];
 };
 
-static void telemetry_log_data_area_toc_parse(const struct telemetry_log *tl,
-					      enum nvme_telemetry_da da,
-					      struct json_object *toc_array,
-					      struct json_object *tele_obj_array)
+int sldm_telemetry_toc_walk(const struct telemetry_log *tl,
+			    enum nvme_telemetry_da da,
+			    sldm_telemetry_object_fn fn, void *arg)
 {
-
-	const struct telemetry_object_header *header;
 	const struct table_of_contents *toc;
-	char *payload;
+	struct telemetry_object_header header;
+	struct sldm_telemetry_object obj;
+	struct toc_item item;
 	uint32_t da_offset;
 	uint32_t da_size;
-	struct json_object *nlog_formats;
+	int err;
 
 	if (telemetry_log_data_area_get_offset(tl, da, &da_offset, &da_size))
-		return;
+		return -EINVAL;
 
 	toc = (struct table_of_contents *)(((char *)tl->log) + da_offset);
-	payload = (char *) tl->log;
-	nlog_formats = solidigm_config_get_nlog_formats(tl->configuration);
 
 	for (int i = 0; i < toc->header.TableOfContentsCount; i++) {
-		struct json_object *structure_definition = NULL;
-		struct json_object *toc_item;
-		uint32_t obj_offset;
-		bool has_struct;
-		const char *nlog_name = NULL;
-		uint32_t header_offset = sizeof(const struct telemetry_object_header);
-		struct json_object *tele_obj_item;
-		struct json_object *parsed_struct;
-		struct json_object *obj_hasTelemObjHdr = NULL;
-		uint64_t object_file_offset;
-
 		if ((char *)&toc->items[i] >
 			(((char *)toc) + da_size - sizeof(const struct toc_item))) {
 			SOLIDIGM_LOG_WARNING(
 			    "Warning: Data Area %d, Table of Contents item %d crossed Data Area size.",
 			    da, i);
-			return;
+			return 0;
 		}
 
-		obj_offset = toc->items[i].OffsetBytes;
-		if ((obj_offset + sizeof(const struct telemetry_object_header)) > da_size) {
+		memcpy(&item, &toc->items[i], sizeof(item));
+		if ((item.OffsetBytes + sizeof(const struct telemetry_object_header)) > da_size) {
 			SOLIDIGM_LOG_WARNING(
 			    "Warning: Data Area %d, item %d data, crossed Data Area size.", da, i);
 			continue;
 		}
 
-		toc_item = json_object_new_object();
-		json_object_array_add(toc_array, toc_item);
-		json_object_add_value_uint(toc_item, "dataArea", da);
-		json_object_add_value_uint(toc_item, "dataAreaIndex", i);
-		json_object_add_value_uint(toc_item, "dataAreaOffset", obj_offset);
-		json_object_add_value_uint(toc_item, "fileOffset", obj_offset + da_offset);
-		json_object_add_value_uint(toc_item, "size", toc->items[i].ContentSizeBytes);
+		memcpy(&header, ((char *)toc) + item.OffsetBytes, sizeof(header));
+		obj = (struct sldm_telemetry_object) {
+			.da = da,
+			.index = i,
+			.da_offset = da_offset,
+			.da_size = da_size,
+			.offset = item.OffsetBytes,
+			.size = item.ContentSizeBytes,
+			.major = header.versionMajor,
+			.minor = header.versionMinor,
+			.token = header.Token,
+			.core_id = header.CoreId,
+		};
+
+		err = fn(tl, &obj, arg);
+		if (err)
+			return err;
+	}
 
-		header = (const struct telemetry_object_header *) (payload + da_offset + obj_offset);
-		json_object_add_value_uint(toc_item, "telemMajor", header->versionMajor);
-		json_object_add_value_uint(toc_item, "telemMinor", header->versionMinor);
-		json_object_add_value_uint(toc_item, "objectId", header->Token);
-		json_object_add_value_uint(toc_item, "mediaBankId", header->CoreId);
+	return 0;
+}
+
+void sldm_telemetry_object_parse(const struct telemetry_log *tl,
+				 const struct sldm_telemetry_object *obj,
+				 const struct nlog_formats *nlog_formats,
+				 struct json_object *toc_array,
+				 struct json_object *tele_obj_array)
+{
+	struct json_object *structure_definition = NULL;
+	struct json_object *toc_item;
+	bool has_struct;
+	const char *nlog_name = NULL;
+	uint32_t header_offset = sizeof(const struct telemetry_object_header);
+	struct json_object *tele_obj_item;
+	struct json_object *parsed_struct;
+	struct json_object *obj_hasTelemObjHdr = NULL;
+	uint64_t object_file_offset;
+
+	toc_item = json_object_new_object();
+	json_object_array_add(toc_array, toc_item);
+	json_object_add_value_uint(toc_item, "dataArea", obj->da);
+	json_object_add_value_uint(toc_item, "dataAreaIndex", obj->index);
+	json_object_add_value_uint(toc_item, "dataAreaOffset", obj->offset);
+	json_object_add_value_uint(toc_item, "fileOffset", obj->offset + obj->da_offset);
+	json_object_add_value_uint(toc_item, "size", obj->size);
+
+	json_object_add_value_uint(toc_item, "telemMajor", obj->major);
+	json_object_add_value_uint(toc_item, "telemMinor", obj->minor);
+	json_object_add_value_uint(toc_item, "objectId", obj->token);
+	json_object_add_value_uint(toc_item, "mediaBankId", obj->core_id);
+
+	has_struct = solidigm_config_get_struct_by_token_version(tl->configuration,
+								 obj->token,
+								 obj->major,
+								 obj->minor,
+								 &structure_definition);
+	if (!has_struct) {
+		if (!nlog_formats)
+			return;
+		nlog_name = solidigm_config_get_nlog_obj_name(tl->configuration,
+								obj->token);
+		if (!nlog_name)
+			return;
 
+		// NLOGs have different parser from other Telemetry objects
 		has_struct = solidigm_config_get_struct_by_token_version(tl->configuration,
-									 header->Token,
-									 header->versionMajor,
-									 header->versionMinor,
-									 &structure_definition);
-		if (!has_struct) {
-			if (!nlog_formats)
-				continue;
-			nlog_name = solidigm_config_get_nlog_obj_name(tl->configuration,
-									header->Token);
-			if (!nlog_name)
-				continue;
-
-			// NLOGs have different parser from other Telemetry objects
-			has_struct = solidigm_config_get_struct_by_token_version(tl->configuration,
-				NLOG_HEADER_ID,
-				header->versionMajor,
-				header->versionMinor,
-				&structure_definition);
-		}
-		tele_obj_item = json_object_new_object();
+			NLOG_HEADER_ID,
+			obj->major,
+			obj->minor,
+			&structure_definition);
+	}
+	tele_obj_item = json_object_new_object();
 
-		json_object_array_add(tele_obj_array, tele_obj_item);
-		json_object_get(toc_item);
-		json_object_add_value_object(tele_obj_item, "metadata", toc_item);
-		parsed_struct = json_object_new_object();
+	json_object_array_add(tele_obj_array, tele_obj_item);
+	json_object_get(toc_item);
+	json_object_add_value_object(tele_obj_item, "metadata", toc_item);
+	parsed_struct = json_object_new_object();
 
-		json_object_add_value_object(tele_obj_item, "objectData", parsed_struct);
+	json_object_add_value_object(tele_obj_item, "objectData", parsed_struct);
 
-		if (json_object_object_get_ex(structure_definition,
-						"hasTelemObjHdr",
-						&obj_hasTelemObjHdr)) {
-			bool hasHeader = json_object_get_boolean(obj_hasTelemObjHdr);
+	if (json_object_object_get_ex(structure_definition,
+					"hasTelemObjHdr",
+					&obj_hasTelemObjHdr)) {
+		bool hasHeader = json_object_get_boolean(obj_hasTelemObjHdr);
 
-			if (hasHeader)
-				header_offset = 0;
-		}
-		object_file_offset = ((uint64_t)da_offset) + obj_offset + header_offset;
+		if (hasHeader)
+			header_offset = 0;
+	}
+	object_file_offset = ((uint64_t)obj->da_offset) + obj->offset + header_offset;
+	if (has_struct) {
+		sldm_telemetry_structure_parse(tl, structure_definition,
+					NUM_BITS_IN_BYTE * object_file_offset,
+					parsed_struct, toc_item);
+	}
+	// NLOGs have different parser from other Telemetry objects
+	if (nlog_name) {
 		if (has_struct) {
-			sldm_telemetry_structure_parse(tl, structure_definition,
-						NUM_BITS_IN_BYTE * object_file_offset,
-						parsed_struct, toc_item);
-		}
-		// NLOGs have different parser from other Telemetry objects
-		if (nlog_name) {
-			if (has_struct) {
-				struct json_object *header_sizeBits = NULL;
-				struct json_object *header_nlogSelect = NULL;
-				struct json_object *header_nlogName = NULL;
-
-				if (json_object_object_get_ex(structure_definition, "sizeBit",
-							      &header_sizeBits))
-					header_offset = json_object_get_int(header_sizeBits) /
-							NUM_BITS_IN_BYTE;
-				// Overwrite nlogName with correct type
-				if (json_object_object_get_ex(parsed_struct, "nlogSelect",
-				    &header_nlogSelect) &&
-				    json_object_object_get_ex(header_nlogSelect, "nlogName",
-				    &header_nlogName)) {
-					int nlogName = json_object_get_int(header_nlogName);
-					char *name = (char *)&nlogName;
-					struct json_object *nlog_name_obj = NULL;
-
-					reverse_string(name, sizeof(uint32_t));
-					sldm_uint8_array_to_string((const uint8_t *)name,
-								   sizeof(uint32_t),
-								   &nlog_name_obj);
-					json_object_object_add(header_nlogSelect, "nlogName",
-							       nlog_name_obj);
-				}
+			struct json_object *header_sizeBits = NULL;
+			struct json_object *header_nlogSelect = NULL;
+			struct json_object *header_nlogName = NULL;
+
+			if (json_object_object_get_ex(structure_definition, "sizeBit",
+						      &header_sizeBits))
+				header_offset = json_object_get_int(header_sizeBits) /
+						NUM_BITS_IN_BYTE;
+			// Overwrite nlogName with correct type
+			if (json_object_object_get_ex(parsed_struct, "nlogSelect",
+			    &header_nlogSelect) &&
+			    json_object_object_get_ex(header_nlogSelect, "nlogName",
+			    &header_nlogName)) {
+				int nlogName = json_object_get_int(header_nlogName);
+				char *name = (char *)&nlogName;
+				struct json_object *nlog_name_obj = NULL;
+
+				reverse_string(name, sizeof(uint32_t));
+				sldm_uint8_array_to_string((const uint8_t *)name,
+							   sizeof(uint32_t),
+							   &nlog_name_obj);
+				json_object_object_add(header_nlogSelect, "nlogName",
+						       nlog_name_obj);
 			}
-			// Overwrite the object name
-			json_object_object_add(toc_item, "objName",
-					       json_object_new_string(nlog_name));
-
-			telemetry_log_nlog_parse(tl, nlog_formats,
-						 object_file_offset + header_offset,
-						 toc->items[i].ContentSizeBytes - header_offset,
-						 parsed_struct, toc_item);
 		}
+		// Overwrite the object name
+		json_object_object_add(toc_item, "objName",
+				       json_object_new_string(nlog_name));
+
+		telemetry_log_nlog_parse(tl, nlog_formats,
+					 object_file_offset + header_offset,
+					 obj->size - header_offset,
+					 parsed_struct, toc_item);
 	}
 }
 
+struct toc_parse_arg {
+	const struct nlog_formats *nlog_formats;
+	struct json_object *toc_array;
+	struct json_object *tele_obj_array;
+};
+
+static int telemetry_log_toc_item_parse(const struct telemetry_log *tl,
+					const struct sldm_telemetry_object *obj,
+					void *arg)
+{
+	struct toc_parse_arg *a = arg;
+
+	sldm_telemetry_object_parse(tl, obj, a->nlog_formats, a->toc_array,
+				    a->tele_obj_array);
+	return 0;
+}
+
+static void telemetry_log_data_area_toc_parse(const struct telemetry_log *tl,
+					      enum nvme_telemetry_da da,
+					      const struct nlog_formats *nlog_formats,
+					      struct json_object *toc_array,
+					      struct json_object *tele_obj_array)
+{
+	struct toc_parse_arg arg = {
+		.nlog_formats = nlog_formats,
+		.toc_array = toc_array,
+		.tele_obj_array = tele_obj_array,
+	};
+
+	sldm_telemetry_toc_walk(tl, da, telemetry_log_toc_item_parse, &arg);
+}
+
 void solidigm_telemetry_log_da1_check_ocp(struct telemetry_log *tl)
 {
 	const uint64_t ocp_telemetry_uuid[] = {0xBC73719D87E64EFA, 0xBA560A9C3043424C};
@@ -596,6 +568,7 @@ int solidigm_telemetry_log_data_areas_parse(struct telemetry_log *tl,
 {
 	struct json_object *tele_obj_array = NULL;
 	struct json_object *toc_array = NULL;
+	struct nlog_formats *nlog_formats;
 
 	solidigm_telemetry_log_da1_check_ocp(tl);
 	sldm_telemetry_da2_check_skhT(tl);
@@ -621,8 +594,14 @@ int solidigm_telemetry_log_data_areas_parse(struct telemetry_log *tl,
 		json_object_add_value_array(tl->root, "tableOfContents", toc_array);
 		json_object_add_value_array(tl->root, "telemetryObjects", tele_obj_array);
 
+		nlog_formats = solidigm_nlog_formats_compile(
+			solidigm_config_get_nlog_formats(tl->configuration));
+
 		for (enum nvme_telemetry_da da = first_da; da <= last_da; da++)
-			telemetry_log_data_area_toc_parse(tl, da, toc_array, tele_obj_array);
+			telemetry_log_data_area_toc_parse(tl, da, nlog_formats, toc_array,
+							  tele_obj_array);
+
+		solidigm_nlog_formats_free(nlog_formats);
 	}
 	return 0;
 }
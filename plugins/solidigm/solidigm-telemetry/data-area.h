@@ -20,4 +20,40 @@ int sldm_telemetry_structure_parse(const struct telemetry_log *tl,
 					 struct json_object *output,
 					 struct json_object *metadata);
 
+/* a Telemetry Object listed in the Table of Contents of a data area */
+struct sldm_telemetry_object {
+	enum nvme_telemetry_da da;
+	int index;
+	uint32_t da_offset;	/* of the data area in the log */
+	uint32_t da_size;
+	uint32_t offset;	/* of the object in the data area */
+	uint32_t size;
+	uint16_t major;
+	uint16_t minor;
+	uint32_t token;
+	uint8_t core_id;
+};
+
+typedef int (*sldm_telemetry_object_fn)(const struct telemetry_log *tl,
+					const struct sldm_telemetry_object *obj,
+					void *arg);
+
+struct nlog_formats;
+
+/*
+ * Calls fn for each object of the Table of Contents of data area da whose
+ * header fits into the data area, stopping at the first Table of Contents
+ * entry which does not. Returns -EINVAL if the data area does not fit the
+ * log, else 0 or the first non zero return of fn.
+ */
+int sldm_telemetry_toc_walk(const struct telemetry_log *tl,
+			    enum nvme_telemetry_da da,
+			    sldm_telemetry_object_fn fn, void *arg);
+/* decodes obj with the configuration of tl into the two arrays */
+void sldm_telemetry_object_parse(const struct telemetry_log *tl,
+				 const struct sldm_telemetry_object *obj,
+				 const struct nlog_formats *nlog_formats,
+				 struct json_object *toc_array,
+				 struct json_object *tele_obj_array);
+
 #endif /* __SOLIDIGM_DATA_AREA_H__ */
@@ -0,0 +1,514 @@
+// SPDX-License-Identifier: MIT
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "config.h"
+#include "data-area.h"
+#include "diff.h"
+#include "nlog.h"
+#include "skht.h"
+
+/* an object of a capture, as listed in its Table of Contents */
+struct sldm_diff_obj {
+	struct sldm_telemetry_object obj;
+	unsigned int nr;	/* earlier objects with the same key */
+	const uint8_t *data;
+	uint32_t len;
+};
+
+struct sldm_diff_capture {
+	const struct nvme_tdiff_log *log;
+	struct telemetry_log tl;
+	struct sldm_diff_obj *objs;
+	int nr;
+	int alloc;
+};
+
+struct sldm_diff_out {
+	const struct nlog_formats *nlog_formats;
+	struct json_object *objects;
+	struct json_object *fields;
+	struct json_object *events;
+};
+
+static int sldm_diff_obj_add(const struct telemetry_log *tl,
+			     const struct sldm_telemetry_object *obj, void *arg)
+{
+	struct sldm_diff_capture *c = arg;
+	struct sldm_diff_obj *o;
+
+	if (c->nr == c->alloc) {
+		int alloc = c->alloc ? c->alloc * 2 : 64;
+
+		o = realloc(c->objs, alloc * sizeof(*o));
+		if (!o)
+			return -ENOMEM;
+		c->objs = o;
+		c->alloc = alloc;
+	}
+
+	o = &c->objs[c->nr++];
+	o->obj = *obj;
+	o->nr = 0;
+	o->data = (const uint8_t *)tl->log + obj->da_offset + obj->offset;
+	/* only the object header was checked against the data area */
+	o->len = min(obj->size, obj->da_size - obj->offset);
+
+	return 0;
+}
+
+static int sldm_diff_key_cmp(const struct sldm_diff_obj *x,
+			     const struct sldm_diff_obj *y)
+{
+	if (x->obj.da != y->obj.da)
+		return x->obj.da < y->obj.da ? -1 : 1;
+	if (x->obj.token != y->obj.token)
+		return x->obj.token < y->obj.token ? -1 : 1;
+	if (x->obj.core_id != y->obj.core_id)
+		return x->obj.core_id < y->obj.core_id ? -1 : 1;
+	if (x->nr != y->nr)
+		return x->nr < y->nr ? -1 : 1;
+
+	return 0;
+}
+
+/* Table of Contents order within a key, so that repeated objects pair up */
+static int sldm_diff_obj_cmp(const void *a, const void *b)
+{
+	const struct sldm_diff_obj *x = a, *y = b;
+	int cmp = sldm_diff_key_cmp(x, y);
+
+	if (cmp)
+		return cmp;
+
+	return x->obj.index - y->obj.index;
+}
+
+static int sldm_diff_capture_init(struct sldm_diff_capture *c,
+				  const struct nvme_tdiff_log *log,
+				  struct json_object *configuration,
+				  struct sldm_plan_cache *plans,
+				  unsigned int last_da)
+{
+	enum nvme_telemetry_da da = NVME_TELEMETRY_DA_1;
+	int i, err;
+
+	memset(c, 0, sizeof(*c));
+	c->log = log;
+	c->tl.log = (struct nvme_telemetry_log *)log->buf;
+	c->tl.log_size = log->size;
+	c->tl.configuration = configuration;
+	c->tl.plans = plans;
+
+	solidigm_telemetry_log_da1_check_ocp(&c->tl);
+	sldm_telemetry_da2_check_skhT(&c->tl);
+	if (c->tl.is_skhT) {
+		fprintf(stderr, "%s: no Table of Contents in this log format\n",
+			log->path);
+		return 0;
+	}
+
+	/* data areas 1 and 2 of an OCP log are compared by the ocp plugin */
+	if (c->tl.is_ocp)
+		da = NVME_TELEMETRY_DA_3;
+
+	for (; da <= last_da && da <= NVME_TELEMETRY_DA_4; da++) {
+		if (!log->da_len[da])
+			continue;
+		err = sldm_telemetry_toc_walk(&c->tl, da, sldm_diff_obj_add, c);
+		if (err && err != -EINVAL)
+			return err;
+	}
+
+	if (c->nr)
+		qsort(c->objs, c->nr, sizeof(*c->objs), sldm_diff_obj_cmp);
+	for (i = 1; i < c->nr; i++) {
+		c->objs[i].nr = 0;
+		if (c->objs[i].obj.da == c->objs[i - 1].obj.da &&
+		    c->objs[i].obj.token == c->objs[i - 1].obj.token &&
+		    c->objs[i].obj.core_id == c->objs[i - 1].obj.core_id)
+			c->objs[i].nr = c->objs[i - 1].nr + 1;
+	}
+
+	return 0;
+}
+
+/* the decoded object with its "metadata" and "objectData", NULL if unknown */
+static struct json_object *sldm_diff_decode(const struct sldm_diff_capture *c,
+					    const struct sldm_diff_obj *o,
+					    const struct sldm_diff_out *out)
+{
+	struct json_object *toc_array = json_create_array();
+	struct json_object *tele_obj_array = json_create_array();
+	struct json_object *item = NULL;
+
+	sldm_telemetry_object_parse(&c->tl, &o->obj, out->nlog_formats,
+				    toc_array, tele_obj_array);
+	if (json_object_array_length(tele_obj_array))
+		item = json_object_get(json_object_array_get_idx(tele_obj_array, 0));
+
+	json_free_object(toc_array);
+	json_free_object(tele_obj_array);
+
+	return item;
+}
+
+static const char *sldm_diff_name(struct json_object *item)
+{
+	struct json_object *metadata, *name;
+
+	if (item && json_object_object_get_ex(item, "metadata", &metadata) &&
+	    json_object_object_get_ex(metadata, "objName", &name))
+		return json_object_get_string(name);
+
+	return "";
+}
+
+static struct json_object *sldm_diff_entry(const struct sldm_diff_obj *o,
+					   const char *name)
+{
+	struct json_object *obj = json_create_object();
+
+	json_object_add_value_uint(obj, "data_area", o->obj.da);
+	json_object_add_value_uint(obj, "object_id", o->obj.token);
+	json_object_add_value_uint(obj, "media_bank", o->obj.core_id);
+	json_object_add_value_string(obj, "name", name);
+
+	return obj;
+}
+
+static uint64_t sldm_diff_value(struct json_object *val)
+{
+	int64_t v = json_object_get_int64(val);
+
+	/* values above INT64_MAX are kept as unsigned */
+	return v == INT64_MAX ? json_object_get_uint64(val) : (uint64_t)v;
+}
+
+static void sldm_diff_field_add(struct sldm_diff_out *out,
+				const struct sldm_diff_obj *o, const char *name,
+				const char *path, struct json_object *b,
+				struct json_object *a)
+{
+	struct json_object *obj = sldm_diff_entry(o, name);
+
+	json_object_add_value_string(obj, "field", path);
+	json_object_object_add(obj, "before", json_object_get(b));
+	json_object_object_add(obj, "after", json_object_get(a));
+	if (json_object_is_type(b, json_type_int) &&
+	    json_object_is_type(a, json_type_int))
+		json_object_add_value_int64(obj, "delta",
+			(int64_t)(sldm_diff_value(a) - sldm_diff_value(b)));
+	json_array_add_value_object(out->fields, obj);
+}
+
+/* reports the leaves of two decoded objects which differ */
+static void sldm_diff_fields(struct sldm_diff_out *out,
+			     const struct sldm_diff_obj *o, const char *name,
+			     char *path, size_t size, struct json_object *b,
+			     struct json_object *a)
+{
+	size_t n = strlen(path), i, nr;
+	enum json_type type = json_object_get_type(a);
+
+	if (type != json_object_get_type(b)) {
+		sldm_diff_field_add(out, o, name, path, b, a);
+		return;
+	}
+
+	switch (type) {
+	case json_type_object: {
+		json_object_object_foreach(a, key, val) {
+			struct json_object *bval;
+
+			/* the events of an NLOG are compared as a log */
+			if (!n && !strcmp(key, "events"))
+				continue;
+			if (!json_object_object_get_ex(b, key, &bval))
+				continue;
+			snprintf(path + n, size - n, n ? ".%s" : "%s", key);
+			sldm_diff_fields(out, o, name, path, size, bval, val);
+		}
+		break;
+	}
+	case json_type_array:
+		nr = min(json_object_array_length(a), json_object_array_length(b));
+		for (i = 0; i < nr; i++) {
+			snprintf(path + n, size - n, "[%zu]", i);
+			sldm_diff_fields(out, o, name, path, size,
+					 json_object_array_get_idx(b, i),
+					 json_object_array_get_idx(a, i));
+		}
+		break;
+	default:
+		if (!json_object_equal(b, a))
+			sldm_diff_field_add(out, o, name, path, b, a);
+		break;
+	}
+
+	path[n] = '\0';
+}
+
+/* the timestamp, header and parameters of an event, not its format */
+static bool sldm_diff_event_eq(struct json_object *x, struct json_object *y)
+{
+	int i;
+
+	if (!x || !y)
+		return false;
+
+	for (i = 0; i < 4; i++)
+		if (!json_object_equal(json_object_array_get_idx(x, i),
+				       json_object_array_get_idx(y, i)))
+			return false;
+
+	return true;
+}
+
+/*
+ * The events are listed newest first. Those of the after capture which
+ * precede the newest event of the before capture, and the one after it
+ * to tell repeated events apart, are new; all are if the log wrapped past
+ * it.
+ */
+static void sldm_diff_events(struct sldm_diff_out *out,
+			     const struct sldm_diff_obj *o, const char *name,
+			     struct json_object *b, struct json_object *a)
+{
+	size_t nb = json_object_array_length(b);
+	size_t na = json_object_array_length(a);
+	size_t k, first_old = na;
+	struct json_object *obj;
+
+	for (k = 0; nb && k < na; k++) {
+		if (!sldm_diff_event_eq(json_object_array_get_idx(a, k),
+					json_object_array_get_idx(b, 0)))
+			continue;
+		if (nb > 1 && k + 1 < na &&
+		    !sldm_diff_event_eq(json_object_array_get_idx(a, k + 1),
+					json_object_array_get_idx(b, 1)))
+			continue;
+		first_old = k;
+		break;
+	}
+
+	for (k = 0; k < first_old; k++) {
+		obj = sldm_diff_entry(o, name);
+		json_object_object_add(obj, "event",
+				       json_object_get(json_object_array_get_idx(a, k)));
+		json_array_add_value_object(out->events, obj);
+	}
+}
+
+static void sldm_diff_decoded(struct sldm_diff_out *out,
+			      const struct sldm_diff_obj *o, const char *name,
+			      struct json_object *b, struct json_object *a)
+{
+	struct json_object *bdata, *adata, *bevents, *aevents;
+	char path[512] = "";
+
+	if (!json_object_object_get_ex(b, "objectData", &bdata) ||
+	    !json_object_object_get_ex(a, "objectData", &adata))
+		return;
+
+	sldm_diff_fields(out, o, name, path, sizeof(path), bdata, adata);
+
+	if (json_object_object_get_ex(bdata, "events", &bevents) &&
+	    json_object_object_get_ex(adata, "events", &aevents))
+		sldm_diff_events(out, o, name, bevents, aevents);
+}
+
+static uint32_t sldm_diff_changed_bytes(const struct sldm_diff_obj *b,
+					const struct sldm_diff_obj *a)
+{
+	uint32_t len = min(b->len, a->len), i, changed = 0;
+
+	for (i = 0; i < len; i++)
+		if (b->data[i] != a->data[i])
+			changed++;
+
+	return changed + max(b->len, a->len) - len;
+}
+
+static void sldm_diff_object(struct sldm_diff_out *out,
+			     const struct sldm_diff_capture *before,
+			     const struct sldm_diff_obj *b,
+			     const struct sldm_diff_capture *after,
+			     const struct sldm_diff_obj *a)
+{
+	const struct sldm_diff_obj *o = a ? a : b;
+	const char *state = !b ? "added" : !a ? "removed" : "changed";
+	struct json_object *bitem = NULL, *aitem = NULL, *obj;
+	const char *name;
+
+	if (before->tl.configuration) {
+		if (b)
+			bitem = sldm_diff_decode(before, b, out);
+		if (a)
+			aitem = sldm_diff_decode(after, a, out);
+	}
+	name = sldm_diff_name(aitem ? aitem : bitem);
+
+	obj = sldm_diff_entry(o, name);
+	json_object_add_value_string(obj, "state", state);
+	json_object_add_value_uint(obj, "before_size", b ? b->len : 0);
+	json_object_add_value_uint(obj, "after_size", a ? a->len : 0);
+	json_object_add_value_uint(obj, "changed_bytes",
+				   a && b ? sldm_diff_changed_bytes(b, a) :
+				   o->len);
+	json_array_add_value_object(out->objects, obj);
+
+	if (bitem && aitem)
+		sldm_diff_decoded(out, o, name, bitem, aitem);
+
+	json_free_object(bitem);
+	json_free_object(aitem);
+}
+
+static const char *sldm_diff_str(struct json_object *obj, const char *key)
+{
+	struct json_object *val;
+
+	if (!json_object_object_get_ex(obj, key, &val))
+		return "";
+
+	return json_object_to_json_string_ext(val, JSON_C_TO_STRING_PLAIN);
+}
+
+static uint64_t sldm_diff_uint(struct json_object *obj, const char *key)
+{
+	struct json_object *val;
+
+	if (!json_object_object_get_ex(obj, key, &val))
+		return 0;
+
+	return json_object_get_uint64(val);
+}
+
+static void sldm_diff_show(const struct sldm_diff_out *out)
+{
+	struct json_object *obj;
+	size_t i, nr;
+
+	nr = json_object_array_length(out->objects);
+	printf("\nChanged objects\n%-2s %-10s %-4s %-8s %10s %10s %10s %s\n",
+	       "DA", "Object Id", "Bank", "State", "Before", "After", "Changed",
+	       "Name");
+	for (i = 0; i < nr; i++) {
+		obj = json_object_array_get_idx(out->objects, i);
+		printf("%-2" PRIu64 " 0x%08" PRIx64 " %-4" PRIu64 " %-8s %10" PRIu64
+		       " %10" PRIu64 " %10" PRIu64 " %s\n",
+		       sldm_diff_uint(obj, "data_area"),
+		       sldm_diff_uint(obj, "object_id"),
+		       sldm_diff_uint(obj, "media_bank"),
+		       json_object_get_string(json_object_object_get(obj, "state")),
+		       sldm_diff_uint(obj, "before_size"),
+		       sldm_diff_uint(obj, "after_size"),
+		       sldm_diff_uint(obj, "changed_bytes"),
+		       json_object_get_string(json_object_object_get(obj, "name")));
+	}
+	if (!nr)
+		printf("none\n");
+
+	nr = json_object_array_length(out->fields);
+	printf("\nChanged fields\n%-4s %-24s %-40s %20s %20s %21s\n", "Bank",
+	       "Object", "Field", "before", "after", "delta");
+	for (i = 0; i < nr; i++) {
+		obj = json_object_array_get_idx(out->fields, i);
+		printf("%-4" PRIu64 " %-24s %-40s %20s %20s %21s\n",
+		       sldm_diff_uint(obj, "media_bank"),
+		       json_object_get_string(json_object_object_get(obj, "name")),
+		       json_object_get_string(json_object_object_get(obj, "field")),
+		       sldm_diff_str(obj, "before"), sldm_diff_str(obj, "after"),
+		       sldm_diff_str(obj, "delta"));
+	}
+	if (!nr)
+		printf("none\n");
+
+	nr = json_object_array_length(out->events);
+	printf("\nNew events\n%-4s %-24s %s\n", "Bank", "Object", "Event");
+	for (i = 0; i < nr; i++) {
+		obj = json_object_array_get_idx(out->events, i);
+		printf("%-4" PRIu64 " %-24s %s\n",
+		       sldm_diff_uint(obj, "media_bank"),
+		       json_object_get_string(json_object_object_get(obj, "name")),
+		       sldm_diff_str(obj, "event"));
+	}
+	if (!nr)
+		printf("none\n");
+}
+
+int sldm_telemetry_diff(const struct nvme_tdiff *d,
+			struct json_object *configuration,
+			struct sldm_plan_cache *plans,
+			struct json_object *root)
+{
+	struct sldm_diff_capture before = { 0 }, after = { 0 };
+	struct nlog_formats *nlog_formats = NULL;
+	struct sldm_diff_out out = { 0 };
+	int i = 0, j = 0, cmp, err;
+
+	err = sldm_diff_capture_init(&before, &d->before, configuration, plans,
+				     d->last_da);
+	if (!err)
+		err = sldm_diff_capture_init(&after, &d->after, configuration,
+					     plans, d->last_da);
+	if (err)
+		goto out;
+
+	if (configuration)
+		nlog_formats = solidigm_nlog_formats_compile(
+			solidigm_config_get_nlog_formats(configuration));
+
+	out.nlog_formats = nlog_formats;
+	out.objects = json_create_array();
+	out.fields = json_create_array();
+	out.events = json_create_array();
+
+	while (i < before.nr || j < after.nr) {
+		const struct sldm_diff_obj *b = i < before.nr ? &before.objs[i] : NULL;
+		const struct sldm_diff_obj *a = j < after.nr ? &after.objs[j] : NULL;
+
+		if (!b)
+			cmp = 1;
+		else if (!a)
+			cmp = -1;
+		else
+			cmp = sldm_diff_key_cmp(b, a);
+
+		if (cmp < 0) {
+			sldm_diff_object(&out, &before, b, &after, NULL);
+			i++;
+		} else if (cmp > 0) {
+			sldm_diff_object(&out, &before, NULL, &after, a);
+			j++;
+		} else {
+			if (b->len != a->len || memcmp(b->data, a->data, a->len))
+				sldm_diff_object(&out, &before, b, &after, a);
+			i++;
+			j++;
+		}
+	}
+
+	if (root) {
+		json_object_add_value_array(root, "objects", out.objects);
+		json_object_add_value_array(root, "fields", out.fields);
+		json_object_add_value_array(root, "new_events", out.events);
+	} else {
+		sldm_diff_show(&out);
+		json_free_object(out.objects);
+		json_free_object(out.fields);
+		json_free_object(out.events);
+	}
+
+	solidigm_nlog_formats_free(nlog_formats);
+out:
+	free(before.objs);
+	free(after.objs);
+
+	return err;
+}
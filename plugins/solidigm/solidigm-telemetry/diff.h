@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef __SOLIDIGM_TELEMETRY_DIFF_H__
+#define __SOLIDIGM_TELEMETRY_DIFF_H__
+
+#include "nvme-telemetry-diff.h"
+#include "telemetry-log.h"
+
+/*
+ * Shows the Telemetry Objects which changed between two Solidigm telemetry
+ * captures opened with nvme_tdiff_open().
+ *
+ * The objects of the Tables of Contents of the data areas present in both
+ * captures are matched by data area, token and media bank. Added, removed
+ * and changed objects are listed with the number of changed bytes. With a
+ * configuration the changed objects are decoded as well: the fields which
+ * changed are shown with their delta, and for NLOG objects the events that
+ * were logged after the last event of the before capture.
+ *
+ * configuration and plans may be NULL, root is NULL for text output.
+ */
+int sldm_telemetry_diff(const struct nvme_tdiff *d,
+			struct json_object *configuration,
+			struct sldm_plan_cache *plans,
+			struct json_object *root);
+
+#endif /* __SOLIDIGM_TELEMETRY_DIFF_H__ */
@@ -7,6 +7,7 @@
 
 #include "nlog.h"
 #include "config.h"
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -24,21 +25,218 @@ struct header_mismatch {
 	uint32_t miss;
 };
 
-static int formats_find(struct json_object *formats, uint32_t val, struct json_object **format)
+/* a header of 0 is never valid and marks a free slot */
+struct nlog_format_slot {
+	uint32_t header;
+	uint32_t id;
+};
+
+struct nlog_formats {
+	struct nlog_format_slot *slots;
+	struct json_object **format;
+	uint32_t shift;
+	uint32_t nr;
+};
+
+static uint32_t nlog_formats_hash(const struct nlog_formats *nf, uint32_t header)
 {
-	char hex_header[STR_HEX32_SIZE];
+	return (header * 0x9E3779B1U) >> nf->shift;
+}
+
+static const struct nlog_format_slot *nlog_formats_find(const struct nlog_formats *nf,
+							uint32_t header)
+{
+	uint32_t mask = (1U << (32 - nf->shift)) - 1;
+	uint32_t i;
+
+	if (!header)
+		return NULL;
+
+	for (i = nlog_formats_hash(nf, header); nf->slots[i].header; i = (i + 1) & mask)
+		if (nf->slots[i].header == header)
+			return &nf->slots[i];
 
-	snprintf(hex_header, STR_HEX32_SIZE, "0x%08X", val);
-	return json_object_object_get_ex(formats, hex_header, format);
+	return NULL;
+}
+
+struct nlog_formats *solidigm_nlog_formats_compile(struct json_object *formats)
+{
+	struct nlog_formats *nf;
+	uint32_t bits = 4, mask, i;
+	size_t count;
+
+	if (!formats)
+		return NULL;
+
+	/* keep the table at most half full */
+	count = json_object_object_length(formats);
+	while ((1UL << bits) < 2 * count)
+		bits++;
+
+	nf = calloc(1, sizeof(*nf));
+	if (!nf)
+		return NULL;
+
+	nf->shift = 32 - bits;
+	mask = (1U << bits) - 1;
+	nf->slots = calloc(1UL << bits, sizeof(*nf->slots));
+	nf->format = calloc(count ? count : 1, sizeof(*nf->format));
+	if (!nf->slots || !nf->format) {
+		solidigm_nlog_formats_free(nf);
+		return NULL;
+	}
+
+	json_object_object_foreach(formats, key, format) {
+		uint32_t header = strtoul(key, NULL, 16);
+
+		if (!header)
+			continue;
+
+		for (i = nlog_formats_hash(nf, header); nf->slots[i].header; i = (i + 1) & mask)
+			if (nf->slots[i].header == header)
+				break;
+		if (nf->slots[i].header)
+			continue;
+
+		nf->slots[i].header = header;
+		nf->slots[i].id = nf->nr;
+		nf->format[nf->nr++] = format;
+	}
+
+	return nf;
+}
+
+void solidigm_nlog_formats_free(struct nlog_formats *nf)
+{
+	if (!nf)
+		return;
+
+	free(nf->slots);
+	free(nf->format);
+	free(nf);
 }
 
 static uint32_t nlog_get_pos(const uint32_t *nlog, const uint32_t nlog_size, int pos)
 {
-	return nlog[pos % nlog_size];
+	int64_t idx = pos % (int64_t)nlog_size;
+
+	return nlog[idx < 0 ? idx + nlog_size : idx];
+}
+
+/*
+ * Walk over the circular buffer from one start offset, scoring it by the
+ * number of places where the chain of valid headers breaks.
+ */
+struct nlog_walk {
+	int next;		/* next header candidate */
+	int end;		/* last header candidate */
+	int last_bad;
+	bool events;
+	bool done;
+	uint32_t tail_count;
+	int leader;		/* walk this one follows, itself if none */
+	int64_t delta;		/* tail count relative to the leader */
+};
+
+static void nlog_walk_step(struct nlog_walk *w, const uint32_t *nlog, const uint32_t nlog_size,
+			   const struct nlog_formats *nf)
+{
+	uint32_t header = nlog_get_pos(nlog, nlog_size, w->next);
+
+	if (!nlog_formats_find(nf, header)) {
+		if (w->events) {
+			if (w->next != w->last_bad - 1)
+				w->tail_count++;
+			w->last_bad = w->next;
+		}
+		w->next--;
+		return;
+	}
+
+	w->next -= LOG_ENTRY_HEADER_SIZE + LOG_ENTRY_TIMESTAMP_SIZE +
+		   (header & LOG_ENTRY_NUM_ARGS_MASK);
+	w->events = true;
+}
+
+/* walks in the same state make the same decisions from there on */
+static bool nlog_walk_same(const struct nlog_walk *a, const struct nlog_walk *b)
+{
+	return a->next == b->next && a->events == b->events &&
+	       (a->last_bad == a->next + 1) == (b->last_bad == b->next + 1);
+}
+
+/*
+ * Scores every start offset up to LOG_ENTRY_MAX_SIZE in a single pass. The
+ * walks advance in lockstep and as soon as two of them meet on the same
+ * header candidate in the same state only the one reaching further is
+ * continued, the other one keeps its tail count relative to it. The walks
+ * typically synchronize after a few entries, so the buffer is scanned about
+ * once instead of once per offset.
+ */
+static int nlog_find_offset(const uint32_t *nlog, const uint32_t nlog_size,
+			    const struct nlog_formats *nf, uint32_t *tail_count)
+{
+	struct nlog_walk w[LOG_ENTRY_MAX_SIZE];
+	int best = 0;
+	int lead, other, r, s;
+
+	for (s = 0; s < LOG_ENTRY_MAX_SIZE; s++) {
+		w[s] = (struct nlog_walk) {
+			.next = nlog_size - s - 1,
+			.end = -s,
+			.last_bad = nlog_size + 1, // invalid nlog offset
+			.done = !nlog_size,
+			.leader = s,
+		};
+	}
+
+	while (true) {
+		r = -1;
+		for (s = 0; s < LOG_ENTRY_MAX_SIZE; s++) {
+			if (w[s].leader != s || w[s].done)
+				continue;
+			if (r < 0 || w[s].next > w[r].next)
+				r = s;
+		}
+		if (r < 0)
+			break;
+
+		nlog_walk_step(&w[r], nlog, nlog_size, nf);
+
+		for (s = 0; s < LOG_ENTRY_MAX_SIZE; s++) {
+			if (w[s].leader != r || w[s].done || w[r].next >= w[s].end)
+				continue;
+			w[s].tail_count = w[r].tail_count + w[s].delta;
+			w[s].done = true;
+		}
+
+		for (s = 0; s < LOG_ENTRY_MAX_SIZE; s++) {
+			if (s == r || w[s].leader != s || w[s].done || w[r].done ||
+			    !nlog_walk_same(&w[s], &w[r]))
+				continue;
+
+			lead = w[s].end < w[r].end ? s : r;
+			other = lead == s ? r : s;
+			for (int f = 0; f < LOG_ENTRY_MAX_SIZE; f++) {
+				if (w[f].leader != other || w[f].done)
+					continue;
+				w[f].leader = lead;
+				w[f].delta += (int64_t)w[other].tail_count - w[lead].tail_count;
+			}
+			break;
+		}
+	}
+
+	for (s = 1; s < LOG_ENTRY_MAX_SIZE; s++)
+		if (w[s].tail_count < w[best].tail_count)
+			best = s;
+
+	*tail_count = w[best].tail_count;
+	return best;
 }
 
 static uint32_t nlog_get_events(const uint32_t *nlog, const uint32_t nlog_size, int start_offset,
-				struct json_object *formats, struct json_object *events,
+				const struct nlog_formats *nf, struct json_object *events,
 				struct header_mismatch *tail_mismatches)
 {
 	uint32_t event_count = 0;
@@ -47,11 +245,12 @@ static uint32_t nlog_get_events(const uint32_t *nlog, const uint32_t nlog_size,
 	uint32_t prev_header = 0;
 
 	for (int i = nlog_size - start_offset - 1; i >= -start_offset; i--) {
-		struct json_object *format = NULL;
+		const struct nlog_format_slot *slot;
 		uint32_t header = nlog_get_pos(nlog, nlog_size, i);
 		uint32_t num_data;
 
-		if (header == 0 || !formats_find(formats, header, &format)) {
+		slot = nlog_formats_find(nf, header);
+		if (!slot) {
 			if (event_count > 0) {
 				//check if found circular buffer tail
 				if (i != (last_bad_header_pos - 1)) {
@@ -68,6 +267,7 @@ static uint32_t nlog_get_events(const uint32_t *nlog, const uint32_t nlog_size,
 		}
 		num_data = header & LOG_ENTRY_NUM_ARGS_MASK;
 		if (events) {
+			struct json_object *format = nf->format[slot->id];
 			struct json_object *event = json_object_new_array();
 			struct json_object *param = json_object_new_array();
 			uint32_t val = nlog_get_pos(nlog, nlog_size, i - 1);
@@ -92,26 +292,19 @@ static uint32_t nlog_get_events(const uint32_t *nlog, const uint32_t nlog_size,
 	return tail_count;
 }
 
-int solidigm_nlog_parse(const char *buffer, uint64_t buff_size,	struct json_object *formats,
+int solidigm_nlog_parse(const char *buffer, uint64_t buff_size, const struct nlog_formats *nf,
 			struct json_object *metadata, struct json_object *output)
 {
-	uint32_t smaller_tail_count = UINT32_MAX;
-	int best_offset = 0;
-	struct header_mismatch tail_mismatches[LOG_ENTRY_MAX_SIZE][MAX_HEADER_MISMATCH_TRACK];
+	uint32_t smaller_tail_count;
+	int best_offset;
+	struct header_mismatch tail_mismatches[MAX_HEADER_MISMATCH_TRACK];
 	struct json_object *events = json_object_new_array();
 	const uint32_t *nlog = (uint32_t *)buffer;
 	const uint32_t nlog_size = buff_size / sizeof(uint32_t);
 
-	for (int i = 0; i < LOG_ENTRY_MAX_SIZE; i++) {
-		uint32_t tail_count = nlog_get_events(nlog, nlog_size, i, formats, NULL,
-						      tail_mismatches[i]);
-		if (tail_count < smaller_tail_count) {
-			best_offset = i;
-			smaller_tail_count = tail_count;
-		}
-		if (tail_count == 0)
-			break;
-	}
+	best_offset = nlog_find_offset(nlog, nlog_size, nf, &smaller_tail_count);
+	nlog_get_events(nlog, nlog_size, best_offset, nf, events, tail_mismatches);
+
 	if (smaller_tail_count > 1) {
 		int obj_id = -1;
 		int media_bank = -1;
@@ -129,13 +322,12 @@ int solidigm_nlog_parse(const char *buffer, uint64_t buff_size,	struct json_obje
 		for (int i = 0; i < show_mismatch_num; i++)
 			pos += snprintf(&str_mismatches[pos], (STR_HEX32_SIZE + 1) * 2,
 				       "0x%08X-0x%08X ",
-				       tail_mismatches[best_offset][i].prev,
-				       tail_mismatches[best_offset][i].miss);
+				       tail_mismatches[i].prev,
+				       tail_mismatches[i].miss);
 
 		SOLIDIGM_LOG_WARNING("Warning: obj:%d-%d with %d header sequence mismatches ( %s).",
 				      obj_id, media_bank, smaller_tail_count, str_mismatches);
 	}
-	nlog_get_events(nlog, nlog_size, best_offset, formats, events, NULL);
 
 	json_object_object_add(output, "events", events);
 	return 0;
@@ -6,6 +6,15 @@
  */
 #include "telemetry-log.h"
 
+/*
+ * NLOG_FORMATS of a configuration compiled into a hash table keyed by the
+ * entry header, built once and shared by all nlog objects of a log.
+ */
+struct nlog_formats;
+
+struct nlog_formats *solidigm_nlog_formats_compile(struct json_object *formats);
+void solidigm_nlog_formats_free(struct nlog_formats *nf);
+
 int solidigm_nlog_parse(const char *buffer, uint64_t bufer_size,
-			struct json_object *formats, struct json_object *metadata,
+			const struct nlog_formats *nf, struct json_object *metadata,
 			struct json_object *output);
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Solidigm.
+ *
+ * Author: leonardo.da.cunha@solidigm.com
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan.h"
+
+#define SIGNED_int_PREFIX "int"
+#define SIGNED_INT_PREFIX "INT"
+
+#define PLAN_CACHE_MIN_SIZE 64
+
+struct sldm_plan_cache {
+	struct sldm_plan **slot;
+	uint32_t size;
+	uint32_t nr;
+};
+
+static int plan_reserve(struct sldm_plan *plan, uint32_t nr)
+{
+	struct sldm_plan_node *node;
+	uint32_t alloc = plan->alloc ? plan->alloc : 8;
+
+	while (alloc < plan->nr + nr)
+		alloc *= 2;
+
+	if (alloc != plan->alloc) {
+		node = realloc(plan->node, alloc * sizeof(*node));
+		if (!node)
+			return -1;
+		plan->node = node;
+		plan->alloc = alloc;
+	}
+
+	memset(&plan->node[plan->nr], 0, nr * sizeof(*plan->node));
+	plan->nr += nr;
+
+	return 0;
+}
+
+static struct json_object *plan_node_compile(struct sldm_plan_node *n)
+{
+	struct json_object *def = n->def;
+	struct json_object *members = NULL;
+	struct json_object *sizes;
+	struct json_object *obj;
+	bool is_enumeration = false;
+	const char *type = "";
+
+	if (!json_object_object_get_ex(def, "name", &obj)) {
+		n->error = SLDM_PLAN_NO_NAME;
+		return NULL;
+	}
+	n->name_obj = obj;
+	n->name = json_object_get_string(obj);
+
+	if (json_object_object_get_ex(def, "type", &obj))
+		type = json_object_get_string(obj);
+
+	if (!json_object_object_get_ex(def, "offsetBit", &obj)) {
+		n->error = SLDM_PLAN_NO_OFFSET;
+		return NULL;
+	}
+	n->offset_bit = json_object_get_uint64(obj);
+
+	if (!json_object_object_get_ex(def, "sizeBit", &obj)) {
+		n->error = SLDM_PLAN_NO_SIZE;
+		return NULL;
+	}
+	n->size_bit = (uint32_t)json_object_get_uint64(obj);
+
+	if (json_object_object_get_ex(def, "enum", &obj))
+		is_enumeration = json_object_get_boolean(obj);
+
+	json_object_object_get_ex(def, "memberList", &members);
+
+	if (!json_object_object_get_ex(def, "arraySize", &sizes)) {
+		n->error = SLDM_PLAN_NO_ARRAY_SIZE;
+		return NULL;
+	}
+
+	n->rank = json_object_array_length(sizes);
+	if (!n->rank) {
+		n->error = SLDM_PLAN_FLEXIBLE_ARRAY;
+		return NULL;
+	}
+	if (n->rank > MAX_ARRAY_RANK) {
+		n->error = SLDM_PLAN_ARRAY_RANK;
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < n->rank; i++)
+		n->dims[i] = json_object_get_int(json_object_array_get_idx(sizes, i));
+
+	if (json_object_object_get_ex(def, "arraySizeIndicator", &obj)) {
+		n->force_array = true;
+		n->indicator = json_object_get_string(obj);
+	}
+
+	n->is_signed = !strncmp(type, SIGNED_int_PREFIX, sizeof(SIGNED_int_PREFIX) - 1) ||
+		       !strncmp(type, SIGNED_INT_PREFIX, sizeof(SIGNED_INT_PREFIX) - 1);
+	n->is_uint8 = !strcmp(type, "UINT8") || !strcmp(type, "uint8_t");
+	n->is_value = is_enumeration || !members;
+	if (n->is_value)
+		return NULL;
+
+	n->nr_members = json_object_array_length(members);
+	return members;
+}
+
+struct sldm_plan *sldm_plan_compile(struct json_object *def)
+{
+	struct sldm_plan *plan = calloc(1, sizeof(*plan));
+	struct json_object *members;
+	uint32_t first;
+
+	if (!plan)
+		return NULL;
+
+	plan->def = def;
+	if (plan_reserve(plan, 1))
+		goto err;
+	plan->node[0].def = def;
+
+	/* breadth first, so the members of a node are next to each other */
+	for (uint32_t i = 0; i < plan->nr; i++) {
+		members = plan_node_compile(&plan->node[i]);
+		if (!members || !plan->node[i].nr_members)
+			continue;
+
+		first = plan->nr;
+		if (plan_reserve(plan, plan->node[i].nr_members))
+			goto err;
+
+		plan->node[i].first_member = first;
+		for (uint32_t k = 0; k < plan->node[i].nr_members; k++)
+			plan->node[first + k].def = json_object_array_get_idx(members, k);
+	}
+
+	return plan;
+err:
+	sldm_plan_free(plan);
+	return NULL;
+}
+
+void sldm_plan_free(struct sldm_plan *plan)
+{
+	if (!plan)
+		return;
+
+	free(plan->node);
+	free(plan);
+}
+
+void sldm_plan_warn(const struct sldm_plan_node *n)
+{
+	const char *def = json_object_to_json_string(n->def);
+
+	switch (n->error) {
+	case SLDM_PLAN_NO_NAME:
+		SOLIDIGM_LOG_WARNING("Warning: Structure definition missing property 'name': %s",
+				     def);
+		break;
+	case SLDM_PLAN_NO_OFFSET:
+		SOLIDIGM_LOG_WARNING(
+		    "Warning: Structure definition missing property 'offsetBit': %s", def);
+		break;
+	case SLDM_PLAN_NO_SIZE:
+		SOLIDIGM_LOG_WARNING(
+		    "Warning: Structure definition missing property 'sizeBit': %s", def);
+		break;
+	case SLDM_PLAN_NO_ARRAY_SIZE:
+		SOLIDIGM_LOG_WARNING(
+		    "Warning: Structure definition missing property 'arraySize': %s", def);
+		break;
+	case SLDM_PLAN_FLEXIBLE_ARRAY:
+		SOLIDIGM_LOG_WARNING(
+		    "Warning: Structure property 'arraySize' don't support flexible array: %s",
+		    def);
+		break;
+	case SLDM_PLAN_ARRAY_RANK:
+		SOLIDIGM_LOG_WARNING(
+		    "Warning: Structure property 'arraySize' don't support more than %d dimensions: %s",
+		    MAX_ARRAY_RANK, def);
+		break;
+	default:
+		break;
+	}
+}
+
+static uint32_t plan_cache_hash(const struct sldm_plan_cache *cache, const void *def)
+{
+	return (uint32_t)(((uintptr_t)def >> 4) * 2654435761U) & (cache->size - 1);
+}
+
+static int plan_cache_grow(struct sldm_plan_cache *cache)
+{
+	struct sldm_plan **old = cache->slot;
+	uint32_t old_size = cache->size;
+	uint32_t i, j;
+
+	cache->size = old_size ? old_size * 2 : PLAN_CACHE_MIN_SIZE;
+	cache->slot = calloc(cache->size, sizeof(*cache->slot));
+	if (!cache->slot) {
+		cache->slot = old;
+		cache->size = old_size;
+		return -1;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		for (j = plan_cache_hash(cache, old[i]->def); cache->slot[j];
+		     j = (j + 1) & (cache->size - 1))
+			;
+		cache->slot[j] = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+struct sldm_plan_cache *sldm_plan_cache_new(void)
+{
+	struct sldm_plan_cache *cache = calloc(1, sizeof(*cache));
+
+	if (cache && plan_cache_grow(cache)) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void sldm_plan_cache_free(struct sldm_plan_cache *cache)
+{
+	if (!cache)
+		return;
+
+	for (uint32_t i = 0; i < cache->size; i++)
+		sldm_plan_free(cache->slot[i]);
+	free(cache->slot);
+	free(cache);
+}
+
+struct sldm_plan *sldm_plan_cache_get(struct sldm_plan_cache *cache,
+				      struct json_object *def)
+{
+	struct sldm_plan *plan;
+	uint32_t i;
+
+	for (i = plan_cache_hash(cache, def); cache->slot[i]; i = (i + 1) & (cache->size - 1))
+		if (cache->slot[i]->def == def)
+			return cache->slot[i];
+
+	plan = sldm_plan_compile(def);
+	if (!plan)
+		return NULL;
+
+	/* keep the table at most half full */
+	if (2 * (cache->nr + 1) > cache->size) {
+		if (plan_cache_grow(cache)) {
+			sldm_plan_free(plan);
+			return NULL;
+		}
+		for (i = plan_cache_hash(cache, def); cache->slot[i];
+		     i = (i + 1) & (cache->size - 1))
+			;
+	}
+
+	cache->slot[i] = plan;
+	cache->nr++;
+
+	return plan;
+}
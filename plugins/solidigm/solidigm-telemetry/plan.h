@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Copyright (c) 2025 Solidigm.
+ *
+ * Author: leonardo.da.cunha@solidigm.com
+ */
+#ifndef __SOLIDIGM_PLAN_H__
+#define __SOLIDIGM_PLAN_H__
+
+#include "telemetry-log.h"
+
+#define MAX_ARRAY_RANK 16
+
+enum sldm_plan_error {
+	SLDM_PLAN_OK,
+	SLDM_PLAN_NO_NAME,
+	SLDM_PLAN_NO_OFFSET,
+	SLDM_PLAN_NO_SIZE,
+	SLDM_PLAN_NO_ARRAY_SIZE,
+	SLDM_PLAN_FLEXIBLE_ARRAY,
+	SLDM_PLAN_ARRAY_RANK,
+};
+
+/*
+ * A structure definition of the configuration compiled into a flat array of
+ * nodes, so that decoding many instances of it does not look up the same
+ * json properties again for every instance and array element. The members
+ * of a node are the nodes first_member to first_member + nr_members - 1.
+ * Definition errors are kept in the node and reported when it is decoded.
+ */
+struct sldm_plan_node {
+	struct json_object *def;
+	struct json_object *name_obj;
+	const char *name;
+	const char *indicator;		/* arraySizeIndicator */
+	uint64_t offset_bit;
+	uint32_t size_bit;
+	uint32_t rank;
+	uint32_t dims[MAX_ARRAY_RANK];
+	uint32_t first_member;
+	uint32_t nr_members;
+	enum sldm_plan_error error;
+	bool is_value;
+	bool is_signed;
+	bool is_uint8;
+	bool force_array;
+};
+
+struct sldm_plan {
+	struct json_object *def;
+	struct sldm_plan_node *node;
+	uint32_t nr;
+	uint32_t alloc;
+};
+
+struct sldm_plan *sldm_plan_compile(struct json_object *def);
+void sldm_plan_free(struct sldm_plan *plan);
+void sldm_plan_warn(const struct sldm_plan_node *node);
+
+/* plans by definition, each definition is compiled once per log */
+struct sldm_plan_cache;
+
+struct sldm_plan_cache *sldm_plan_cache_new(void);
+void sldm_plan_cache_free(struct sldm_plan_cache *cache);
+struct sldm_plan *sldm_plan_cache_get(struct sldm_plan_cache *cache,
+				      struct json_object *def);
+
+#endif /* __SOLIDIGM_PLAN_H__ */
@@ -22,11 +22,14 @@
 
 #define MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
 
+struct sldm_plan_cache;
+
 struct telemetry_log {
 	struct nvme_telemetry_log *log;
 	size_t log_size;
 	struct json_object *root;
 	struct json_object *configuration;
+	struct sldm_plan_cache *plans;
 	bool is_ocp;
 	bool is_skhT;
 };
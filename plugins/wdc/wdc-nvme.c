@@ -33,9 +33,11 @@
 
 #include "common.h"
 #include "nvme.h"
+#include "nvme-capture.h"
 #include "libnvme.h"
 #include "plugin.h"
 #include "linux/types.h"
+#include "util/bundle.h"
 #include "util/cleanup.h"
 #include "util/types.h"
 #include "nvme-print.h"
@@ -45,8 +47,6 @@
 #include "wdc-utils.h"
 #include "wdc-nvme-cmds.h"
 
-#define WRITE_SIZE	(sizeof(__u8) * 4096)
-
 #define WDC_NVME_SUBCMD_SHIFT				8
 
 #define WDC_NVME_LOG_SIZE_DATA_LEN			0x08
@@ -463,9 +463,7 @@ static __u8 wdc_lat_mon_guid[WDC_C3_GUID_LENGTH] = {
 #define WDC_DE_GLOBAL_NSID				0xFFFFFFFF
 #define WDC_DE_DEFAULT_NAMESPACE_ID			0x01
 #define WDC_DE_PATH_SEPARATOR				"/"
-#define WDC_DE_TAR_FILES				"*.bin"
 #define WDC_DE_TAR_FILE_EXTN				".tar.gz"
-#define WDC_DE_TAR_CMD					"tar -czf"
 
 /* VS NAND Stats */
 #define WDC_NVME_NAND_STATS_LOG_ID			0xFB
@@ -855,8 +853,6 @@ struct tarfile_metadata {
 	int8_t bufferFolderPath[MAX_PATH_LEN];
 	char bufferFolderName[MAX_PATH_LEN];
 	char tarFileName[MAX_PATH_LEN];
-	char tarFiles[MAX_PATH_LEN];
-	char tarCmd[MAX_PATH_LEN+MAX_PATH_LEN];
 	char currDir[MAX_PATH_LEN];
 	UtilsTimeInfo timeInfo;
 	uint8_t *timeString[MAX_PATH_LEN];
@@ -2247,44 +2243,27 @@ static int wdc_get_serial_name(struct nvme_transport_handle *hdl, char *file, si
 static int wdc_create_log_file(const char *file, const __u8 *drive_log_data,
 			       __u32 drive_log_length)
 {
-	int fd;
-	int ret;
+	struct nvme_capture_file output;
+	int ret, err;
 
 	if (!drive_log_length) {
 		fprintf(stderr, "ERROR: WDC: invalid log file length\n");
 		return -1;
 	}
 
-	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (fd < 0) {
-		fprintf(stderr, "ERROR: WDC: open: %s\n", strerror(errno));
+	ret = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE | NVME_CAPTURE_SYNC);
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: open: %s\n", strerror(-ret));
 		return -1;
 	}
 
-	while (drive_log_length > WRITE_SIZE) {
-		ret = write(fd, drive_log_data, WRITE_SIZE);
-		if (ret < 0) {
-			fprintf(stderr, "ERROR: WDC: write: %s\n", strerror(errno));
-			close(fd);
-			return -1;
-		}
-		drive_log_data += WRITE_SIZE;
-		drive_log_length -= WRITE_SIZE;
-	}
-
-	ret = write(fd, drive_log_data, drive_log_length);
-	if (ret < 0) {
-		fprintf(stderr, "ERROR: WDC: write: %s\n", strerror(errno));
-		close(fd);
+	ret = nvme_capture_file_write(&output, drive_log_data, drive_log_length);
+	err = nvme_capture_file_close(&output);
+	if (ret || err) {
+		fprintf(stderr, "ERROR: WDC: write: %s\n", strerror(-(ret ? ret : err)));
 		return -1;
 	}
 
-	if (fsync(fd) < 0) {
-		fprintf(stderr, "ERROR: WDC: fsync: %s\n", strerror(errno));
-		close(fd);
-		return -1;
-	}
-	close(fd);
 	return 0;
 }
 
@@ -3110,6 +3089,46 @@ static __u32 wdc_dump_dui_data_v2(struct nvme_transport_handle *hdl, __u32 dataL
 	return ret;
 }
 
+static int wdc_dui_fetch_v1(struct nvme_capture *c, void *buf, uint64_t off, uint32_t len)
+{
+	return wdc_dump_dui_data(c->priv, len, off, buf, off + len == c->offset + c->size);
+}
+
+static int wdc_dui_fetch_v2(struct nvme_capture *c, void *buf, uint64_t off, uint32_t len)
+{
+	return wdc_dump_dui_data_v2(c->priv, len, off, buf, off + len == c->offset + c->size);
+}
+
+static int wdc_dui_capture(struct nvme_transport_handle *hdl, struct nvme_capture_file *output,
+			   __u32 xfer_size, __u64 offset, __u64 size, bool v2, const char *func)
+{
+	struct nvme_capture c;
+	int ret;
+
+	nvme_capture_init(&c, hdl);
+	c.offset = offset;
+	c.size = size;
+	c.chunk = xfer_size;
+	c.file = output;
+	c.fetch = v2 ? wdc_dui_fetch_v2 : wdc_dui_fetch_v1;
+	c.priv = hdl;
+
+	ret = nvme_capture_run(&c);
+	if (ret && ret == c.status) {
+		fprintf(stderr,
+			"%s: ERROR: WDC: Get chunk %u, size = 0x%"PRIx64", offset = 0x%"PRIx64"\n",
+			func, c.chunks, (uint64_t)size, (uint64_t)(c.offset + c.done));
+		fprintf(stderr, "%s: ERROR: WDC: ", func);
+		nvme_show_status(ret);
+	} else if (ret) {
+		fprintf(stderr, "%s: ERROR: WDC: Failed to flush DUI data to file! %s\n",
+			func, strerror(-ret));
+		ret = -1;
+	}
+
+	return ret;
+}
+
 static int wdc_do_dump(struct nvme_transport_handle *hdl, __u32 opcode, __u32 data_len,
 		       __u32 cdw12, const char *file, __u32 xfer_size)
 {
@@ -3168,14 +3187,46 @@ static int wdc_do_dump(struct nvme_transport_handle *hdl, __u32 opcode, __u32 da
 	return ret;
 }
 
+struct wdc_e6_capture {
+	struct nvme_transport_handle *hdl;
+	__u32 opcode;
+	__u32 cdw12;
+};
+
+static int wdc_e6_fetch(struct nvme_capture *c, void *buf, uint64_t off, uint32_t len)
+{
+	struct wdc_e6_capture *e6 = c->priv;
+	struct nvme_passthru_cmd admin_cmd;
+	int ret;
+
+	memset(&admin_cmd, 0, sizeof(struct nvme_passthru_cmd));
+	admin_cmd.opcode = e6->opcode;
+	admin_cmd.addr = (__u64)(uintptr_t)buf;
+	admin_cmd.data_len = len;
+	admin_cmd.cdw10 = len >> 2;
+	admin_cmd.cdw12 = e6->cdw12;
+	admin_cmd.cdw13 = off >> 2;
+
+	ret = nvme_submit_admin_passthru(e6->hdl, &admin_cmd);
+	if (ret)
+		nvme_show_status(ret);
+
+	return ret;
+}
+
 static int wdc_do_dump_e6(struct nvme_transport_handle *hdl, __u32 opcode, __u32 data_len,
 			  __u32 cdw12, char *file, __u32 xfer_size, __u8 *log_hdr)
 {
+	struct wdc_e6_capture e6 = {
+		.hdl = hdl,
+		.opcode = opcode,
+		.cdw12 = cdw12,
+	};
+	struct nvme_capture_file output;
+	struct nvme_capture c;
+	char partial[PATH_MAX];
 	int ret = 0;
-	__u8 *dump_data;
-	__u32 curr_data_offset, log_size;
-	int i;
-	struct nvme_passthru_cmd admin_cmd;
+	int err;
 
 	/* if data_len is not 4 byte aligned */
 	if (data_len & 0x00000003) {
@@ -3187,59 +3238,56 @@ static int wdc_do_dump_e6(struct nvme_transport_handle *hdl, __u32 opcode, __u32
 		data_len &= 0xFFFFFFFC;
 	}
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * data_len);
-
-	if (!dump_data) {
-		fprintf(stderr, "%s: ERROR: malloc: %s\n", __func__, strerror(errno));
+	if (data_len < WDC_NVME_LOG_SIZE_HDR_LEN) {
+		fprintf(stderr, "ERROR: WDC: invalid log file length\n");
 		return -1;
 	}
-	memset(dump_data, 0, sizeof(__u8) * data_len);
-	memset(&admin_cmd, 0, sizeof(struct nvme_passthru_cmd));
-	curr_data_offset = WDC_NVME_LOG_SIZE_HDR_LEN;
-	i = 0;
-
-	/* copy the 8 byte header into the dump_data buffer */
-	memcpy(dump_data, log_hdr, WDC_NVME_LOG_SIZE_HDR_LEN);
 
-	admin_cmd.opcode = opcode;
-	admin_cmd.cdw12 = cdw12;
+	ret = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE);
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: open: %s\n", strerror(-ret));
+		return -1;
+	}
 
-	/* subtract off the header size since that was already copied into the buffer */
-	log_size = (data_len - curr_data_offset);
-	while (log_size > 0) {
-		xfer_size = min(xfer_size, log_size);
+	/* the 8 byte header was already read, the log is streamed after it */
+	ret = nvme_capture_file_write(&output, log_hdr, WDC_NVME_LOG_SIZE_HDR_LEN);
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: write: %s\n", strerror(-ret));
+		nvme_capture_file_close(&output);
+		return -1;
+	}
 
-		admin_cmd.addr = (__u64)(uintptr_t)dump_data + (__u64)curr_data_offset;
-		admin_cmd.data_len = xfer_size;
-		admin_cmd.cdw10 = xfer_size >> 2;
-		admin_cmd.cdw13 = curr_data_offset >> 2;
+	nvme_capture_init(&c, hdl);
+	c.offset = WDC_NVME_LOG_SIZE_HDR_LEN;
+	c.size = data_len - WDC_NVME_LOG_SIZE_HDR_LEN;
+	c.chunk = xfer_size;
+	c.file = &output;
+	c.fetch = wdc_e6_fetch;
+	c.priv = &e6;
 
-		ret = nvme_submit_admin_passthru(hdl, &admin_cmd);
-		if (ret) {
-			nvme_show_status(ret);
-			fprintf(stderr, "%s: ERROR: WDC: Get chunk %d, size = 0x%x, offset = 0x%x, addr = 0x%lx\n",
-					__func__, i, admin_cmd.data_len, curr_data_offset, (unsigned long)admin_cmd.addr);
-			break;
-		}
-
-		log_size         -= xfer_size;
-		curr_data_offset += xfer_size;
-		i++;
-	}
+	ret = nvme_capture_run(&c);
+	err = nvme_capture_file_close(&output);
+	if (err && !ret)
+		ret = err;
 
 	if (!ret) {
 		fprintf(stderr, "%s: INFO: ", __func__);
 		nvme_show_status(ret);
-	} else {
+	} else if (c.status && ret == c.status) {
+		fprintf(stderr, "%s: ERROR: WDC: Get chunk %u, offset = 0x%"PRIx64"\n",
+			__func__, c.chunks, (uint64_t)(c.offset + c.done));
 		fprintf(stderr, "%s: FAILURE: ", __func__);
 		nvme_show_status(ret);
 		fprintf(stderr, "%s: Partial data may have been captured\n", __func__);
-		snprintf(file + strlen(file), PATH_MAX, "%s", "-PARTIAL");
+		snprintf(partial, sizeof(partial), "%s-PARTIAL", file);
+		if (!rename(file, partial))
+			snprintf(file + strlen(file), PATH_MAX, "%s", "-PARTIAL");
+		ret = 0;
+	} else {
+		fprintf(stderr, "ERROR: WDC: write: %s\n", strerror(-ret));
+		ret = -1;
 	}
 
-	ret = wdc_create_log_file(file, dump_data, data_len);
-
-	free(dump_data);
 	return ret;
 }
 
@@ -3249,13 +3297,12 @@ static int wdc_do_cap_telemetry_log(struct nvme_global_ctx *ctx,
 {
 	struct nvme_telemetry_log *log;
 	size_t full_size = 0;
-	int err = 0, output;
+	struct nvme_capture_file output;
+	int err = 0, ret;
 	__u32 host_gen = 1;
 	int ctrl_init = 0;
 	__u64 result;
 	void *buf = NULL;
-	__u8 *data_ptr = NULL;
-	int data_written = 0, data_remaining = 0;
 	struct nvme_id_ctrl ctrl;
 	__u64 capabilities = 0;
 
@@ -3317,11 +3364,11 @@ static int wdc_do_cap_telemetry_log(struct nvme_global_ctx *ctx,
 		return -EINVAL;
 	}
 
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	err = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE | NVME_CAPTURE_SYNC);
+	if (err) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n",
-				__func__, file, strerror(errno));
-		return output;
+				__func__, file, strerror(-err));
+		return err;
 	}
 
 	if (ctrl_init)
@@ -3343,39 +3390,15 @@ static int wdc_do_cap_telemetry_log(struct nvme_global_ctx *ctx,
 		goto close_output;
 	}
 
-	/*
-	 *Continuously pull data until the offset hits the end of the last
-	 *block.
-	 */
-	data_written = 0;
-	data_remaining = full_size;
-	data_ptr = (__u8 *)log;
-
-	while (data_remaining) {
-		data_written = write(output, data_ptr, data_remaining);
-
-		if (data_written < 0) {
-			data_remaining = data_written;
-			break;
-		} else if (data_written <= data_remaining) {
-			data_remaining -= data_written;
-			data_ptr += data_written;
-		} else {
-			/* Unexpected overwrite */
-			fprintf(stderr, "Failure: Unexpected telemetry log overwrite - data_remaining = 0x%x, data_written = 0x%x\n",
-					data_remaining, data_written);
-			break;
-		}
-	}
-
-	if (fsync(output) < 0) {
-		fprintf(stderr, "ERROR: %s: fsync: %s\n", __func__, strerror(errno));
-		err = -1;
-	}
-
+	/* the zero filled parts of the data areas are left as holes */
+	err = nvme_capture_file_write(&output, log, full_size);
 	free(log);
 close_output:
-	close(output);
+	ret = nvme_capture_file_close(&output);
+	if (ret && !err) {
+		fprintf(stderr, "ERROR: %s: write: %s\n", __func__, strerror(-ret));
+		err = -1;
+	}
 	return err;
 }
 
@@ -3439,14 +3462,9 @@ static int wdc_do_cap_dui_v1(struct nvme_transport_handle *hdl, char *file, __u3
 {
 	__s32 log_size = 0;
 	__u32 cap_dui_length = le32_to_cpu(log_hdr->log_size);
-	__u32 curr_data_offset = 0;
-	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
-	bool last_xfer = false;
+	struct nvme_capture_file output;
 	int err;
-	int i;
 	int j;
-	int output;
 	int ret = 0;
 
 	if (verbose) {
@@ -3480,67 +3498,31 @@ static int wdc_do_cap_dui_v1(struct nvme_transport_handle *hdl, char *file, __u3
 
 	*total_size = log_size;
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size);
-	if (!dump_data) {
-		fprintf(stderr, "%s: ERROR: dump data V1 malloc failed : status %s, size = 0x%x\n",
-			__func__, strerror(errno), (unsigned int)xfer_size);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	err = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE);
+	if (err) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n", __func__, file,
-			strerror(errno));
-		free(dump_data);
-		return output;
+			strerror(-err));
+		return err;
 	}
 
 	/* write the telemetry and log headers into the dump_file */
-	err = write(output, (void *)log_hdr, WDC_NVME_CAP_DUI_HEADER_SIZE);
-	if (err != WDC_NVME_CAP_DUI_HEADER_SIZE) {
+	err = nvme_capture_file_write(&output, log_hdr, WDC_NVME_CAP_DUI_HEADER_SIZE);
+	if (err) {
 		fprintf(stderr, "%s: Failed to flush header data to file!\n", __func__);
-		goto free_mem;
+		nvme_capture_file_close(&output);
+		return -1;
 	}
 
-	log_size -= WDC_NVME_CAP_DUI_HEADER_SIZE;
-	curr_data_offset = WDC_NVME_CAP_DUI_HEADER_SIZE;
-	i = 0;
-	buffer_addr = dump_data;
-
-	for (; log_size > 0; log_size -= xfer_size) {
-		xfer_size = min(xfer_size, log_size);
-
-		if (log_size <= xfer_size)
-			last_xfer = true;
-
-		ret = wdc_dump_dui_data(hdl, xfer_size, curr_data_offset, buffer_addr, last_xfer);
-		if (ret) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Get chunk %d, size = 0x%"PRIx64", offset = 0x%x, addr = %p\n",
-				__func__, i, (uint64_t)log_size, curr_data_offset, buffer_addr);
-			fprintf(stderr, "%s: ERROR: WDC: ", __func__);
-			nvme_show_status(ret);
-			break;
-		}
-
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size);
-		if (err != xfer_size) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size = 0x%x\n",
-				__func__, i, err, xfer_size);
-			ret = -1;
-			goto free_mem;
-		}
+	if (log_size > WDC_NVME_CAP_DUI_HEADER_SIZE)
+		ret = wdc_dui_capture(hdl, &output, xfer_size, WDC_NVME_CAP_DUI_HEADER_SIZE,
+				      log_size - WDC_NVME_CAP_DUI_HEADER_SIZE, false, __func__);
 
-		curr_data_offset += xfer_size;
-		i++;
+	err = nvme_capture_file_close(&output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: Failed to flush DUI data to file! %s\n", __func__,
+			strerror(-err));
+		ret = -1;
 	}
-
-free_mem:
-	close(output);
-	free(dump_data);
 	return ret;
 }
 
@@ -3551,14 +3533,9 @@ static int wdc_do_cap_dui_v2_v3(struct nvme_transport_handle *hdl, char *file, _
 	__u64 cap_dui_length_v3;
 	__u64 curr_data_offset = 0;
 	__s64 log_size = 0;
-	__u64 xfer_size_long = (__u64)xfer_size;
-	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
-	bool last_xfer = false;
-	int err;
-	int i;
+	struct nvme_capture_file output;
 	int j;
-	int output;
+	int err;
 	int ret = 0;
 	struct wdc_dui_log_hdr_v3 *log_hdr_v3 = (struct wdc_dui_log_hdr_v3 *)log_hdr;
 
@@ -3613,21 +3590,11 @@ static int wdc_do_cap_dui_v2_v3(struct nvme_transport_handle *hdl, char *file, _
 		return -1;
 	}
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size_long);
-	if (!dump_data) {
-		fprintf(stderr,
-			"%s: ERROR: dump data v3 malloc failed : status %s, size = 0x%"PRIx64"\n",
-			__func__, strerror(errno), (uint64_t)xfer_size_long);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size_long);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	err = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE);
+	if (err) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n",
-				__func__, file, strerror(errno));
-		free(dump_data);
-		return output;
+				__func__, file, strerror(-err));
+		return err;
 	}
 
 	curr_data_offset = 0;
@@ -3648,44 +3615,15 @@ static int wdc_do_cap_dui_v2_v3(struct nvme_transport_handle *hdl, char *file, _
 		curr_data_offset = offset;
 	}
 
-	i = 0;
-	buffer_addr = dump_data;
-
-	for (; log_size > 0; log_size -= xfer_size_long) {
-		xfer_size_long = min(xfer_size_long, log_size);
-
-		if (log_size <= xfer_size_long)
-			last_xfer = true;
-
-		ret = wdc_dump_dui_data_v2(hdl, (__u32)xfer_size_long, curr_data_offset, buffer_addr,
-					   last_xfer);
-		if (ret) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Get chunk %d, size = 0x%"PRIx64", offset = 0x%"PRIx64", addr = %p\n",
-				__func__, i, (uint64_t)*total_size, (uint64_t)curr_data_offset,
-				buffer_addr);
-			fprintf(stderr, "%s: ERROR: WDC: ", __func__);
-			nvme_show_status(ret);
-			break;
-		}
-
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size_long);
-		if (err != xfer_size_long) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size = 0x%"PRIx64"\n",
-				__func__, i, err, (uint64_t)xfer_size_long);
-			ret = -1;
-			goto free_mem;
-		}
+	ret = wdc_dui_capture(hdl, &output, xfer_size, curr_data_offset, log_size, true,
+			      __func__);
 
-		curr_data_offset += xfer_size_long;
-		i++;
+	err = nvme_capture_file_close(&output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: Failed to flush DUI data to file! %s\n", __func__,
+			strerror(-err));
+		ret = -1;
 	}
-
-free_mem:
-	close(output);
-	free(dump_data);
 	return ret;
 }
 
@@ -3695,17 +3633,12 @@ static int wdc_do_cap_dui_v4(struct nvme_transport_handle *hdl, char *file, __u3
 {
 	__s64 log_size = 0;
 	__s64 section_size_bytes = 0;
-	__s64 xfer_size_long = (__s64)xfer_size;
 	__u64 cap_dui_length_v4;
 	__u64 curr_data_offset = 0;
-	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
-	int err;
-	int i;
+	struct nvme_capture_file output;
 	int j;
-	int output;
+	int err;
 	int ret = 0;
-	bool last_xfer = false;
 	struct wdc_dui_log_hdr_v4 *log_hdr_v4 = (struct wdc_dui_log_hdr_v4 *)log_hdr;
 
 	cap_dui_length_v4 = le64_to_cpu(log_hdr_v4->log_size_sectors) * WDC_NVME_SN730_SECTOR_SIZE;
@@ -3755,20 +3688,11 @@ static int wdc_do_cap_dui_v4(struct nvme_transport_handle *hdl, char *file, __u3
 		return -1;
 	}
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size_long);
-	if (!dump_data) {
-		fprintf(stderr, "%s: ERROR: dump data V4 malloc failed : status %s, size = 0x%x\n",
-			__func__, strerror(errno), (unsigned int)xfer_size_long);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size_long);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
-		fprintf(stderr, "%s: Failed to open output file %s: %s!\n", __func__, file,
-			strerror(errno));
-		free(dump_data);
-		return output;
+	err = nvme_capture_file_open(&output, file, NVME_CAPTURE_SPARSE);
+	if (err) {
+		fprintf(stderr, "%s: Failed to open output file %s: %s!\n",
+				__func__, file, strerror(-err));
+		return err;
 	}
 
 	curr_data_offset = 0;
@@ -3789,43 +3713,15 @@ static int wdc_do_cap_dui_v4(struct nvme_transport_handle *hdl, char *file, __u3
 		curr_data_offset = offset;
 	}
 
-	i = 0;
-	buffer_addr = dump_data;
-
-	for (; log_size > 0; log_size -= xfer_size_long) {
-		xfer_size_long = min(xfer_size_long, log_size);
-
-		if (log_size <= xfer_size_long)
-			last_xfer = true;
-
-		ret = wdc_dump_dui_data_v2(hdl, (__u32)xfer_size_long, curr_data_offset, buffer_addr, last_xfer);
-		if (ret) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Get chunk %d, size = 0x%"PRIx64", offset = 0x%"PRIx64", addr = %p\n",
-				__func__, i, (uint64_t)log_size, (uint64_t)curr_data_offset,
-				buffer_addr);
-			fprintf(stderr, "%s: ERROR: WDC:", __func__);
-			nvme_show_status(ret);
-			break;
-		}
-
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size_long);
-		if (err != xfer_size_long) {
-			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size_long = 0x%"PRIx64"\n",
-				__func__, i, err, (uint64_t)xfer_size_long);
-			ret = -1;
-			goto free_mem;
-		}
+	ret = wdc_dui_capture(hdl, &output, xfer_size, curr_data_offset, log_size, true,
+			      __func__);
 
-		curr_data_offset += xfer_size_long;
-		i++;
+	err = nvme_capture_file_close(&output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: Failed to flush DUI data to file! %s\n", __func__,
+			strerror(-err));
+		ret = -1;
 	}
-
-free_mem:
-	close(output);
-	free(dump_data);
 	return ret;
 }
 
@@ -4039,6 +3935,25 @@ out:
 	return ret;
 }
 
+/* adds a bin file to a Drive Essentials or internal log archive */
+static int wdc_de_bundle_add(struct nvme_bundle *b, const char *fileName,
+			     const void *buffer, size_t bufferLen)
+{
+	int ret;
+
+	/* the size is known, the archive does not keep a copy of the buffer */
+	ret = nvme_bundle_begin(b, fileName, bufferLen);
+	if (!ret)
+		ret = nvme_bundle_append(b, fileName, buffer, bufferLen);
+
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: write of %s failed: %s\n", fileName, strerror(-ret));
+		return WDC_STATUS_UNABLE_TO_WRITE_ALL_DATA;
+	}
+
+	return WDC_STATUS_SUCCESS;
+}
+
 static int wdc_do_sn730_get_and_tar(struct nvme_transport_handle *hdl, char *outputName)
 {
 	int ret = 0;
@@ -4052,6 +3967,7 @@ static int wdc_do_sn730_get_and_tar(struct nvme_transport_handle *hdl, char *out
 	uint32_t core_dump_log_len = 0;
 	uint32_t extended_log_len = 0;
 	struct tarfile_metadata *tarInfo = NULL;
+	struct nvme_bundle *b = NULL;
 
 	tarInfo = (struct tarfile_metadata *)malloc(sizeof(struct tarfile_metadata));
 	if (!tarInfo) {
@@ -4061,7 +3977,7 @@ static int wdc_do_sn730_get_and_tar(struct nvme_transport_handle *hdl, char *out
 	}
 	memset(tarInfo, 0, sizeof(struct tarfile_metadata));
 
-	/* Create Logs directory */
+	/* Name the log archive */
 	wdc_UtilsGetTime(&tarInfo->timeInfo);
 	memset(tarInfo->timeString, 0, sizeof(tarInfo->timeString));
 	wdc_UtilsSnprintf((char *)tarInfo->timeString, MAX_PATH_LEN, "%02u%02u%02u_%02u%02u%02u",
@@ -4080,14 +3996,6 @@ static int wdc_do_sn730_get_and_tar(struct nvme_transport_handle *hdl, char *out
 		goto free_buf;
 	}
 
-	ret = wdc_UtilsCreateDir((char *)tarInfo->bufferFolderPath);
-	if (ret) {
-		fprintf(stderr, "ERROR: WDC: create directory failed, ret = %d, dir = %s\n", ret, tarInfo->bufferFolderPath);
-		goto free_buf;
-	} else {
-		fprintf(stderr, "Stored log files in directory: %s\n", tarInfo->bufferFolderPath);
-	}
-
 	ret = wdc_do_get_sn730_log_len(hdl, &full_log_len, SN730_GET_FULL_LOG_LENGTH);
 	if (ret) {
 		nvme_show_status(ret);
@@ -4148,32 +4056,31 @@ static int wdc_do_sn730_get_and_tar(struct nvme_transport_handle *hdl, char *out
 		goto free_buf;
 	}
 
-	/* Write log files */
-	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s%s%s_%s.bin", (char *)tarInfo->bufferFolderPath, WDC_DE_PATH_SEPARATOR,
-			"full_log", (char *)tarInfo->timeString);
-	wdc_WriteToFile(tarInfo->fileName, (char *)full_log_buf, full_log_len);
-
-	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s%s%s_%s.bin", (char *)tarInfo->bufferFolderPath, WDC_DE_PATH_SEPARATOR,
-			"key_log", (char *)tarInfo->timeString);
-	wdc_WriteToFile(tarInfo->fileName, (char *)key_log_buf, key_log_len);
+	/* the log files are streamed into the archive, no directory is created */
+	wdc_UtilsSnprintf(tarInfo->tarFileName, sizeof(tarInfo->tarFileName), "%s%s", (char *)tarInfo->bufferFolderPath, WDC_DE_TAR_FILE_EXTN);
+	ret = nvme_bundle_open(&b, tarInfo->tarFileName, tarInfo->bufferFolderName);
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: create archive failed, ret = %d, file = %s\n", ret, tarInfo->tarFileName);
+		goto free_buf;
+	}
 
-	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s%s%s_%s.bin", (char *)tarInfo->bufferFolderPath, WDC_DE_PATH_SEPARATOR,
-			"core_dump_log", (char *)tarInfo->timeString);
-	wdc_WriteToFile(tarInfo->fileName, (char *)core_dump_log_buf, core_dump_log_len);
+	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s_%s.bin", "full_log", (char *)tarInfo->timeString);
+	wdc_de_bundle_add(b, tarInfo->fileName, full_log_buf, full_log_len);
 
-	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s%s%s_%s.bin", (char *)tarInfo->bufferFolderPath, WDC_DE_PATH_SEPARATOR,
-			"extended_log", (char *)tarInfo->timeString);
-	wdc_WriteToFile(tarInfo->fileName, (char *)extended_log_buf, extended_log_len);
+	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s_%s.bin", "key_log", (char *)tarInfo->timeString);
+	wdc_de_bundle_add(b, tarInfo->fileName, key_log_buf, key_log_len);
 
-	/* Tar the log directory */
-	wdc_UtilsSnprintf(tarInfo->tarFileName, sizeof(tarInfo->tarFileName), "%s%s", (char *)tarInfo->bufferFolderPath, WDC_DE_TAR_FILE_EXTN);
-	wdc_UtilsSnprintf(tarInfo->tarFiles, sizeof(tarInfo->tarFiles), "%s%s%s", (char *)tarInfo->bufferFolderName, WDC_DE_PATH_SEPARATOR, WDC_DE_TAR_FILES);
-	wdc_UtilsSnprintf(tarInfo->tarCmd, sizeof(tarInfo->tarCmd), "%s %s %s", WDC_DE_TAR_CMD, (char *)tarInfo->tarFileName, (char *)tarInfo->tarFiles);
+	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s_%s.bin", "core_dump_log", (char *)tarInfo->timeString);
+	wdc_de_bundle_add(b, tarInfo->fileName, core_dump_log_buf, core_dump_log_len);
 
-	ret = system(tarInfo->tarCmd);
+	wdc_UtilsSnprintf(tarInfo->fileName, MAX_PATH_LEN, "%s_%s.bin", "extended_log", (char *)tarInfo->timeString);
+	wdc_de_bundle_add(b, tarInfo->fileName, extended_log_buf, extended_log_len);
 
+	ret = nvme_bundle_close(b);
 	if (ret)
-		fprintf(stderr, "ERROR: WDC: Tar of log data failed, ret = %d\n", ret);
+		fprintf(stderr, "ERROR: WDC: write of log archive %s failed, ret = %d\n", tarInfo->tarFileName, ret);
+	else
+		fprintf(stderr, "Stored log files in archive: %s\n", tarInfo->tarFileName);
 
 free_buf:
 	free(tarInfo);
@@ -4184,15 +4091,15 @@ free_buf:
 	return ret;
 }
 
-static int dump_internal_logs(struct nvme_transport_handle *hdl, const char *dir_name, int verbose)
+static int dump_internal_logs(struct nvme_transport_handle *hdl, struct nvme_bundle *b, int verbose)
 {
-	char file_path[PATH_MAX];
+	const char *file_name = "telemetry.bin";
 	void *telemetry_log;
 	const size_t bs = 512;
 	struct nvme_telemetry_log *hdr;
 	struct nvme_passthru_cmd cmd;
 	size_t full_size, offset = bs;
-	int err, output;
+	int err;
 
 	if (verbose)
 		printf("NVMe Telemetry log...\n");
@@ -4206,14 +4113,6 @@ static int dump_internal_logs(struct nvme_transport_handle *hdl, const char *dir
 	}
 	memset(hdr, 0, bs);
 
-	sprintf(file_path, "%s/telemetry.bin", dir_name);
-	output = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
-		fprintf(stderr, "Failed to open output file %s: %s!\n", file_path, strerror(errno));
-		err = output;
-		goto free_mem;
-	}
-
 	nvme_init_get_log(&cmd, NVME_NSID_ALL, NVME_LOG_LID_TELEMETRY_HOST,
 			  NVME_CSI_NVM, hdr, bs);
 	cmd.cdw10 |= NVME_FIELD_ENCODE(NVME_LOG_TELEM_HOST_LSP_CREATE,
@@ -4225,17 +4124,20 @@ static int dump_internal_logs(struct nvme_transport_handle *hdl, const char *dir
 	else if (err > 0) {
 		nvme_show_status(err);
 		fprintf(stderr, "Failed to acquire telemetry header %d!\n", err);
-		goto close_output;
+		goto free_mem;
 	}
 
-	err = write(output, (void *)hdr, bs);
-	if (err != bs) {
+	full_size = (le16_to_cpu(hdr->dalb3) * bs) + offset;
+
+	/* the log is streamed in 512 byte chunks, not held in memory */
+	err = nvme_bundle_begin(b, file_name, full_size);
+	if (!err)
+		err = nvme_bundle_append(b, file_name, hdr, bs);
+	if (err) {
 		fprintf(stderr, "Failed to flush all data to file!\n");
-		goto close_output;
+		goto free_mem;
 	}
 
-	full_size = (le16_to_cpu(hdr->dalb3) * bs) + offset;
-
 	while (offset != full_size) {
 		nvme_init_get_log(&cmd, NVME_NSID_ALL, NVME_LOG_LID_TELEMETRY_HOST,
 				  NVME_CSI_NVM, telemetry_log, bs);
@@ -4250,17 +4152,14 @@ static int dump_internal_logs(struct nvme_transport_handle *hdl, const char *dir
 			break;
 		}
 
-		err = write(output, (void *)telemetry_log, bs);
-		if (err != bs) {
+		err = nvme_bundle_append(b, file_name, telemetry_log, bs);
+		if (err) {
 			fprintf(stderr, "Failed to flush all data to file!\n");
 			break;
 		}
-		err = 0;
 		offset += bs;
 	}
 
-close_output:
-	close(output);
 free_mem:
 	free(hdr);
 	free(telemetry_log);
@@ -4315,8 +4214,9 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *acmd,
 	__u64 capabilities = 0;
 	__u32 device_id, read_vendor_id;
 	char file_path[PATH_MAX/2] = {0};
-	char cmd_buf[PATH_MAX] = {0};
-	int ret = -1;
+	struct nvme_bundle *b;
+	const char *root;
+	int ret = -1, err;
 
 	struct config {
 		char *file;
@@ -4481,33 +4381,29 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *acmd,
 			ret = wdc_do_cap_diag(ctx, hdl, f, xfer_size,
 					telemetry_type, telemetry_data_area);
 		} else {
-			if (cfg.verbose)
-				printf("Creating temp directory...\n");
-
-			ret = mkdir(fb, 0666);
+			/* the logs are streamed into the archive, no directory is created */
+			root = strrchr(fb, '/');
+			ret = nvme_bundle_open(&b, file_path, root ? root + 1 : fb);
 			if (ret) {
-				fprintf(stderr, "Failed to create directory!\n");
+				fprintf(stderr, "Failed to create an archive file: %s\n",
+					strerror(-ret));
 				goto out;
 			}
 
-			ret = dump_internal_logs(hdl, fb, cfg.verbose);
+			ret = dump_internal_logs(hdl, b, cfg.verbose);
 			if (ret < 0)
-				perror("vs-internal-log");
+				fprintf(stderr, "vs-internal-log: %s\n", strerror(-ret));
 
 			if (cfg.verbose)
 				printf("Archiving...\n");
 
-			if (snprintf(cmd_buf, PATH_MAX,
-				     "tar --remove-files -czf %s %s",
-				     file_path, fb) >= PATH_MAX) {
-				fprintf(stderr, "Command buffer is too long!\n");
-				ret = -1;
-				goto out;
+			err = nvme_bundle_close(b);
+			if (err) {
+				fprintf(stderr, "Failed to create an archive file: %s\n",
+					strerror(-err));
+				if (!ret)
+					ret = err;
 			}
-
-			ret = system(cmd_buf);
-			if (ret)
-				fprintf(stderr, "Failed to create an archive file!\n");
 		}
 		goto out;
 	}
@@ -9984,7 +9880,7 @@ end:
 	return ret;
 }
 
-static int wdc_de_get_dump_trace(struct nvme_transport_handle *hdl, const char *filePath, __u16 binFileNameLen,
+static int wdc_de_get_dump_trace(struct nvme_transport_handle *hdl, struct nvme_bundle *b,
 				 const char *binFileName)
 {
 	int ret = WDC_STATUS_FAILURE;
@@ -9999,7 +9895,7 @@ static int wdc_de_get_dump_trace(struct nvme_transport_handle *hdl, const char *
 	__u32 i;
 	__u32 maximumTransferLength = 0;
 
-	if (!binFileName || !filePath) {
+	if (!binFileName || !b) {
 		ret = WDC_STATUS_INVALID_PARAMETER;
 		return ret;
 	}
@@ -10064,9 +9960,9 @@ static int wdc_de_get_dump_trace(struct nvme_transport_handle *hdl, const char *
 	} while (0);
 
 	if (ret == WDC_STATUS_SUCCESS) {
-		ret = wdc_WriteToFile(binFileName, (char *)readBuffer, dumptraceSize);
+		ret = wdc_de_bundle_add(b, binFileName, readBuffer, dumptraceSize);
 		if (ret != WDC_STATUS_SUCCESS)
-			fprintf(stderr, "ERROR: WDC: %s: wdc_WriteToFile failed, ret = %d\n",
+			fprintf(stderr, "ERROR: WDC: %s: wdc_de_bundle_add failed, ret = %d\n",
 				__func__, ret);
 	} else {
 		fprintf(stderr, "ERROR: WDC: %s: Read Buffer Loop failed, ret = %d\n", __func__,
@@ -10080,7 +9976,7 @@ static int wdc_de_get_dump_trace(struct nvme_transport_handle *hdl, const char *
 
 int wdc_fetch_vu_file_directory(struct nvme_transport_handle *hdl,
 				struct WDC_DE_VU_LOG_DIRECTORY deEssentialsList,
-				__s8 *bufferFolderPath, __u8 *serialNo, __u8 *timeString)
+				struct nvme_bundle *b, __u8 *serialNo, __u8 *timeString)
 {
 	int ret = wdc_fetch_log_directory(hdl, &deEssentialsList);
 	__u32 listIdx;
@@ -10110,14 +10006,10 @@ int wdc_fetch_vu_file_directory(struct nvme_transport_handle *hdl,
 			/* Write databuffer to file */
 			if (ret == WDC_STATUS_SUCCESS) {
 				memset(fileName, 0, sizeof(fileName));
-				wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+				wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin",
 						deEssentialsList.logEntry[listIdx].metaData.fileName, serialNo, timeString);
-				if (deEssentialsList.logEntry[listIdx].metaData.fileSize > 0xFFFFFFFF) {
-					wdc_WriteToFile(fileName, dataBuffer, 0xFFFFFFFF);
-					wdc_WriteToFile(fileName, dataBuffer + 0xFFFFFFFF, (__u32)(deEssentialsList.logEntry[listIdx].metaData.fileSize - 0xFFFFFFFF));
-				} else {
-					wdc_WriteToFile(fileName, dataBuffer, (__u32)deEssentialsList.logEntry[listIdx].metaData.fileSize);
-				}
+				wdc_de_bundle_add(b, fileName, dataBuffer,
+						  (size_t)deEssentialsList.logEntry[listIdx].metaData.fileSize);
 			} else {
 				fprintf(stderr, "ERROR: WDC: wdc_fetch_log_file_from_device: %s failed, ret = %d\n",
 						deEssentialsList.logEntry[listIdx].metaData.fileName, ret);
@@ -10129,7 +10021,7 @@ int wdc_fetch_vu_file_directory(struct nvme_transport_handle *hdl,
 	return ret;
 }
 
-int wdc_read_debug_directory(struct nvme_transport_handle *hdl, __s8 *bufferFolderPath, __u8 *serialNo,
+int wdc_read_debug_directory(struct nvme_transport_handle *hdl, struct nvme_bundle *b, __u8 *serialNo,
 			     __u8 *timeString)
 {
 	__u32 maxNumOfVUFiles = 0;
@@ -10146,7 +10038,7 @@ int wdc_read_debug_directory(struct nvme_transport_handle *hdl, __s8 *bufferFold
 	    (struct WDC_DRIVE_ESSENTIALS *)calloc(1, sizeof(struct WDC_DRIVE_ESSENTIALS) * maxNumOfVUFiles);
 	deEssentialsList.maxNumLogEntries = maxNumOfVUFiles;
 
-	ret = wdc_fetch_vu_file_directory(hdl, deEssentialsList, bufferFolderPath, serialNo,
+	ret = wdc_fetch_vu_file_directory(hdl, deEssentialsList, b, serialNo,
 					  timeString);
 
 	free(deEssentialsList.logEntry);
@@ -10164,8 +10056,7 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	__s8 bufferFolderPath[MAX_PATH_LEN];
 	char bufferFolderName[MAX_PATH_LEN];
 	char tarFileName[MAX_PATH_LEN];
-	char tarFiles[MAX_PATH_LEN];
-	char tarCmd[MAX_PATH_LEN+MAX_PATH_LEN];
+	struct nvme_bundle *b;
 	UtilsTimeInfo timeInfo;
 	__u8 timeString[MAX_PATH_LEN];
 	__u8 serialNo[WDC_SERIAL_NO_LEN];
@@ -10190,8 +10081,6 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	memset(bufferFolderPath, 0, sizeof(bufferFolderPath));
 	memset(bufferFolderName, 0, sizeof(bufferFolderName));
 	memset(tarFileName, 0, sizeof(tarFileName));
-	memset(tarFiles, 0, sizeof(tarFiles));
-	memset(tarCmd, 0, sizeof(tarCmd));
 	memset(&timeInfo, 0, sizeof(timeInfo));
 
 	if (wdc_get_serial_and_fw_rev(hdl, (char *)idSerialNo, (char *)idFwRev)) {
@@ -10202,7 +10091,7 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	fprintf(stderr, "Get Drive Essentials Data for device serial #: %s and fw revision: %s\n",
 		idSerialNo, idFwRev);
 
-	/* Create Drive Essentials directory */
+	/* Name the Drive Essentials archive */
 	wdc_UtilsGetTime(&timeInfo);
 	memset(timeString, 0, sizeof(timeString));
 	wdc_UtilsSnprintf((char *)timeString, MAX_PATH_LEN, "%02u%02u%02u_%02u%02u%02u",
@@ -10235,35 +10124,38 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 		}
 	}
 
-	ret = wdc_UtilsCreateDir((char *)bufferFolderPath);
+	/* the bin files are streamed into the archive, no directory is created */
+	wdc_UtilsSnprintf(tarFileName, sizeof(tarFileName), "%s%s", (char *)bufferFolderPath, WDC_DE_TAR_FILE_EXTN);
+	ret = nvme_bundle_open(&b, tarFileName, bufferFolderName);
 	if (ret) {
-		fprintf(stderr, "ERROR: WDC: create directory failed, ret = %d, dir = %s\n", ret, bufferFolderPath);
+		fprintf(stderr, "ERROR: WDC: create archive failed, ret = %d, file = %s\n", ret, tarFileName);
 		return -1;
 	}
 
-	fprintf(stderr, "Store Drive Essentials bin files in directory: %s\n", bufferFolderPath);
+	fprintf(stderr, "Store Drive Essentials bin files in archive: %s\n", tarFileName);
 
 	/* Get Identify Controller Data */
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
 	ret = nvme_identify_ctrl(hdl, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed, ret = %d\n", ret);
+		nvme_bundle_close(b);
+		unlink(tarFileName);
 		return -1;
 	}
 
-	wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath,
-			  WDC_DE_PATH_SEPARATOR, "IdentifyController", (char *)serialNo,
+	wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin", "IdentifyController", (char *)serialNo,
 			  (char *)timeString);
-	wdc_WriteToFile(fileName, (char *)&ctrl, sizeof(struct nvme_id_ctrl));
+	wdc_de_bundle_add(b, fileName, &ctrl, sizeof(struct nvme_id_ctrl));
 
 	memset(&ns, 0, sizeof(struct nvme_id_ns));
 	ret = nvme_identify_ns(hdl, 1, &ns);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ns() failed, ret = %d\n", ret);
 	} else {
-		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin",
 				"IdentifyNamespace", (char *)serialNo, (char *)timeString);
-		wdc_WriteToFile(fileName, (char *)&ns, sizeof(struct nvme_id_ns));
+		wdc_de_bundle_add(b, fileName, &ns, sizeof(struct nvme_id_ns));
 	}
 
 	/* Get Log Pages (0x01, 0x02, 0x03, 0xC0 and 0xE3) */
@@ -10276,9 +10168,9 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_error_log() failed, ret = %d\n", ret);
 	} else {
-		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin",
 				"ErrorLog", (char *)serialNo, (char *)timeString);
-		wdc_WriteToFile(fileName, (char *)elogBuffer, elogBufferSize);
+		wdc_de_bundle_add(b, fileName, elogBuffer, elogBufferSize);
 	}
 
 	free(dataBuffer);
@@ -10290,9 +10182,9 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_smart_log() failed, ret = %d\n", ret);
 	} else {
-		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin",
 				"SmartLog", (char *)serialNo, (char *)timeString);
-		wdc_WriteToFile(fileName, (char *)&smart_log, sizeof(struct nvme_smart_log));
+		wdc_de_bundle_add(b, fileName, &smart_log, sizeof(struct nvme_smart_log));
 	}
 
 	/* Get FW Slot log page */
@@ -10301,9 +10193,9 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_fw_log() failed, ret = %d\n", ret);
 	} else {
-		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+		wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin",
 				"FwSLotLog", (char *)serialNo, (char *)timeString);
-		wdc_WriteToFile(fileName, (char *)&fw_log, sizeof(struct nvme_firmware_slot));
+		wdc_de_bundle_add(b, fileName, &fw_log, sizeof(struct nvme_firmware_slot));
 	}
 
 	/* Get VU log pages */
@@ -10324,9 +10216,9 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 					deVULogPagesList[vuLogIdx].logPageId, ret);
 		} else {
 			wdc_UtilsDeleteCharFromString((char *)deVULogPagesList[vuLogIdx].logPageIdStr, 4, ' ');
-			wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+			wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s_%s.bin",
 					"LogPage", (char *)&deVULogPagesList[vuLogIdx].logPageIdStr, (char *)serialNo, (char *)timeString);
-			wdc_WriteToFile(fileName, (char *)dataBuffer, dataBufferSize);
+			wdc_de_bundle_add(b, fileName, dataBuffer, dataBufferSize);
 		}
 
 		free(dataBuffer);
@@ -10349,37 +10241,27 @@ static int wdc_do_drive_essentials(struct nvme_global_ctx *ctx, struct nvme_tran
 			fprintf(stderr, "ERROR: WDC: nvme_get_feature id 0x%x failed, ret = %d\n",
 					deFeatureIdList[listIdx].featureId, ret);
 		} else {
-			wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s0x%x_%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR,
+			wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s0x%x_%s_%s_%s.bin",
 					"FEATURE_ID_", deFeatureIdList[listIdx].featureId,
 					deFeatureIdList[listIdx].featureName, serialNo, timeString);
-			wdc_WriteToFile(fileName, (char *)featureIdBuff, sizeof(featureIdBuff));
+			wdc_de_bundle_add(b, fileName, featureIdBuff, sizeof(featureIdBuff));
 		}
 	}
 
-	ret = wdc_read_debug_directory(hdl, bufferFolderPath, serialNo, timeString);
+	ret = wdc_read_debug_directory(hdl, b, serialNo, timeString);
 
 	/* Get Dump Trace Data */
-	wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s%s%s_%s_%s.bin", (char *)bufferFolderPath, WDC_DE_PATH_SEPARATOR, "dumptrace", serialNo, timeString);
-	ret = wdc_de_get_dump_trace(hdl, (char *)bufferFolderPath, 0, fileName);
+	wdc_UtilsSnprintf(fileName, MAX_PATH_LEN, "%s_%s_%s.bin", "dumptrace", serialNo, timeString);
+	ret = wdc_de_get_dump_trace(hdl, b, fileName);
 	if (ret != WDC_STATUS_SUCCESS)
 		fprintf(stderr, "ERROR: WDC: wdc_de_get_dump_trace failed, ret = %d\n", ret);
 
-	/* Tar the Drive Essentials directory */
-	wdc_UtilsSnprintf(tarFileName, sizeof(tarFileName), "%s%s", (char *)bufferFolderPath, WDC_DE_TAR_FILE_EXTN);
-	if (dir)
-		wdc_UtilsSnprintf(tarFiles, sizeof(tarFiles), "%s%s%s%s%s", (char *)dir,
-				  WDC_DE_PATH_SEPARATOR, (char *)bufferFolderName,
-				  WDC_DE_PATH_SEPARATOR, WDC_DE_TAR_FILES);
-	else
-		wdc_UtilsSnprintf(tarFiles, sizeof(tarFiles), "%s%s%s", (char *)bufferFolderName,
-				  WDC_DE_PATH_SEPARATOR, WDC_DE_TAR_FILES);
-	wdc_UtilsSnprintf(tarCmd, sizeof(tarCmd), "%s %s %s", WDC_DE_TAR_CMD, (char *)tarFileName, (char *)tarFiles);
-
-	ret = system(tarCmd);
-
-	if (ret)
-		fprintf(stderr, "ERROR: WDC: Tar of Drive Essentials data failed, ret = %d\n",
-			ret);
+	ret = nvme_bundle_close(b);
+	if (ret) {
+		fprintf(stderr, "ERROR: WDC: write of Drive Essentials archive %s failed, ret = %d\n",
+			tarFileName, ret);
+		return -1;
+	}
 
 	fprintf(stderr, "Get of Drive Essentials data successful\n");
 	return 0;
@@ -90,49 +90,6 @@ int wdc_UtilsGetTime(PUtilsTimeInfo timeInfo)
 	return WDC_STATUS_SUCCESS;
 }
 
-int wdc_UtilsCreateDir(const char *path)
-{
-	int retStatus;
-	int status = WDC_STATUS_SUCCESS;
-
-	if (!path)
-		return WDC_STATUS_INVALID_PARAMETER;
-
-	retStatus = mkdir(path, 0x999);
-	if (retStatus < 0) {
-		if (errno == EEXIST)
-			status = WDC_STATUS_DIR_ALREADY_EXISTS;
-		else if (errno == ENOENT)
-			status = WDC_STATUS_PATH_NOT_FOUND;
-		else
-			status = WDC_STATUS_CREATE_DIRECTORY_FAILED;
-	}
-
-	return status;
-}
-
-int wdc_WriteToFile(const char *fileName, const char *buffer, unsigned int bufferLen)
-{
-	int          status = WDC_STATUS_SUCCESS;
-	FILE         *file;
-	size_t       bytesWritten = 0;
-
-	file = fopen(fileName, "ab+");
-	if (!file) {
-		status = WDC_STATUS_UNABLE_TO_OPEN_FILE;
-		goto end;
-	}
-
-	bytesWritten = fwrite(buffer, 1, bufferLen, file);
-	if (bytesWritten != bufferLen)
-		status = WDC_STATUS_UNABLE_TO_WRITE_ALL_DATA;
-
-end:
-	if (file)
-		fclose(file);
-	return status;
-}
-
 /**
  * Compares the strings ignoring their cases.
  *
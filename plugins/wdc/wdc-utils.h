@@ -74,7 +74,5 @@ int wdc_UtilsSnprintf(char *buffer, unsigned int sizeOfBuffer, const char *forma
 void wdc_UtilsDeleteCharFromString(char* buffer, int buffSize, char charToRemove);
 int wdc_UtilsGetTime(PUtilsTimeInfo timeInfo);
 int wdc_UtilsStrCompare(const char *pcSrc, const char *pcDst);
-int wdc_UtilsCreateDir(const char *path);
-int wdc_WriteToFile(const char *fileName, const char *buffer, unsigned int bufferLen);
 void wdc_StrFormat(char *formatter, size_t fmt_sz, char *tofmt, size_t tofmtsz);
 bool wdc_CheckUuidListSupport(struct nvme_transport_handle *hdl, struct nvme_id_uuid_list *uuid_list);
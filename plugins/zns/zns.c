@@ -12,6 +12,7 @@
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
+#include "nvme-ioq.h"
 #include "nvme-print.h"
 #include "util/cleanup.h"
 
@@ -772,6 +773,357 @@ static int zone_mgmt_recv(int argc, char **argv, struct command *acmd, struct pl
 	return err;
 }
 
+/* one report or append transfer, when MDTS or ZASL do not limit it */
+#define ZONE_MAX_XFER			(1024 * 1024)
+#define ZONE_INDEX_MAGIC		"NVMEZIDX"
+#define ZONE_INDEX_VERSION		1
+
+/*
+ * All zones of a report kept in one buffer behind a zone report header,
+ * so the zone list can be printed with a single nvme_show_zns_report_zones().
+ */
+struct zone_index {
+	struct nvme_zone_report	*report;
+	__u64			nr;
+	__u32			desc_size;
+	__u32			nsid;
+	__u64			zsze;
+	__u64			first;
+	__u32			chunk;
+	__u64			next;
+	__u64			end;	/* where a report first came up short */
+	bool			extended;
+	bool			partial;
+};
+
+struct zone_index_hdr {
+	char	magic[8];
+	__le32	version;
+	__le32	rsvd12;
+	__le64	nr_zones;
+	__le64	zsze;
+};
+
+struct zone_index_rec {
+	__le64	zslba;
+	__le64	wp;
+	__le64	zcap;
+	__u8	zt;
+	__u8	zs;
+	__u8	za;
+	__u8	zai;
+	__u8	rsvd28[4];
+};
+
+struct zone_filter {
+	__u32	states;		/* bitmap of zone states, 0 for all */
+	int	fill_min;	/* percent of the capacity written, -1 unset */
+	int	fill_max;
+};
+
+/* the minimum memory page size is assumed to be 4 KiB */
+static __u64 zone_max_xfer(struct nvme_transport_handle *hdl, bool append)
+{
+	struct nvme_zns_id_ctrl zctrl;
+	struct nvme_passthru_cmd cmd;
+	struct nvme_id_ctrl ctrl;
+	__u64 xfer = ZONE_MAX_XFER;
+	__u8 limit = 0;
+
+	if (!nvme_identify_ctrl(hdl, &ctrl))
+		limit = ctrl.mdts;
+
+	/* a zero Zone Append Size Limit refers to MDTS */
+	if (append) {
+		nvme_init_zns_identify_ctrl(&cmd, &zctrl);
+		if (!nvme_submit_admin_passthru(hdl, &cmd) && zctrl.zasl)
+			limit = zctrl.zasl;
+	}
+
+	if (limit && limit < 20)
+		xfer = min(xfer, 4096ULL << limit);
+
+	return xfer;
+}
+
+static struct nvme_zns_desc *zone_index_desc(struct zone_index *zi, __u64 i)
+{
+	return (void *)zi->report->entries + i * zi->desc_size;
+}
+
+static __u64 zone_written(struct nvme_zns_desc *desc)
+{
+	switch (desc->zs >> 4) {
+	case NVME_ZNS_ZS_EMPTY:
+	case NVME_ZNS_ZS_OFFLINE:
+		return 0;
+	case NVME_ZNS_ZS_FULL:
+	case NVME_ZNS_ZS_READ_ONLY:
+		return le64_to_cpu(desc->zcap);
+	default:
+		return le64_to_cpu(desc->wp) - le64_to_cpu(desc->zslba);
+	}
+}
+
+static int zone_report_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			    void *buf)
+{
+	struct zone_index *zi = q->priv;
+	__u64 n;
+
+	if (zi->next >= zi->nr)
+		return 0;
+
+	n = min(zi->nr - zi->next, (__u64)zi->chunk);
+	nvme_init_zns_report_zones(cmd, zi->nsid,
+				   (zi->first + zi->next) * zi->zsze,
+				   NVME_ZNS_ZRAS_REPORT_ALL, zi->extended,
+				   zi->partial, buf,
+				   sizeof(struct nvme_zone_report) +
+				   n * zi->desc_size);
+	zi->next += n;
+
+	return 1;
+}
+
+static int zone_report_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			    void *buf, int err)
+{
+	struct zone_index *zi = q->priv;
+	struct nvme_zone_report *r = buf;
+	__u64 slba = cmd->cdw10 | (__u64)cmd->cdw11 << 32;
+	__u64 idx = slba / zi->zsze - zi->first, n;
+
+	if (err) {
+		nvme_show_err("zns report-zones", err);
+		return err;
+	}
+
+	n = (cmd->data_len - sizeof(*r)) / zi->desc_size;
+	if (le64_to_cpu(r->nr_zones) < n) {
+		/* the namespace ends here, no zones follow */
+		n = le64_to_cpu(r->nr_zones);
+		zi->end = min(zi->end, idx + n);
+	}
+	memcpy(zone_index_desc(zi, idx), r->entries, n * zi->desc_size);
+
+	return 0;
+}
+
+/*
+ * Without a state filter the zones are contiguous and of the same size, so
+ * the reports of disjoint zone ranges can be requested concurrently. The
+ * index is trimmed to the first report which came up short, the
+ * descriptors behind it are not filled in.
+ */
+static int zone_index_fetch(struct nvme_transport_handle *hdl,
+			    struct zone_index *zi, unsigned int qd)
+{
+	struct nvme_ioq q = {
+		.hdl = hdl,
+		.depth = qd,
+		.buf_size = sizeof(struct nvme_zone_report) +
+			zi->chunk * zi->desc_size,
+		.prep = zone_report_prep,
+		.done = zone_report_done,
+		.priv = zi,
+	};
+	int err;
+
+	zi->next = 0;
+	zi->end = zi->nr;
+
+	err = nvme_ioq_run(&q);
+	if (!err)
+		zi->nr = zi->end;
+
+	return err;
+}
+
+/* zones filtered by state follow each other, request them one by one */
+static int zone_index_fetch_state(struct nvme_transport_handle *hdl,
+				  struct zone_index *zi, __u64 zslba,
+				  int state, bool partial)
+{
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	struct nvme_passthru_cmd cmd;
+	struct nvme_zone_report *r;
+	__u64 got = 0, n;
+	__u32 len;
+	int err;
+
+	len = sizeof(*r) + zi->chunk * zi->desc_size;
+	r = nvme_alloc_huge(len, &mh);
+	if (!r)
+		return -ENOMEM;
+
+	while (got < zi->nr) {
+		n = min(zi->nr - got, (__u64)zi->chunk);
+		nvme_init_zns_report_zones(&cmd, zi->nsid, zslba, state,
+					   zi->extended, partial, r,
+					   sizeof(*r) + n * zi->desc_size);
+		err = nvme_submit_io_passthru(hdl, &cmd);
+		if (err) {
+			nvme_show_err("zns report-zones", err);
+			return err;
+		}
+
+		n = min(n, le64_to_cpu(r->nr_zones));
+		if (!n)
+			break;
+
+		memcpy(zone_index_desc(zi, got), r->entries, n * zi->desc_size);
+		got += n;
+		zslba = le64_to_cpu(zone_index_desc(zi, got - 1)->zslba) +
+			zi->zsze;
+	}
+
+	zi->nr = got;
+
+	return 0;
+}
+
+static int zone_filter_parse(const char *str, struct zone_filter *f)
+{
+	static const struct {
+		const char	*name;
+		int		state;
+	} states[] = {
+		{ "empty",	NVME_ZNS_ZS_EMPTY },
+		{ "imp-open",	NVME_ZNS_ZS_IMPL_OPEN },
+		{ "exp-open",	NVME_ZNS_ZS_EXPL_OPEN },
+		{ "closed",	NVME_ZNS_ZS_CLOSED },
+		{ "read-only",	NVME_ZNS_ZS_READ_ONLY },
+		{ "full",	NVME_ZNS_ZS_FULL },
+		{ "offline",	NVME_ZNS_ZS_OFFLINE },
+	};
+	_cleanup_free_ char *s = strdup(str);
+	char *tok, *save;
+	unsigned int i;
+	int v;
+
+	if (!s)
+		return -ENOMEM;
+
+	f->states = 0;
+	f->fill_min = -1;
+	f->fill_max = -1;
+
+	for (tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (sscanf(tok, "fill>%d", &v) == 1) {
+			f->fill_min = v;
+			continue;
+		}
+		if (sscanf(tok, "fill<%d", &v) == 1) {
+			f->fill_max = v;
+			continue;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(states); i++) {
+			if (!strcmp(tok, states[i].name)) {
+				f->states |= 1 << states[i].state;
+				break;
+			}
+		}
+		if (i == ARRAY_SIZE(states)) {
+			nvme_show_error("invalid zone filter '%s'", tok);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static bool zone_filter_match(struct zone_filter *f, struct nvme_zns_desc *desc)
+{
+	__u64 zcap = le64_to_cpu(desc->zcap);
+	__u64 fill = zcap ? zone_written(desc) * 100 / zcap : 0;
+
+	if (f->states && !(f->states & (1 << (desc->zs >> 4))))
+		return false;
+	if (f->fill_min >= 0 && fill <= f->fill_min)
+		return false;
+	if (f->fill_max >= 0 && fill >= f->fill_max)
+		return false;
+
+	return true;
+}
+
+static void zone_index_filter(struct zone_index *zi, struct zone_filter *f)
+{
+	__u64 i, n = 0;
+
+	for (i = 0; i < zi->nr; i++) {
+		if (!zone_filter_match(f, zone_index_desc(zi, i)))
+			continue;
+		if (i != n)
+			memcpy(zone_index_desc(zi, n), zone_index_desc(zi, i),
+			       zi->desc_size);
+		n++;
+	}
+
+	zi->nr = n;
+}
+
+static void zone_index_summary(struct zone_index *zi)
+{
+	__u64 count[16] = { 0 }, zcap = 0, written = 0, i;
+	struct nvme_zns_desc *desc;
+	int zs;
+
+	for (i = 0; i < zi->nr; i++) {
+		desc = zone_index_desc(zi, i);
+		count[desc->zs >> 4]++;
+		zcap += le64_to_cpu(desc->zcap);
+		written += zone_written(desc);
+	}
+
+	printf("zones     : %"PRIu64"\n", (uint64_t)zi->nr);
+	for (zs = 0; zs < 16; zs++)
+		if (count[zs])
+			printf("%-10s: %"PRIu64"\n", nvme_zone_state_to_string(zs),
+			       (uint64_t)count[zs]);
+	printf("capacity  : %"PRIu64" blocks\n", (uint64_t)zcap);
+	printf("written   : %"PRIu64" blocks (%.1f%%)\n", (uint64_t)written,
+	       zcap ? written * 100.0 / zcap : 0);
+}
+
+static int zone_index_dump(struct zone_index *zi, const char *path)
+{
+	struct zone_index_hdr hdr = {
+		.magic = ZONE_INDEX_MAGIC,
+		.version = cpu_to_le32(ZONE_INDEX_VERSION),
+		.nr_zones = cpu_to_le64(zi->nr),
+		.zsze = cpu_to_le64(zi->zsze),
+	};
+	_cleanup_file_ FILE *f = NULL;
+	struct zone_index_rec rec = { 0 };
+	struct nvme_zns_desc *desc;
+	__u64 i;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		return -errno;
+
+	for (i = 0; i < zi->nr; i++) {
+		desc = zone_index_desc(zi, i);
+		rec.zslba = desc->zslba;
+		rec.wp = desc->wp;
+		rec.zcap = desc->zcap;
+		rec.zt = desc->zt;
+		rec.zs = desc->zs;
+		rec.za = desc->za;
+		rec.zai = desc->zai;
+		if (fwrite(&rec, sizeof(rec), 1, f) != 1)
+			return -errno;
+	}
+
+	return fflush(f) ? -errno : 0;
+}
+
 static int report_zones(int argc, char **argv, struct command *acmd, struct plugin *plugin)
 {
 	const char *desc = "Retrieve the Report Zones data structure";
@@ -781,26 +1133,26 @@ static int report_zones(int argc, char **argv, struct command *acmd, struct plug
 	const char *ext = "set to use the extended report zones";
 	const char *part = "set to use the partial report";
 	const char *verbose = "show report zones verbosity";
+	const char *queue_depth = "number of report commands kept in flight";
+	const char *filter = "only show zones matching a comma separated list of states\n"
+		"(empty, imp-open, exp-open, closed, read-only, full, offline)\n"
+		"and fill levels in percent of the capacity (fill>N, fill<N)";
+	const char *summary = "show zone statistics instead of the zones";
+	const char *index_file = "write a compact binary zone index to this file";
 
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
 	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
-	struct nvme_zone_report *report, *buff;
+	_cleanup_free_ struct nvme_zone_report *buff = NULL;
 	struct nvme_passthru_cmd cmd;
+	struct zone_filter zf = { 0 };
+	struct zone_index zi = { 0 };
 	nvme_print_flags_t flags;
 	int zdes = 0, err = -1;
-	__u32 report_size;
-
-	unsigned int nr_zones_chunks = 1024,   /* 1024 entries * 64 bytes per entry = 64k byte transfer */
-			nr_zones_retrieved = 0,
-			nr_zones,
-			log_len;
-	__u64 offset;
-	int total_nr_zones = 0;
+	__u64 total_nr_zones, xfer;
 	struct nvme_zns_id_ns id_zns;
 	struct nvme_id_ns id_ns;
 	uint8_t lbaf;
-	__le64	zsze;
 	struct json_object *zone_list = NULL;
 
 	struct config {
@@ -812,11 +1164,18 @@ static int report_zones(int argc, char **argv, struct command *acmd, struct plug
 		bool  verbose;
 		bool  extended;
 		bool  partial;
+		__u32 qd;
+		char  *filter;
+		bool  summary;
+		char  *index_file;
 	};
 
 	struct config cfg = {
 		.output_format = "normal",
 		.num_descs = -1,
+		.qd = 4,
+		.filter = "",
+		.index_file = "",
 	};
 
 	OPT_ARGS(opts) = {
@@ -828,6 +1187,10 @@ static int report_zones(int argc, char **argv, struct command *acmd, struct plug
 		OPT_FLAG("verbose",       'v', &cfg.verbose,        verbose),
 		OPT_FLAG("extended",      'e', &cfg.extended,       ext),
 		OPT_FLAG("partial",       'p', &cfg.partial,        part),
+		OPT_UINT("queue-depth",   'q', &cfg.qd,             queue_depth),
+		OPT_LIST("filter",        'F', &cfg.filter,         filter),
+		OPT_FLAG("summary",       'm', &cfg.summary,        summary),
+		OPT_FILE("index-file",    'i', &cfg.index_file,     index_file),
 		OPT_END()
 	};
 
@@ -841,6 +1204,12 @@ static int report_zones(int argc, char **argv, struct command *acmd, struct plug
 	if (cfg.verbose)
 		flags |= VERBOSE;
 
+	if (strlen(cfg.filter)) {
+		err = zone_filter_parse(cfg.filter, &zf);
+		if (err)
+			return err;
+	}
+
 	if (!cfg.namespace_id) {
 		err = nvme_get_nsid(hdl, &cfg.namespace_id);
 		if (err < 0) {
@@ -865,84 +1234,406 @@ static int report_zones(int argc, char **argv, struct command *acmd, struct plug
 	if (!err) {
 		/* get zsze field from zns id ns data - needed for offset calculation */
 		nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
-		zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+		zi.zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
 	} else {
 		nvme_show_status(err);
 		return err;
 	}
+	if (!zi.zsze) {
+		nvme_show_error("zone size is zero");
+		return -EINVAL;
+	}
+
+	xfer = zone_max_xfer(hdl, false);
 
-	log_len = sizeof(struct nvme_zone_report);
-	buff = calloc(1, log_len);
-	if (!buff) {
+	buff = calloc(1, sizeof(struct nvme_zone_report));
+	if (!buff)
 		return -ENOMEM;
-	}
 
 	nvme_init_zns_report_zones(&cmd, cfg.namespace_id, 0, cfg.state, false,
-				   false, buff, log_len);
+				   false, buff, sizeof(struct nvme_zone_report));
 	err = nvme_submit_io_passthru(hdl, &cmd);
 	if (err > 0) {
 		nvme_show_status(err);
-		goto free_buff;
+		return err;
 	} else if (err < 0) {
 		perror("zns report-zones");
-		goto free_buff;
+		return err;
 	}
 
 	total_nr_zones = le64_to_cpu(buff->nr_zones);
 
-	if (cfg.num_descs == -1)
-		cfg.num_descs = total_nr_zones;
+	zi.nsid = cfg.namespace_id;
+	zi.extended = cfg.extended;
+	zi.partial = cfg.partial;
+	zi.desc_size = sizeof(struct nvme_zns_desc) + zdes;
+	zi.chunk = (xfer - sizeof(struct nvme_zone_report)) / zi.desc_size;
+	if (!zi.chunk)
+		zi.chunk = 1;
+
+	zi.first = cfg.state ? 0 : cfg.zslba / zi.zsze;
+	zi.nr = total_nr_zones > zi.first ? total_nr_zones - zi.first : 0;
+	if (cfg.num_descs >= 0 && cfg.num_descs < zi.nr)
+		zi.nr = cfg.num_descs;
+
+	zi.report = nvme_alloc_huge(sizeof(struct nvme_zone_report) +
+				    zi.nr * zi.desc_size, &mh);
+	if (!zi.report)
+		return -ENOMEM;
 
-	nr_zones = cfg.num_descs;
-	if (nr_zones < nr_zones_chunks)
-		nr_zones_chunks = nr_zones;
+	if (cfg.state)
+		err = zone_index_fetch_state(hdl, &zi, cfg.zslba, cfg.state,
+					     cfg.partial);
+	else
+		err = zone_index_fetch(hdl, &zi, cfg.qd);
+	if (err)
+		return err;
 
-	log_len = sizeof(struct nvme_zone_report) + ((sizeof(struct nvme_zns_desc) * nr_zones_chunks) + (nr_zones_chunks * zdes));
-	report_size = log_len;
+	if (strlen(cfg.filter))
+		zone_index_filter(&zi, &zf);
+	zi.report->nr_zones = cpu_to_le64(zi.nr);
 
-	report = nvme_alloc_huge(report_size, &mh);
-	if (!report) {
-		perror("alloc");
-		return -ENOMEM;
+	if (strlen(cfg.index_file)) {
+		err = zone_index_dump(&zi, cfg.index_file);
+		if (err) {
+			nvme_show_error("failed to write %s: %s", cfg.index_file,
+					nvme_strerror(-err));
+			return err;
+		}
 	}
 
-	offset = cfg.zslba;
+	if (cfg.summary) {
+		zone_index_summary(&zi);
+		return 0;
+	}
 
-	nvme_zns_start_zone_list(total_nr_zones, &zone_list, flags);
+	nvme_zns_start_zone_list(zi.nr, &zone_list, flags);
+	if (zi.nr)
+		nvme_show_zns_report_zones(zi.report, zi.nr, zdes,
+					   sizeof(struct nvme_zone_report) +
+					   zi.nr * zi.desc_size,
+					   zone_list, flags);
+	nvme_zns_finish_zone_list(zi.nr, zone_list, flags);
 
-	while (nr_zones_retrieved < nr_zones) {
-		if (nr_zones_retrieved >= nr_zones)
+	return 0;
+}
+
+/*
+ * Streaming zone append: the input is split into appends which are spread
+ * over several zones with a few of them in flight per zone. A zone which
+ * is written up to its capacity turns full, its slot then continues with
+ * the next writable zone.
+ */
+struct zone_stream_slot {
+	__u64		zslba;
+	__u64		left;		/* blocks up to the zone capacity */
+	bool		written;
+	unsigned int	inflight;
+};
+
+struct zone_stream_cmd {
+	__u64		offset;		/* of the data in the input */
+	unsigned int	slot;
+	__u32		nlb;
+	struct timeval	start;
+};
+
+struct zone_stream {
+	struct nvme_transport_handle *hdl;
+	struct zone_index	zi;
+	struct zone_stream_slot	*slots;
+	unsigned int		nr_slots;
+	unsigned int		qd;
+	unsigned int		rr;
+	__u64			next_zone;
+	__u32			nsid;
+	__u32			lba_size;
+	__u64			data_size;
+	__u16			control;
+	int			dfd;
+	bool			eof;
+	__u64			offset;
+	FILE			*map;
+	__u64			appends;
+	__u64			blocks;
+	__u64			zones;
+	unsigned long long	lat_us;
+	unsigned long long	lat_max_us;
+};
+
+static int zone_stream_send(struct zone_stream *zs, __u64 zslba,
+			    enum nvme_zns_send_action zsa)
+{
+	struct nvme_passthru_cmd cmd;
+
+	nvme_init_zns_mgmt_send(&cmd, zs->nsid, zslba, zsa, false, 0, 0,
+				NULL, 0);
+
+	return nvme_submit_io_passthru(zs->hdl, &cmd);
+}
+
+/* moves @slot to the next zone with room left, opening it explicitly */
+static int zone_stream_next_zone(struct zone_stream *zs,
+				 struct zone_stream_slot *slot)
+{
+	struct nvme_zns_desc *desc;
+	__u64 zcap, written;
+	int err;
+
+	while (zs->next_zone < zs->zi.nr) {
+		desc = zone_index_desc(&zs->zi, zs->next_zone++);
+
+		switch (desc->zs >> 4) {
+		case NVME_ZNS_ZS_EMPTY:
+		case NVME_ZNS_ZS_IMPL_OPEN:
+		case NVME_ZNS_ZS_EXPL_OPEN:
+		case NVME_ZNS_ZS_CLOSED:
 			break;
+		default:
+			continue;
+		}
+
+		zcap = le64_to_cpu(desc->zcap);
+		written = zone_written(desc);
+		if (written >= zcap)
+			continue;
+
+		slot->zslba = le64_to_cpu(desc->zslba);
+		slot->left = zcap - written;
+		slot->written = false;
 
-		if (nr_zones_retrieved + nr_zones_chunks > nr_zones) {
-			nr_zones_chunks = nr_zones - nr_zones_retrieved;
-			log_len = sizeof(struct nvme_zone_report) + ((sizeof(struct nvme_zns_desc) * nr_zones_chunks) + (nr_zones_chunks * zdes));
+		if (desc->zs >> 4 == NVME_ZNS_ZS_EXPL_OPEN)
+			return 0;
+
+		err = zone_stream_send(zs, slot->zslba, NVME_ZNS_ZSA_OPEN);
+		if (err) {
+			nvme_show_err("zns open-zone", err);
+			return err;
 		}
 
-		nvme_init_zns_report_zones(&cmd, cfg.namespace_id, offset,
-					   cfg.state, cfg.extended, cfg.partial,
-					   report, log_len);
-		err = nvme_submit_io_passthru(hdl, &cmd);
-		if (err > 0) {
-			nvme_show_status(err);
+		return 0;
+	}
+
+	slot->left = 0;
+
+	return -ENOSPC;
+}
+
+static int zone_stream_read(struct zone_stream *zs, void *buf, size_t len)
+{
+	size_t n = 0;
+	ssize_t ret;
+
+	while (n < len) {
+		ret = read(zs->dfd, buf + n, len - n);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (!ret) {
+			zs->eof = true;
 			break;
-		} else if (err < 0) {
-			perror("zns report-zones");
+		}
+		n += ret;
+	}
+
+	return n;
+}
+
+static int zone_stream_prep(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			    void *buf)
+{
+	struct zone_stream *zs = q->priv;
+	struct zone_stream_cmd *c = buf + zs->data_size;
+	struct zone_stream_slot *slot = NULL;
+	unsigned int i, s;
+	__u32 nlb;
+	int n, err;
+
+	if (zs->eof)
+		return 0;
+
+	/* the queue has nr_slots * qd entries, one slot always has room */
+	for (i = 0; i < zs->nr_slots; i++) {
+		s = (zs->rr + i) % zs->nr_slots;
+		if (zs->slots[s].inflight < zs->qd) {
+			slot = &zs->slots[s];
+			zs->rr = s + 1;
 			break;
 		}
+	}
+	if (!slot)
+		return 0;
+
+	if (!slot->left) {
+		err = zone_stream_next_zone(zs, slot);
+		if (err)
+			return err;
+		zs->zones++;
+	}
+
+	n = zone_stream_read(zs, buf, min(zs->data_size,
+					  slot->left * zs->lba_size));
+	if (n <= 0)
+		return n;
+
+	nlb = (n + zs->lba_size - 1) / zs->lba_size;
+	memset(buf + n, 0, nlb * zs->lba_size - n);
+
+	nvme_init_zns_append(cmd, zs->nsid, slot->zslba, nlb - 1, zs->control,
+			     0, 0, buf, nlb * zs->lba_size, NULL, 0);
+
+	c->offset = zs->offset;
+	c->slot = slot - zs->slots;
+	c->nlb = nlb;
+
+	zs->offset += n;
+	slot->left -= nlb;
+	slot->written = true;
+	slot->inflight++;
+	gettimeofday(&c->start, NULL);
+
+	return 1;
+}
+
+static int zone_stream_done(struct nvme_ioq *q, struct nvme_passthru_cmd *cmd,
+			    void *buf, int err)
+{
+	struct zone_stream *zs = q->priv;
+	struct zone_stream_cmd *c = buf + zs->data_size;
+	struct timeval now;
+	unsigned long long us;
+
+	gettimeofday(&now, NULL);
+	us = elapsed_utime(c->start, now);
+	zs->lat_us += us;
+	zs->lat_max_us = max(zs->lat_max_us, us);
+
+	zs->slots[c->slot].inflight--;
+	if (err) {
+		nvme_show_err("zns zone-append", err);
+		return err;
+	}
+
+	zs->appends++;
+	zs->blocks += c->nlb;
+
+	/*
+	 * A range file of the written blocks, in completion order; appends in
+	 * flight together may complete in any order, the input offset tells.
+	 */
+	fprintf(zs->map, "%"PRIu64" %"PRIu32" # %"PRIu64"\n",
+		(uint64_t)cmd->result, c->nlb, (uint64_t)c->offset);
+
+	return 0;
+}
+
+static int zone_append_stream(struct zone_stream *zs, __u64 zslba,
+			      bool finish, bool latency)
+{
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	struct timeval start_time, end_time;
+	struct nvme_zns_id_ns id_zns;
+	struct nvme_id_ns id_ns;
+	unsigned long long us;
+	FILE *out;
+	struct nvme_ioq q = { 0 };
+	unsigned int i;
+	__u32 limit;
+	__u8 lbaf;
+	int err, ret;
 
-		if (!err)
-			nvme_show_zns_report_zones(report, nr_zones_chunks,
-						   zdes, log_len, zone_list, flags);
+	err = nvme_identify_ns(zs->hdl, zs->nsid, &id_ns);
+	if (!err)
+		err = nvme_zns_identify_ns(zs->hdl, zs->nsid, &id_zns);
+	if (err) {
+		nvme_show_status(err);
+		return err;
+	}
 
-		nr_zones_retrieved += nr_zones_chunks;
-		offset = le64_to_cpu(report->entries[nr_zones_chunks-1].zslba) + zsze;
+	nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
+	zs->zi.zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+	if (!zs->zi.zsze) {
+		nvme_show_error("zone size is zero");
+		return -EINVAL;
 	}
 
-	nvme_zns_finish_zone_list(total_nr_zones, zone_list, flags);
+	/*
+	 * Every slot keeps a zone open, stay within the open and active
+	 * resources; both limits are 0's based, all ones for no limit.
+	 */
+	limit = min(le32_to_cpu(id_zns.mor), le32_to_cpu(id_zns.mar));
+	if (limit != 0xffffffff && zs->nr_slots > limit + 1) {
+		fprintf(stderr, "zone-append: %u zones exceed the open zone limit, using %u\n",
+			zs->nr_slots, limit + 1);
+		zs->nr_slots = limit + 1;
+	}
+
+	zs->zi.nsid = zs->nsid;
+	zs->zi.desc_size = sizeof(struct nvme_zns_desc);
+	zs->zi.partial = true;
+	zs->zi.chunk = (zone_max_xfer(zs->hdl, false) -
+			sizeof(struct nvme_zone_report)) / zs->zi.desc_size;
+	zs->zi.first = zslba / zs->zi.zsze;
+	zs->zi.nr = le64_to_cpu(id_ns.nsze) / zs->zi.zsze;
+	zs->zi.nr = zs->zi.nr > zs->zi.first ? zs->zi.nr - zs->zi.first : 0;
+
+	zs->zi.report = nvme_alloc_huge(sizeof(struct nvme_zone_report) +
+					zs->zi.nr * zs->zi.desc_size, &mh);
+	if (!zs->zi.report)
+		return -ENOMEM;
+
+	err = zone_index_fetch(zs->hdl, &zs->zi, 4);
+	if (err)
+		return err;
+
+	zs->slots = calloc(zs->nr_slots, sizeof(*zs->slots));
+	if (!zs->slots)
+		return -ENOMEM;
 
-free_buff:
-	free(buff);
+	q.hdl = zs->hdl;
+	q.depth = zs->nr_slots * zs->qd;
+	q.buf_size = zs->data_size + sizeof(struct zone_stream_cmd);
+	q.prep = zone_stream_prep;
+	q.done = zone_stream_done;
+	q.priv = zs;
+
+	fprintf(zs->map, "# lba blocks # input offset\n");
+
+	gettimeofday(&start_time, NULL);
+	err = nvme_ioq_run(&q);
+	gettimeofday(&end_time, NULL);
+
+	/* full zones finished on their own, the partially written ones not */
+	for (i = 0; finish && i < zs->nr_slots; i++) {
+		if (!zs->slots[i].written || !zs->slots[i].left)
+			continue;
+
+		ret = zone_stream_send(zs, zs->slots[i].zslba,
+				       NVME_ZNS_ZSA_FINISH);
+		if (ret) {
+			nvme_show_err("zns finish-zone", ret);
+			if (!err)
+				err = ret;
+		}
+	}
+
+	free(zs->slots);
+
+	if (err == -ENOSPC)
+		nvme_show_error("zone-append: no writable zone left");
+
+	/* keep the summary out of a map written to stdout */
+	out = zs->map == stdout ? stderr : stdout;
+	us = elapsed_utime(start_time, end_time);
+	fprintf(out, "appended %"PRIu64" bytes to %"PRIu64" zones in %"PRIu64" appends, %.1f MB/s\n",
+		(uint64_t)zs->offset, (uint64_t)zs->zones,
+		(uint64_t)zs->appends,
+		us ? zs->blocks * zs->lba_size / (double)us : 0);
+	if (latency && zs->appends)
+		fprintf(out, " latency: zone append: %llu us average, %llu us max\n",
+			zs->lat_us / zs->appends, zs->lat_max_us);
 
 	return err;
 }
@@ -962,6 +1653,11 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 	const char *metadata_size = "size of metadata in bytes";
 	const char *data_size = "size of data in bytes";
 	const char *latency = "output latency statistics";
+	const char *stream = "append the whole input, spread over several zones";
+	const char *nr_zones = "number of zones written concurrently in stream mode";
+	const char *queue_depth = "appends in flight per zone in stream mode";
+	const char *map_file = "file for the LBA map of the stream (default: stdout)";
+	const char *finish = "finish the partially written zones after the stream";
 
 	_cleanup_nvme_transport_handle_ struct nvme_transport_handle *hdl = NULL;
 	_cleanup_nvme_global_ctx_ struct nvme_global_ctx *ctx = NULL;
@@ -988,9 +1684,17 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 		__u8   prinfo;
 		bool   piremap;
 		bool   latency;
+		bool   stream;
+		__u32  nr_zones;
+		__u32  qd;
+		char  *map_file;
+		bool   finish;
 	};
 
-	struct config cfg = {};
+	struct config cfg = {
+		.nr_zones = 1,
+		.qd = 1,
+	};
 
 	OPT_ARGS(opts) = {
 		OPT_UINT("namespace-id", 'n', &cfg.namespace_id,  namespace_id),
@@ -1004,6 +1708,11 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 		OPT_BYTE("prinfo",            'p', &cfg.prinfo,        prinfo),
 		OPT_FLAG("piremap",           'P', &cfg.piremap,       piremap),
 		OPT_FLAG("latency",           't', &cfg.latency,       latency),
+		OPT_FLAG("stream",            'S', &cfg.stream,        stream),
+		OPT_UINT("zones",             'Z', &cfg.nr_zones,      nr_zones),
+		OPT_UINT("queue-depth",       'q', &cfg.qd,            queue_depth),
+		OPT_FILE("map-file",          'L', &cfg.map_file,      map_file),
+		OPT_FLAG("finish",            'F', &cfg.finish,        finish),
 		OPT_END()
 	};
 
@@ -1011,7 +1720,7 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 	if (err)
 		return errno;
 
-	if (!cfg.data_size) {
+	if (!cfg.data_size && !cfg.stream) {
 		fprintf(stderr, "Append size not provided\n");
 		return -EINVAL;
 	}
@@ -1053,6 +1762,65 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 		return -EINVAL;
 	}
 
+	control |= (cfg.prinfo << 10);
+	if (cfg.limited_retry)
+		control |= NVME_IO_LR;
+	if (cfg.fua)
+		control |= NVME_IO_FUA;
+	if (cfg.piremap)
+		control |= NVME_IO_ZNS_APPEND_PIREMAP;
+
+	if (cfg.stream) {
+		struct zone_stream zs = {
+			.hdl = hdl,
+			.nsid = cfg.namespace_id,
+			.lba_size = lba_size,
+			.control = control,
+			.nr_slots = cfg.nr_zones ? cfg.nr_zones : 1,
+			.qd = cfg.qd ? cfg.qd : 1,
+			.dfd = dfd,
+			.map = stdout,
+		};
+		__u64 max = zone_max_xfer(hdl, true);
+
+		if (cfg.metadata || cfg.metadata_size) {
+			nvme_show_error("metadata is not supported in stream mode");
+			return -EINVAL;
+		}
+
+		zs.data_size = cfg.data_size ? cfg.data_size : max;
+		if (zs.data_size > max || zs.data_size < lba_size) {
+			nvme_show_error("append size %"PRIu64" outside of 1 block and the limit of %"PRIu64" bytes",
+					(uint64_t)zs.data_size, (uint64_t)max);
+			return -EINVAL;
+		}
+
+		if (cfg.data) {
+			zs.dfd = open(cfg.data, O_RDONLY);
+			if (zs.dfd < 0) {
+				perror(cfg.data);
+				return -errno;
+			}
+		}
+		if (cfg.map_file) {
+			zs.map = fopen(cfg.map_file, "w");
+			if (!zs.map) {
+				err = -errno;
+				perror(cfg.map_file);
+			}
+		}
+
+		if (zs.map)
+			err = zone_append_stream(&zs, cfg.zslba, cfg.finish,
+						 cfg.latency);
+
+		if (cfg.map_file && zs.map)
+			fclose(zs.map);
+		if (cfg.data)
+			close(zs.dfd);
+		return err;
+	}
+
 	if (cfg.data) {
 		dfd = open(cfg.data, O_RDONLY);
 		if (dfd < 0) {
@@ -1100,13 +1868,6 @@ static int zone_append(int argc, char **argv, struct command *acmd, struct plugi
 	}
 
 	nblocks = (cfg.data_size / lba_size) - 1;
-	control |= (cfg.prinfo << 10);
-	if (cfg.limited_retry)
-		control |= NVME_IO_LR;
-	if (cfg.fua)
-		control |= NVME_IO_FUA;
-	if (cfg.piremap)
-		control |= NVME_IO_ZNS_APPEND_PIREMAP;
 
 	gettimeofday(&start_time, NULL);
 	nvme_init_zns_append(&cmd, cfg.namespace_id, cfg.zslba, nblocks,
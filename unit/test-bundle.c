@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../util/bundle.h"
+#include "../util/crc32.h"
+
+#define BLOCK		512
+
+static int test_rc;
+
+static unsigned char data[3 * 4096 + 100];
+
+static unsigned char *read_file(const char *path, size_t *len)
+{
+	unsigned char *buf = NULL;
+	FILE *f = fopen(path, "r");
+	long size;
+
+	if (!f)
+		return NULL;
+	if (!fseek(f, 0, SEEK_END) && (size = ftell(f)) > 0) {
+		rewind(f);
+		buf = malloc(size);
+		if (buf && fread(buf, 1, size, f) != (size_t)size) {
+			free(buf);
+			buf = NULL;
+		}
+		*len = size;
+	}
+	fclose(f);
+
+	return buf;
+}
+
+static int write_bundle(const char *path)
+{
+	struct nvme_bundle *b;
+	int err;
+
+	err = nvme_bundle_open(&b, path, "SN/");
+	if (err)
+		return err;
+
+	nvme_bundle_append(b, "Controller/log.bin", data, 4096);
+	nvme_bundle_append(b, "Controller/log.bin", data + 4096,
+			   sizeof(data) - 4096);
+	nvme_bundle_printf(b, "info.txt", "model %s\n", "test");
+
+	return nvme_bundle_close(b);
+}
+
+static void check_member(const char *name, const unsigned char *hdr,
+			 const char *exp_name, size_t exp_size)
+{
+	unsigned int sum = 0, chksum;
+	size_t size;
+	int i;
+
+	for (i = 0; i < BLOCK; i++)
+		sum += (i >= 148 && i < 156) ? ' ' : hdr[i];
+	chksum = strtoul((const char *)hdr + 148, NULL, 8);
+	size = strtoull((const char *)hdr + 124, NULL, 8);
+
+	if (strcmp((const char *)hdr, exp_name) || size != exp_size ||
+	    sum != chksum || memcmp(hdr + 257, "ustar", 6)) {
+		printf("ERROR: %s: member %s size %zu chksum %o/%o, expected %s size %zu\n",
+		       name, hdr, size, chksum, sum, exp_name, exp_size);
+		test_rc = 1;
+	}
+}
+
+static void tar_test(const char *path)
+{
+	const unsigned char *hdr;
+	unsigned char *buf;
+	char manifest[256];
+	size_t len, off;
+	int err;
+
+	err = write_bundle(path);
+	buf = err ? NULL : read_file(path, &len);
+	if (!buf) {
+		printf("ERROR: tar: writing the bundle failed: %s\n",
+		       strerror(err ? -err : errno));
+		test_rc = 1;
+		return;
+	}
+
+	if (len % (20 * BLOCK)) {
+		printf("ERROR: tar: size %zu is not a multiple of the record size\n",
+		       len);
+		test_rc = 1;
+	}
+
+	hdr = buf;
+	check_member("tar", hdr, "SN/Controller/log.bin", sizeof(data));
+	if (memcmp(hdr + BLOCK, data, sizeof(data))) {
+		printf("ERROR: tar: log.bin data mismatch\n");
+		test_rc = 1;
+	}
+
+	off = BLOCK + (sizeof(data) + BLOCK - 1) / BLOCK * BLOCK;
+	check_member("tar", buf + off, "SN/info.txt", 11);
+
+	off += 2 * BLOCK;
+	snprintf(manifest, sizeof(manifest),
+		 "%08x %zu SN/Controller/log.bin\n%08x 11 SN/info.txt\n",
+		 crc32(0, data, sizeof(data)),
+		 sizeof(data), crc32(0, (unsigned char *)"model test\n", 11));
+	check_member("tar", buf + off, "SN/MANIFEST", strlen(manifest));
+	if (strncmp((const char *)buf + off + BLOCK, manifest, strlen(manifest))) {
+		printf("ERROR: tar: manifest is\n%.*s\nexpected\n%s\n",
+		       (int)strlen(manifest), buf + off + BLOCK, manifest);
+		test_rc = 1;
+	}
+
+	free(buf);
+}
+
+/* sized members are streamed to a pipe behind their header */
+static void pipe_test(void)
+{
+	static unsigned char buf[64 * 1024];
+	struct nvme_bundle *b;
+	int fds[2], out, err;
+	size_t off;
+	ssize_t len;
+
+	if (pipe(fds))
+		return;
+	out = dup(STDOUT_FILENO);
+	dup2(fds[1], STDOUT_FILENO);
+	close(fds[1]);
+
+	err = nvme_bundle_open(&b, "-", NULL);
+	dup2(out, STDOUT_FILENO);
+	close(out);
+	if (!err) {
+		nvme_bundle_begin(b, "log.bin", sizeof(data));
+		nvme_bundle_append(b, "log.bin", data, 4096);
+		nvme_bundle_append(b, "log.bin", data + 4096,
+				   sizeof(data) - 4096);
+		nvme_bundle_begin(b, "short.bin", 100);
+		nvme_bundle_append(b, "short.bin", data, 40);
+		err = nvme_bundle_close(b);
+	}
+	len = err ? -1 : read(fds[0], buf, sizeof(buf));
+	close(fds[0]);
+	if (len < 0) {
+		printf("ERROR: pipe: writing the bundle failed: %s\n",
+		       strerror(err ? -err : errno));
+		test_rc = 1;
+		return;
+	}
+
+	check_member("pipe", buf, "log.bin", sizeof(data));
+	if (memcmp(buf + BLOCK, data, sizeof(data))) {
+		printf("ERROR: pipe: log.bin data mismatch\n");
+		test_rc = 1;
+	}
+
+	off = BLOCK + (sizeof(data) + BLOCK - 1) / BLOCK * BLOCK;
+	check_member("pipe", buf + off, "short.bin", 100);
+	if (memcmp(buf + off + BLOCK, data, 40) ||
+	    buf[off + BLOCK + 40] || buf[off + BLOCK + 99]) {
+		printf("ERROR: pipe: short.bin is not filled up with zeros\n");
+		test_rc = 1;
+	}
+}
+
+static void oversize_test(const char *path)
+{
+	struct nvme_bundle *b;
+	int err;
+
+	err = nvme_bundle_open(&b, path, NULL);
+	if (err)
+		return;
+
+	nvme_bundle_begin(b, "log.bin", 100);
+	err = nvme_bundle_append(b, "log.bin", data, 101);
+	if (err != -EFBIG || nvme_bundle_close(b) != -EFBIG) {
+		printf("ERROR: oversize: appending past the size gave %d\n",
+		       err);
+		test_rc = 1;
+	}
+}
+
+static void zip_test(const char *path)
+{
+	const unsigned char *eocd;
+	unsigned char *buf;
+	size_t len;
+	int err;
+
+	err = write_bundle(path);
+	buf = err ? NULL : read_file(path, &len);
+	if (!buf || len < 22) {
+		printf("ERROR: zip: writing the bundle failed\n");
+		test_rc = 1;
+		free(buf);
+		return;
+	}
+
+	eocd = buf + len - 22;
+	if (memcmp(buf, "PK\3\4", 4) || memcmp(eocd, "PK\5\6", 4) ||
+	    eocd[10] != 3) {
+		printf("ERROR: zip: bad signature or member count\n");
+		test_rc = 1;
+	}
+
+	free(buf);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/nvme-bundle-XXXXXX";
+	char *zip;
+	size_t i;
+	int fd;
+
+	test_rc = 0;
+
+	/* a zero block in the middle is written as a hole */
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i / 4096 == 1) ? 0 : i * 7;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	tar_test(path);
+	oversize_test(path);
+	unlink(path);
+
+	pipe_test();
+
+	if (asprintf(&zip, "%s.zip", path) < 0)
+		return 1;
+	zip_test(zip);
+	unlink(zip);
+	free(zip);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
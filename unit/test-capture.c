@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../nvme-capture.h"
+
+#define LOG_SIZE	(64 * 1024 + 100)
+
+static int test_rc;
+
+static unsigned char log_data[LOG_SIZE];
+
+struct fake_log {
+	uint64_t	next;		/* the fetches must come in order */
+	uint64_t	fail_off;	/* fails once per fetch at this offset */
+	unsigned int	fail_count;
+	unsigned int	fetches;
+};
+
+static int fake_fetch(struct nvme_capture *c, void *buf, uint64_t off,
+		      uint32_t len)
+{
+	struct fake_log *f = c->priv;
+
+	f->fetches++;
+	if (off != f->next || off + len > LOG_SIZE || len % c->align)
+		return -EINVAL;
+
+	/* a skipped chunk is not fetched again */
+	if (off == f->fail_off && f->fail_count) {
+		if (!--f->fail_count && c->skip_errors)
+			f->next = off + len;
+		return 0x4002;
+	}
+
+	memcpy(buf, log_data + off, len);
+	f->next = off + len;
+
+	return 0;
+}
+
+static unsigned char *capture(const char *name, const char *path,
+			      struct fake_log *f, unsigned int retries,
+			      bool skip, int exp_err, size_t *len)
+{
+	struct nvme_capture_file file;
+	struct nvme_capture c;
+	unsigned char *buf;
+	struct stat st;
+	int err, fd;
+
+	if (nvme_capture_file_open(&file, path, NVME_CAPTURE_SPARSE |
+				   NVME_CAPTURE_MANIFEST))
+		return NULL;
+
+	nvme_capture_init(&c, NULL);
+	c.offset = 100;
+	c.size = LOG_SIZE - 100;
+	c.chunk = 8192 + 3;
+	c.retries = retries;
+	c.skip_errors = skip;
+	c.file = &file;
+	c.fetch = fake_fetch;
+	c.priv = f;
+	f->next = c.offset;
+
+	err = nvme_capture_run(&c);
+	if (err != exp_err) {
+		printf("ERROR: %s: capture returned %d, expected %d\n", name,
+		       err, exp_err);
+		test_rc = 1;
+	}
+
+	err = nvme_capture_file_close(&file);
+	if (err) {
+		printf("ERROR: %s: close returned %d\n", name, err);
+		test_rc = 1;
+	}
+
+	/* the full blocks of the zero range are holes */
+	if (!exp_err && !skip && file.holes != 4 * NVME_CAPTURE_BLOCK) {
+		printf("ERROR: %s: %" PRIu64 " bytes of holes\n", name,
+		       file.holes);
+		test_rc = 1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	buf = NULL;
+	if (!fstat(fd, &st) && st.st_size) {
+		buf = malloc(st.st_size);
+		if (buf && pread(fd, buf, st.st_size, 0) != st.st_size) {
+			free(buf);
+			buf = NULL;
+		}
+		*len = st.st_size;
+	}
+	close(fd);
+
+	return buf;
+}
+
+static void check_data(const char *name, const unsigned char *buf,
+		       size_t len, size_t exp_len, uint64_t zero_off,
+		       uint32_t zero_len)
+{
+	size_t i;
+
+	if (!buf || len != exp_len) {
+		printf("ERROR: %s: captured %zu bytes, expected %zu\n", name,
+		       buf ? len : 0, exp_len);
+		test_rc = 1;
+		return;
+	}
+
+	for (i = 0; i < len; i++) {
+		unsigned char exp = log_data[100 + i];
+
+		if (100 + i >= zero_off && 100 + i < zero_off + zero_len)
+			exp = 0;
+		if (buf[i] != exp) {
+			printf("ERROR: %s: mismatch at %zu\n", name, i);
+			test_rc = 1;
+			return;
+		}
+	}
+}
+
+static void check_manifest(const char *name, const char *path,
+			   const unsigned char *buf, size_t len)
+{
+	char mpath[64], line[64], exp[64];
+	size_t off = 0;
+	uint64_t hash;
+	FILE *m;
+
+	snprintf(mpath, sizeof(mpath), "%s.blocks", path);
+	m = fopen(mpath, "r");
+	if (!m) {
+		printf("ERROR: %s: no manifest\n", name);
+		test_rc = 1;
+		return;
+	}
+
+	if (!fgets(line, sizeof(line), m) ||
+	    strcmp(line, "nvme-capture-manifest 1\n") ||
+	    !fgets(line, sizeof(line), m) || strcmp(line, "block-size 4096\n")) {
+		printf("ERROR: %s: bad manifest header\n", name);
+		test_rc = 1;
+		goto out;
+	}
+
+	for (off = 0; buf && off < len; off += NVME_CAPTURE_BLOCK) {
+		hash = nvme_capture_block_hash(buf + off,
+				len - off < NVME_CAPTURE_BLOCK ?
+				len - off : NVME_CAPTURE_BLOCK);
+		snprintf(exp, sizeof(exp), "%016" PRIx64 "\n", hash);
+		if (!fgets(line, sizeof(line), m) || strcmp(line, exp)) {
+			printf("ERROR: %s: manifest mismatch at %zu\n", name, off);
+			test_rc = 1;
+			goto out;
+		}
+	}
+
+	snprintf(exp, sizeof(exp), "size %zu\n", len);
+	if (!fgets(line, sizeof(line), m) || strcmp(line, exp)) {
+		printf("ERROR: %s: bad manifest size\n", name);
+		test_rc = 1;
+	}
+out:
+	fclose(m);
+}
+
+static void test_hash(void)
+{
+	unsigned char blk[NVME_CAPTURE_BLOCK] = { 0 };
+	uint64_t h;
+	size_t i;
+
+	if (nvme_capture_block_hash(blk, sizeof(blk))) {
+		printf("ERROR: hash of a zero block\n");
+		test_rc = 1;
+	}
+
+	blk[sizeof(blk) - 1] = 1;
+	h = nvme_capture_block_hash(blk, sizeof(blk));
+	blk[sizeof(blk) - 1] = 2;
+	if (!h || h == nvme_capture_block_hash(blk, sizeof(blk))) {
+		printf("ERROR: hash does not change with the data\n");
+		test_rc = 1;
+	}
+
+	/* the top bit of two words flipped, which cancelled out in word FNV */
+	for (i = 0; i < sizeof(blk); i++)
+		blk[i] = rand();
+	h = nvme_capture_block_hash(blk, sizeof(blk));
+	blk[7] ^= 0x80;
+	blk[sizeof(blk) - 1] ^= 0x80;
+	if (h == nvme_capture_block_hash(blk, sizeof(blk))) {
+		printf("ERROR: hash collision of two flipped top bits\n");
+		test_rc = 1;
+	}
+}
+
+int main(void)
+{
+	char path[] = "/tmp/nvme-capture-XXXXXX";
+	char mpath[64];
+	struct fake_log f;
+	unsigned char *buf;
+	size_t i, len = 0;
+	int fd;
+
+	test_rc = 0;
+	test_hash();
+
+	/* a zero range larger than a hole block in the middle */
+	for (i = 0; i < LOG_SIZE; i++)
+		log_data[i] = (i >= 20000 && i < 40000) ? 0 : i % 251 + 1;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	memset(&f, 0, sizeof(f));
+	f.fail_off = UINT64_MAX;
+	buf = capture("full", path, &f, 0, false, 0, &len);
+	check_data("full", buf, len, LOG_SIZE - 100, 0, 0);
+	check_manifest("full", path, buf, len);
+	free(buf);
+
+	/* a failing chunk is retried */
+	memset(&f, 0, sizeof(f));
+	f.fail_off = 100 + 8192;
+	f.fail_count = 2;
+	buf = capture("retry", path, &f, 2, false, 0, &len);
+	check_data("retry", buf, len, LOG_SIZE - 100, 0, 0);
+	free(buf);
+
+	/* without retries the capture stops after the previous chunk */
+	memset(&f, 0, sizeof(f));
+	f.fail_off = 100 + 2 * 8192;
+	f.fail_count = 1;
+	buf = capture("stop", path, &f, 0, false, 0x4002, &len);
+	check_data("stop", buf, len, 2 * 8192, 0, 0);
+	free(buf);
+
+	/* a skipped chunk is written as zeros */
+	memset(&f, 0, sizeof(f));
+	f.fail_off = 100 + 8192;
+	f.fail_count = 1;
+	buf = capture("skip", path, &f, 0, true, 0, &len);
+	check_data("skip", buf, len, LOG_SIZE - 100, 100 + 8192, 8192);
+	check_manifest("skip", path, buf, len);
+	free(buf);
+
+	unlink(path);
+	snprintf(mpath, sizeof(mpath), "%s.blocks", path);
+	unlink(mpath);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
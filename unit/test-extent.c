@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <ccan/endian/endian.h>
+
+#include "../util/extent.h"
+
+static int test_rc;
+
+struct ext {
+	uint64_t slba;
+	uint64_t nlb;
+};
+
+static void check_list(const char *name, struct nvme_extent_list *list,
+		       const struct ext *exp, size_t nr)
+{
+	size_t i;
+
+	if (list->nr != nr) {
+		printf("ERROR: %s: got %zu extents, expected %zu\n", name,
+		       list->nr, nr);
+		test_rc = 1;
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (list->ext[i].slba == exp[i].slba &&
+		    list->ext[i].nlb == exp[i].nlb)
+			continue;
+
+		printf("ERROR: %s: extent %zu is %llu+%llu, expected %llu+%llu\n",
+		       name, i, (unsigned long long)list->ext[i].slba,
+		       (unsigned long long)list->ext[i].nlb,
+		       (unsigned long long)exp[i].slba,
+		       (unsigned long long)exp[i].nlb);
+		test_rc = 1;
+	}
+}
+
+static int write_file(const char *path, const void *data, size_t len)
+{
+	FILE *f = fopen(path, "w");
+	size_t n;
+
+	if (!f)
+		return -errno;
+	n = fwrite(data, 1, len, f);
+	fclose(f);
+
+	return n == len ? 0 : -EIO;
+}
+
+static void parse_test(const char *name, const char *path, const void *data,
+		       size_t len, uint32_t unit, const struct ext *exp,
+		       size_t nr)
+{
+	struct nvme_extent_list list = { 0 };
+	int err;
+
+	err = write_file(path, data, len);
+	if (!err)
+		err = nvme_extent_parse_file(&list, path);
+	if (err) {
+		printf("ERROR: %s: parsing failed: %s\n", name, strerror(-err));
+		test_rc = 1;
+		return;
+	}
+
+	if (list.unit != unit) {
+		printf("ERROR: %s: unit %u, expected %u\n", name, list.unit,
+		       unit);
+		test_rc = 1;
+	}
+
+	check_list(name, &list, exp, nr);
+	nvme_extent_free(&list);
+}
+
+static const char text[] =
+	"# start count\n"
+	"0 8\n"
+	"0x100, 0x10\n"
+	"\n"
+	"64:4 # trailing comment\n";
+
+static const struct ext text_exp[] = {
+	{ 0, 8 }, { 256, 16 }, { 64, 4 },
+};
+
+static const char filefrag[] =
+	"Filesystem type is: ef53\n"
+	"File size of f is 1048576 (256 blocks of 4096 bytes)\n"
+	" ext:     logical_offset:        physical_offset: length:   expected: flags:\n"
+	"   0:        0..     127:      34816..     34943:    128:\n"
+	"   1:      128..     255:      40000..     40127:    128:      34944: last,eof\n"
+	"f: 2 extents found\n";
+
+static const struct ext filefrag_exp[] = {
+	{ 34816, 128 }, { 40000, 128 },
+};
+
+static void binary_test(const char *path)
+{
+	leint64_t rec[4] = {
+		cpu_to_le64(10), cpu_to_le64(1),
+		cpu_to_le64(0x100000000ULL), cpu_to_le64(2),
+	};
+	static const struct ext exp[] = {
+		{ 10, 1 }, { 0x100000000ULL, 2 },
+	};
+
+	parse_test("binary", path, rec, sizeof(rec), 0, exp, 2);
+}
+
+static void coalesce_test(void)
+{
+	static const struct ext in[] = {
+		{ 100, 10 }, { 0, 10 }, { 10, 5 }, { 105, 10 }, { 50, 1 },
+	};
+	static const struct ext sorted[] = {
+		{ 0, 15 }, { 50, 1 }, { 100, 15 },
+	};
+	static const struct ext ordered[] = {
+		{ 100, 10 }, { 0, 15 }, { 105, 10 }, { 50, 1 },
+	};
+	struct nvme_extent_list a = { 0 }, b = { 0 };
+	size_t i;
+
+	for (i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+		nvme_extent_add(&a, in[i].slba, in[i].nlb, 0);
+		nvme_extent_add(&b, in[i].slba, in[i].nlb, 0);
+	}
+
+	nvme_extent_coalesce(&a, true);
+	check_list("coalesce sorted", &a, sorted, 3);
+	nvme_extent_coalesce(&b, false);
+	check_list("coalesce ordered", &b, ordered, 4);
+
+	if (nvme_extent_blocks(&a) != 31) {
+		printf("ERROR: coalesce sorted: %llu blocks, expected 31\n",
+		       (unsigned long long)nvme_extent_blocks(&a));
+		test_rc = 1;
+	}
+
+	nvme_extent_free(&a);
+	nvme_extent_free(&b);
+}
+
+static void scale_test(void)
+{
+	static const struct ext exp[] = {
+		{ 8, 16 },
+	};
+	struct nvme_extent_list list = { 0 };
+
+	nvme_extent_add(&list, 1, 2, 0);
+	if (nvme_extent_scale(&list, 4096, 512)) {
+		printf("ERROR: scale 4096 to 512 failed\n");
+		test_rc = 1;
+	}
+	check_list("scale", &list, exp, 1);
+
+	nvme_extent_add(&list, 3, 1, 0);
+	if (nvme_extent_scale(&list, 512, 4096) != -EINVAL) {
+		printf("ERROR: scale accepted an unaligned extent\n");
+		test_rc = 1;
+	}
+
+	nvme_extent_free(&list);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/nvme-extent-XXXXXX";
+	int fd;
+
+	test_rc = 0;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	parse_test("text", path, text, strlen(text), 0, text_exp, 3);
+	parse_test("filefrag", path, filefrag, strlen(filefrag), 4096,
+		   filefrag_exp, 2);
+	binary_test(path);
+	unlink(path);
+
+	coalesce_test();
+	scale_test();
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../nvme-latency.h"
+
+#define NR_BUCKETS	4
+
+static int test_rc;
+
+static void check(const char *name, double got, double exp)
+{
+	if (fabs(got - exp) > 1e-6) {
+		printf("ERROR: %s: got %f, expected %f\n", name, got, exp);
+		test_rc = 1;
+	}
+}
+
+static void test_percentile(void)
+{
+	struct nvme_lat_hist h;
+	unsigned int i;
+
+	if (nvme_lat_hist_alloc(&h, NR_BUCKETS)) {
+		printf("ERROR: alloc failed\n");
+		test_rc = 1;
+		return;
+	}
+
+	/* 0-100, 100-200, 200-300, 300+ */
+	i = nvme_lat_hist_linear(&h, 0, 3, 0, 100);
+	check("linear next", i, 3);
+	h.edge_us[NR_BUCKETS] = NVME_LAT_INF;
+
+	check("empty", nvme_lat_hist_percentile(&h, 50), 0);
+
+	h.count[0] = 50;
+	h.count[1] = 40;
+	h.count[2] = 9;
+	h.count[3] = 1;
+	check("total", nvme_lat_hist_total(&h), 100);
+	check("p50", nvme_lat_hist_percentile(&h, 50), 100);
+	check("p70", nvme_lat_hist_percentile(&h, 70), 150);
+	check("p99", nvme_lat_hist_percentile(&h, 99), 300);
+	check("p99.9", nvme_lat_hist_percentile(&h, 99.9), 300);
+
+	nvme_lat_hist_free(&h);
+}
+
+struct fake_log {
+	const uint64_t	(*reads)[NR_BUCKETS];
+	unsigned int	nr;
+	unsigned int	next;
+	uint64_t	ios[8];
+	double		max_us[8];
+};
+
+static int fake_sample(struct nvme_lat_sampler *s, uint64_t *count)
+{
+	struct fake_log *f = s->priv;
+
+	if (f->next == f->nr)
+		return -1;
+	memcpy(count, f->reads[f->next++], sizeof(uint64_t) * NR_BUCKETS);
+
+	return 0;
+}
+
+static void fake_report(struct nvme_lat_sampler *s, double t)
+{
+	struct fake_log *f = s->priv;
+
+	f->ios[s->samples - 1] = s->ios;
+	f->max_us[s->samples - 1] = s->max_us;
+}
+
+static void sample(const char *name, bool cleared,
+		   const uint64_t (*reads)[NR_BUCKETS], unsigned int nr,
+		   const uint64_t *ios, const double *max_us)
+{
+	struct fake_log f = { .reads = reads, .nr = nr };
+	struct nvme_lat_sampler s = {
+		.count = nr - 1,
+		.cleared = cleared,
+		.sample = fake_sample,
+		.report = fake_report,
+		.priv = &f,
+	};
+	unsigned int i;
+	int err;
+
+	if (nvme_lat_hist_alloc(&s.hist, NR_BUCKETS)) {
+		printf("ERROR: %s: alloc failed\n", name);
+		test_rc = 1;
+		return;
+	}
+	nvme_lat_hist_linear(&s.hist, 0, NR_BUCKETS, 0, 100);
+	s.hist.edge_us[NR_BUCKETS] = NVME_LAT_INF;
+
+	err = nvme_lat_sampler_run(&s);
+	if (err || s.samples != nr - 1) {
+		printf("ERROR: %s: err %d, %u samples\n", name, err, s.samples);
+		test_rc = 1;
+	}
+
+	for (i = 0; i < nr - 1; i++) {
+		check(name, f.ios[i], ios[i]);
+		check(name, f.max_us[i], max_us[i]);
+	}
+
+	nvme_lat_hist_free(&s.hist);
+}
+
+int main(void)
+{
+	static const uint64_t cumulative[][NR_BUCKETS] = {
+		{ 10, 10, 0, 0 },
+		{ 20, 15, 0, 0 },	/* +10 +5 */
+		{ 20, 15, 0, 2 },	/* +2 in the open bucket */
+		{ 3, 15, 0, 2 },	/* the first counter was reset */
+	};
+	static const uint64_t cumulative_ios[] = { 15, 2, 3 };
+	static const double cumulative_max[] = { 200, 300, 100 };
+
+	static const uint64_t cleared[][NR_BUCKETS] = {
+		{ 10, 10, 0, 0 },
+		{ 1, 0, 1, 0 },
+		{ 0, 0, 0, 0 },
+	};
+	static const uint64_t cleared_ios[] = { 2, 0 };
+	static const double cleared_max[] = { 300, 0 };
+
+	test_percentile();
+	sample("cumulative", false, cumulative, 4, cumulative_ios, cumulative_max);
+	sample("cleared", true, cleared, 3, cleared_ios, cleared_max);
+
+	return test_rc;
+}
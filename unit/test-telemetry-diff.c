@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libnvme.h>
+
+#include "../nvme-telemetry-diff.h"
+
+#define BLOCK		NVME_LOG_TELEM_BLOCK_SIZE
+#define NR_BLOCKS	32
+
+static int test_rc;
+
+static unsigned char before[BLOCK * (NR_BLOCKS + 1)];
+static unsigned char after[BLOCK * (NR_BLOCKS + 1)];
+
+static void header(unsigned char *log, __u16 dalb1, __u16 dalb2, __u16 dalb3)
+{
+	struct nvme_telemetry_log *hdr = (void *)log;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->lpi = NVME_LOG_LID_TELEMETRY_HOST;
+	hdr->dalb1 = htole16(dalb1);
+	hdr->dalb2 = htole16(dalb2);
+	hdr->dalb3 = htole16(dalb3);
+}
+
+static int write_log(char *path, const unsigned char *log, size_t len)
+{
+	int fd = mkstemp(path);
+
+	if (fd < 0)
+		return -1;
+	if (write(fd, log, len) != (ssize_t)len) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	return 0;
+}
+
+static void diff(const char *name, size_t before_len, size_t after_len,
+		 int exp_err, const struct nvme_tdiff_region *exp,
+		 unsigned int nr)
+{
+	char bpath[] = "/tmp/nvme-tdiff-XXXXXX";
+	char apath[] = "/tmp/nvme-tdiff-XXXXXX";
+	struct nvme_tdiff d = { .block = BLOCK };
+	unsigned int i;
+	int err;
+
+	if (write_log(bpath, before, before_len) ||
+	    write_log(apath, after, after_len)) {
+		printf("ERROR: %s: cannot write the captures\n", name);
+		test_rc = 1;
+		goto out;
+	}
+
+	err = nvme_tdiff_open(&d, bpath, apath);
+	if (!err)
+		err = nvme_tdiff_compare(&d);
+	if (err != exp_err) {
+		printf("ERROR: %s: err %d, expected %d\n", name, err, exp_err);
+		test_rc = 1;
+	}
+	if (err)
+		goto out;
+
+	if (d.nr_regions != nr) {
+		printf("ERROR: %s: %u regions, expected %u\n", name,
+		       d.nr_regions, nr);
+		test_rc = 1;
+	}
+	for (i = 0; i < nr && i < d.nr_regions; i++) {
+		if (d.regions[i].da != exp[i].da || d.regions[i].off != exp[i].off ||
+		    d.regions[i].len != exp[i].len) {
+			printf("ERROR: %s: region %u is %u/%llu/%llu\n", name, i,
+			       d.regions[i].da,
+			       (unsigned long long)d.regions[i].off,
+			       (unsigned long long)d.regions[i].len);
+			test_rc = 1;
+		}
+	}
+	nvme_tdiff_close(&d);
+out:
+	unlink(bpath);
+	unlink(apath);
+}
+
+int main(void)
+{
+	static const struct nvme_tdiff_region changed[] = {
+		{ 1, 0, 2 * BLOCK },		/* blocks 1 and 2 */
+		{ 2, 3 * BLOCK, BLOCK },
+		{ 3, 0, BLOCK },
+	};
+	static const struct nvme_tdiff_region grown[] = {
+		{ 3, 8 * BLOCK, 8 * BLOCK },
+	};
+	unsigned int i;
+
+	for (i = BLOCK; i < sizeof(before); i++)
+		before[i] = i * 7;
+
+	/* data areas 1 to 3 are blocks 1-8, 9-16 and 17-24 */
+	header(before, 8, 16, 24);
+	memcpy(after, before, sizeof(after));
+	diff("equal", 25 * BLOCK, 25 * BLOCK, 0, NULL, 0);
+
+	after[BLOCK + 10] ^= 1;
+	after[2 * BLOCK + 500] ^= 1;
+	after[12 * BLOCK] ^= 1;
+	after[17 * BLOCK + BLOCK - 1] ^= 1;
+	diff("changed", 25 * BLOCK, 25 * BLOCK, 0, changed, 3);
+
+	/* data area 3 grew, the header itself is not compared */
+	memcpy(after, before, sizeof(after));
+	header(after, 8, 16, 32);
+	diff("grown", 25 * BLOCK, 33 * BLOCK, 0, grown, 1);
+
+	/* data area 3 is not compared if one capture stops before its end */
+	diff("truncated", 25 * BLOCK, 20 * BLOCK, 0, NULL, 0);
+
+	header(after, 8, 4, 24);
+	diff("boundaries", 25 * BLOCK, 25 * BLOCK, -EINVAL, NULL, 0);
+
+	return test_rc;
+}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../util/trace.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+static int test_rc;
+
+struct bucket_test {
+	uint64_t latency_ns;
+	int exp;
+};
+
+static struct bucket_test bucket_tests[] = {
+	{ 0, 0 },
+	{ 999, 0 },
+	{ 1000, 0 },
+	{ 2000, 1 },
+	{ 3999, 1 },
+	{ 4000, 2 },
+	{ 1000000, 9 },
+	{ 30000000000ULL, 24 },
+	{ ~0ULL, 31 },
+};
+
+static void bucket_test(struct bucket_test *test)
+{
+	int b = nvme_trace_hist_bucket(test->latency_ns);
+
+	if (b == test->exp)
+		return;
+
+	printf("ERROR: bucket for %llu ns: got %d, expected %d\n",
+	       (unsigned long long)test->latency_ns, b, test->exp);
+	test_rc = 1;
+}
+
+static void record_test(const char *path)
+{
+	struct nvme_trace_file_hdr hdr;
+	const struct nvme_trace_hist *h;
+	struct nvme_trace_rec rec = {
+		.queue = NVME_TRACE_QUEUE_ADMIN,
+		.opcode = 0x02,	/* Get Log Page */
+		.cdw = { 0x007f0002 },
+		.latency_ns = 5000,
+	};
+	FILE *f;
+	int i;
+
+	if (nvme_trace_init(path, "binary")) {
+		printf("ERROR: nvme_trace_init failed\n");
+		test_rc = 1;
+		return;
+	}
+
+	for (i = 0; i < NVME_TRACE_RING_SIZE + 10; i++)
+		nvme_trace_record(&rec);
+	rec.queue = NVME_TRACE_QUEUE_IO;
+	rec.latency_ns = 30000000000ULL;
+	nvme_trace_record(&rec);
+
+	h = nvme_trace_get_hist(NVME_TRACE_HIST_LOG, 0x02);
+	if (h->count != NVME_TRACE_RING_SIZE + 10 || h->bucket[2] != h->count) {
+		printf("ERROR: log histogram count %llu\n",
+		       (unsigned long long)h->count);
+		test_rc = 1;
+	}
+	h = nvme_trace_get_hist(NVME_TRACE_HIST_IO, 0x02);
+	if (h->count != 1 || h->max_ns != 30000000000ULL) {
+		printf("ERROR: io histogram not updated\n");
+		test_rc = 1;
+	}
+
+	if (nvme_trace_dump()) {
+		printf("ERROR: nvme_trace_dump failed\n");
+		test_rc = 1;
+		return;
+	}
+
+	f = fopen(path, "r");
+	if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1) {
+		printf("ERROR: cannot read trace file\n");
+		test_rc = 1;
+		goto out;
+	}
+
+	if (memcmp(hdr.magic, NVME_TRACE_MAGIC, sizeof(NVME_TRACE_MAGIC)) ||
+	    hdr.nr_recs != NVME_TRACE_RING_SIZE || hdr.nr_hists != 3) {
+		printf("ERROR: unexpected trace header: %llu records, %u histograms\n",
+		       (unsigned long long)hdr.nr_recs, hdr.nr_hists);
+		test_rc = 1;
+	}
+out:
+	if (f)
+		fclose(f);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/nvme-trace-XXXXXX";
+	unsigned int i;
+	int fd;
+
+	test_rc = 0;
+
+	for (i = 0; i < ARRAY_SIZE(bucket_tests); i++)
+		bucket_test(&bucket_tests[i]);
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	record_test(path);
+	unlink(path);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,784 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <ccan/minmax/minmax.h>
+
+#include "bundle.h"
+#include "crc32.h"
+
+#define TAR_BLOCK		512
+#define TAR_RECORD		(20 * TAR_BLOCK)
+#define BUNDLE_HOLE		4096
+#define BUNDLE_GZ_MAX		(1U << 30)
+#define BUNDLE_NO_SIZE		UINT64_MAX
+
+#define ZIP_LOCAL_SIG		0x04034b50
+#define ZIP_DESC_SIG		0x08074b50
+#define ZIP_CENTRAL_SIG		0x02014b50
+#define ZIP_END_SIG		0x06054b50
+#define ZIP_FLAG_DESC		0x0008
+#define ZIP_VERSION		20
+
+enum bundle_format {
+	BUNDLE_TAR,
+	BUNDLE_TGZ,
+	BUNDLE_ZIP,
+};
+
+struct tar_header {
+	char	name[100];
+	char	mode[8];
+	char	uid[8];
+	char	gid[8];
+	char	size[12];
+	char	mtime[12];
+	char	chksum[8];
+	char	typeflag;
+	char	linkname[100];
+	char	magic[6];
+	char	version[2];
+	char	uname[32];
+	char	gname[32];
+	char	devmajor[8];
+	char	devminor[8];
+	char	prefix[155];
+	char	pad[12];
+};
+
+struct bundle_member {
+	char		*name;
+	uint64_t	size;
+	uint64_t	off;		/* of the tar or zip local header */
+	uint32_t	crc;
+};
+
+/* the opaque subset of the zlib gz* API, see bundle_zlib_load() */
+struct bundle_zlib {
+	void	*handle;
+	void	*(*gzdopen)(int fd, const char *mode);
+	int	(*gzwrite)(void *file, const void *buf, unsigned int len);
+	int	(*gzclose)(void *file);
+};
+
+struct nvme_bundle {
+	enum bundle_format	format;
+	int			fd;
+	bool			seekable;
+	uint64_t		pos;
+	time_t			mtime;
+	char			*root;
+	int			err;
+
+	struct bundle_zlib	zlib;
+	void			*gz;
+
+	/*
+	 * The member being written. Unless its size was given up front it is
+	 * buffered if its header goes first.
+	 */
+	struct bundle_member	*cur;
+	uint64_t		cur_size;	/* or BUNDLE_NO_SIZE */
+	unsigned char		*buf;
+	size_t			buf_len;
+	size_t			buf_alloc;
+
+	struct bundle_member	*m;
+	size_t			nr;
+	size_t			alloc;
+};
+
+/*
+ * zlib is not linked in: util/crc32.c exports a crc32() of its own which
+ * would interpose the one zlib uses internally.
+ */
+static int bundle_zlib_load(struct bundle_zlib *z)
+{
+	z->handle = dlopen("libz.so.1", RTLD_NOW | RTLD_LOCAL);
+	if (!z->handle)
+		return -ENOENT;
+
+	z->gzdopen = dlsym(z->handle, "gzdopen");
+	z->gzwrite = dlsym(z->handle, "gzwrite");
+	z->gzclose = dlsym(z->handle, "gzclose");
+	if (!z->gzdopen || !z->gzwrite || !z->gzclose) {
+		dlclose(z->handle);
+		z->handle = NULL;
+		return -ENOENT;
+	}
+
+	return 0;
+}
+
+static bool has_suffix(const char *s, const char *suffix)
+{
+	size_t len = strlen(s), n = strlen(suffix);
+
+	return len >= n && !strcasecmp(s + len - n, suffix);
+}
+
+static void bundle_fail(struct nvme_bundle *b, int err)
+{
+	if (!b->err)
+		b->err = err;
+}
+
+static int bundle_out(struct nvme_bundle *b, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	ssize_t n;
+
+	if (b->err)
+		return b->err;
+
+	while (len) {
+		if (b->gz) {
+			n = min_t(size_t, len, BUNDLE_GZ_MAX);
+			if (b->zlib.gzwrite(b->gz, p, n) != n) {
+				bundle_fail(b, -EIO);
+				return b->err;
+			}
+		} else if (b->seekable) {
+			n = pwrite(b->fd, p, len, b->pos);
+		} else {
+			n = write(b->fd, p, len);
+		}
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			bundle_fail(b, -errno);
+			return b->err;
+		}
+		p += n;
+		len -= n;
+		b->pos += n;
+	}
+
+	return 0;
+}
+
+static bool is_zero(const unsigned char *p, size_t len)
+{
+	return !len || (!p[0] && !memcmp(p, p + 1, len - 1));
+}
+
+/* all-zero file system blocks are skipped and read back as holes */
+static int bundle_out_sparse(struct nvme_bundle *b, const void *data,
+			     size_t len)
+{
+	const unsigned char *p = data;
+	size_t n;
+	int err;
+
+	if (!b->seekable)
+		return bundle_out(b, data, len);
+
+	while (len) {
+		n = min_t(size_t, len, BUNDLE_HOLE - b->pos % BUNDLE_HOLE);
+		if (n == BUNDLE_HOLE && is_zero(p, n)) {
+			b->pos += n;
+		} else {
+			err = bundle_out(b, p, n);
+			if (err)
+				return err;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int bundle_pad(struct nvme_bundle *b, size_t align)
+{
+	static const unsigned char zero[TAR_BLOCK];
+	size_t n = (align - b->pos % align) % align;
+
+	if (b->seekable) {
+		b->pos += n;
+		return 0;
+	}
+
+	while (n) {
+		size_t len = min_t(size_t, n, sizeof(zero));
+		int err = bundle_out(b, zero, len);
+
+		if (err)
+			return err;
+		n -= len;
+	}
+
+	return 0;
+}
+
+static void tar_octal(char *field, size_t len, uint64_t val)
+{
+	/* sizes which do not fit use the GNU base-256 encoding */
+	if (len > 8 && val >> (3 * (len - 1))) {
+		memset(field, 0, len);
+		field[0] = (char)0x80;
+		for (size_t i = len - 1; i > 0 && val; i--, val >>= 8)
+			field[i] = val & 0xff;
+		return;
+	}
+
+	snprintf(field, len, "%0*llo", (int)len - 1, (unsigned long long)val);
+}
+
+static int tar_header(struct nvme_bundle *b, struct bundle_member *m,
+		      struct tar_header *h)
+{
+	size_t len = strlen(m->name), split;
+	unsigned int sum = 0;
+	unsigned char *p;
+
+	memset(h, 0, sizeof(*h));
+
+	split = 0;
+	if (len > sizeof(h->name)) {
+		/* the longest prefix leaving a name which fits */
+		for (split = len - sizeof(h->name) - 1; split < len; split++)
+			if (m->name[split] == '/')
+				break;
+		if (split >= len || split > sizeof(h->prefix))
+			return -ENAMETOOLONG;
+		memcpy(h->prefix, m->name, split);
+		split++;
+	}
+	memcpy(h->name, m->name + split, len - split);
+
+	tar_octal(h->mode, sizeof(h->mode), 0644);
+	tar_octal(h->uid, sizeof(h->uid), 0);
+	tar_octal(h->gid, sizeof(h->gid), 0);
+	tar_octal(h->size, sizeof(h->size), m->size);
+	tar_octal(h->mtime, sizeof(h->mtime), b->mtime);
+	h->typeflag = '0';
+	memcpy(h->magic, "ustar", 6);
+	memcpy(h->version, "00", 2);
+	strcpy(h->uname, "root");
+	strcpy(h->gname, "root");
+
+	memset(h->chksum, ' ', sizeof(h->chksum));
+	for (p = (unsigned char *)h; p < (unsigned char *)(h + 1); p++)
+		sum += *p;
+	snprintf(h->chksum, sizeof(h->chksum) - 1, "%06o", sum);
+
+	return 0;
+}
+
+static void put_le16(unsigned char **p, uint16_t v)
+{
+	(*p)[0] = v;
+	(*p)[1] = v >> 8;
+	*p += 2;
+}
+
+static void put_le32(unsigned char **p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p, v >> 16);
+}
+
+static void zip_dos_time(time_t t, uint16_t *dtime, uint16_t *ddate)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	if (tm.tm_year < 80) {
+		*dtime = 0;
+		*ddate = (1 << 5) | 1;
+		return;
+	}
+
+	*dtime = tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2;
+	*ddate = (tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday;
+}
+
+/*
+ * Zip members are streamed: the local header carries no sizes and is
+ * followed by a data descriptor once the member is complete.
+ */
+static int zip_local_header(struct nvme_bundle *b, struct bundle_member *m)
+{
+	size_t len = strlen(m->name);
+	unsigned char hdr[30], *p = hdr;
+	uint16_t dtime, ddate;
+	int err;
+
+	if (b->pos > UINT32_MAX || len > UINT16_MAX)
+		return -EFBIG;
+
+	zip_dos_time(b->mtime, &dtime, &ddate);
+	put_le32(&p, ZIP_LOCAL_SIG);
+	put_le16(&p, ZIP_VERSION);
+	put_le16(&p, ZIP_FLAG_DESC);
+	put_le16(&p, 0);		/* stored */
+	put_le16(&p, dtime);
+	put_le16(&p, ddate);
+	put_le32(&p, 0);		/* crc */
+	put_le32(&p, 0);		/* compressed size */
+	put_le32(&p, 0);		/* size */
+	put_le16(&p, len);
+	put_le16(&p, 0);		/* extra field length */
+
+	err = bundle_out(b, hdr, sizeof(hdr));
+	if (!err)
+		err = bundle_out(b, m->name, len);
+
+	return err;
+}
+
+static int zip_descriptor(struct nvme_bundle *b, struct bundle_member *m)
+{
+	unsigned char desc[16], *p = desc;
+
+	if (m->size > UINT32_MAX)
+		return -EFBIG;
+
+	put_le32(&p, ZIP_DESC_SIG);
+	put_le32(&p, m->crc);
+	put_le32(&p, m->size);
+	put_le32(&p, m->size);
+
+	return bundle_out(b, desc, sizeof(desc));
+}
+
+static int zip_central_directory(struct nvme_bundle *b)
+{
+	uint64_t start = b->pos;
+	unsigned char hdr[46], *p;
+	uint16_t dtime, ddate;
+	size_t i, len;
+	int err;
+
+	zip_dos_time(b->mtime, &dtime, &ddate);
+
+	for (i = 0; i < b->nr; i++) {
+		struct bundle_member *m = &b->m[i];
+
+		len = strlen(m->name);
+		p = hdr;
+		put_le32(&p, ZIP_CENTRAL_SIG);
+		put_le16(&p, 3 << 8 | ZIP_VERSION);	/* made by unix */
+		put_le16(&p, ZIP_VERSION);
+		put_le16(&p, ZIP_FLAG_DESC);
+		put_le16(&p, 0);
+		put_le16(&p, dtime);
+		put_le16(&p, ddate);
+		put_le32(&p, m->crc);
+		put_le32(&p, m->size);
+		put_le32(&p, m->size);
+		put_le16(&p, len);
+		put_le16(&p, 0);		/* extra field length */
+		put_le16(&p, 0);		/* comment length */
+		put_le16(&p, 0);		/* disk number */
+		put_le16(&p, 0);		/* internal attributes */
+		put_le32(&p, (uint32_t)(S_IFREG | 0644) << 16);
+		put_le32(&p, m->off);
+
+		err = bundle_out(b, hdr, sizeof(hdr));
+		if (!err)
+			err = bundle_out(b, m->name, len);
+		if (err)
+			return err;
+	}
+
+	if (b->nr > UINT16_MAX || b->pos > UINT32_MAX)
+		return -EFBIG;
+
+	p = hdr;
+	put_le32(&p, ZIP_END_SIG);
+	put_le16(&p, 0);			/* disk number */
+	put_le16(&p, 0);			/* disk with the directory */
+	put_le16(&p, b->nr);
+	put_le16(&p, b->nr);
+	put_le32(&p, b->pos - start);
+	put_le32(&p, start);
+	put_le16(&p, 0);			/* comment length */
+
+	return bundle_out(b, hdr, p - hdr);
+}
+
+static int bundle_buffer(struct nvme_bundle *b, const void *data, size_t len)
+{
+	unsigned char *buf;
+	size_t alloc;
+
+	if (b->buf_len + len > b->buf_alloc) {
+		alloc = b->buf_alloc ? b->buf_alloc : 64 * 1024;
+		while (alloc < b->buf_len + len)
+			alloc *= 2;
+		buf = realloc(b->buf, alloc);
+		if (!buf)
+			return -ENOMEM;
+		b->buf = buf;
+		b->buf_alloc = alloc;
+	}
+
+	memcpy(b->buf + b->buf_len, data, len);
+	b->buf_len += len;
+
+	return 0;
+}
+
+/* the member header has to be written before its data */
+static bool bundle_header_first(struct nvme_bundle *b)
+{
+	return b->format != BUNDLE_ZIP && !b->seekable;
+}
+
+static bool bundle_buffered(struct nvme_bundle *b)
+{
+	return bundle_header_first(b) && b->cur_size == BUNDLE_NO_SIZE;
+}
+
+static int bundle_member_data(struct nvme_bundle *b, struct bundle_member *m,
+			      const void *data, size_t len)
+{
+	int err;
+
+	if (bundle_buffered(b))
+		err = bundle_buffer(b, data, len);
+	else
+		err = bundle_out_sparse(b, data, len);
+	if (err)
+		return err;
+
+	m->crc = crc32(m->crc, (unsigned char *)data, len);
+	m->size += len;
+
+	return 0;
+}
+
+/* a member which came up short of its size is filled up with zeros */
+static int bundle_member_fill(struct nvme_bundle *b, struct bundle_member *m)
+{
+	static const unsigned char zero[BUNDLE_HOLE];
+	int err;
+
+	while (m->size < b->cur_size) {
+		err = bundle_member_data(b, m, zero,
+			min_t(uint64_t, b->cur_size - m->size, sizeof(zero)));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int bundle_finish_member(struct nvme_bundle *b)
+{
+	struct bundle_member *m = b->cur;
+	struct tar_header h;
+	uint64_t end;
+	int err;
+
+	if (!m)
+		return 0;
+
+	if (b->cur_size != BUNDLE_NO_SIZE) {
+		err = bundle_member_fill(b, m);
+		if (err)
+			return err;
+	}
+	b->cur = NULL;
+
+	if (b->format == BUNDLE_ZIP)
+		return zip_descriptor(b, m);
+
+	if (bundle_header_first(b) && b->cur_size != BUNDLE_NO_SIZE)
+		return bundle_pad(b, TAR_BLOCK);
+
+	err = tar_header(b, m, &h);
+	if (err)
+		return err;
+
+	if (bundle_header_first(b)) {
+		err = bundle_out(b, &h, sizeof(h));
+		if (!err)
+			err = bundle_out(b, b->buf, b->buf_len);
+		b->buf_len = 0;
+	} else {
+		end = b->pos;
+		b->pos = m->off;
+		err = bundle_out(b, &h, sizeof(h));
+		b->pos = end;
+	}
+	if (err)
+		return err;
+
+	return bundle_pad(b, TAR_BLOCK);
+}
+
+static int bundle_start_member(struct nvme_bundle *b, const char *name,
+			       uint64_t size)
+{
+	struct bundle_member *m;
+	struct tar_header h;
+	int err;
+
+	err = bundle_finish_member(b);
+	if (err)
+		return err;
+
+	if (b->nr == b->alloc) {
+		size_t alloc = b->alloc ? b->alloc * 2 : 32;
+
+		m = realloc(b->m, alloc * sizeof(*m));
+		if (!m)
+			return -ENOMEM;
+		b->m = m;
+		b->alloc = alloc;
+	}
+
+	m = &b->m[b->nr];
+	memset(m, 0, sizeof(*m));
+	if (*b->root) {
+		if (asprintf(&m->name, "%s/%s", b->root, name) < 0)
+			return -ENOMEM;
+	} else {
+		m->name = strdup(name);
+		if (!m->name)
+			return -ENOMEM;
+	}
+	m->off = b->pos;
+	b->nr++;
+	b->cur = m;
+	b->cur_size = size;
+
+	if (b->format == BUNDLE_ZIP)
+		return zip_local_header(b, m);
+
+	if (!bundle_header_first(b)) {
+		/* the header is filled in once the size is known */
+		b->pos += TAR_BLOCK;
+	} else if (size != BUNDLE_NO_SIZE) {
+		m->size = size;
+		err = tar_header(b, m, &h);
+		m->size = 0;
+		if (!err)
+			err = bundle_out(b, &h, sizeof(h));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+int nvme_bundle_append(struct nvme_bundle *b, const char *name,
+		       const void *data, size_t len)
+{
+	struct bundle_member *m = b->cur;
+	const char *cur = NULL;
+	int err;
+
+	if (b->err)
+		return b->err;
+
+	if (m)
+		cur = *b->root ? m->name + strlen(b->root) + 1 : m->name;
+	if (!cur || strcmp(cur, name)) {
+		err = bundle_start_member(b, name, BUNDLE_NO_SIZE);
+		if (err)
+			goto fail;
+		m = b->cur;
+	}
+
+	if (!len)
+		return 0;
+
+	if (b->cur_size != BUNDLE_NO_SIZE && len > b->cur_size - m->size) {
+		err = -EFBIG;
+		goto fail;
+	}
+
+	err = bundle_member_data(b, m, data, len);
+	if (err)
+		goto fail;
+
+	return 0;
+fail:
+	bundle_fail(b, err);
+	return b->err;
+}
+
+int nvme_bundle_begin(struct nvme_bundle *b, const char *name, uint64_t size)
+{
+	int err;
+
+	if (b->err)
+		return b->err;
+
+	err = bundle_start_member(b, name, size);
+	if (err)
+		bundle_fail(b, err);
+
+	return b->err;
+}
+
+int nvme_bundle_printf(struct nvme_bundle *b, const char *name,
+		       const char *fmt, ...)
+{
+	char *str;
+	va_list ap;
+	int len, err;
+
+	va_start(ap, fmt);
+	len = vasprintf(&str, fmt, ap);
+	va_end(ap);
+	if (len < 0) {
+		bundle_fail(b, -ENOMEM);
+		return b->err;
+	}
+
+	err = nvme_bundle_append(b, name, str, len);
+	free(str);
+
+	return err;
+}
+
+static int bundle_manifest(struct nvme_bundle *b)
+{
+	size_t i, nr = b->nr;
+	int err = 0;
+
+	for (i = 0; i < nr && !err; i++)
+		err = nvme_bundle_printf(b, "MANIFEST", "%08x %llu %s\n",
+					 b->m[i].crc,
+					 (unsigned long long)b->m[i].size,
+					 b->m[i].name);
+
+	return err;
+}
+
+static int bundle_trailer(struct nvme_bundle *b)
+{
+	static const unsigned char zero[2 * TAR_BLOCK];
+	int err;
+
+	if (b->format == BUNDLE_ZIP)
+		return zip_central_directory(b);
+
+	if (b->seekable) {
+		b->pos += sizeof(zero);
+	} else {
+		err = bundle_out(b, zero, sizeof(zero));
+		if (err)
+			return err;
+	}
+
+	return bundle_pad(b, TAR_RECORD);
+}
+
+int nvme_bundle_close(struct nvme_bundle *b)
+{
+	size_t i;
+	int err;
+
+	if (!b)
+		return 0;
+
+	err = bundle_manifest(b);
+	if (!err)
+		err = bundle_finish_member(b);
+	if (!err)
+		err = bundle_trailer(b);
+	if (err)
+		bundle_fail(b, err);
+
+	/* trailing holes are not allocated by the writes */
+	if (b->seekable && !b->err && ftruncate(b->fd, b->pos))
+		bundle_fail(b, -errno);
+
+	if (b->gz) {
+		if (b->zlib.gzclose(b->gz))
+			bundle_fail(b, -EIO);
+	} else if (b->fd >= 0 && close(b->fd)) {
+		bundle_fail(b, -errno);
+	}
+	if (b->zlib.handle)
+		dlclose(b->zlib.handle);
+
+	err = b->err;
+	for (i = 0; i < b->nr; i++)
+		free(b->m[i].name);
+	free(b->m);
+	free(b->buf);
+	free(b->root);
+	free(b);
+
+	return err;
+}
+
+int nvme_bundle_open(struct nvme_bundle **bp, const char *path,
+		     const char *root)
+{
+	struct nvme_bundle *b;
+	struct stat st;
+	size_t len;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+
+	b->fd = -1;
+	b->mtime = time(NULL);
+	b->root = strdup(root ? root : "");
+	if (!b->root)
+		goto nomem;
+	len = strlen(b->root);
+	while (len && b->root[len - 1] == '/')
+		b->root[--len] = '\0';
+
+	if (has_suffix(path, ".zip"))
+		b->format = BUNDLE_ZIP;
+	else if (has_suffix(path, ".tar.gz") || has_suffix(path, ".tgz"))
+		b->format = BUNDLE_TGZ;
+
+	if (!strcmp(path, "-"))
+		b->fd = dup(STDOUT_FILENO);
+	else
+		b->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (b->fd < 0) {
+		int err = -errno;
+
+		free(b->root);
+		free(b);
+		return err;
+	}
+
+	if (b->format == BUNDLE_TGZ) {
+		if (bundle_zlib_load(&b->zlib)) {
+			fprintf(stderr,
+				"zlib not available, writing an uncompressed tar to %s\n",
+				path);
+			b->format = BUNDLE_TAR;
+		} else {
+			b->gz = b->zlib.gzdopen(b->fd, "wb");
+			if (!b->gz)
+				goto nomem;
+		}
+	}
+
+	b->seekable = b->format != BUNDLE_TGZ && !fstat(b->fd, &st) &&
+		S_ISREG(st.st_mode);
+
+	*bp = b;
+	return 0;
+
+nomem:
+	b->err = -ENOMEM;
+	nvme_bundle_close(b);
+	return -ENOMEM;
+}
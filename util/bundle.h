@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-process writer for support bundles.
+ *
+ * Log buffers are streamed straight into a single archive below the
+ * directory @root, without temporary files or external tools. The archive
+ * format follows the extension of @path:
+ *  - ".tar.gz" or ".tgz", a gzip compressed tar; zlib is loaded at run
+ *    time and a plain tar is written instead if it is not available
+ *  - ".zip", a zip archive with stored (uncompressed) members
+ *  - anything else, a plain ustar archive; if @path is a regular file the
+ *    all-zero blocks of the members are skipped and left as holes
+ *
+ * nvme_bundle_append() adds @data to the member @name; consecutive appends
+ * to the same name extend one member, so large logs can be written chunk
+ * by chunk. A tar member has to be buffered in memory until it is complete
+ * when its header cannot be patched in place afterwards (".tar.gz" or a
+ * pipe); nvme_bundle_begin() starts the member @name with its @size given
+ * up front, so the header is written at once and the appends which follow
+ * are streamed. Appending more than @size is an error, a member which
+ * comes up short is filled up with zeros.
+ *
+ * nvme_bundle_close() adds a MANIFEST member listing the crc32, size and
+ * name of every member, finishes the archive and returns the first error
+ * seen while writing it.
+ */
+
+struct nvme_bundle;
+
+int nvme_bundle_open(struct nvme_bundle **bp, const char *path,
+		     const char *root);
+int nvme_bundle_append(struct nvme_bundle *b, const char *name,
+		       const void *data, size_t len);
+int nvme_bundle_begin(struct nvme_bundle *b, const char *name, uint64_t size);
+int nvme_bundle_printf(struct nvme_bundle *b, const char *name,
+		       const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+int nvme_bundle_close(struct nvme_bundle *b);
+
+#endif /* _BUNDLE_H_ */
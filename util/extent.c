@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccan/endian/endian.h>
+
+#include "extent.h"
+
+int nvme_extent_add(struct nvme_extent_list *list, uint64_t slba,
+		    uint64_t nlb, uint32_t attr)
+{
+	struct nvme_extent *e;
+
+	if (!nlb)
+		return 0;
+
+	if (list->nr == list->alloc) {
+		size_t alloc = list->alloc ? list->alloc * 2 : 256;
+
+		e = realloc(list->ext, alloc * sizeof(*e));
+		if (!e)
+			return -ENOMEM;
+		list->ext = e;
+		list->alloc = alloc;
+	}
+
+	e = &list->ext[list->nr++];
+	e->slba = slba;
+	e->nlb = nlb;
+	e->attr = attr;
+
+	return 0;
+}
+
+void nvme_extent_free(struct nvme_extent_list *list)
+{
+	free(list->ext);
+	memset(list, 0, sizeof(*list));
+}
+
+uint64_t nvme_extent_blocks(const struct nvme_extent_list *list)
+{
+	uint64_t blocks = 0;
+	size_t i;
+
+	for (i = 0; i < list->nr; i++)
+		blocks += list->ext[i].nlb;
+
+	return blocks;
+}
+
+static int extent_parse_binary(struct nvme_extent_list *list, FILE *f)
+{
+	struct {
+		leint64_t	slba;
+		leint64_t	nlb;
+	} rec;
+	int err;
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		err = nvme_extent_add(list, le64_to_cpu(rec.slba),
+				      le64_to_cpu(rec.nlb), 0);
+		if (err)
+			return err;
+	}
+
+	return ferror(f) ? -EIO : 0;
+}
+
+/*
+ * filefrag -v prints
+ *   File size of f is 1048576 (256 blocks of 4096 bytes)
+ *    ext:     logical_offset:        physical_offset: length:   expected: flags:
+ *      0:        0..     255:      34816..     35071:    256:             last,eof
+ */
+static int extent_parse_filefrag(struct nvme_extent_list *list,
+				 const char *line)
+{
+	unsigned long long lstart, lend, pstart, pend, len;
+	unsigned int unit;
+	const char *p;
+
+	p = strstr(line, "blocks of ");
+	if (p && sscanf(p, "blocks of %u bytes", &unit) == 1) {
+		list->unit = unit;
+		return 1;
+	}
+
+	if (sscanf(line, " %*u: %llu.. %llu: %llu.. %llu: %llu:",
+		   &lstart, &lend, &pstart, &pend, &len) == 5)
+		return nvme_extent_add(list, pstart, len, 0) ? -ENOMEM : 1;
+
+	return 0;
+}
+
+static int extent_parse_text(struct nvme_extent_list *list, FILE *f)
+{
+	char line[512];
+	int err;
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long v[2];
+		char *p = line, *end;
+		int i;
+
+		err = extent_parse_filefrag(list, line);
+		if (err < 0)
+			return err;
+		if (err)
+			continue;
+
+		for (i = 0; i < 2; i++) {
+			while (*p == ' ' || *p == '\t' || *p == ',' ||
+			       *p == ':')
+				p++;
+			if (*p == '#' || *p == '\n' || !*p)
+				break;
+			errno = 0;
+			v[i] = strtoull(p, &end, 0);
+			if (errno || end == p)
+				break;
+			p = end;
+		}
+
+		/* headers and other noise of extent dumps are skipped */
+		if (i != 2)
+			continue;
+
+		err = nvme_extent_add(list, v[0], v[1], 0);
+		if (err)
+			return err;
+	}
+
+	return ferror(f) ? -EIO : 0;
+}
+
+int nvme_extent_parse_file(struct nvme_extent_list *list, const char *path)
+{
+	unsigned char buf[4096];
+	FILE *f;
+	size_t len;
+	int err;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	len = fread(buf, 1, sizeof(buf), f);
+	rewind(f);
+
+	if (memchr(buf, '\0', len))
+		err = extent_parse_binary(list, f);
+	else
+		err = extent_parse_text(list, f);
+
+	fclose(f);
+	return err;
+}
+
+/*
+ * Converts extents given in @unit bytes into logical blocks. Extents which
+ * do not start and end on a logical block boundary are rejected, rounding
+ * would make the command touch data outside of the extent.
+ */
+int nvme_extent_scale(struct nvme_extent_list *list, uint32_t unit,
+		      uint32_t lba_size)
+{
+	size_t i;
+
+	if (!unit || unit == lba_size)
+		return 0;
+
+	for (i = 0; i < list->nr; i++) {
+		struct nvme_extent *e = &list->ext[i];
+		uint64_t start = e->slba * unit, len = e->nlb * unit;
+
+		if (start % lba_size || len % lba_size)
+			return -EINVAL;
+
+		e->slba = start / lba_size;
+		e->nlb = len / lba_size;
+	}
+
+	return 0;
+}
+
+static int extent_cmp(const void *a, const void *b)
+{
+	const struct nvme_extent *x = a, *y = b;
+
+	if (x->slba != y->slba)
+		return x->slba < y->slba ? -1 : 1;
+	if (x->nlb != y->nlb)
+		return x->nlb < y->nlb ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Merges adjacent extents with the same attributes. With @sort the list is
+ * sorted first and overlapping extents are merged as well, which is what a
+ * deallocate wants. Without it the order is preserved and only neighbours
+ * are merged, as the order defines the layout of a copy destination.
+ */
+void nvme_extent_coalesce(struct nvme_extent_list *list, bool sort)
+{
+	size_t i, n = 0;
+
+	if (!list->nr)
+		return;
+
+	if (sort)
+		qsort(list->ext, list->nr, sizeof(*list->ext), extent_cmp);
+
+	for (i = 1; i < list->nr; i++) {
+		struct nvme_extent *prev = &list->ext[n];
+		struct nvme_extent *e = &list->ext[i];
+		uint64_t end = prev->slba + prev->nlb;
+
+		if (e->attr == prev->attr &&
+		    (e->slba == end || (sort && e->slba < end))) {
+			if (e->slba + e->nlb > end)
+				prev->nlb = e->slba + e->nlb - prev->slba;
+			continue;
+		}
+
+		list->ext[++n] = *e;
+	}
+
+	list->nr = n + 1;
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _EXTENT_H_
+#define _EXTENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Growable list of block extents, read from range files and split into
+ * command sized batches by the Dataset Management and Copy commands.
+ *
+ * Range files are accepted in three formats:
+ *  - text, one "<start> <count>" pair per line, separated by blanks, ',' or
+ *    ':'; numbers may be decimal or 0x prefixed hex, '#' starts a comment
+ *  - 'filefrag -v' output; the physical extents are used and the unit is
+ *    taken from the "blocks of N bytes" header line
+ *  - binary, a sequence of little endian { u64 start; u64 count; } records
+ */
+
+struct nvme_extent {
+	uint64_t	slba;
+	uint64_t	nlb;
+	uint32_t	attr;
+};
+
+struct nvme_extent_list {
+	struct nvme_extent	*ext;
+	size_t			nr;
+	size_t			alloc;
+	/* bytes per unit of the parsed extents, 0 if not known */
+	uint32_t		unit;
+};
+
+int nvme_extent_add(struct nvme_extent_list *list, uint64_t slba,
+		    uint64_t nlb, uint32_t attr);
+int nvme_extent_parse_file(struct nvme_extent_list *list, const char *path);
+int nvme_extent_scale(struct nvme_extent_list *list, uint32_t unit,
+		      uint32_t lba_size);
+void nvme_extent_coalesce(struct nvme_extent_list *list, bool sort);
+uint64_t nvme_extent_blocks(const struct nvme_extent_list *list);
+void nvme_extent_free(struct nvme_extent_list *list);
+
+#endif /* _EXTENT_H_ */
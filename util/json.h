@@ -13,6 +13,8 @@
 #define json_free_array(a) json_object_put(a)
 #define json_object_add_value_uint(o, k, v) json_object_object_add(o, k, json_object_new_uint64(v))
 #define json_object_add_value_int(o, k, v) json_object_object_add(o, k, json_object_new_int(v))
+#define json_object_add_value_int64(o, k, v) \
+	json_object_object_add(o, k, json_object_new_int64(v))
 #ifndef CONFIG_JSONC_14
 #define json_object_new_uint64(v) util_json_object_new_uint64(v)
 #define json_object_get_uint64(v) util_json_object_get_uint64(v)
@@ -42,6 +44,12 @@ static inline int json_array_add_value_string(struct json_object *o, const char
 		JSON_C_TO_STRING_PRETTY |				\
 		JSON_C_TO_STRING_NOSLASHESCAPE))
 
+/* one object per line, for output consumed while it is produced */
+#define json_print_object_line(o)					\
+	printf("%s\n", json_object_to_json_string_ext(o,		\
+		JSON_C_TO_STRING_PLAIN |				\
+		JSON_C_TO_STRING_NOSLASHESCAPE))
+
 struct json_object *util_json_object_new_double(long double d);
 struct json_object *util_json_object_new_uint64(uint64_t i);
 struct json_object *util_json_object_new_uint128(nvme_uint128_t val);
@@ -56,12 +64,14 @@ struct json_object;
 #define json_free_object(o) ((void)(o))
 #define json_object_add_value_uint(o, k, v) ((void)(v))
 #define json_object_add_value_int(o, k, v) ((void)(v))
+#define json_object_add_value_int64(o, k, v) ((void)(v))
 #define json_object_add_value_uint64(o, k, v) ((void)(v))
 #define json_object_add_value_uint128(o, k, v)
 #define json_object_add_value_double(o, k, v)
 #define json_object_add_value_float(o, k, v)
 #define json_array_add_value_object(o, k) ((void)(k))
 #define json_print_object(o, u) ((void)(o))
+#define json_print_object_line(o) ((void)(o))
 #define json_object_object_add(o, k, v) ((void)(v))
 #define json_object_new_int(v)
 #define json_object_new_array(a) NULL
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _STATEFILE_H_
+#define _STATEFILE_H_
+
+#include <stddef.h>
+
+/*
+ * Replaces @path with @len bytes of @buf. The data goes to "<path>.tmp"
+ * first, is synced and renamed over @path, so a crash leaves either the
+ * old or the new state behind, never a partial one. Returns 0 or a
+ * negative errno.
+ */
+int nvme_state_file_write(const char *path, const void *buf, size_t len);
+
+#endif /* _STATEFILE_H_ */
@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <libnvme.h>
+
+#include "trace.h"
+
+/*
+ * A dump may run from a signal handler or another thread while a slot is
+ * written, so each slot is a seqlock: its sequence is odd during the copy
+ * and 2 * (lap + 1) once record lap * NVME_TRACE_RING_SIZE + slot is in.
+ */
+struct trace_slot {
+	uint64_t seq;
+	struct nvme_trace_rec rec;
+};
+
+struct trace_ring {
+	struct trace_ring *next;
+	uint64_t head;		/* number of records ever written */
+	struct trace_slot slot[NVME_TRACE_RING_SIZE];
+};
+
+static char *trace_path;
+static enum nvme_trace_format trace_format;
+static bool trace_enabled;
+static int trace_dumping;
+
+/* rings are only ever pushed onto this list, never removed */
+static struct trace_ring *trace_rings;
+static __thread struct trace_ring *trace_ring;
+
+static struct nvme_trace_hist trace_hist[NVME_TRACE_HIST_KINDS][256];
+static struct nvme_trace_file_counters trace_counters;
+
+static const char * const trace_queue_str[] = {
+	[NVME_TRACE_QUEUE_ADMIN]	= "admin",
+	[NVME_TRACE_QUEUE_IO]		= "io",
+	[NVME_TRACE_QUEUE_MI]		= "mi",
+};
+
+static const char * const trace_hist_str[] = {
+	[NVME_TRACE_HIST_ADMIN]	= "admin",
+	[NVME_TRACE_HIST_IO]	= "io",
+	[NVME_TRACE_HIST_LOG]	= "log",
+};
+
+uint64_t nvme_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool nvme_trace_enabled(void)
+{
+	return trace_enabled;
+}
+
+int nvme_trace_hist_bucket(uint64_t latency_ns)
+{
+	uint64_t us = latency_ns / 1000;
+	int b = 0;
+
+	while (us > 1 && b < NVME_TRACE_HIST_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+
+	return b;
+}
+
+static struct trace_ring *trace_get_ring(void)
+{
+	struct trace_ring *r = trace_ring;
+
+	if (r)
+		return r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->next = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(&trace_rings, &r->next, r, false,
+					    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		;
+
+	trace_ring = r;
+	return r;
+}
+
+static void trace_hist_add(struct nvme_trace_hist *h, uint64_t latency_ns)
+{
+	uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum_ns, latency_ns, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->bucket[nvme_trace_hist_bucket(latency_ns)], 1,
+			   __ATOMIC_RELAXED);
+
+	while (latency_ns > max &&
+	       !__atomic_compare_exchange_n(&h->max_ns, &max, latency_ns, false,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void nvme_trace_record(const struct nvme_trace_rec *rec)
+{
+	struct trace_slot *s;
+	struct trace_ring *r;
+	uint64_t head, seq;
+
+	if (!trace_enabled)
+		return;
+
+	switch (rec->queue) {
+	case NVME_TRACE_QUEUE_IO:
+		trace_hist_add(&trace_hist[NVME_TRACE_HIST_IO][rec->opcode],
+			       rec->latency_ns);
+		break;
+	default:
+		trace_hist_add(&trace_hist[NVME_TRACE_HIST_ADMIN][rec->opcode],
+			       rec->latency_ns);
+		if (rec->opcode == nvme_admin_get_log_page)
+			trace_hist_add(&trace_hist[NVME_TRACE_HIST_LOG][rec->cdw[0] & 0xff],
+				       rec->latency_ns);
+		break;
+	}
+
+	r = trace_get_ring();
+	if (!r)
+		return;
+
+	head = r->head;
+	s = &r->slot[head % NVME_TRACE_RING_SIZE];
+	seq = s->seq;
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->rec = *rec;
+	s->rec.tid = syscall(SYS_gettid);
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+const struct nvme_trace_hist *nvme_trace_get_hist(enum nvme_trace_hist_kind kind,
+						  uint8_t id)
+{
+	if (kind >= NVME_TRACE_HIST_KINDS)
+		return NULL;
+
+	return &trace_hist[kind][id];
+}
+
+void nvme_trace_add_retry_stats(const struct nvme_trace_file_counters *delta)
+{
+	struct nvme_trace_file_counters *c = &trace_counters;
+
+	if (!trace_enabled)
+		return;
+
+	__atomic_fetch_add(&c->commands, delta->commands, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->retries, delta->retries, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->status_retries, delta->status_retries,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->errno_retries, delta->errno_retries,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->exhausted, delta->exhausted, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->deadline_expired, delta->deadline_expired,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->backoff_ns, delta->backoff_ns, __ATOMIC_RELAXED);
+}
+
+const struct nvme_trace_file_counters *nvme_trace_get_retry_stats(void)
+{
+	return &trace_counters;
+}
+
+/*
+ * The dump path only uses stack buffers, its own number formatting,
+ * write(2) and lseek(2), all async-signal-safe, so that it can be invoked
+ * from the SIGUSR1 handler while a command is stalled. stdio must not be
+ * used here.
+ */
+static int trace_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+struct trace_buf {
+	char	buf[1024];
+	size_t	len;
+};
+
+static void trace_puts(struct trace_buf *b, const char *s)
+{
+	while (*s && b->len < sizeof(b->buf))
+		b->buf[b->len++] = *s++;
+}
+
+static void trace_putu(struct trace_buf *b, uint64_t v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (n && b->len < sizeof(b->buf))
+		b->buf[b->len++] = tmp[--n];
+}
+
+static void trace_putd(struct trace_buf *b, int64_t v)
+{
+	if (v < 0) {
+		trace_puts(b, "-");
+		trace_putu(b, -(uint64_t)v);
+	} else {
+		trace_putu(b, v);
+	}
+}
+
+static void trace_put_field(struct trace_buf *b, const char *name, uint64_t v)
+{
+	trace_puts(b, ",\"");
+	trace_puts(b, name);
+	trace_puts(b, "\":");
+	trace_putu(b, v);
+}
+
+static int trace_dump_rec_json(int fd, const struct nvme_trace_rec *rec)
+{
+	static const char * const cdw[] = {
+		"cdw10", "cdw11", "cdw12", "cdw13", "cdw14", "cdw15",
+	};
+	struct trace_buf b = { .len = 0 };
+	int i;
+
+	trace_puts(&b, "{\"type\":\"cmd\"");
+	trace_put_field(&b, "tid", rec->tid);
+	trace_put_field(&b, "start_ns", rec->start_ns);
+	trace_puts(&b, ",\"queue\":\"");
+	trace_puts(&b, rec->queue <= NVME_TRACE_QUEUE_MI ?
+		   trace_queue_str[rec->queue] : "unknown");
+	trace_puts(&b, "\"");
+	trace_put_field(&b, "opcode", rec->opcode);
+	trace_put_field(&b, "nsid", rec->nsid);
+	for (i = 0; i < 6; i++)
+		trace_put_field(&b, cdw[i], rec->cdw[i]);
+	trace_put_field(&b, "data_len", rec->data_len);
+	trace_puts(&b, ",\"status\":");
+	trace_putd(&b, rec->status);
+	trace_put_field(&b, "retries", rec->retries);
+	trace_put_field(&b, "latency_ns", rec->latency_ns);
+	trace_puts(&b, "}\n");
+
+	return trace_write(fd, b.buf, b.len);
+}
+
+static int trace_dump_hist_json(int fd, int kind, int id,
+				const struct nvme_trace_hist *h)
+{
+	struct trace_buf b = { .len = 0 };
+	int i;
+
+	trace_puts(&b, "{\"type\":\"hist\",\"kind\":\"");
+	trace_puts(&b, trace_hist_str[kind]);
+	trace_puts(&b, "\",\"id\":");
+	trace_putd(&b, id);
+	trace_put_field(&b, "count", h->count);
+	trace_put_field(&b, "sum_ns", h->sum_ns);
+	trace_put_field(&b, "max_ns", h->max_ns);
+	trace_puts(&b, ",\"buckets_log2_us\":[");
+	for (i = 0; i < NVME_TRACE_HIST_BUCKETS; i++) {
+		if (i)
+			trace_puts(&b, ",");
+		trace_putu(&b, h->bucket[i]);
+	}
+	trace_puts(&b, "]}\n");
+
+	return trace_write(fd, b.buf, b.len);
+}
+
+static int trace_dump_counters_json(int fd,
+				    const struct nvme_trace_file_counters *c)
+{
+	struct trace_buf b = { .len = 0 };
+
+	trace_puts(&b, "{\"type\":\"retry\"");
+	trace_put_field(&b, "commands", c->commands);
+	trace_put_field(&b, "retries", c->retries);
+	trace_put_field(&b, "status_retries", c->status_retries);
+	trace_put_field(&b, "errno_retries", c->errno_retries);
+	trace_put_field(&b, "exhausted", c->exhausted);
+	trace_put_field(&b, "deadline_expired", c->deadline_expired);
+	trace_put_field(&b, "backoff_ns", c->backoff_ns);
+	trace_puts(&b, "}\n");
+
+	return trace_write(fd, b.buf, b.len);
+}
+
+static uint64_t trace_ring_count(struct trace_ring *r, uint64_t *first)
+{
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	*first = head > NVME_TRACE_RING_SIZE ? head - NVME_TRACE_RING_SIZE : 0;
+	return head;
+}
+
+/* copies record @i of @r, false if it is being written or was replaced */
+static bool trace_ring_read(struct trace_ring *r, uint64_t i,
+			    struct nvme_trace_rec *rec)
+{
+	struct trace_slot *s = &r->slot[i % NVME_TRACE_RING_SIZE];
+	uint64_t seq = 2 * (i / NVME_TRACE_RING_SIZE + 1);
+
+	if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != seq)
+		return false;
+
+	memcpy(rec, &s->rec, sizeof(*rec));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static int trace_dump_fd(int fd)
+{
+	struct nvme_trace_file_hdr hdr = { 0 };
+	struct trace_ring *r;
+	uint64_t i, first, head;
+	int kind, id, err;
+
+	/* the counts are filled in once it is known what was written */
+	if (trace_format == NVME_TRACE_FORMAT_BINARY) {
+		memcpy(hdr.magic, NVME_TRACE_MAGIC, sizeof(NVME_TRACE_MAGIC));
+		hdr.version = NVME_TRACE_VERSION;
+		hdr.rec_size = sizeof(struct nvme_trace_rec);
+		hdr.hist_size = sizeof(struct nvme_trace_file_hist);
+
+		err = trace_write(fd, &hdr, sizeof(hdr));
+		if (err)
+			return err;
+	}
+
+	for (r = trace_rings; r; r = r->next) {
+		head = trace_ring_count(r, &first);
+		for (i = first; i < head; i++) {
+			struct nvme_trace_rec rec;
+
+			if (!trace_ring_read(r, i, &rec))
+				continue;
+
+			if (trace_format == NVME_TRACE_FORMAT_BINARY)
+				err = trace_write(fd, &rec, sizeof(rec));
+			else
+				err = trace_dump_rec_json(fd, &rec);
+			if (err)
+				return err;
+			hdr.nr_recs++;
+		}
+	}
+
+	for (kind = 0; kind < NVME_TRACE_HIST_KINDS; kind++) {
+		for (id = 0; id < 256; id++) {
+			struct nvme_trace_hist *h = &trace_hist[kind][id];
+			struct nvme_trace_file_hist fh = { 0 };
+
+			if (!h->count)
+				continue;
+
+			if (trace_format == NVME_TRACE_FORMAT_BINARY) {
+				fh.kind = kind;
+				fh.id = id;
+				fh.hist = *h;
+				err = trace_write(fd, &fh, sizeof(fh));
+			} else {
+				err = trace_dump_hist_json(fd, kind, id, h);
+			}
+			if (err)
+				return err;
+			hdr.nr_hists++;
+		}
+	}
+
+	if (trace_format != NVME_TRACE_FORMAT_BINARY)
+		return trace_dump_counters_json(fd, &trace_counters);
+
+	err = trace_write(fd, &trace_counters, sizeof(trace_counters));
+	if (err)
+		return err;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return -errno;
+
+	return trace_write(fd, &hdr, sizeof(hdr));
+}
+
+int nvme_trace_dump(void)
+{
+	int fd, err;
+
+	if (!trace_enabled)
+		return 0;
+
+	if (__atomic_exchange_n(&trace_dumping, 1, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+
+	fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	err = trace_dump_fd(fd);
+	close(fd);
+out:
+	__atomic_store_n(&trace_dumping, 0, __ATOMIC_RELEASE);
+	return err;
+}
+
+static void trace_sigusr1_handler(int signum)
+{
+	int errno_save = errno;
+
+	nvme_trace_dump();
+	errno = errno_save;
+}
+
+static void trace_atexit(void)
+{
+	if (nvme_trace_dump() < 0)
+		fprintf(stderr, "failed to write trace file %s\n", trace_path);
+}
+
+int nvme_trace_init(const char *path, const char *format)
+{
+	struct sigaction act;
+
+	if (trace_enabled)
+		return 0;
+
+	if (!format || !strcmp(format, "ndjson") || !strcmp(format, "json"))
+		trace_format = NVME_TRACE_FORMAT_NDJSON;
+	else if (!strcmp(format, "binary"))
+		trace_format = NVME_TRACE_FORMAT_BINARY;
+	else
+		return -EINVAL;
+
+	trace_path = strdup(path);
+	if (!trace_path)
+		return -ENOMEM;
+
+	sigemptyset(&act.sa_mask);
+	act.sa_handler = trace_sigusr1_handler;
+	act.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &act, NULL) == -1)
+		return -errno;
+
+	if (atexit(trace_atexit))
+		return -ENOMEM;
+
+	trace_enabled = true;
+	return 0;
+}
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Command trace recorder
+ *
+ * Every passthru and MI command is recorded into a per-thread ring buffer
+ * together with its monotonic-clock latency. Latencies are also accumulated
+ * into per-opcode and per-log-id histograms. The trace is written to a file
+ * on exit or when SIGUSR1 is received, either as NDJSON (one object per line)
+ * or as a compact binary file described by the structures below. The retry
+ * policy counters of libnvme are accumulated over all handles and written
+ * after the histograms.
+ */
+
+#define NVME_TRACE_RING_SIZE		4096
+#define NVME_TRACE_HIST_BUCKETS		32
+
+#define NVME_TRACE_MAGIC		"NVMETRC"
+#define NVME_TRACE_VERSION		2
+
+enum nvme_trace_queue {
+	NVME_TRACE_QUEUE_ADMIN	= 0,
+	NVME_TRACE_QUEUE_IO	= 1,
+	NVME_TRACE_QUEUE_MI	= 2,
+};
+
+enum nvme_trace_format {
+	NVME_TRACE_FORMAT_NDJSON,
+	NVME_TRACE_FORMAT_BINARY,
+};
+
+enum nvme_trace_hist_kind {
+	NVME_TRACE_HIST_ADMIN	= 0,	/* keyed by admin opcode */
+	NVME_TRACE_HIST_IO	= 1,	/* keyed by I/O opcode */
+	NVME_TRACE_HIST_LOG	= 2,	/* keyed by Get Log Page log id */
+	NVME_TRACE_HIST_KINDS,
+};
+
+struct nvme_trace_rec {
+	uint64_t	start_ns;	/* CLOCK_MONOTONIC at submission */
+	uint64_t	latency_ns;
+	uint32_t	nsid;
+	uint32_t	data_len;
+	uint32_t	cdw[6];		/* cdw10 .. cdw15 */
+	int32_t		status;		/* 0, NVMe status or negative errno */
+	uint32_t	tid;
+	uint8_t		queue;		/* enum nvme_trace_queue */
+	uint8_t		opcode;
+	uint16_t	retries;	/* retries done by the retry policy */
+	uint8_t		rsvd[4];
+};
+
+struct nvme_trace_hist {
+	uint64_t	count;
+	uint64_t	sum_ns;
+	uint64_t	max_ns;
+	/* bucket i counts latencies in [2^i, 2^(i+1)) microseconds */
+	uint64_t	bucket[NVME_TRACE_HIST_BUCKETS];
+};
+
+/*
+ * binary file layout: header, nr_recs records, nr_hists histogram entries,
+ * one struct nvme_trace_file_counters
+ */
+struct nvme_trace_file_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	rec_size;
+	uint64_t	nr_recs;
+	uint32_t	nr_hists;
+	uint32_t	hist_size;
+};
+
+struct nvme_trace_file_hist {
+	uint8_t		kind;		/* enum nvme_trace_hist_kind */
+	uint8_t		id;
+	uint8_t		rsvd[6];
+	struct nvme_trace_hist hist;
+};
+
+struct nvme_trace_file_counters {
+	uint64_t	commands;
+	uint64_t	retries;
+	uint64_t	status_retries;
+	uint64_t	errno_retries;
+	uint64_t	exhausted;
+	uint64_t	deadline_expired;
+	uint64_t	backoff_ns;
+};
+
+int nvme_trace_init(const char *path, const char *format);
+bool nvme_trace_enabled(void);
+uint64_t nvme_trace_now(void);
+void nvme_trace_record(const struct nvme_trace_rec *rec);
+const struct nvme_trace_hist *nvme_trace_get_hist(enum nvme_trace_hist_kind kind,
+						  uint8_t id);
+int nvme_trace_hist_bucket(uint64_t latency_ns);
+void nvme_trace_add_retry_stats(const struct nvme_trace_file_counters *delta);
+const struct nvme_trace_file_counters *nvme_trace_get_retry_stats(void);
+int nvme_trace_dump(void);
+
+#endif /* _TRACE_H_ */